@@ -0,0 +1,146 @@
+/***************************************************************************
+ *                                                                         *
+ * amon_metrics.c : Sample server metrics as AMON oids                     *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2000 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * Publishes the metrics of ../common/metrics.c in an OidTree, so the      *
+ * numbers written to the metrics file can also be read by an AMON client. *
+ *                                                                         *
+ * Every metric gets a sub tree <base>.<metric id>:                        *
+ *                                                                         *
+ *   .1  name of the metric (string)                                       *
+ *   .2  value of a counter or gauge, number of values of a histogram      *
+ *   .3  sum of the values of a histogram                                  *
+ *   .4  50th percentile of a histogram                                    *
+ *   .5  90th percentile of a histogram                                    *
+ *   .6  99th percentile of a histogram                                    *
+ *   .7  largest value of a histogram                                      *
+ *                                                                         *
+ * Values are read when they are asked for, so GetAll and notify requests  *
+ * on the sub tree see the current numbers. Only the metrics which exist   *
+ * when amon_metrics_register() is called are published.                   *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "opsec/opsec.h"
+#include "opsec/opsec_error.h"
+
+#include "../common/metrics.h"
+#include "amon_metrics.h"
+
+static int get_name(opsec_value_t *value, void *opaque)
+{
+    return opsec_value_set(value, OPSEC_VT_STRING, ((metric *)opaque)->name) == EO_OK ? 0 : -1;
+}
+
+static int get_value(opsec_value_t *value, void *opaque)
+{
+    metric *m = (metric *)opaque;
+    int rc;
+
+    if (m->type == METRIC_GAUGE)
+        rc = opsec_value_set(value, OPSEC_VT_I32BIT, (int)m->value);
+    else if (m->type == METRIC_COUNTER)
+        rc = opsec_value_set(value, OPSEC_VT_UI32BIT, (unsigned int)m->value);
+    else
+        rc = opsec_value_set(value, OPSEC_VT_UI32BIT, (unsigned int)m->count);
+
+    return rc == EO_OK ? 0 : -1;
+}
+
+static int get_sum(opsec_value_t *value, void *opaque)
+{
+    return opsec_value_set(value, OPSEC_VT_UI32BIT, (unsigned int)((metric *)opaque)->sum) == EO_OK ? 0 : -1;
+}
+
+static int get_p50(opsec_value_t *value, void *opaque)
+{
+    return opsec_value_set(value, OPSEC_VT_UI32BIT,
+                           (unsigned int)metric_percentile((metric *)opaque, 50.0)) == EO_OK ? 0 : -1;
+}
+
+static int get_p90(opsec_value_t *value, void *opaque)
+{
+    return opsec_value_set(value, OPSEC_VT_UI32BIT,
+                           (unsigned int)metric_percentile((metric *)opaque, 90.0)) == EO_OK ? 0 : -1;
+}
+
+static int get_p99(opsec_value_t *value, void *opaque)
+{
+    return opsec_value_set(value, OPSEC_VT_UI32BIT,
+                           (unsigned int)metric_percentile((metric *)opaque, 99.0)) == EO_OK ? 0 : -1;
+}
+
+static int get_max(opsec_value_t *value, void *opaque)
+{
+    return opsec_value_set(value, OPSEC_VT_UI32BIT, (unsigned int)((metric *)opaque)->max) == EO_OK ? 0 : -1;
+}
+
+static struct {
+    int          element;
+    char        *suffix;
+    OidGetValue  get_value;
+    int          histogram_only;
+} fields[] = {
+    {AMON_METRIC_NAME,  "Name",  get_name,  0},
+    {AMON_METRIC_VALUE, "Value", get_value, 0},
+    {AMON_METRIC_SUM,   "Sum",   get_sum,   1},
+    {AMON_METRIC_P50,   "P50",   get_p50,   1},
+    {AMON_METRIC_P90,   "P90",   get_p90,   1},
+    {AMON_METRIC_P99,   "P99",   get_p99,   1},
+    {AMON_METRIC_MAX,   "Max",   get_max,   1},
+    {0,                 NULL,    NULL,      0}
+};
+
+/*
+ * Register the oids of every metric under base
+ *
+ * returns 0 on success, else -1
+ */
+int amon_metrics_register(OidTree *tree, const char *base)
+{
+    char oid_str[256];
+    char name[METRICS_NAME_LEN + 16];
+    metric *m;
+    int i;
+
+    if (tree == NULL || base == NULL || strlen(base) > sizeof(oid_str) - 32) {
+        fprintf(stderr, "amon_metrics_register: Invalid Parameters\n");
+        return -1;
+    }
+
+    for (m = metrics_first(); m != NULL; m = m->next) {
+        for (i = 0; fields[i].suffix != NULL; i++) {
+            if (fields[i].histogram_only && m->type != METRIC_HISTOGRAM)
+                continue;
+
+            sprintf(oid_str, "%s.%d.%d", base, m->id, fields[i].element);
+            sprintf(name, "%s%s", m->name, fields[i].suffix);
+
+            if (oid_tree_register_str(tree, oid_str, name, fields[i].get_value, m) == NULL) {
+                fprintf(stderr, "amon_metrics_register: fail to register oid (%s)\n", oid_str);
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
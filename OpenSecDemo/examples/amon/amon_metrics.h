@@ -0,0 +1,47 @@
+#ifndef _AMON_METRICS_H_
+#define _AMON_METRICS_H_
+
+/***************************************************************************
+ *                                                                         *
+ * amon_metrics.h : Sample server metrics as AMON oids                     *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2000 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * See amon_metrics.c for further explanations.                            *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "amon_oid_tree.h"
+
+/*
+ * Private sub tree of the metrics
+ */
+#define AMON_METRICS_OID    "1.7.3"
+
+/*
+ * Elements under <base>.<metric id>
+ */
+#define AMON_METRIC_NAME    1
+#define AMON_METRIC_VALUE   2       /* counter and gauge value, histogram count */
+#define AMON_METRIC_SUM     3       /* histogram only, from here on */
+#define AMON_METRIC_P50     4
+#define AMON_METRIC_P90     5
+#define AMON_METRIC_P99     6
+#define AMON_METRIC_MAX     7
+
+int amon_metrics_register(OidTree *tree, const char *base);
+
+#endif
@@ -0,0 +1,370 @@
+/***************************************************************************
+ *                                                                         *
+ * amon_oid_tree.c : OID registration tree for AMON Servers                *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2000 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * The oids an AMON Server answers for are kept in a tree with one node    *
+ * per oid element, the children of a node sorted by element. Entries      *
+ * may be registered and unregistered at any time.                         *
+ *                                                                         *
+ * Besides the tree, the entries are linked in oid_compare() order, an     *
+ * entry preceding the entries of its sub tree. So:                        *
+ *                                                                         *
+ *   - an exact lookup walks one node per oid element                      *
+ *   - the oid following an entry (GetNext) is entry->next                 *
+ *   - the entries of a sub tree (GetAll) are the list from the first to   *
+ *     the last entry of the sub tree, both found by walking down its      *
+ *     first and last children                                             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "opsec/opsec.h"
+#include "opsec/opsec_error.h"
+
+#include "amon_oid_tree.h"
+
+/*
+ * search the children of node for num
+ *
+ * returns the child, else NULL and the index where it should be inserted
+ */
+static OidTreeNode *node_child(const OidTreeNode *node, OidNum num, unsigned int *index)
+{
+    unsigned int low = 0, high = node->n_children, mid;
+
+    while (low < high) {
+        mid = (low + high) / 2;
+        if (node->children[mid]->num == num) {
+            if (index)
+                *index = mid;
+            return node->children[mid];
+        }
+        if (node->children[mid]->num < num)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    if (index)
+        *index = low;
+    return NULL;
+}
+
+
+static OidTreeNode *node_add_child(OidTreeNode *node, OidNum num, unsigned int index)
+{
+    OidTreeNode *child = NULL;
+
+    if (node->n_children == node->children_size) {
+        unsigned int size = node->children_size ? node->children_size * 2 : 4;
+        OidTreeNode **children = (OidTreeNode **)realloc(node->children, size * sizeof(OidTreeNode *));
+
+        if (children == NULL)
+            return NULL;
+        node->children = children;
+        node->children_size = size;
+    }
+
+    if ( (child = (OidTreeNode *)calloc(1, sizeof(OidTreeNode))) == NULL)
+        return NULL;
+
+    child->num = num;
+    child->parent = node;
+
+    memmove(&node->children[index + 1], &node->children[index],
+            (node->n_children - index) * sizeof(OidTreeNode *));
+    node->children[index] = child;
+    node->n_children++;
+
+    return child;
+}
+
+
+static void node_destroy(OidTreeNode *node)
+{
+    unsigned int i;
+
+    for (i = 0; i < node->n_children; i++)
+        node_destroy(node->children[i]);
+
+    if (node->children)
+        free(node->children);
+    if (node->parent)
+        free(node);
+}
+
+
+/*
+ * remove node and its ancestors while they have neither entry nor children
+ */
+static void node_prune(OidTreeNode *node)
+{
+    OidTreeNode *parent;
+    unsigned int index;
+
+    while ( (parent = node->parent) != NULL && node->entry == NULL && node->n_children == 0) {
+        node_child(parent, node->num, &index);
+        memmove(&parent->children[index], &parent->children[index + 1],
+                (parent->n_children - index - 1) * sizeof(OidTreeNode *));
+        parent->n_children--;
+
+        node_destroy(node);
+        node = parent;
+    }
+}
+
+
+static OidTreeNode *node_lookup(const OidTree *tree, const Oid *oid)
+{
+    const OidTreeNode *node = &tree->root;
+    unsigned int i, len = oid_get_length(oid);
+
+    for (i = 0; i < len && node != NULL; i++)
+        node = node_child(node, (OidNum)oid_element(oid, i), NULL);
+
+    return (OidTreeNode *)node;
+}
+
+
+/*
+ * first and last entries of the sub tree of node
+ */
+static OidEntry *subtree_first(const OidTreeNode *node)
+{
+    while (node->entry == NULL && node->n_children)
+        node = node->children[0];
+
+    return node->entry;
+}
+
+static OidEntry *subtree_last(const OidTreeNode *node)
+{
+    while (node->n_children)
+        node = node->children[node->n_children - 1];
+
+    return node->entry;
+}
+
+
+/*
+ * the entry which precedes the entries of the sub tree of node
+ */
+static OidEntry *subtree_predecessor(const OidTreeNode *node)
+{
+    const OidTreeNode *parent;
+    unsigned int index;
+
+    for ( ; (parent = node->parent) != NULL; node = parent) {
+        node_child(parent, node->num, &index);
+
+        if (index > 0)
+            return subtree_last(parent->children[index - 1]);
+
+        if (parent->entry)
+            return parent->entry;
+    }
+
+    return NULL;
+}
+
+
+/*
+ * Create an empty tree
+ */
+OidTree *oid_tree_create()
+{
+    return (OidTree *)calloc(1, sizeof(OidTree));
+}
+
+
+void oid_tree_destroy(OidTree *tree)
+{
+    OidEntry *entry, *next;
+
+    if (tree == NULL)
+        return;
+
+    for (entry = tree->first; entry != NULL; entry = next) {
+        next = entry->next;
+        oid_destroy(entry->oid);
+        free(entry->name);
+        free(entry);
+    }
+
+    node_destroy(&tree->root);
+    free(tree);
+}
+
+
+/*
+ * Register an oid
+ *
+ * returns the new entry, else NULL (also if the oid is already registered)
+ */
+OidEntry *oid_tree_register(OidTree *tree, const Oid *oid, const char *name,
+                            OidGetValue get_value, void *opaque)
+{
+    OidTreeNode *node = &tree->root, *child;
+    OidEntry *entry = NULL, *prev;
+    unsigned int i, index, len = oid_get_length(oid);
+
+    if (len == 0) {
+        fprintf(stderr, "oid_tree_register: empty oid (%s)\n", name);
+        return NULL;
+    }
+
+    for (i = 0; i < len; i++, node = child) {
+        OidNum num = (OidNum)oid_element(oid, i);
+
+        if ( (child = node_child(node, num, &index)) == NULL &&
+             (child = node_add_child(node, num, index)) == NULL) {
+            fprintf(stderr, "oid_tree_register: out of memory\n");
+            node_prune(node);
+            return NULL;
+        }
+    }
+
+    if (node->entry != NULL) {
+        fprintf(stderr, "oid_tree_register: oid of %s is already registered by %s\n",
+                name, node->entry->name);
+        return NULL;
+    }
+
+    if ( (entry = (OidEntry *)calloc(1, sizeof(OidEntry))) == NULL ||
+         (entry->name = strdup(name)) == NULL ||
+         oid_duplicate(&entry->oid, oid) != EO_OK) {
+        fprintf(stderr, "oid_tree_register: failed to create entry %s\n", name);
+        if (entry) {
+            free(entry->name);
+            free(entry);
+        }
+        node_prune(node);
+        return NULL;
+    }
+
+    entry->get_value = get_value;
+    entry->opaque = opaque;
+    entry->node = node;
+    node->entry = entry;
+
+    /* link it after the entry which precedes it */
+    if ( (prev = subtree_predecessor(node)) != NULL) {
+        entry->prev = prev;
+        entry->next = prev->next;
+        prev->next = entry;
+    } else {
+        entry->next = tree->first;
+        tree->first = entry;
+    }
+    if (entry->next)
+        entry->next->prev = entry;
+    else
+        tree->last = entry;
+
+    tree->n_entries++;
+
+    return entry;
+}
+
+
+OidEntry *oid_tree_register_str(OidTree *tree, const char *oid_str, const char *name,
+                                OidGetValue get_value, void *opaque)
+{
+    OidEntry *entry = NULL;
+    Oid *oid = NULL;
+
+    if (oid_create_from_string(&oid, oid_str) != EO_OK) {
+        fprintf(stderr, "oid_tree_register_str: fail to create oid (%s)\n", oid_str);
+        return NULL;
+    }
+
+    entry = oid_tree_register(tree, oid, name, get_value, opaque);
+    oid_destroy(oid);
+
+    return entry;
+}
+
+
+/*
+ * Unregister an oid
+ *
+ * returns 0 on success, else -1
+ */
+int oid_tree_unregister(OidTree *tree, const Oid *oid)
+{
+    OidTreeNode *node;
+    OidEntry *entry;
+
+    if ( (node = node_lookup(tree, oid)) == NULL || (entry = node->entry) == NULL)
+        return -1;
+
+    if (entry->prev)
+        entry->prev->next = entry->next;
+    else
+        tree->first = entry->next;
+    if (entry->next)
+        entry->next->prev = entry->prev;
+    else
+        tree->last = entry->prev;
+
+    node->entry = NULL;
+    tree->n_entries--;
+
+    oid_destroy(entry->oid);
+    free(entry->name);
+    free(entry);
+
+    node_prune(node);
+
+    return 0;
+}
+
+
+/*
+ * Find the entry of the given oid
+ *
+ * returns the entry, else NULL
+ */
+OidEntry *oid_tree_find(const OidTree *tree, const Oid *oid)
+{
+    OidTreeNode *node = node_lookup(tree, oid);
+
+    return (node ? node->entry : NULL);
+}
+
+
+/*
+ * Find the entries of the given oid and its sub tree: they are the
+ * entries from *first to *last in the list
+ *
+ * returns 0 if there are any, else -1
+ */
+int oid_tree_subtree(const OidTree *tree, const Oid *oid,
+                     OidEntry **first, OidEntry **last)
+{
+    OidTreeNode *node = node_lookup(tree, oid);
+
+    if (node == NULL || (*first = subtree_first(node)) == NULL)
+        return -1;
+
+    *last = subtree_last(node);
+    return 0;
+}
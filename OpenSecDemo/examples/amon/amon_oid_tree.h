@@ -0,0 +1,84 @@
+#ifndef _AMON_OID_TREE_H_
+#define _AMON_OID_TREE_H_
+
+/***************************************************************************
+ *                                                                         *
+ * amon_oid_tree.h : OID registration tree for AMON Servers                *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2000 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * See amon_oid_tree.c for further explanations.                           *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "opsec/opsec.h"
+#include "opsec/amon_oid.h"
+#include "opsec/amon_api.h"
+
+typedef struct _OidEntry    OidEntry;
+typedef struct _OidTreeNode OidTreeNode;
+
+/*
+ * Fills the value of an oid, returns 0 on success, else -1
+ */
+typedef int (*OidGetValue)(opsec_value_t *value, void *opaque);
+
+/*
+ * A registered oid
+ */
+struct _OidEntry {
+    Oid          *oid;
+    char         *name;
+    OidGetValue   get_value;
+    void         *opaque;
+    OidTreeNode  *node;
+    OidEntry     *prev;             /* oid_compare() order */
+    OidEntry     *next;
+};
+
+/*
+ * One oid element. A node always has an entry or children.
+ */
+struct _OidTreeNode {
+    OidNum         num;
+    OidTreeNode   *parent;
+    OidTreeNode  **children;        /* sorted by num */
+    unsigned int   n_children;
+    unsigned int   children_size;
+    OidEntry      *entry;
+};
+
+typedef struct _OidTree {
+    OidTreeNode    root;
+    OidEntry      *first;
+    OidEntry      *last;
+    unsigned int   n_entries;
+} OidTree;
+
+OidTree  *oid_tree_create();
+void      oid_tree_destroy(OidTree *tree);
+
+OidEntry *oid_tree_register(OidTree *tree, const Oid *oid, const char *name,
+                            OidGetValue get_value, void *opaque);
+OidEntry *oid_tree_register_str(OidTree *tree, const char *oid_str, const char *name,
+                                OidGetValue get_value, void *opaque);
+int       oid_tree_unregister(OidTree *tree, const Oid *oid);
+
+OidEntry *oid_tree_find(const OidTree *tree, const Oid *oid);
+int       oid_tree_subtree(const OidTree *tree, const Oid *oid,
+                           OidEntry **first, OidEntry **last);
+
+#endif
@@ -40,17 +40,31 @@
 #include "opsec/amon_reply_server_api.h"
 #include "opsec/amon_server.h"
 
+#include "amon_oid_tree.h"
+#include "amon_metrics.h"
+#include "../common/metrics.h"
+
 /*******************************************
  *
  * Global Definitions
  *
  *******************************************/
 #define AMON_DEFAULT_PORT 18193
+#define AMON_DEFAULT_POLLING 10     /* seconds, for notify requests which give none */
 
 static time_t application_start_time = 0;
 static int    sdk_build_number = 0;
 static char  *sdk_version = NULL;
 
+/*
+ * Metrics (see ../common/metrics.c), also published under AMON_METRICS_OID
+ */
+static metric *m_sessions     = NULL;
+static metric *m_requests     = NULL;
+static metric *m_req_errors   = NULL;
+static metric *m_notify       = NULL;
+static metric *m_request_usec = NULL;
+
 /*******************************************
  *
  * Amon Server Handlers
@@ -74,6 +88,7 @@ amon_cancel_handler(OpsecSession *session, AmonReqId id);
  *
  *******************************************/
 static int  process_request(OpsecSession *session, AmonRequest *req, AmonReqId id);
+static void notify_cancel(OpsecSession *session, AmonReqId id);
 static int  db_init(); 
 static void db_destroy();
 /*******************************************
@@ -92,6 +107,15 @@ int main(int argc, char **argv)
     /* get sdk build number */
     opsec_get_sdk_version(NULL, NULL, &sdk_build_number, &sdk_version, NULL);
 
+    /*
+     * Create the metrics, before the MIB database publishes them
+     */
+    m_sessions     = metrics_gauge("amon_sessions", "AMON sessions open");
+    m_requests     = metrics_counter("amon_requests_total", "AMON requests received");
+    m_req_errors   = metrics_counter("amon_request_errors_total", "AMON requests which failed");
+    m_notify       = metrics_gauge("amon_notify_requests", "notify requests active");
+    m_request_usec = metrics_histogram("amon_request_usec", "time to process a request [usec]");
+
     /*
      * Initialize the MIB database
      */
@@ -113,6 +137,9 @@ int main(int argc, char **argv)
         exit(1);
     }
 
+    if (metrics_export_env(env) < 0)
+        fprintf(stderr, "%s: metrics are not exported\n", argv[0]);
+
     /* 
      * Initialize AMON Server Entity 
      * For more options of initialization see opsec.pdf
@@ -148,9 +175,11 @@ int main(int argc, char **argv)
 	/*********************************
 	 * Clean-up
 	 *********************************/
+    metrics_export_stop(env);
     opsec_destroy_entity(server);
 	opsec_env_destroy(env);
     db_destroy();    
+    metrics_destroy();
 
 	return 0;
 }
@@ -168,6 +197,7 @@ static eOpsecHandlerRC
 amon_start_handler(OpsecSession *session)
 {
     fprintf(stderr, "amon_start_handler: session(%x)\n", session);
+    metric_add(m_sessions, 1);
 
     /*
      * initialization of the session
@@ -185,8 +215,10 @@ amon_end_handler(OpsecSession *session)
     fprintf(stderr, "amon_end_handler: session(%x)\n", session);
 
     /*
-     * Destruction of the session 
+     * Destruction of the session: stop its notify requests
      */
+    notify_cancel(session, -1);
+    metric_add(m_sessions, -1);
 
     return OPSEC_SESSION_OK;
 }
@@ -199,6 +231,7 @@ amon_request_handler(OpsecSession *session,
                      AmonRequest *req,
                      AmonReqId id)
 {
+    unsigned long start = metrics_now_usec();
     int rc;
     
     fprintf(stderr, "amon_request_handler: session(%x) ; request(%x) ; id (%d)\n",
@@ -208,6 +241,11 @@ amon_request_handler(OpsecSession *session,
      * process the request, and send back the reply for this request
      */
     rc = process_request(session, req, id);
+
+    metric_inc(m_requests);
+    if (rc != 0)
+        metric_inc(m_req_errors);
+    metric_observe(m_request_usec, metrics_now_usec() - start);
     
     return (rc == 0 ? OPSEC_SESSION_OK : OPSEC_SESSION_ERR);
 }
@@ -225,7 +263,8 @@ amon_cancel_handler(OpsecSession *session,
     /* 
      * handle the cancel of a request
      */
-     
+    notify_cancel(session, id);
+
     return OPSEC_SESSION_OK;
 }
  
@@ -233,8 +272,10 @@ amon_cancel_handler(OpsecSession *session,
 /**************************************************
  *
  * Internal functions - DB implementation
- * Note that this is a very simple way to implement
- * status DB
+ * The oids are registered in an OidTree (see
+ * amon_oid_tree.c), the table below is only the
+ * initial set. More oids may be registered at any
+ * time with oid_tree_register().
  **************************************************/
 
 typedef enum {
@@ -251,35 +292,63 @@ typedef enum {
     GetNone
 } DataType;
 
-/* the Database is ordered */
+/* the order of the table does not matter */
 struct AmonDb {
     char *oid_str;
-    Oid *oid;
     char *name;
     DataType data_type;
 } DB [] = {
     /* start of opsec generic (mandatory) oid set */
-    {"1.3.6.1.4.1.2620.2.1.1.1", 0, "StatusOK",            GetStatusOK}, 
-    {"1.3.6.1.4.1.2620.2.1.1.2", 0, "StatusDescription",   GetStatusDescription}, 
-    {"1.3.6.1.4.1.2620.2.1.1.3", 0, "opsecVendor",         GetVendor},          
-    {"1.3.6.1.4.1.2620.2.1.1.4", 0, "opsecProduct",        GetProduct},
-    {"1.3.6.1.4.1.2620.2.1.1.5", 0, "opsecProductVersion", GetProductVersion},
-    {"1.3.6.1.4.1.2620.2.1.1.6", 0, "opsecSdkVersion",     GetSdkVersion},
-    {"1.3.6.1.4.1.2620.2.1.1.7", 0, "opsecSdkBuild",       GetSdkBuild},
-    {"1.3.6.1.4.1.2620.2.1.1.8", 0, "opsecAppUpTime",      GetAppTime},
+    {"1.3.6.1.4.1.2620.2.1.1.1", "StatusOK",            GetStatusOK}, 
+    {"1.3.6.1.4.1.2620.2.1.1.2", "StatusDescription",   GetStatusDescription}, 
+    {"1.3.6.1.4.1.2620.2.1.1.3", "opsecVendor",         GetVendor},          
+    {"1.3.6.1.4.1.2620.2.1.1.4", "opsecProduct",        GetProduct},
+    {"1.3.6.1.4.1.2620.2.1.1.5", "opsecProductVersion", GetProductVersion},
+    {"1.3.6.1.4.1.2620.2.1.1.6", "opsecSdkVersion",     GetSdkVersion},
+    {"1.3.6.1.4.1.2620.2.1.1.7", "opsecSdkBuild",       GetSdkBuild},
+    {"1.3.6.1.4.1.2620.2.1.1.8", "opsecAppUpTime",      GetAppTime},
     /* end-of opsec generic (mandatory) oid set */
     /* start of private oid set */
-    {"1.7.1",                    0, "myName",              GetMyName},
-    {"1.7.2",                    0, "myNumber",            GetMyNumber},
+    {"1.7.1",                    "myName",              GetMyName},
+    {"1.7.2",                    "myNumber",            GetMyNumber},
     /* end of private oid set */
-    {NULL,                       0, NULL,                  GetNone}
+    {NULL,                       NULL,                  GetNone}
 };
 
+static OidTree *oid_tree = NULL;
 
-static int  db_process_oid(const Oid *oid, AmonReply *rep, eAmonScope scope);
-static int  get_value(opsec_value_t *value, struct AmonDb *pDB);
-static int  add_oid_to_reply(AmonReply *rep, struct AmonDb *pDB, const Oid *oid);
-static struct AmonDb *find_oid(const Oid *oid, eOidContain *contain);
+/*
+ * The values collected for a request
+ */
+typedef struct _AmonRound {
+    OidRep       **reps;
+    unsigned int   n_reps;
+    unsigned int   size;
+} AmonRound;
+
+/*
+ * An active notify request
+ */
+typedef struct _AmonNotify {
+    OpsecSession          *session;
+    OpsecEnv              *env;
+    AmonReqId              id;
+    eAmonScope             scope;
+    Oid                  **oids;
+    unsigned int           n_oids;
+    unsigned int           size_limit;
+    eAmonNotifyReplyMode   mode;
+    unsigned int           polling_interval;
+    unsigned int           period_interval;
+    time_t                 last_full;         /* when all the oids were last sent   */
+    AmonRound              last;              /* values of the last poll, sorted    */
+    struct _AmonNotify    *next;
+} AmonNotify;
+
+static int  db_process_oid(const Oid *oid, AmonRound *round, eAmonScope scope);
+static int  get_value(opsec_value_t *value, void *opaque);
+static int  add_oid_to_round(AmonRound *round, OidEntry *entry, const Oid *oid);
+static void notify_poll(void *opaque);
 
 /*
  * Initialize DataBase.   
@@ -290,14 +359,23 @@ static int db_init()
     struct AmonDb *pDB = NULL;
     int err = 0;
 
+    if ( (oid_tree = oid_tree_create()) == NULL) {
+        fprintf(stderr, "db_init: fail to create oid tree\n");
+        return 1;
+    }
+
     for (pDB = DB; pDB->oid_str != NULL; pDB++) {
-        if (oid_create_from_string(&(pDB->oid), pDB->oid_str) != EO_OK) {
-            fprintf(stderr, "db_init: fail to create oid (%s)\n", pDB->oid_str);
+        if (oid_tree_register_str(oid_tree, pDB->oid_str, pDB->name, get_value, pDB) == NULL) {
+            fprintf(stderr, "db_init: fail to register oid (%s)\n", pDB->oid_str);
             err++;
             break;
        } 
     }
 
+    /* the metrics of this server */
+    if (err == 0 && amon_metrics_register(oid_tree, AMON_METRICS_OID) < 0)
+        err++;
+
     if (err)
         db_destroy();
 
@@ -310,15 +388,14 @@ static int db_init()
  */
 static void db_destroy()
 {
-    struct AmonDb *pDB = NULL;
-
-    for (pDB = DB; pDB->oid_str != NULL; pDB++) 
-        oid_destroy(pDB->oid); 
+    oid_tree_destroy(oid_tree);
+    oid_tree = NULL;
 }
 
 
-static int get_value(opsec_value_t *value, struct AmonDb *pDB)
+static int get_value(opsec_value_t *value, void *opaque)
 {
+    struct AmonDb *pDB = (struct AmonDb *)opaque;
     int rc = 0;
     char *msg = NULL;
     
@@ -417,75 +494,157 @@ static int get_value(opsec_value_t *value, struct AmonDb *pDB)
 }
 
 
+/*
+ * add an OidRep to the round
+ *
+ * return 0 on success, else -1
+ */
+static int round_add(AmonRound *round, OidRep *oid_rep)
+{
+    if (round->n_reps == round->size) {
+        unsigned int size = round->size ? round->size * 2 : 16;
+        OidRep **reps = (OidRep **)realloc(round->reps, size * sizeof(OidRep *));
+
+        if (reps == NULL) {
+            fprintf(stderr, "round_add: out of memory\n");
+            return -1;
+        }
+        round->reps = reps;
+        round->size = size;
+    }
+
+    round->reps[round->n_reps++] = oid_rep;
+    return 0;
+}
+
+
+static void round_clear(AmonRound *round)
+{
+    unsigned int i;
+
+    for (i = 0; i < round->n_reps; i++)
+        oid_reply_destroy(round->reps[i]);
+
+    if (round->reps)
+        free(round->reps);
+
+    memset(round, 0, sizeof(AmonRound));
+}
+
+
 static int
-add_oid_to_reply(AmonReply *rep, struct AmonDb *pDB, const Oid *oid)
+oid_rep_compare(const void *left, const void *right)
+{
+    return oid_compare(oid_reply_get_oid(*(OidRep * const *)left),
+                       oid_reply_get_oid(*(OidRep * const *)right));
+}
+
+
+/*
+ * compare two values of the types this server sets
+ *
+ * returns 1 if they are known to be equal, else 0
+ */
+static int value_equal(const opsec_value_t *left, const opsec_value_t *right)
+{
+    OPSEC_VT type = opsec_value_get_type(left);
+
+    if (type != opsec_value_get_type(right))
+        return 0;
+
+    switch (type) {
+    case OPSEC_VT_STRING:
+    case OPSEC_VT_ISTRING:
+    {
+        char *l_str = NULL, *r_str = NULL;
+
+        if (opsec_value_get(left, &l_str) != EO_OK || opsec_value_get(right, &r_str) != EO_OK)
+            return 0;
+        return (l_str && r_str && strcmp(l_str, r_str) == 0);
+    }
+
+    case OPSEC_VT_INT:
+    case OPSEC_VT_UINT:
+    case OPSEC_VT_TIME:
+    case OPSEC_VT_UI32BIT:
+    case OPSEC_VT_I32BIT:
+    {
+        unsigned int l_num = 0, r_num = 0;
+
+        if (opsec_value_get(left, &l_num) != EO_OK || opsec_value_get(right, &r_num) != EO_OK)
+            return 0;
+        return (l_num == r_num);
+    }
+
+    default:
+        return 0;
+    }
+}
+
+
+/*
+ * did the oid change since the previous round (which is sorted)
+ */
+static int round_changed(const AmonRound *prev, const OidRep *oid_rep)
+{
+    OidRep **found;
+
+    found = (OidRep **)bsearch(&oid_rep, prev->reps, prev->n_reps, sizeof(OidRep *), oid_rep_compare);
+
+    if (found == NULL)
+        return 1;
+
+    if (oid_reply_get_error(*found) != oid_reply_get_error(oid_rep))
+        return 1;
+
+    return !value_equal(oid_reply_get_opsec_value(*found), oid_reply_get_opsec_value(oid_rep));
+}
+
+
+static int
+add_oid_to_round(AmonRound *round, OidEntry *entry, const Oid *oid)
 {
     opsec_value_t *value = NULL;
     OidRep *oid_rep = NULL;
-    int rc = 0;
     eOidError oid_err = OidErr_Ok;
     const Oid *l_oid = NULL;
     
     if ( (value = opsec_value_create()) == NULL) {
-        fprintf(stderr, "add_oid_to_reply: failed to create opsec_value\n");
+        fprintf(stderr, "add_oid_to_round: failed to create opsec_value\n");
         return -1; 
     }
 
-    if (pDB == NULL) {
+    if (entry == NULL) {
         /* the oid was not found in the DB */
         oid_err = OidErr_NotFound;
         if ( (l_oid = oid) == NULL) {
-            fprintf(stderr, "add_oid_to_reply: there is no oid to set\n");
+            fprintf(stderr, "add_oid_to_round: there is no oid to set\n");
             opsec_value_dest(value);
             return -1;
         }
     } else {
-        if ( get_value(value, pDB) != 0 ) {
-            fprintf(stderr, "add_oid_to_reply: failed to get value\n");
+        if ( entry->get_value(value, entry->opaque) != 0 ) {
+            fprintf(stderr, "add_oid_to_round: failed to get value of %s\n", entry->name);
             opsec_value_dest(value);
             return -1;
         }
-        l_oid = pDB->oid;
+        l_oid = entry->oid;
     }
     
     if ( oid_reply_create_with_all(&oid_rep, l_oid, value, oid_err) != EO_OK) {
-        fprintf(stderr, "add_oid_to_reply: failed to create OidReply\n");
+        fprintf(stderr, "add_oid_to_round: failed to create OidReply\n");
         opsec_value_dest(value);
         return -1;
     }
-    
-    if (amon_reply_add_oid(rep, oid_rep) != EO_OK) {
-        fprintf(stderr, "add_oid_to_reply: failed to add OidRep to AmonReply\n");
-        rc = -1;
-    }
 
     opsec_value_dest(value);
-    oid_reply_destroy(oid_rep);
-    
-    return rc;
-}
-
-
-/*
- * search for the given oid in the database or one that contains it
- *
- * returns pointer to the first entry in the database, else NULL
- */
-static struct AmonDb *find_oid(const Oid *oid, eOidContain *contain)
-{
-    struct AmonDb *pDB = NULL;
-    
-    /* find the first oid that contain or identical to the given oid */
-    for (pDB = DB; pDB->oid_str != NULL; pDB++) {
-
-        *contain = oid_contain(pDB->oid, oid);
 
-        if ( *contain == OidContain_LeftContainRight || 
-             *contain == OidContain_Identical) 
-            return pDB;
+    if (round_add(round, oid_rep) != 0) {
+        oid_reply_destroy(oid_rep);
+        return -1;
     }
-
-    return NULL;
+    
+    return 0;
 }
 
 
@@ -495,55 +654,47 @@ static struct AmonDb *find_oid(const Oid *oid, eOidContain *contain)
  * return codes: 0 for success, else -1
  */
 static int
-db_process_oid(const Oid *oid, AmonReply *rep, eAmonScope scope)
+db_process_oid(const Oid *oid, AmonRound *round, eAmonScope scope)
 {
-    struct AmonDb *pDB = NULL;
-    eOidContain contained;
+    OidEntry *entry = NULL, *first = NULL, *last = NULL;
+
+    /* the entries of the given oid and its sub tree */
+    if (oid_tree_subtree(oid_tree, oid, &first, &last) != 0)
+        first = last = NULL;
 
-    /* find the next oid in the DB */
-    pDB = find_oid(oid, &contained);    /* assume that oid is the right operand of the oid_contain */
-    
     switch (scope) {
     case AmonScope_GetNext:
-        if (pDB == NULL)   /* oid not found */
-            return add_oid_to_reply(rep, pDB, oid);
-
-        if (contained == OidContain_LeftContainRight)    /* the next oid is this entry in the Database */ 
-            return add_oid_to_reply(rep, pDB, oid);
+        if (first == NULL)   /* oid not found */
+            return add_oid_to_round(round, NULL, oid);
 
-        /* check if the next entry in the Database is valid */
-        pDB++;
-        return add_oid_to_reply(rep, ( (pDB->oid_str != NULL) ? pDB : NULL ), oid);
+        if (oid_compare(first->oid, oid) != 0)    /* the next oid is the first one of the sub-tree */ 
+            return add_oid_to_round(round, first, oid);
 
+        /* the next entry in the Database, if any */
+        return add_oid_to_round(round, first->next, oid);
         break;
     
     case AmonScope_GetOne:
 
-        if (pDB != NULL && contained == OidContain_Identical)   /* oid found */
-            return add_oid_to_reply(rep, pDB, oid);
+        if (first != NULL && oid_compare(first->oid, oid) == 0)   /* oid found */
+            return add_oid_to_round(round, first, oid);
 
-        return add_oid_to_reply(rep, NULL, oid);              /* oid not found */
+        return add_oid_to_round(round, NULL, oid);              /* oid not found */
         break;
 
     case AmonScope_GetAll:
 
-        if (pDB == NULL)   /* oid not found */
-            return add_oid_to_reply(rep, NULL, oid);
-
-        if (pDB != NULL && contained == OidContain_Identical) /* there is only one oid in this sub-tree */
-            return add_oid_to_reply(rep, pDB, oid); 
+        if (first == NULL)   /* oid not found */
+            return add_oid_to_round(round, NULL, oid);
 
         /* all oid's in the DB that are in the subtree of the given oid */
-        for ( ; pDB->oid_str != NULL; pDB++) {
-            if ( (contained = oid_contain(pDB->oid, oid)) != OidContain_LeftContainRight ) 
-                /* oid is not part of the sub-tree */
-                /* it is possible to break here since the DB is ordered */
-                continue;
-            
-            if ( add_oid_to_reply(rep, pDB, oid) != 0 ) {
-                fprintf(stderr, "db_process_oid: failed to add oid (%s) to reply\n", pDB->oid_str);
+        for (entry = first; ; entry = entry->next) {
+            if ( add_oid_to_round(round, entry, oid) != 0 ) {
+                fprintf(stderr, "db_process_oid: failed to add oid (%s) to reply\n", entry->name);
                 return -1;
             }
+            if (entry == last)
+                break;
         }
 
         return 0;
@@ -557,6 +708,197 @@ db_process_oid(const Oid *oid, AmonReply *rep, eAmonScope scope)
 }
 
 
+/**************************************************
+ *
+ * Internal functions - Replies
+ *
+ * The values of a request are first collected in
+ * a round, which is then sent in chunks of at most
+ * size_limit oids (amon_request_get_size_limit,
+ * 0 for no limit). All the chunks but the last are
+ * marked LastReply_False. The last one is marked
+ * LastReply_True, or LastReply_LastChunk for a
+ * notify request, which stays active.
+ *
+ * Notify requests are polled every polling
+ * interval. In AmonNotifyReplyMode_Update only the
+ * oids whose value changed since the previous poll
+ * are sent, nothing when none did, and the whole
+ * set at least once every period interval (when
+ * one is given).
+ **************************************************/
+
+/*
+ * send the round, only the oids changed from prev if it is not NULL
+ *
+ * returns the number of oids sent, -1 on error
+ */
+static int
+send_round(OpsecSession *session, AmonReqId id, const AmonRound *round,
+           const AmonRound *prev, unsigned int size_limit, eLastReply last_mark)
+{
+    AmonReply    *amon_rep = NULL;
+    unsigned int  i, in_chunk = 0;
+    int           sent = 0;
+
+    for (i = 0; i < round->n_reps; i++) {
+        if (prev && !round_changed(prev, round->reps[i]))
+            continue;
+
+        if (amon_rep && size_limit && in_chunk == size_limit) {
+            /* chunk is full, more to come */
+            amon_reply_set_error(amon_rep, AmonError_OK);
+            amon_reply_set_last_reply_mark(amon_rep, LastReply_False);
+
+            if (amon_reply_send(session, amon_rep, id) != EO_OK) {
+                fprintf(stderr, "send_round: Fail to send reply\n");
+                amon_reply_destroy(amon_rep);
+                return -1;
+            }
+            amon_reply_destroy(amon_rep);
+            amon_rep = NULL;
+        }
+
+        if (amon_rep == NULL) {
+            if (amon_reply_create(&amon_rep) != EO_OK) {
+                fprintf(stderr, "send_round: fail to create AmonReply\n");
+                return -1;
+            }
+            in_chunk = 0;
+        }
+
+        if (amon_reply_add_oid(amon_rep, round->reps[i]) != EO_OK) {
+            fprintf(stderr, "send_round: failed to add OidRep to AmonReply\n");
+            amon_reply_destroy(amon_rep);
+            return -1;
+        }
+        in_chunk++;
+        sent++;
+    }
+
+    /* nothing changed */
+    if (prev && sent == 0)
+        return 0;
+
+    if (amon_rep == NULL && amon_reply_create(&amon_rep) != EO_OK) {
+        fprintf(stderr, "send_round: fail to create AmonReply\n");
+        return -1;
+    }
+
+    amon_reply_set_error(amon_rep, AmonError_OK);
+    amon_reply_set_last_reply_mark(amon_rep, last_mark);
+
+    if (amon_reply_send(session, amon_rep, id) != EO_OK) {
+        fprintf(stderr, "send_round: Fail to send reply\n");
+        sent = -1;
+    }
+
+    amon_reply_destroy(amon_rep);
+
+    return sent;
+}
+
+
+/*
+ * send an error reply, ending the request
+ */
+static void send_error(OpsecSession *session, AmonReqId id)
+{
+    AmonReply *amon_rep = NULL;
+
+    if (amon_reply_create(&amon_rep) != EO_OK)
+        return;
+
+    amon_reply_set_error(amon_rep, AmonError_Error);
+    amon_reply_set_last_reply_mark(amon_rep, LastReply_Error);
+    amon_reply_send(session, amon_rep, id);
+    amon_reply_destroy(amon_rep);
+}
+
+
+static AmonNotify *notify_list = NULL;
+
+static void notify_destroy(AmonNotify *notify)
+{
+    AmonNotify **pp;
+    unsigned int i;
+
+    for (pp = &notify_list; *pp; pp = &(*pp)->next)
+        if (*pp == notify) {
+            *pp = notify->next;
+            metric_add(m_notify, -1);
+            break;
+        }
+
+    opsec_deschedule(notify->env, notify_poll, notify);
+
+    for (i = 0; i < notify->n_oids; i++)
+        oid_destroy(notify->oids[i]);
+    if (notify->oids)
+        free(notify->oids);
+
+    round_clear(&notify->last);
+    free(notify);
+}
+
+
+static AmonNotify *notify_find(OpsecSession *session, AmonReqId id)
+{
+    AmonNotify *notify;
+
+    for (notify = notify_list; notify; notify = notify->next)
+        if (notify->session == session && notify->id == id)
+            return notify;
+
+    return NULL;
+}
+
+
+/*
+ * Poll a notify request, scheduled every polling interval
+ */
+static void notify_poll(void *opaque)
+{
+    AmonNotify   *notify = (AmonNotify *)opaque;
+    AmonRound     round;
+    AmonRound    *prev   = NULL;
+    time_t        now    = time(NULL);
+    unsigned int  i;
+    int           sent;
+
+    memset(&round, 0, sizeof(round));
+
+    for (i = 0; i < notify->n_oids; i++) {
+        if (db_process_oid(notify->oids[i], &round, notify->scope) != 0) {
+            fprintf(stderr, "notify_poll: request # %d failed\n", notify->id);
+            round_clear(&round);
+            send_error(notify->session, notify->id);
+            notify_destroy(notify);
+            return;
+        }
+    }
+
+    if (notify->mode == AmonNotifyReplyMode_Update &&
+        !(notify->period_interval && now - notify->last_full >= (time_t)notify->period_interval))
+        prev = &notify->last;
+    
+    if ( (sent = send_round(notify->session, notify->id, &round, prev,
+                            notify->size_limit, LastReply_LastChunk)) < 0 ) {
+        round_clear(&round);
+        notify_destroy(notify);
+        return;
+    }
+
+    if (prev == NULL)
+        notify->last_full = now;
+
+    /* keep the values to detect the changes of the next poll */
+    qsort(round.reps, round.n_reps, sizeof(OidRep *), oid_rep_compare);
+    round_clear(&notify->last);
+    notify->last = round;
+}
+
+
 /*
  * Process a request, build the reply and send it back to the client
  *
@@ -564,8 +906,11 @@ db_process_oid(const Oid *oid, AmonReply *rep, eAmonScope scope)
  */
 static int process_request(OpsecSession *session, AmonRequest *req, AmonReqId id)
 {
-    AmonReply       *amon_rep   = NULL;
+    AmonRound       round;
+    AmonNotify      *notify     = NULL;
     unsigned int    num_of_oids = 0;
+    unsigned int    size_limit  = 0;
+    unsigned int    polling_interval = 0, period_interval = 0;
     int             err_flag    = 0;
     AmonRequestIter *iter       = NULL;
     const Oid       *oid        = NULL;
@@ -574,20 +919,41 @@ static int process_request(OpsecSession *session, AmonRequest *req, AmonReqId id
     fprintf(stderr, "process_request: session(%x) ; request(%x) ; id (%d)\n",
             session, req, id);
            
-    /* get the number of oids in the request, and the scope of the request */
+    /* get the number of oids in the request, the scope and the size limit of the request */
     num_of_oids = amon_request_get_num_of_oids(req);
     scope = amon_request_get_scope(req);
-    
-    /* create reply object */
-    if (amon_reply_create(&amon_rep) != EO_OK) {
-        fprintf(stderr, "process_request: fail to create AmonReply\n");
-        return -1;
+    size_limit = amon_request_get_size_limit(req);
+
+    memset(&round, 0, sizeof(round));
+
+    /* a notify request keeps its oids for the following polls */
+    if (amon_request_notify_get(req, &polling_interval, &period_interval) == AmonNotify_True) {
+        if ( (notify = (AmonNotify *)calloc(1, sizeof(AmonNotify))) == NULL ||
+             (num_of_oids && (notify->oids = (Oid **)calloc(num_of_oids, sizeof(Oid *))) == NULL) ) {
+            fprintf(stderr, "process_request: out of memory\n");
+            if (notify)
+                free(notify);
+            return -1;
+        }
+        notify->session          = session;
+        notify->env              = opsec_get_session_env(session);
+        notify->id               = id;
+        notify->scope            = scope;
+        notify->size_limit       = size_limit;
+        notify->mode             = amon_request_notify_get_mode(req);
+        notify->polling_interval = polling_interval ? polling_interval : AMON_DEFAULT_POLLING;
+        notify->period_interval  = period_interval;
+        notify->last_full        = time(NULL);
+        notify->next             = notify_list;
+        notify_list              = notify;
+        metric_add(m_notify, 1);
     }
 
     /* create an iterator for the reqeust */
     if (amon_request_iter_create(req, &iter) != EO_OK) {
         fprintf(stderr, "process_request: fail to create Request Iterator\n");
-        amon_reply_destroy(amon_rep);
+        if (notify)
+            notify_destroy(notify);
         return -1;
     }
 
@@ -596,30 +962,60 @@ static int process_request(OpsecSession *session, AmonRequest *req, AmonReqId id
      * for each oid in the request find the valid value/s for this oid,
      */
     while ((oid = amon_request_iter_next(iter)) != NULL) {
-        if ( (err_flag = db_process_oid(oid, amon_rep, scope)) == -1 ) 
+        if ( (err_flag = db_process_oid(oid, &round, scope)) == -1 ) 
             break;
+
+        if (notify && notify->n_oids < num_of_oids) {
+            if (oid_duplicate(&notify->oids[notify->n_oids], oid) != EO_OK) {
+                fprintf(stderr, "process_request: fail to duplicate oid\n");
+                err_flag = -1;
+                break;
+            }
+            notify->n_oids++;
+        }
     }
 
     /* destroy the iterator */
     amon_request_iter_destroy(iter);
     
     /* if there are no errors we should send the reply back */
-    if (err_flag == 0) {
-        amon_reply_set_error(amon_rep, AmonError_OK);
+    if (err_flag == 0 &&
+        send_round(session, id, &round, NULL, size_limit,
+                   notify ? LastReply_LastChunk : LastReply_True) < 0)
+        err_flag = -1;
+
+    if (notify == NULL) {
+        round_clear(&round);
+        return err_flag;
+    }
+
+    if (err_flag != 0) {
+        round_clear(&round);
+        notify_destroy(notify);
+        return err_flag;
+    }
 
-        /* set last reply marker */
-        amon_reply_set_last_reply_mark(amon_rep, LastReply_True);
+    /* the values sent, to detect the changes of the next poll */
+    qsort(round.reps, round.n_reps, sizeof(OidRep *), oid_rep_compare);
+    notify->last = round;
 
-        /* send the reply */
-        if (amon_reply_send(session, amon_rep, id) != EO_OK) {
-            fprintf(stderr, "process_request: Fail to send reply\n");
-            err_flag = -1;
-        }
-    }    
+    opsec_periodic_schedule(notify->env, notify->polling_interval * 1000L, notify_poll, notify);
 
-    /* clean-up */
-    amon_reply_destroy(amon_rep);
-    
-    return err_flag;
+    return 0;
+}
+
+
+/*
+ * Stop a notify request of the session, all of them if id is -1
+ */
+static void notify_cancel(OpsecSession *session, AmonReqId id)
+{
+    AmonNotify *notify, *next;
+
+    for (notify = notify_list; notify; notify = next) {
+        next = notify->next;
+        if (notify->session == session && (id == -1 || notify->id == id))
+            notify_destroy(notify);
+    }
 }
 
@@ -0,0 +1,248 @@
+/***************************************************************************
+ *                                                                         *
+ * bench_stats.c : Throughput and latency statistics for benchmarks        *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2001 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * A 'bench stats' object collects the results of one benchmark: the       *
+ * number of operations, the bytes they moved, the wall clock time of the  *
+ * run and the latency of every operation.                                 *
+ *                                                                         *
+ * Latencies are kept as samples so that percentiles can be reported. Up   *
+ * to max_samples latencies are kept as they come; after that every new    *
+ * latency replaces a random kept one with the probability that keeps the  *
+ * samples a uniform selection of all the operations (reservoir sampling). *
+ * Minimum, maximum and mean are always computed over all the operations.  *
+ *                                                                         *
+ * bench_stats_write() writes the results as a single line JSON object,    *
+ * so the output of several runs can be collected in one file and          *
+ * compared by a script. bench_stats_print() writes the same results in a  *
+ * readable form.                                                          *
+ *                                                                         *
+ ***************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+#include "bench_stats.h"
+
+/*
+ * Current time in micro seconds. Only differences are meaningful.
+ */
+double
+bench_now(void)
+{
+#ifdef WIN32
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER        now;
+
+	if (!freq.QuadPart)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+
+	return (double)now.QuadPart * 1000000.0 / (double)freq.QuadPart;
+#elif defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec * 1000000.0 + (double)ts.tv_nsec / 1000.0;
+#else
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (double)tv.tv_sec * 1000000.0 + (double)tv.tv_usec;
+#endif
+}
+
+bench_stats *
+bench_stats_create(char *name, char *unit, long max_samples)
+{
+	bench_stats *bs = (bench_stats *)calloc(1, sizeof(bench_stats));
+
+	if (!bs) return NULL;
+
+	if (max_samples <= 0)
+		max_samples = BENCH_DEFAULT_SAMPLES;
+
+	if (!(bs->samples = (double *)malloc(max_samples * sizeof(double)))) {
+		free(bs);
+		return NULL;
+	}
+
+	strncpy(bs->name, name, sizeof(bs->name) - 1);
+	strncpy(bs->unit, unit, sizeof(bs->unit) - 1);
+	bs->max_samples = max_samples;
+	bs->seed        = 12345;
+
+	return bs;
+}
+
+void
+bench_stats_destroy(bench_stats *bs)
+{
+	if (!bs) return;
+
+	free(bs->samples);
+	free(bs);
+}
+
+/*
+ * Record a parameter of the run, written along with the results.
+ */
+void
+bench_stats_param(bench_stats *bs, char *key, long value)
+{
+	char buf[BENCH_NAME_LEN + 32];
+	int  len = strlen(bs->params);
+
+	sprintf(buf, "%s\"%.*s\":%ld", len ? "," : "", BENCH_NAME_LEN, key, value);
+	if (len + strlen(buf) < sizeof(bs->params))
+		strcpy(bs->params + len, buf);
+}
+
+void
+bench_stats_start(bench_stats *bs)
+{
+	bs->start = bench_now();
+}
+
+void
+bench_stats_stop(bench_stats *bs)
+{
+	bs->elapsed = bench_now() - bs->start;
+}
+
+/*
+ * Account for one operation which took usec and moved bytes.
+ */
+void
+bench_stats_add(bench_stats *bs, double usec, long bytes)
+{
+	unsigned long r;
+
+	if (bs->n_ops == 0 || usec < bs->lat_min) bs->lat_min = usec;
+	if (bs->n_ops == 0 || usec > bs->lat_max) bs->lat_max = usec;
+	bs->lat_sum += usec;
+	bs->bytes   += bytes;
+	bs->n_ops++;
+
+	if (bs->n_samples < bs->max_samples) {
+		bs->samples[bs->n_samples++] = usec;
+	}
+	else {
+		/* keep it with probability max_samples / n_ops */
+		bs->seed = bs->seed * 1103515245UL + 12345UL;
+		r = (bs->seed >> 1) % (unsigned long)bs->n_ops;
+		if (r < (unsigned long)bs->max_samples)
+			bs->samples[r] = usec;
+	}
+
+	bs->sorted = 0;
+}
+
+void
+bench_stats_error(bench_stats *bs)
+{
+	bs->n_errors++;
+}
+
+static int
+cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x < y) ? -1 : (x > y);
+}
+
+/*
+ * The latency below which pct percent of the samples are (nearest rank).
+ */
+double
+bench_stats_percentile(bench_stats *bs, double pct)
+{
+	long rank;
+
+	if (bs->n_samples == 0) return 0.0;
+
+	if (!bs->sorted) {
+		qsort(bs->samples, bs->n_samples, sizeof(double), cmp_double);
+		bs->sorted = 1;
+	}
+
+	rank = (long)(pct / 100.0 * bs->n_samples + 0.999999);
+	if (rank < 1) rank = 1;
+	if (rank > bs->n_samples) rank = bs->n_samples;
+
+	return bs->samples[rank - 1];
+}
+
+static double
+ops_per_sec(bench_stats *bs)
+{
+	return (bs->elapsed > 0) ? bs->n_ops * 1000000.0 / bs->elapsed : 0.0;
+}
+
+static double
+mb_per_sec(bench_stats *bs)
+{
+	return (bs->elapsed > 0) ? bs->bytes / bs->elapsed : 0.0;   /* bytes per usec */
+}
+
+void
+bench_stats_print(bench_stats *bs, FILE *out)
+{
+	fprintf(out, "%-14s %10ld %ss in %.3f sec: %.0f %ss/sec",
+	        bs->name, bs->n_ops, bs->unit, bs->elapsed / 1000000.0, ops_per_sec(bs), bs->unit);
+	if (bs->bytes > 0)
+		fprintf(out, ", %.1f MB/sec", mb_per_sec(bs));
+	if (bs->n_errors)
+		fprintf(out, ", %ld errors", bs->n_errors);
+	fprintf(out, "\n");
+
+	if (bs->n_ops)
+		fprintf(out, "%-14s latency [usec]: min %.2f mean %.2f p50 %.2f p90 %.2f p99 %.2f p99.9 %.2f max %.2f\n",
+		        "", bs->lat_min, bs->lat_sum / bs->n_ops,
+		        bench_stats_percentile(bs, 50.0), bench_stats_percentile(bs, 90.0),
+		        bench_stats_percentile(bs, 99.0), bench_stats_percentile(bs, 99.9), bs->lat_max);
+}
+
+/*
+ * Write the results as one JSON object on a single line.
+ * Returns 0 if successful, -1 otherwise.
+ */
+int
+bench_stats_write(bench_stats *bs, FILE *out)
+{
+	fprintf(out, "{\"bench\":\"%s\",\"unit\":\"%s\",\"time\":%ld,\"params\":{%s},",
+	        bs->name, bs->unit, (long)time(NULL), bs->params);
+	fprintf(out, "\"ops\":%ld,\"errors\":%ld,\"bytes\":%.0f,\"seconds\":%.6f,\"ops_per_sec\":%.1f,\"mb_per_sec\":%.3f,",
+	        bs->n_ops, bs->n_errors, bs->bytes, bs->elapsed / 1000000.0, ops_per_sec(bs), mb_per_sec(bs));
+	fprintf(out, "\"latency_usec\":{\"min\":%.3f,\"mean\":%.3f,\"p50\":%.3f,\"p90\":%.3f,\"p99\":%.3f,\"p999\":%.3f,\"max\":%.3f,\"samples\":%ld}}\n",
+	        bs->lat_min, bs->n_ops ? bs->lat_sum / bs->n_ops : 0.0,
+	        bench_stats_percentile(bs, 50.0), bench_stats_percentile(bs, 90.0),
+	        bench_stats_percentile(bs, 99.0), bench_stats_percentile(bs, 99.9),
+	        bs->lat_max, bs->n_samples);
+
+	return (fflush(out) == 0 && !ferror(out)) ? 0 : -1;
+}
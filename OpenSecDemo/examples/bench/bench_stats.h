@@ -0,0 +1,73 @@
+#ifndef _BENCH_STATS_H_
+#define _BENCH_STATS_H_
+
+/***************************************************************************
+ *                                                                         *
+ * bench_stats.h : Throughput and latency statistics for benchmarks        *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2001 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * See bench_stats.c for further explanations.                             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <stdio.h>
+
+#define BENCH_NAME_LEN          64
+#define BENCH_PARAMS_LEN        512
+
+/*
+ * Default number of latency samples kept per benchmark. Beyond that a
+ * uniform sample of the operations is kept, so memory stays bounded.
+ */
+#define BENCH_DEFAULT_SAMPLES   (64 * 1024)
+
+typedef struct _bench_stats {
+	char     name[BENCH_NAME_LEN];
+	char     unit[BENCH_NAME_LEN];       /* what one operation is          */
+	char     params[BENCH_PARAMS_LEN];   /* "key":value pairs, for output  */
+
+	double  *samples;                    /* latencies [usec]               */
+	long     max_samples;
+	long     n_samples;
+	int      sorted;
+	unsigned long seed;                  /* of the sample selection        */
+
+	long     n_ops;
+	long     n_errors;
+	double   bytes;
+	double   lat_min;
+	double   lat_max;
+	double   lat_sum;
+
+	double   start;                      /* [usec]                         */
+	double   elapsed;                    /* [usec], set by bench_stats_stop */
+} bench_stats;
+
+double        bench_now(void);
+
+bench_stats * bench_stats_create(char *name, char *unit, long max_samples);
+void          bench_stats_destroy(bench_stats *bs);
+void          bench_stats_param(bench_stats *bs, char *key, long value);
+void          bench_stats_start(bench_stats *bs);
+void          bench_stats_stop(bench_stats *bs);
+void          bench_stats_add(bench_stats *bs, double usec, long bytes);
+void          bench_stats_error(bench_stats *bs);
+double        bench_stats_percentile(bench_stats *bs, double pct);
+void          bench_stats_print(bench_stats *bs, FILE *out);
+int           bench_stats_write(bench_stats *bs, FILE *out);
+
+#endif
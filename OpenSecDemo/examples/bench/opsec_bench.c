@@ -0,0 +1,1052 @@
+/***************************************************************************
+ *                                                                         *
+ * opsec_bench.c : Benchmarks of the sample servers' hot paths             *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2001 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ * Measures the throughput and the latency of the code the samples run     *
+ * for every unit of work, without a Check Point peer:                     *
+ *                                                                         *
+ *   cvp  - a CVP request going through the scan stream: every chunk is    *
+ *          written to the stream and handed to the scanner (cvp_receive), *
+ *          then the content is read back in chunks (cvp_send), as in      *
+ *          cvp/cvp_av_server.c.                                           *
+ *                                                                         *
+ *   scan - the content of CVP requests going through the scan engines     *
+ *          (see ../common/scan_engine.c): the eicar engine and the        *
+ *          patterns engine, with -p synthetic patterns (scan_chunk).      *
+ *                                                                         *
+ *   ufp  - categorization of a URL by the category engine (ufp_match),    *
+ *          and the full lookup of ufp/ufp_server.c, where the verdict     *
+ *          cache is asked first (ufp_cached).                             *
+ *                                                                         *
+ *   sam  - parsing of SAM command lines, as in sam/sam_client.c and       *
+ *          sam/sam_daemon.c (sam_parse).                                  *
+ *                                                                         *
+ *   lea  - records per second read from a LEA server (lea_records). The   *
+ *          SDK has no LEA server side, so this one needs a real server    *
+ *          (-H) and is skipped otherwise.                                 *
+ *                                                                         *
+ * The input of the in-process benchmarks is synthetic and deterministic,  *
+ * so runs on different builds and machines can be compared. Every         *
+ * benchmark first runs a warm-up, which is not measured.                  *
+ *                                                                         *
+ * The results are written as one JSON object per line (see                *
+ * bench_stats.c) to stdout or to the -o file, which is appended to. A     *
+ * readable summary goes to stderr.                                        *
+ *                                                                         *
+ * Usage: opsec_bench [-b cvp|scan|ufp|sam|lea|all] [-n <operations>]      *
+ *                    [-w <warm-up operations>] [-o <results file>]        *
+ *                    [-c <chunk size>] [-f <file size>]                   *
+ *                    [-m <memory threshold>] [-p <patterns>]              *
+ *                    [-u <distinct urls>] [-k <verdict cache size>]       *
+ *                    [-H <lea server ip>] [-P <lea server port>]          *
+ *                    [-l <log file>]                                      *
+ *                                                                         *
+ * Link with bench_stats.c, ../common/scan_stream.c,                       *
+ * ../common/scan_engine.c, ../common/aho_corasick.c, ../ufp/ufp_cat.c,    *
+ * ../ufp/ufp_verdict.c and ../sam/sam_command.c.                          *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#ifdef WIN32
+#include <winsock.h>
+#else
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
+
+#include "opsec/opsec.h"
+#include "opsec/opsec_error.h"
+#include "opsec/lea.h"
+#include "opsec/ufp_opsec.h"
+
+#include "../common/scan_stream.h"
+#include "../common/scan_engine.h"
+#include "../ufp/ufp_cat.h"
+#include "../ufp/ufp_verdict.h"
+#include "../sam/sam_command.h"
+
+#include "bench_stats.h"
+
+/*
+ * Defaults
+ */
+#define DEF_OPS           200000
+#define DEF_WARMUP        10000
+#define DEF_CHUNK_SIZE    4096
+#define DEF_FILE_SIZE     (64 * 1024)
+#define DEF_PATTERNS      1000
+#define DEF_URLS          10000
+#define DEF_CACHE_SIZE    4096
+#define DEF_LEA_PORT      18184
+
+#ifdef WIN32
+#define   SPILL_DIR   "c:\\temp\\"
+#else
+#define   SPILL_DIR   "/tmp/"
+#endif
+
+#define BENCH_CATS        32      /* categories of the ufp benchmark */
+#define BENCH_SIG_LEN     12      /* pattern length of the scan benchmark */
+#define BENCH_URL_LEN     256
+#define BENCH_MAX_ARGS    16
+
+/*
+ * Global definitions
+ */
+char *ProgName = "Unknown";
+
+static long  n_ops         = DEF_OPS;
+static long  n_warmup      = DEF_WARMUP;
+static int   chunk_size    = DEF_CHUNK_SIZE;
+static long  file_size     = DEF_FILE_SIZE;
+static int   mem_threshold = SCAN_STREAM_DEFAULT_THRESHOLD;
+static int   n_patterns    = DEF_PATTERNS;
+static int   n_urls        = DEF_URLS;
+static int   cache_size    = DEF_CACHE_SIZE;
+static char *lea_host      = NULL;
+static int   lea_port      = DEF_LEA_PORT;
+static char *lea_file      = LEA_NORMAL;
+
+static FILE *results       = NULL;
+
+/*
+ * SAM command lines of the sam benchmark
+ */
+static char *sam_lines[] = {
+	"-t 60 -l log_alert -f All -A drop src 10.1.2.3",
+	"-t 3600 -l log_noalert -A reject dst 192.168.10.20",
+	"-f All -A notify subsrc 10.0.0.0 255.0.0.0",
+	"-t 600 -A inhibit_drop srv 10.1.1.1 10.2.2.2 80 6",
+	"-l nolog -A inhibit subdstsrv 172.16.0.0 255.240.0.0 443 6",
+	"-C -A drop src 10.1.2.3",
+	NULL
+};
+
+
+/* -------------------------------------------------------------------------------------
+                                       Results
+   ------------------------------------------------------------------------------------- */
+
+ /* -----------------------------------------------------------------------------
+  |  report:
+  |  -------
+  |
+  |  Description:
+  |  ------------
+  |  Writes the results of a benchmark and destroys its statistics.
+  |
+  |  Parameters:
+  |  -----------
+  |  bs - the benchmark statistics.
+  |
+  |  Returned value:
+  |  ---------------
+  |  0 if successful, -1 otherwise.
+   ----------------------------------------------------------------------------- */
+static int report(bench_stats *bs)
+{
+	int rc;
+
+	bench_stats_print(bs, stderr);
+	if ((rc = bench_stats_write(bs, results)) < 0)
+		fprintf(stderr, "%s: failed to write the results of %s\n", ProgName, bs->name);
+
+	bench_stats_destroy(bs);
+	return rc;
+}
+
+
+/* -------------------------------------------------------------------------------------
+                                         CVP
+   ------------------------------------------------------------------------------------- */
+
+ /* -----------------------------------------------------------------------------
+  |  scan_data:
+  |  ----------
+  |
+  |  Description:
+  |  ------------
+  |  Scanner hook of the scan stream. Reads every byte of the chunk, as a
+  |  scan engine would.
+  |
+  |  Parameters:
+  |  -----------
+  |  opaque - points to the running checksum.
+  |  data   - chunk data, NULL at the end of the file.
+  |  len    - chunk length, -1 at the end of the file.
+  |
+  |  Returned value:
+  |  ---------------
+  |  0.
+   ----------------------------------------------------------------------------- */
+static int scan_data(void *opaque, char *data, int len)
+{
+	unsigned long *sum = (unsigned long *)opaque;
+	int i;
+
+	for (i = 0; data && i < len; i++)
+		*sum = (*sum << 1 | *sum >> 31) ^ (unsigned char)data[i];
+
+	return 0;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  cvp_requests:
+  |  -------------
+  |
+  |  Description:
+  |  ------------
+  |  Passes CVP requests of file_size bytes through the scan stream, until
+  |  'count' chunks were received. The time spent receiving and sending is
+  |  added to the elapsed time of recv and send respectively.
+  |
+  |  Parameters:
+  |  -----------
+  |  data  - file_size bytes of content.
+  |  count - number of chunks.
+  |  recv  - statistics of the received chunks, NULL for a warm-up.
+  |  send  - statistics of the chunks read back, NULL for a warm-up.
+  |
+  |  Returned value:
+  |  ---------------
+  |  0 if successful, -1 if a chunk could not be written or read back. The
+  |  failure is counted in recv or send, so that it shows in the result.
+   ----------------------------------------------------------------------------- */
+static int cvp_requests(char *data, long count, bench_stats *recv, bench_stats *send)
+{
+	scan_stream   *ss;
+	unsigned long  sum = 0;
+	double         t, phase;
+	char          *buf;
+	long           off, done = 0;
+	int            len;
+
+	while (done < count) {
+		phase = bench_now();
+
+		if (!(ss = scan_stream_create(mem_threshold, SPILL_DIR))) {
+			fprintf(stderr, "%s: scan_stream_create failed\n", ProgName);
+			return -1;
+		}
+		scan_stream_set_scanner(ss, scan_data, &sum);
+
+		for (off = 0; off < file_size && done < count; off += len, done++) {
+			len = (file_size - off < chunk_size) ? (int)(file_size - off) : chunk_size;
+			t = bench_now();
+			if (scan_stream_write(ss, data + off, len) < 0) {
+				fprintf(stderr, "%s: scan_stream_write failed\n", ProgName);
+				if (recv) bench_stats_error(recv);
+				scan_stream_destroy(ss);
+				return -1;
+			}
+			if (recv) bench_stats_add(recv, bench_now() - t, len);
+		}
+
+		if (scan_stream_finish(ss) < 0) {
+			fprintf(stderr, "%s: scan_stream_finish failed\n", ProgName);
+			if (recv) bench_stats_error(recv);
+			scan_stream_destroy(ss);
+			return -1;
+		}
+
+		t = bench_now();
+		if (recv) recv->elapsed += t - phase;
+		phase = t;
+
+		for (;;) {
+			t = bench_now();
+			if ((len = scan_stream_peek(ss, &buf, chunk_size)) <= 0)
+				break;
+			scan_stream_advance(ss, len);
+			if (send) bench_stats_add(send, bench_now() - t, len);
+		}
+		scan_stream_destroy(ss);
+
+		if (len < 0) {
+			fprintf(stderr, "%s: scan_stream_peek failed\n", ProgName);
+			if (send) bench_stats_error(send);
+			return -1;
+		}
+		if (send) send->elapsed += bench_now() - phase;
+	}
+
+	return 0;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  bench_cvp:
+  |  ----------
+  |
+  |  Description:
+  |  ------------
+  |  Runs the cvp benchmark.
+  |
+  |  Parameters:
+  |  -----------
+  |  None.
+  |
+  |  Returned value:
+  |  ---------------
+  |  0 if successful, -1 otherwise.
+   ----------------------------------------------------------------------------- */
+static int bench_cvp(void)
+{
+	bench_stats *recv, *send;
+	char        *data;
+	long         i;
+	int          rc;
+
+	if (chunk_size <= 0 || file_size <= 0) {
+		fprintf(stderr, "%s: cvp: bad chunk or file size\n", ProgName);
+		return -1;
+	}
+
+	if (!(data = (char *)malloc(file_size))) {
+		fprintf(stderr, "%s: cvp: out of memory\n", ProgName);
+		return -1;
+	}
+	for (i = 0; i < file_size; i++)
+		data[i] = (char)(i * 131 + (i >> 8));
+
+	recv = bench_stats_create("cvp_receive", "chunk", 0);
+	send = bench_stats_create("cvp_send", "chunk", 0);
+	if (!recv || !send) {
+		fprintf(stderr, "%s: cvp: out of memory\n", ProgName);
+		bench_stats_destroy(recv);
+		bench_stats_destroy(send);
+		free(data);
+		return -1;
+	}
+
+	rc = cvp_requests(data, n_warmup, NULL, NULL);
+
+	if (rc == 0)
+		rc = cvp_requests(data, n_ops, recv, send);
+
+	bench_stats_param(recv, "chunk_size", chunk_size);
+	bench_stats_param(recv, "file_size", file_size);
+	bench_stats_param(recv, "mem_threshold", mem_threshold);
+	strcpy(send->params, recv->params);
+
+	if (report(recv) < 0 || report(send) < 0)
+		rc = -1;
+
+	free(data);
+	return rc;
+}
+
+
+/* -------------------------------------------------------------------------------------
+                                         SCAN
+   ------------------------------------------------------------------------------------- */
+
+ /* -----------------------------------------------------------------------------
+  |  scan_signatures:
+  |  ----------------
+  |
+  |  Description:
+  |  ------------
+  |  Writes n_patterns pseudo random patterns of BENCH_SIG_LEN bytes to a
+  |  signature file of the patterns engine.
+  |
+  |  Parameters:
+  |  -----------
+  |  file - the signature file.
+  |
+  |  Returned value:
+  |  ---------------
+  |  0 if successful, -1 otherwise.
+   ----------------------------------------------------------------------------- */
+static int scan_signatures(char *file)
+{
+	unsigned long seed = 12345;
+	FILE         *fp;
+	int           i, j;
+
+	if (!(fp = fopen(file, "w"))) {
+		fprintf(stderr, "%s: scan: can not create %s\n", ProgName, file);
+		return -1;
+	}
+
+	for (i = 0; i < n_patterns; i++) {
+		fprintf(fp, "Bench.Sig.%d ", i);
+		for (j = 0; j < BENCH_SIG_LEN; j++) {
+			seed = seed * 1103515245UL + 12345UL;
+			fprintf(fp, "%02x", (unsigned int)((seed >> 16) & 0xff));
+		}
+		fprintf(fp, "\n");
+	}
+
+	return (fclose(fp) == 0) ? 0 : -1;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  scan_requests:
+  |  --------------
+  |
+  |  Description:
+  |  ------------
+  |  Passes the content of CVP requests of file_size bytes through the scan
+  |  engines, until 'count' chunks were scanned.
+  |
+  |  Parameters:
+  |  -----------
+  |  chain - the scan engines.
+  |  data  - file_size bytes of content.
+  |  count - number of chunks.
+  |  bs    - statistics of the scanned chunks, NULL for a warm-up.
+  |
+  |  Returned value:
+  |  ---------------
+  |  0 if successful, -1 otherwise.
+   ----------------------------------------------------------------------------- */
+static int scan_requests(scan_chain *chain, char *data, long count, bench_stats *bs)
+{
+	scan_job *job;
+	double    t;
+	long      off, done = 0;
+	int       len;
+
+	while (done < count) {
+		if (!(job = scan_job_begin(chain))) {
+			fprintf(stderr, "%s: scan_job_begin failed\n", ProgName);
+			return -1;
+		}
+
+		for (off = 0; off < file_size && done < count; off += len, done++) {
+			len = (file_size - off < chunk_size) ? (int)(file_size - off) : chunk_size;
+			t = bench_now();
+			if (scan_job_data(job, data + off, len) == SCAN_ERROR && bs)
+				bench_stats_error(bs);
+			if (bs) bench_stats_add(bs, bench_now() - t, len);
+		}
+
+		if (scan_job_end(job) != SCAN_CLEAN && bs)
+			bench_stats_error(bs);
+		scan_job_free(job);
+	}
+
+	return 0;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  bench_scan:
+  |  -----------
+  |
+  |  Description:
+  |  ------------
+  |  Runs the scan benchmark.
+  |
+  |  Parameters:
+  |  -----------
+  |  None.
+  |
+  |  Returned value:
+  |  ---------------
+  |  0 if successful, -1 otherwise.
+   ----------------------------------------------------------------------------- */
+static int bench_scan(void)
+{
+	char         sig_file[256], engines[512];
+	scan_chain  *chain;
+	bench_stats *bs;
+	char        *data;
+	long         i;
+	int          rc;
+
+	if (chunk_size <= 0 || file_size <= 0 || n_patterns <= 0) {
+		fprintf(stderr, "%s: scan: bad chunk size, file size or patterns\n", ProgName);
+		return -1;
+	}
+
+	sprintf(sig_file, "%sbench_sigs.txt", SPILL_DIR);
+	if (scan_signatures(sig_file) < 0)
+		return -1;
+
+	sprintf(engines, "eicar,patterns=%s", sig_file);
+	chain = scan_chain_create();
+	if (!chain || scan_chain_config(chain, engines) < 0) {
+		fprintf(stderr, "%s: scan: failed to load the engines\n", ProgName);
+		scan_chain_destroy(chain);
+		remove(sig_file);
+		return -1;
+	}
+	remove(sig_file);
+
+	if (!(data = (char *)malloc(file_size)) || !(bs = bench_stats_create("scan_chunk", "chunk", 0))) {
+		fprintf(stderr, "%s: scan: out of memory\n", ProgName);
+		free(data);
+		scan_chain_destroy(chain);
+		return -1;
+	}
+	for (i = 0; i < file_size; i++)
+		data[i] = (char)(i * 131 + (i >> 8));
+
+	scan_requests(chain, data, n_warmup, NULL);
+
+	bench_stats_start(bs);
+	rc = scan_requests(chain, data, n_ops, bs);
+	bench_stats_stop(bs);
+
+	bench_stats_param(bs, "chunk_size", chunk_size);
+	bench_stats_param(bs, "file_size", file_size);
+	bench_stats_param(bs, "patterns", n_patterns);
+
+	if (report(bs) < 0)
+		rc = -1;
+
+	scan_chain_destroy(chain);
+	free(data);
+	return rc;
+}
+
+
+/* -------------------------------------------------------------------------------------
+                                         UFP
+   ------------------------------------------------------------------------------------- */
+
+ /* -----------------------------------------------------------------------------
+  |  ufp_urls:
+  |  ---------
+  |
+  |  Description:
+  |  ------------
+  |  Builds n_urls distinct URLs. About half of them hold a match string.
+  |
+  |  Parameters:
+  |  -----------
+  |  None.
+  |
+  |  Returned value:
+  |  ---------------
+  |  The array of URLs, NULL if out of memory.
+   ----------------------------------------------------------------------------- */
+static char **ufp_urls(void)
+{
+	char **urls;
+	int    i;
+
+	if (!(urls = (char **)calloc(n_urls, sizeof(char *))))
+		return NULL;
+
+	for (i = 0; i < n_urls; i++) {
+		if (!(urls[i] = (char *)malloc(BENCH_URL_LEN))) {
+			while (i-- > 0)
+				free(urls[i]);
+			free(urls);
+			return NULL;
+		}
+		sprintf(urls[i], "http://www.host%d.example.com/dir%d/kw%04d.html?id=%d",
+		        i % 997, i % 31, (int)((i * 7L) % (2L * n_patterns)), i);
+	}
+
+	return urls;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  url_index:
+  |  ----------
+  |
+  |  Description:
+  |  ------------
+  |  Picks the URL of the i'th lookup. Like real traffic, most lookups go to
+  |  a few popular sites: 4 out of 5 pick one of the first fifth of the
+  |  URLs, the rest pick any URL. The sequence is the same on every run.
+  |
+  |  Parameters:
+  |  -----------
+  |  i - number of the lookup.
+  |
+  |  Returned value:
+  |  ---------------
+  |  Index into the URLs.
+   ----------------------------------------------------------------------------- */
+static int url_index(long i)
+{
+	unsigned long r = (unsigned long)i * 2654435761UL;
+	int           hot = (n_urls >= 5) ? n_urls / 5 : n_urls;
+
+	r ^= r >> 13;
+	return (int)((i % 5) ? (r >> 3) % hot : (r >> 3) % n_urls);
+}
+
+ /* -----------------------------------------------------------------------------
+  |  ufp_lookups:
+  |  ------------
+  |
+  |  Description:
+  |  ------------
+  |  Categorizes 'count' URLs, as the UFP server's cat_handler does.
+  |
+  |  Parameters:
+  |  -----------
+  |  engine   - the category engine.
+  |  cache    - the verdict cache, NULL to only run the category engine.
+  |  pool     - the mask pool.
+  |  mask_len - of a categorization mask.
+  |  urls     - n_urls URLs, picked by url_index.
+  |  count    - number of URLs to categorize.
+  |  bs       - statistics, NULL for a warm-up.
+  |
+  |  Returned value:
+  |  ---------------
+  |  None.
+   ----------------------------------------------------------------------------- */
+static void ufp_lookups(ufp_cat_engine *engine, ufp_verdict_cache *cache, ufp_mask_pool *pool,
+                        int mask_len, char **urls, long count, bench_stats *bs)
+{
+	char         key[UFP_VERDICT_URL_LEN];
+	ufp_verdict *verdict;
+	ufp_mask     mask;
+	double       t;
+	char        *url;
+	long         i;
+	int          rc;
+
+	for (i = 0; i < count; i++) {
+		url     = urls[url_index(i)];
+		verdict = NULL;
+		rc      = 0;
+
+		t = bench_now();
+
+		if (cache && ufp_verdict_normalize(url, key, sizeof(key)) >= 0) {
+			if ((verdict = ufp_verdict_lookup(cache, key))) {
+				if (bs) bench_stats_add(bs, bench_now() - t, 0);
+				continue;
+			}
+			verdict = ufp_verdict_insert(cache, key);
+		}
+
+		if (!(mask = verdict ? verdict->mask : ufp_mask_pool_get(pool))) {
+			if (bs) bench_stats_error(bs);
+			continue;
+		}
+
+		if ((rc = ufp_cat_engine_match(engine, url, mask, mask_len)) < 0 && verdict)
+			ufp_verdict_remove(cache, verdict);
+
+		if (!verdict)
+			ufp_mask_pool_put(pool, mask);
+
+		if (bs) {
+			if (rc < 0)
+				bench_stats_error(bs);
+			else
+				bench_stats_add(bs, bench_now() - t, 0);
+		}
+	}
+}
+
+ /* -----------------------------------------------------------------------------
+  |  bench_ufp:
+  |  ----------
+  |
+  |  Description:
+  |  ------------
+  |  Runs the ufp benchmarks.
+  |
+  |  Parameters:
+  |  -----------
+  |  None.
+  |
+  |  Returned value:
+  |  ---------------
+  |  0 if successful, -1 otherwise.
+   ----------------------------------------------------------------------------- */
+static int bench_ufp(void)
+{
+	static char        names[BENCH_CATS][16];
+	char              *dict[BENCH_CATS];
+	unsigned int       cat_ttl[BENCH_CATS];
+	char               pattern[32];
+	ufp_cat_engine    *engine = NULL;
+	ufp_mask_pool     *pool   = NULL;
+	ufp_verdict_cache *cache  = NULL;
+	bench_stats       *bs;
+	char             **urls   = NULL;
+	int                mask_len = ((BENCH_CATS + 7) / 8) * 8;
+	int                i, rc = -1;
+
+	for (i = 0; i < BENCH_CATS; i++) {
+		sprintf(names[i], "cat%02d", i);
+		dict[i]    = names[i];
+		cat_ttl[i] = 60000;
+	}
+
+	if (n_patterns <= 0 || n_urls <= 0 || cache_size <= 0) {
+		fprintf(stderr, "%s: ufp: bad number of match strings, urls or cache size\n", ProgName);
+		return -1;
+	}
+
+	if (!(engine = ufp_cat_engine_create(dict, BENCH_CATS))) {
+		fprintf(stderr, "%s: ufp: ufp_cat_engine_create failed\n", ProgName);
+		return -1;
+	}
+	for (i = 0; i < n_patterns; i++) {
+		sprintf(pattern, "kw%04d", i);
+		if (ufp_cat_engine_add(engine, pattern, i % BENCH_CATS) < 0) {
+			fprintf(stderr, "%s: ufp: ufp_cat_engine_add failed\n", ProgName);
+			goto end;
+		}
+	}
+	if (ufp_cat_engine_compile(engine) < 0) {
+		fprintf(stderr, "%s: ufp: ufp_cat_engine_compile failed\n", ProgName);
+		goto end;
+	}
+
+	pool  = ufp_mask_pool_create(mask_len, cache_size + 16);
+	cache = pool ? ufp_verdict_cache_create(cache_size, pool, BENCH_CATS, cat_ttl, 60000, 3600) : NULL;
+	urls  = ufp_urls();
+	if (!pool || !cache || !urls) {
+		fprintf(stderr, "%s: ufp: out of memory\n", ProgName);
+		goto end;
+	}
+
+	/*
+	 * The category engine alone
+	 */
+	if (!(bs = bench_stats_create("ufp_match", "url", 0)))
+		goto end;
+	bench_stats_param(bs, "patterns", n_patterns);
+	bench_stats_param(bs, "urls", n_urls);
+
+	ufp_lookups(engine, NULL, pool, mask_len, urls, n_warmup, NULL);
+	bench_stats_start(bs);
+	ufp_lookups(engine, NULL, pool, mask_len, urls, n_ops, bs);
+	bench_stats_stop(bs);
+	if (report(bs) < 0)
+		goto end;
+
+	/*
+	 * The verdict cache in front of it
+	 */
+	if (!(bs = bench_stats_create("ufp_cached", "url", 0)))
+		goto end;
+	bench_stats_param(bs, "patterns", n_patterns);
+	bench_stats_param(bs, "urls", n_urls);
+	bench_stats_param(bs, "cache_size", cache_size);
+
+	ufp_lookups(engine, cache, pool, mask_len, urls, n_warmup, NULL);
+	cache->hits = cache->misses = cache->evictions = 0;
+	bench_stats_start(bs);
+	ufp_lookups(engine, cache, pool, mask_len, urls, n_ops, bs);
+	bench_stats_stop(bs);
+	bench_stats_param(bs, "hits", cache->hits);
+	bench_stats_param(bs, "misses", cache->misses);
+	if (report(bs) < 0)
+		goto end;
+
+	rc = 0;
+
+end:
+	if (urls) {
+		for (i = 0; i < n_urls; i++)
+			free(urls[i]);
+		free(urls);
+	}
+	ufp_verdict_cache_destroy(cache);
+	ufp_mask_pool_destroy(pool);
+	ufp_cat_engine_destroy(engine);
+
+	return rc;
+}
+
+
+/* -------------------------------------------------------------------------------------
+                                         SAM
+   ------------------------------------------------------------------------------------- */
+
+ /* -----------------------------------------------------------------------------
+  |  sam_commands:
+  |  -------------
+  |
+  |  Description:
+  |  ------------
+  |  Parses 'count' command lines, taking the lines of sam_lines in turn.
+  |
+  |  Parameters:
+  |  -----------
+  |  argc  - number of arguments of every line.
+  |  argv  - arguments of every line.
+  |  lines - number of lines.
+  |  count - number of commands to parse.
+  |  bs    - statistics, NULL for a warm-up.
+  |
+  |  Returned value:
+  |  ---------------
+  |  None.
+   ----------------------------------------------------------------------------- */
+static void sam_commands(int *argc, char *(*argv)[BENCH_MAX_ARGS], int lines, long count, bench_stats *bs)
+{
+	struct SamCommand command;
+	double            t;
+	long              i;
+	int               line, rc;
+
+	for (i = 0; i < count; i++) {
+		line = (int)(i % lines);
+
+		t = bench_now();
+		SamCommandInit(&command);
+		rc = SamCommandParse(&command, 0, argc[line], argv[line]);
+		t = bench_now() - t;
+
+		if (!bs)
+			continue;
+		if (rc < 0)
+			bench_stats_error(bs);
+		else
+			bench_stats_add(bs, t, 0);
+	}
+}
+
+ /* -----------------------------------------------------------------------------
+  |  bench_sam:
+  |  ----------
+  |
+  |  Description:
+  |  ------------
+  |  Runs the sam benchmark. Sending the commands needs a SAM server, so
+  |  only the client side preparation of a command is measured.
+  |
+  |  Parameters:
+  |  -----------
+  |  None.
+  |
+  |  Returned value:
+  |  ---------------
+  |  0 if successful, -1 otherwise.
+   ----------------------------------------------------------------------------- */
+static int bench_sam(void)
+{
+	static char   buf[sizeof(sam_lines) / sizeof(sam_lines[0])][256];
+	char         *argv[sizeof(sam_lines) / sizeof(sam_lines[0])][BENCH_MAX_ARGS];
+	int           argc[sizeof(sam_lines) / sizeof(sam_lines[0])];
+	char         *tok;
+	bench_stats  *bs;
+	int           lines;
+
+	for (lines = 0; sam_lines[lines]; lines++) {
+		strncpy(buf[lines], sam_lines[lines], sizeof(buf[lines]) - 1);
+		argc[lines] = 0;
+		for (tok = strtok(buf[lines], " "); tok && argc[lines] < BENCH_MAX_ARGS; tok = strtok(NULL, " "))
+			argv[lines][argc[lines]++] = tok;
+	}
+
+	if (!(bs = bench_stats_create("sam_parse", "command", 0)))
+		return -1;
+	bench_stats_param(bs, "lines", lines);
+
+	sam_commands(argc, argv, lines, n_warmup, NULL);
+	bench_stats_start(bs);
+	sam_commands(argc, argv, lines, n_ops, bs);
+	bench_stats_stop(bs);
+
+	return report(bs);
+}
+
+
+/* -------------------------------------------------------------------------------------
+                                         LEA
+   ------------------------------------------------------------------------------------- */
+
+static bench_stats *lea_stats = NULL;
+static double       lea_last  = 0;
+
+ /* -----------------------------------------------------------------------------
+  |  lea_record_handler:
+  |  -------------------
+  |
+  |  Description:
+  |  ------------
+  |  Accounts for a record. The latency of a record is the time since the
+  |  previous one.
+  |
+  |  Parameters:
+  |  -----------
+  |  session - pointer to an OpsecSession object.
+  |  rec     - the record.
+  |  perm    - attribute permissions.
+  |
+  |  Returned value:
+  |  ---------------
+  |  OPSEC_SESSION_OK, OPSEC_SESSION_END once n_ops records were read.
+   ----------------------------------------------------------------------------- */
+static int lea_record_handler(OpsecSession *session, lea_record *rec, int perm[])
+{
+	double now = bench_now();
+
+	bench_stats_add(lea_stats, now - lea_last, 0);
+	lea_last = now;
+
+	return (lea_stats->n_ops >= n_ops) ? OPSEC_SESSION_END : OPSEC_SESSION_OK;
+}
+
+static int lea_eof_handler(OpsecSession *session)
+{
+	return OPSEC_SESSION_END;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  bench_lea:
+  |  ----------
+  |
+  |  Description:
+  |  ------------
+  |  Runs the lea benchmark against the server given with -H. The log file
+  |  is read from its start, offline, until n_ops records or its end.
+  |
+  |  Parameters:
+  |  -----------
+  |  None.
+  |
+  |  Returned value:
+  |  ---------------
+  |  0 if successful or skipped, -1 otherwise.
+   ----------------------------------------------------------------------------- */
+static int bench_lea(void)
+{
+	OpsecEnv    *env;
+	OpsecEntity *client = NULL, *server = NULL;
+	int          rc = -1;
+
+	if (!lea_host) {
+		fprintf(stderr, "%s: lea: no LEA server given (-H), skipped\n", ProgName);
+		return 0;
+	}
+
+	if (!(lea_stats = bench_stats_create("lea_records", "record", 0)))
+		return -1;
+	bench_stats_param(lea_stats, "port", lea_port);
+
+	if (!(env = opsec_init(OPSEC_EOL))) {
+		fprintf(stderr, "%s: opsec_init failed (%s)\n", ProgName, opsec_errno_str(opsec_errno));
+		bench_stats_destroy(lea_stats);
+		return -1;
+	}
+
+	client = opsec_init_entity(env, LEA_CLIENT,
+	                           LEA_RECORD_HANDLER, lea_record_handler,
+	                           LEA_EOF_HANDLER, lea_eof_handler,
+	                           OPSEC_EOL);
+	server = opsec_init_entity(env, LEA_SERVER,
+	                           OPSEC_ENTITY_NAME, "lea_server",
+	                           OPSEC_SERVER_IP, inet_addr(lea_host),
+	                           OPSEC_SERVER_PORT, (int)htons((unsigned short)lea_port),
+	                           OPSEC_EOL);
+	if (!client || !server) {
+		fprintf(stderr, "%s: opsec_init_entity failed (%s)\n", ProgName, opsec_errno_str(opsec_errno));
+		goto end;
+	}
+
+	if (!lea_new_session(client, server, LEA_OFFLINE, LEA_FILENAME, lea_file, LEA_AT_START)) {
+		fprintf(stderr, "%s: lea_new_session failed (%s)\n", ProgName, opsec_errno_str(opsec_errno));
+		goto end;
+	}
+
+	bench_stats_start(lea_stats);
+	lea_last = lea_stats->start;
+	opsec_mainloop(env);
+	bench_stats_stop(lea_stats);
+
+	rc = report(lea_stats);
+	lea_stats = NULL;
+
+end:
+	bench_stats_destroy(lea_stats);
+	lea_stats = NULL;
+	if (client) opsec_destroy_entity(client);
+	if (server) opsec_destroy_entity(server);
+	opsec_env_destroy(env);
+
+	return rc;
+}
+
+
+/* -------------------------------------------------------------------------------------
+                                        M A I N
+   ------------------------------------------------------------------------------------- */
+static void usage(void)
+{
+	fprintf(stderr, "Usage: %s [-b cvp|scan|ufp|sam|lea|all] [-n <operations>] [-w <warm-up operations>]\n"
+	                "       [-o <results file>] [-c <chunk size>] [-f <file size>] [-m <memory threshold>]\n"
+	                "       [-p <patterns>] [-u <distinct urls>] [-k <verdict cache size>]\n"
+	                "       [-H <lea server ip>] [-P <lea server port>] [-l <log file>]\n", ProgName);
+	exit(1);
+}
+
+int main(int ac, char *av[])
+{
+	char *bench = "all";
+	char *out   = NULL;
+	int   all, idx, rc = 0;
+
+	ProgName = av[0];
+
+	for (idx = 1; idx + 1 < ac; idx += 2) {
+		if (av[idx][0] != '-' || !av[idx][1] || av[idx][2])
+			usage();
+
+		switch (av[idx][1]) {
+		case 'b': bench         = av[idx + 1];       break;
+		case 'n': n_ops         = atol(av[idx + 1]); break;
+		case 'w': n_warmup      = atol(av[idx + 1]); break;
+		case 'o': out           = av[idx + 1];       break;
+		case 'c': chunk_size    = atoi(av[idx + 1]); break;
+		case 'f': file_size     = atol(av[idx + 1]); break;
+		case 'm': mem_threshold = atoi(av[idx + 1]); break;
+		case 'p': n_patterns    = atoi(av[idx + 1]); break;
+		case 'u': n_urls        = atoi(av[idx + 1]); break;
+		case 'k': cache_size    = atoi(av[idx + 1]); break;
+		case 'H': lea_host      = av[idx + 1];       break;
+		case 'P': lea_port      = atoi(av[idx + 1]); break;
+		case 'l': lea_file      = av[idx + 1];       break;
+		default:  usage();
+		}
+	}
+	if (idx < ac || n_ops <= 0 || n_warmup < 0)
+		usage();
+
+	all = !strcmp(bench, "all");
+	if (!all && strcmp(bench, "cvp") && strcmp(bench, "scan") && strcmp(bench, "ufp") &&
+	    strcmp(bench, "sam") && strcmp(bench, "lea"))
+		usage();
+
+	if (!out)
+		results = stdout;
+	else if (!(results = fopen(out, "a"))) {
+		fprintf(stderr, "%s: can not open %s\n", ProgName, out);
+		exit(1);
+	}
+
+	if ((all || !strcmp(bench, "cvp")) && bench_cvp() < 0) rc = 1;
+	if ((all || !strcmp(bench, "scan")) && bench_scan() < 0) rc = 1;
+	if ((all || !strcmp(bench, "ufp")) && bench_ufp() < 0) rc = 1;
+	if ((all || !strcmp(bench, "sam")) && bench_sam() < 0) rc = 1;
+	if ((all || !strcmp(bench, "lea")) && bench_lea() < 0) rc = 1;
+
+	if (results != stdout && fclose(results) != 0) {
+		fprintf(stderr, "%s: failed to close %s\n", ProgName, out);
+		rc = 1;
+	}
+
+	return rc;
+}
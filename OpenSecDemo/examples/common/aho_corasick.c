@@ -0,0 +1,289 @@
+/***************************************************************************
+ *                                                                         *
+ * aho_corasick.c : Aho-Corasick automaton for the sample servers          *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2001 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * An Aho-Corasick automaton, shared by the UFP categorization engine (see *
+ * ../ufp/ufp_cat.c) and the patterns scan engine (see scan_engine.c).     *
+ *                                                                         *
+ * The automaton is a trie of the strings added, where every node also has *
+ * a failure link (the node of the longest proper suffix of the node       *
+ * string that is in the trie) and an output. A text is matched in a       *
+ * single pass - one transition per byte, whatever the number of strings.  *
+ *                                                                         *
+ * Outputs are ints which the users give a meaning: the id of an interned  *
+ * category mask for UFP, a pattern number for the patterns engine. A user *
+ * sets the output of the node ac_add() returns. ac_compile() then merges  *
+ * the output of every node with the one of its failure target, through    *
+ * the merge function given, so the output of a node covers every string   *
+ * which ends there.                                                       *
+ *                                                                         *
+ * Bytes are matched as they are: a user which folds the case does so on   *
+ * the strings it adds and on the text alike. depth[] keeps the length of  *
+ * the string of every node, i.e. how many of the last bytes the current   *
+ * node still depends on.                                                  *
+ *                                                                         *
+ * While strings are added the trie is kept as child lists, sorted by      *
+ * character (b_first_child, b_sibling, b_char). Compiling replaces them   *
+ * with edge arrays which are binary searched, except the root whose edges *
+ * are looked up directly.                                                 *
+ *                                                                         *
+ ***************************************************************************/
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "aho_corasick.h"
+
+#define AC_INITIAL_NODES   1024
+
+static int
+ac_grow_nodes(ac_automaton *ac)
+{
+	int   size = ac->nodes_size ? ac->nodes_size * 2 : AC_INITIAL_NODES;
+	void *p;
+
+	if (!(p = realloc(ac->b_first_child, size * sizeof(int)))) return -1;
+	ac->b_first_child = (int *)p;
+	if (!(p = realloc(ac->b_sibling, size * sizeof(int)))) return -1;
+	ac->b_sibling = (int *)p;
+	if (!(p = realloc(ac->b_char, size))) return -1;
+	ac->b_char = (unsigned char *)p;
+	if (!(p = realloc(ac->out, size * sizeof(int)))) return -1;
+	ac->out = (int *)p;
+	if (!(p = realloc(ac->depth, size * sizeof(int)))) return -1;
+	ac->depth = (int *)p;
+
+	ac->nodes_size = size;
+
+	return 0;
+}
+
+ac_automaton *
+ac_create(void)
+{
+	ac_automaton *ac = (ac_automaton *)calloc(1, sizeof(ac_automaton));
+
+	if (!ac) return NULL;
+
+	if (ac_grow_nodes(ac) < 0) {
+		ac_destroy(ac);
+		return NULL;
+	}
+
+	/* the root */
+	ac->b_first_child[0] = -1;
+	ac->b_sibling[0]     = -1;
+	ac->b_char[0]        = 0;
+	ac->out[0]           = -1;
+	ac->depth[0]         = 0;
+	ac->n_nodes          = 1;
+
+	return ac;
+}
+
+void
+ac_destroy(ac_automaton *ac)
+{
+	if (!ac) return;
+
+	free(ac->b_first_child);
+	free(ac->b_sibling);
+	free(ac->b_char);
+	free(ac->out);
+	free(ac->depth);
+	free(ac->fail);
+	free(ac->edge_start);
+	free(ac->edge_char);
+	free(ac->edge_next);
+	free(ac);
+}
+
+/*
+ * Return the child of 'node' on 'c', creating it if needed. Children are
+ * kept sorted by their character.
+ */
+static int
+ac_child(ac_automaton *ac, int node, unsigned char c)
+{
+	int *link;
+	int  child;
+
+	/* grow first - 'link' points into the node arrays */
+	if (ac->n_nodes == ac->nodes_size && ac_grow_nodes(ac) < 0)
+		return -1;
+
+	link = &ac->b_first_child[node];
+	while (*link >= 0 && ac->b_char[*link] < c)
+		link = &ac->b_sibling[*link];
+
+	if (*link >= 0 && ac->b_char[*link] == c)
+		return *link;
+
+	child = ac->n_nodes++;
+	ac->b_first_child[child] = -1;
+	ac->b_sibling[child]     = *link;
+	ac->b_char[child]        = c;
+	ac->out[child]           = -1;
+	ac->depth[child]         = ac->depth[node] + 1;
+	*link = child;
+
+	return child;
+}
+
+/*
+ * Add a string of len bytes. Must be called before compiling.
+ * Returns the node where the string ends, whose output the caller sets,
+ * or -1 on error.
+ */
+int
+ac_add(ac_automaton *ac, unsigned char *str, int len)
+{
+	int node = 0, i;
+
+	if (!ac || ac->compiled || !str || len <= 0) return -1;
+
+	for (i = 0; i < len; i++)
+		if ((node = ac_child(ac, node, str[i])) < 0)
+			return -1;
+
+	return node;
+}
+
+/*
+ * The child of node on c in the compiled automaton, -1 if there is none.
+ */
+static int
+ac_edge(ac_automaton *ac, int node, unsigned char c)
+{
+	int lo = ac->edge_start[node],
+	    hi = ac->edge_start[node + 1] - 1,
+	    mid;
+
+	while (lo <= hi) {
+		mid = (lo + hi) / 2;
+		if (ac->edge_char[mid] == c) return ac->edge_next[mid];
+		if (ac->edge_char[mid] < c) lo = mid + 1;
+		else hi = mid - 1;
+	}
+
+	return -1;
+}
+
+/*
+ * Where the compiled automaton goes from node on c.
+ */
+int
+ac_goto(ac_automaton *ac, int node, unsigned char c)
+{
+	int next;
+
+	for (;;) {
+		if (node == 0)
+			return ac->root_next[c];
+		if ((next = ac_edge(ac, node, c)) >= 0)
+			return next;
+		node = ac->fail[node];
+	}
+}
+
+/*
+ * Build the edge arrays and the failure links, and merge the outputs.
+ * Without a merge function a node keeps its own output, or takes the one
+ * of its failure target if it has none.
+ * Returns 0 if successful, -1 otherwise.
+ */
+int
+ac_compile(ac_automaton *ac, ac_merge merge, void *opaque)
+{
+	int  n;
+	int *queue;
+	int  head = 0, tail = 0;
+	int  node, child, e, g, m;
+
+	if (!ac || ac->compiled) return -1;
+
+	n = ac->n_nodes;
+
+	ac->fail       = (int *)calloc(n, sizeof(int));
+	ac->edge_start = (int *)malloc((n + 1) * sizeof(int));
+	ac->edge_char  = (unsigned char *)malloc(n);
+	ac->edge_next  = (int *)malloc(n * sizeof(int));
+	queue          = (int *)malloc(n * sizeof(int));
+
+	if (!ac->fail || !ac->edge_start || !ac->edge_char || !ac->edge_next || !queue) {
+		free(queue);
+		return -1;
+	}
+
+	/* edge arrays - the child lists are already sorted */
+	for (node = 0, e = 0; node < n; node++) {
+		ac->edge_start[node] = e;
+		for (child = ac->b_first_child[node]; child >= 0; child = ac->b_sibling[child]) {
+			ac->edge_char[e] = ac->b_char[child];
+			ac->edge_next[e] = child;
+			e++;
+		}
+	}
+	ac->edge_start[n] = e;
+
+	memset(ac->root_next, 0, sizeof(ac->root_next));
+	for (e = ac->edge_start[0]; e < ac->edge_start[1]; e++) {
+		ac->root_next[ac->edge_char[e]] = ac->edge_next[e];
+		ac->fail[ac->edge_next[e]]      = 0;
+		queue[tail++] = ac->edge_next[e];
+	}
+
+	/*
+	 * Breadth first, so the failure target of a node (which is shallower)
+	 * already has its link and its final output.
+	 */
+	while (head < tail) {
+		node = queue[head++];
+
+		for (e = ac->edge_start[node]; e < ac->edge_start[node + 1]; e++) {
+			child = ac->edge_next[e];
+			g     = ac_goto(ac, ac->fail[node], ac->edge_char[e]);
+
+			ac->fail[child] = g;
+			if (merge)
+				m = merge(ac->out[child], ac->out[g], opaque);
+			else
+				m = (ac->out[child] >= 0) ? ac->out[child] : ac->out[g];
+			if (m == AC_ERROR) {
+				free(queue);
+				return -1;
+			}
+			ac->out[child] = m;
+
+			queue[tail++] = child;
+		}
+	}
+
+	free(queue);
+
+	free(ac->b_first_child);
+	free(ac->b_sibling);
+	free(ac->b_char);
+	ac->b_first_child = ac->b_sibling = NULL;
+	ac->b_char        = NULL;
+
+	ac->compiled = 1;
+
+	return 0;
+}
@@ -0,0 +1,68 @@
+#ifndef _AHO_CORASICK_H_
+#define _AHO_CORASICK_H_
+
+/***************************************************************************
+ *                                                                         *
+ * aho_corasick.h : Aho-Corasick automaton for the sample servers          *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2001 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * See aho_corasick.c for further explanations.                            *
+ *                                                                         *
+ ***************************************************************************/
+
+/*
+ * Returned by a merge function which failed.
+ */
+#define AC_ERROR   (-2)
+
+/*
+ * Merges the output of a node with the one of its failure target (-1 is
+ * no output). Returns the output of the node, or AC_ERROR.
+ */
+typedef int (*ac_merge)(int own, int inherited, void *opaque);
+
+/*
+ * out[] and depth[] may be read by the users, the rest is private.
+ */
+typedef struct _ac_automaton {
+	int              n_nodes;
+	int              nodes_size;
+
+	int             *out;             /* output of each node, or -1         */
+	int             *depth;           /* length of the node's string        */
+
+	/* build time trie */
+	int             *b_first_child;
+	int             *b_sibling;
+	unsigned char   *b_char;
+
+	/* compiled automaton */
+	int             *fail;            /* failure link of each node          */
+	int             *edge_start;      /* edges of node n: [edge_start[n],   */
+	unsigned char   *edge_char;       /*                   edge_start[n+1]) */
+	int             *edge_next;
+	int              root_next[256];  /* root edges, direct lookup          */
+	int              compiled;
+} ac_automaton;
+
+ac_automaton * ac_create(void);
+void           ac_destroy(ac_automaton *ac);
+int            ac_add(ac_automaton *ac, unsigned char *str, int len);
+int            ac_compile(ac_automaton *ac, ac_merge merge, void *opaque);
+int            ac_goto(ac_automaton *ac, int node, unsigned char c);
+
+#endif
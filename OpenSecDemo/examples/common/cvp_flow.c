@@ -0,0 +1,371 @@
+/***************************************************************************
+ *                                                                         *
+ * cvp_flow.c : Credit based flow control for CVP senders                  *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2001 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * A 'cvp flow' sends data to one side of a CVP connection (the source or  *
+ * the destination) under the CVP clear-to-send flow control.              *
+ *                                                                         *
+ * cvp_send_chunk_to_dst/src() refuse a chunk when the client buffer is    *
+ * full, and the client fires a CTS signal once it has room again. The     *
+ * flow keeps one credit: it is granted by a CTS signal and taken back by  *
+ * a refused send. Without the credit no send is tried, so the data is     *
+ * never offered again and again to a full client - it waits in the flow   *
+ * until the next CTS signal, which sends as much as the client takes.     *
+ *                                                                         *
+ * The size of the sends adapts: it doubles after a run of accepted sends  *
+ * and halves after a refused one, between the chunk size the flow was     *
+ * created with and cvp_max_chunk_size(). The CTS signal is tuned to the   *
+ * current size, so the client signals when the next send fits.            *
+ *                                                                         *
+ * cvp_flow_write() sends directly from the caller's data while the flow   *
+ * has the credit, and copies only what was not taken. A producer that     *
+ * reads its data from a file should ask cvp_flow_room() first, so data    *
+ * is only produced when it can be sent.                                   *
+ *                                                                         *
+ * The flow counts the sends, the refused sends and the time it spent      *
+ * waiting for a CTS signal (stall time), see cvp_flow_print_stats().      *
+ *                                                                         *
+ ***************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "opsec/opsec.h"
+#include "opsec/cvp.h"
+
+#include "cvp_flow.h"
+#include "metrics.h"
+
+/* accepted sends before the send size doubles */
+#define CVP_FLOW_GROW_AFTER   4
+
+/*
+ * Tune the CTS signal to the current send size.
+ */
+static void
+cvp_flow_set_cts(cvp_flow *flow)
+{
+	int size = flow->to_src ? cvp_cts_src_chunk_size(flow->session, flow->chunk)
+	                        : cvp_cts_chunk_size(flow->session, flow->chunk);
+
+	if (size > 0 && size < flow->chunk)
+		flow->chunk = size;
+}
+
+cvp_flow *
+cvp_flow_create(OpsecSession *session, int to_src, int chunk_size)
+{
+	cvp_flow *flow = (cvp_flow *)calloc(1, sizeof(cvp_flow));
+	int       max  = 0;
+
+	if (!flow) return NULL;
+
+	flow->session = session;
+	flow->to_src  = to_src;
+	flow->credit  = 1;
+
+	if ((to_src ? cvp_max_src_chunk_size(session, &max) : cvp_max_chunk_size(session, &max)) < 0 ||
+	    max <= 0)
+		max = chunk_size;
+	if (max > CVP_FLOW_MAX_CHUNK)
+		max = CVP_FLOW_MAX_CHUNK;
+
+	flow->min_chunk = (chunk_size > 0 && chunk_size < max) ? chunk_size : max;
+	flow->max_chunk = max;
+	flow->chunk     = flow->min_chunk;
+
+	if (flow->chunk <= 0) {
+		fprintf(stderr, "cvp_flow_create: bad chunk size (%d)\n", chunk_size);
+		free(flow);
+		return NULL;
+	}
+
+	cvp_flow_set_cts(flow);
+	flow->min_chunk = flow->chunk;
+
+	return flow;
+}
+
+void
+cvp_flow_destroy(cvp_flow *flow)
+{
+	if (!flow) return;
+
+	free(flow->buf);
+	free(flow);
+}
+
+static int
+cvp_flow_send(cvp_flow *flow, char *data, int len)
+{
+	return flow->to_src ? cvp_send_chunk_to_src(flow->session, data, len)
+	                    : cvp_send_chunk_to_dst(flow->session, data, len);
+}
+
+/*
+ * A send was refused: give up the credit until the next CTS signal, and
+ * ask for smaller chunks.
+ */
+static void
+cvp_flow_refused(cvp_flow *flow)
+{
+	flow->credit      = 0;
+	flow->accepted    = 0;
+	flow->refused++;
+	flow->stall_start = metrics_now_usec();
+
+	if (flow->chunk > flow->min_chunk) {
+		flow->chunk /= 2;
+		if (flow->chunk < flow->min_chunk)
+			flow->chunk = flow->min_chunk;
+		cvp_flow_set_cts(flow);
+	}
+}
+
+static void
+cvp_flow_accepted(cvp_flow *flow, int len)
+{
+	flow->sends++;
+	flow->bytes += len;
+
+	if (++flow->accepted >= CVP_FLOW_GROW_AFTER && flow->chunk < flow->max_chunk) {
+		flow->accepted = 0;
+		flow->chunk    = (flow->chunk > flow->max_chunk / 2) ? flow->max_chunk : flow->chunk * 2;
+		cvp_flow_set_cts(flow);
+	}
+}
+
+/*
+ * Send from 'data' while the flow has the credit.
+ * Returns the number of bytes sent, or -1 on a fatal error.
+ */
+static int
+cvp_flow_push(cvp_flow *flow, char *data, int len)
+{
+	int sent = 0;
+	int n, rc;
+
+	while (flow->credit && sent < len) {
+		n  = (len - sent < flow->chunk) ? len - sent : flow->chunk;
+		rc = cvp_flow_send(flow, data + sent, n);
+		if (rc == CVP_DATA_FLOW_DIRECTION_ERR || rc == CVP_SEND_TO_SRC_DISABLED) {
+			fprintf(stderr, "cvp_flow_push: send refused (%d)\n", rc);
+			return -1;
+		}
+		if (rc != 0) {
+			cvp_flow_refused(flow);
+			break;
+		}
+		cvp_flow_accepted(flow, n);
+		sent += n;
+	}
+
+	return sent;
+}
+
+/*
+ * Send the queued data, then the EOF, while the flow has the credit.
+ */
+static int
+cvp_flow_pump(cvp_flow *flow)
+{
+	int n, rc;
+
+	if (flow->buf_len > 0) {
+		if ((n = cvp_flow_push(flow, flow->buf + flow->buf_off, flow->buf_len)) < 0)
+			return -1;
+		flow->buf_off += n;
+		flow->buf_len -= n;
+		if (flow->buf_len == 0)
+			flow->buf_off = 0;
+	}
+
+	if (flow->eof && !flow->eof_sent && flow->buf_len == 0 && flow->credit) {
+		rc = cvp_flow_send(flow, NULL, -1);
+		if (rc == CVP_DATA_FLOW_DIRECTION_ERR || rc == CVP_SEND_TO_SRC_DISABLED)
+			return -1;
+		if (rc != 0)
+			cvp_flow_refused(flow);
+		else
+			flow->eof_sent = 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Queue 'len' bytes of 'data'.
+ */
+static int
+cvp_flow_queue(cvp_flow *flow, char *data, int len)
+{
+	int   size;
+	char *buf;
+
+	if (flow->buf_off + flow->buf_len + len > flow->buf_size && flow->buf_off > 0) {
+		memmove(flow->buf, flow->buf + flow->buf_off, flow->buf_len);
+		flow->buf_off = 0;
+	}
+
+	if (flow->buf_len + len > flow->buf_size) {
+		size = flow->buf_size ? flow->buf_size : flow->max_chunk;
+		while (size < flow->buf_len + len)
+			size *= 2;
+		if (!(buf = (char *)realloc(flow->buf, size))) {
+			fprintf(stderr, "cvp_flow_queue: out of memory\n");
+			return -1;
+		}
+		flow->buf      = buf;
+		flow->buf_size = size;
+	}
+
+	memcpy(flow->buf + flow->buf_off + flow->buf_len, data, len);
+	flow->buf_len += len;
+
+	return 0;
+}
+
+/*
+ * Send 'len' bytes, or keep them until the client has room.
+ * Returns 0 if successful, -1 otherwise.
+ */
+int
+cvp_flow_write(cvp_flow *flow, char *data, int len)
+{
+	int sent = 0;
+
+	if (!flow || flow->eof || len < 0) return -1;
+
+	if (flow->buf_len == 0 && (sent = cvp_flow_push(flow, data, len)) < 0)
+		return -1;
+
+	return (sent < len) ? cvp_flow_queue(flow, data + sent, len - sent) : 0;
+}
+
+/*
+ * Send the EOF once the queued data is sent.
+ * Returns 0 if successful, -1 otherwise.
+ */
+int
+cvp_flow_eof(cvp_flow *flow)
+{
+	if (!flow) return -1;
+
+	flow->eof = 1;
+
+	return cvp_flow_pump(flow);
+}
+
+/*
+ * To be called from the CTS signal handler of the flow direction.
+ * Returns 0 if successful, -1 otherwise.
+ */
+int
+cvp_flow_cts(cvp_flow *flow)
+{
+	unsigned long stall;
+
+	if (!flow) return -1;
+
+	flow->cts_signals++;
+
+	if (!flow->credit) {
+		stall = metrics_now_usec() - flow->stall_start;
+		flow->stall_usec += stall;
+		if (stall > flow->max_stall_usec)
+			flow->max_stall_usec = stall;
+		flow->credit = 1;
+	}
+
+	return cvp_flow_pump(flow);
+}
+
+/*
+ * How many bytes a producer should write now: the current send size if
+ * the flow has the credit and nothing queued, 0 otherwise.
+ */
+int
+cvp_flow_room(cvp_flow *flow)
+{
+	if (!flow || flow->eof || !flow->credit || flow->buf_len > 0)
+		return 0;
+
+	return flow->chunk;
+}
+
+/*
+ * Bytes not sent yet.
+ */
+int
+cvp_flow_pending(cvp_flow *flow)
+{
+	return flow ? flow->buf_len : 0;
+}
+
+/*
+ * 1 once the EOF was asked for, though it may not be sent yet.
+ */
+int
+cvp_flow_at_eof(cvp_flow *flow)
+{
+	return (flow && flow->eof) ? 1 : 0;
+}
+
+/*
+ * The largest send of the flow - the size of a buffer for cvp_flow_write.
+ */
+int
+cvp_flow_max_chunk(cvp_flow *flow)
+{
+	return flow ? flow->max_chunk : 0;
+}
+
+/*
+ * Totals of the flow so far: sends accepted, sends refused, bytes sent.
+ * Any of the pointers may be NULL.
+ */
+void
+cvp_flow_get_stats(cvp_flow *flow, long *sends, long *refused, double *bytes)
+{
+	if (sends)   *sends   = flow ? flow->sends : 0;
+	if (refused) *refused = flow ? flow->refused : 0;
+	if (bytes)   *bytes   = flow ? flow->bytes : 0;
+}
+
+/*
+ * 1 once all the data and the EOF were sent.
+ */
+int
+cvp_flow_done(cvp_flow *flow)
+{
+	return (flow && flow->eof_sent) ? 1 : 0;
+}
+
+void
+cvp_flow_print_stats(cvp_flow *flow, FILE *out)
+{
+	if (!flow) return;
+
+	fprintf(out, "cvp flow to %s: %.0f bytes in %ld sends, %ld refused, %ld cts signals, "
+	             "send size %d (%d..%d), stalled %.3f sec (max %.3f sec)\n",
+	        flow->to_src ? "source" : "destination", flow->bytes, flow->sends,
+	        flow->refused, flow->cts_signals, flow->chunk, flow->min_chunk, flow->max_chunk,
+	        flow->stall_usec / 1000000.0, flow->max_stall_usec / 1000000.0);
+}
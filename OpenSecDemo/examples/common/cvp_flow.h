@@ -0,0 +1,76 @@
+#ifndef _CVP_FLOW_H_
+#define _CVP_FLOW_H_
+
+/***************************************************************************
+ *                                                                         *
+ * cvp_flow.h : Credit based flow control for CVP senders                  *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2001 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * See cvp_flow.c for further explanations.                                *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <stdio.h>
+
+#include "opsec/opsec.h"
+
+/*
+ * The largest send, whatever the client allows - the flow and its users
+ * keep buffers of that size.
+ */
+#define CVP_FLOW_MAX_CHUNK   (64 * 1024)
+
+typedef struct _cvp_flow {
+	OpsecSession  *session;
+	int            to_src;          /* else to the destination          */
+
+	int            chunk;           /* current send size                */
+	int            min_chunk;
+	int            max_chunk;       /* cvp_max_chunk_size()             */
+	int            credit;          /* a send may be tried              */
+	int            accepted;        /* sends accepted in a row          */
+
+	char          *buf;             /* data not taken by the client yet */
+	int            buf_size;
+	int            buf_off;
+	int            buf_len;
+	char           eof;             /* EOF asked for                    */
+	char           eof_sent;
+
+	long           sends;
+	long           refused;
+	long           cts_signals;
+	double         bytes;
+	unsigned long  stall_start;     /* [usec], of the current stall     */
+	unsigned long  stall_usec;      /* waiting for a CTS signal, total  */
+	unsigned long  max_stall_usec;
+} cvp_flow;
+
+cvp_flow * cvp_flow_create(OpsecSession *session, int to_src, int chunk_size);
+void       cvp_flow_destroy(cvp_flow *flow);
+int        cvp_flow_write(cvp_flow *flow, char *data, int len);
+int        cvp_flow_eof(cvp_flow *flow);
+int        cvp_flow_cts(cvp_flow *flow);
+int        cvp_flow_room(cvp_flow *flow);
+int        cvp_flow_pending(cvp_flow *flow);
+int        cvp_flow_at_eof(cvp_flow *flow);
+int        cvp_flow_max_chunk(cvp_flow *flow);
+int        cvp_flow_done(cvp_flow *flow);
+void       cvp_flow_get_stats(cvp_flow *flow, long *sends, long *refused, double *bytes);
+void       cvp_flow_print_stats(cvp_flow *flow, FILE *out);
+
+#endif
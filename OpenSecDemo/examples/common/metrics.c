@@ -0,0 +1,472 @@
+/***************************************************************************
+ *                                                                         *
+ * metrics.c : Counters, gauges and histograms for the sample servers      *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2001 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * A process wide registry of named metrics:                               *
+ *                                                                         *
+ *   counter   - a number which only grows (requests, chunks, bytes).      *
+ *   gauge     - a number which goes up and down (sessions, queue depth).  *
+ *   histogram - a distribution of values, typically latencies in micro    *
+ *               seconds. The buckets are log-linear, as in HDR            *
+ *               histograms: every power of 2 is split in 8 buckets, so a  *
+ *               percentile is off by at most 1/8 of its value, and a      *
+ *               histogram has a fixed size whatever values it gets.       *
+ *                                                                         *
+ * Metrics are created by name while the server starts, before any other   *
+ * thread runs; creating a metric which exists returns the existing one.   *
+ * Updates take no lock: counters, gauges and buckets are single words     *
+ * changed with atomic operations, so the worker threads of mt_cvp may     *
+ * update the same metric concurrently. A reader may see a histogram       *
+ * whose count and buckets differ by the updates in progress.              *
+ *                                                                         *
+ * metrics_write() writes every metric in the Prometheus text format.      *
+ * metrics_export_start() rewrites a file with that text periodically,     *
+ * from the OPSEC main loop - the local endpoint for operators and         *
+ * collectors. metrics_export_env() does so when OPSEC_METRICS_FILE is     *
+ * set, so every server exports its metrics without a new command line     *
+ * option. See ../amon/amon_metrics.c for the same metrics as AMON oids.   *
+ *                                                                         *
+ ***************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+#include "metrics.h"
+
+#if defined(WIN32)
+#define ATOMIC_ADD(p, n)        InterlockedExchangeAdd((volatile LONG *)(p), (LONG)(n))
+#define ATOMIC_CAS(p, old, new) (InterlockedCompareExchange((volatile LONG *)(p), (LONG)(new), (LONG)(old)) == (LONG)(old))
+#elif defined(__GNUC__)
+#define ATOMIC_ADD(p, n)        __sync_fetch_and_add((p), (n))
+#define ATOMIC_CAS(p, old, new) __sync_bool_compare_and_swap((p), (old), (new))
+#else
+/* no atomic operations - single threaded servers only */
+#define ATOMIC_ADD(p, n)        (*(p) += (n))
+#define ATOMIC_CAS(p, old, new) (*(p) == (old) ? (*(p) = (new), 1) : 0)
+#endif
+
+static metric *metrics_list = NULL;
+static metric *metrics_last = NULL;
+static int     metrics_n    = 0;
+
+/*
+ * The exports, one per OPSEC environment. The registry above is process
+ * wide: every export writes all the metrics.
+ */
+typedef struct _metrics_export {
+	struct _metrics_export *next;
+	OpsecEnv               *env;
+	char                    file[METRICS_FILE_LEN];
+	int                     interval;    /* [sec] */
+} metrics_export;
+
+static metrics_export *exports = NULL;
+
+
+/* -------------------------------------------------------------------------------------
+                                       Registry
+   ------------------------------------------------------------------------------------- */
+
+static metric *
+metric_create(char *name, char *help, metric_type type)
+{
+	metric *m;
+
+	for (m = metrics_list; m; m = m->next) {
+		if (!strcmp(m->name, name)) {
+			if (m->type == type)
+				return m;
+			fprintf(stderr, "metric_create: %s exists with another type\n", name);
+			return NULL;
+		}
+	}
+
+	if (!(m = (metric *)calloc(1, sizeof(metric))))
+		return NULL;
+
+	if (type == METRIC_HISTOGRAM &&
+	    !(m->buckets = (volatile long *)calloc(METRIC_HIST_BUCKETS, sizeof(long)))) {
+		free(m);
+		return NULL;
+	}
+
+	strncpy(m->name, name, sizeof(m->name) - 1);
+	strncpy(m->help, help ? help : "", sizeof(m->help) - 1);
+	m->type = type;
+	m->id   = ++metrics_n;
+
+	if (metrics_last)
+		metrics_last->next = m;
+	else
+		metrics_list = m;
+	metrics_last = m;
+
+	return m;
+}
+
+metric *
+metrics_counter(char *name, char *help)
+{
+	return metric_create(name, help, METRIC_COUNTER);
+}
+
+metric *
+metrics_gauge(char *name, char *help)
+{
+	return metric_create(name, help, METRIC_GAUGE);
+}
+
+metric *
+metrics_histogram(char *name, char *help)
+{
+	return metric_create(name, help, METRIC_HISTOGRAM);
+}
+
+/*
+ * The metrics in registration order, linked by next.
+ */
+metric *
+metrics_first(void)
+{
+	return metrics_list;
+}
+
+/*
+ * Free every metric. No metric may be used afterwards.
+ */
+void
+metrics_destroy(void)
+{
+	metric *m;
+
+	while ((m = metrics_list)) {
+		metrics_list = m->next;
+		free((void *)m->buckets);
+		free(m);
+	}
+	metrics_last = NULL;
+	metrics_n    = 0;
+}
+
+
+/* -------------------------------------------------------------------------------------
+                                        Updates
+   ------------------------------------------------------------------------------------- */
+
+/*
+ * The updates accept NULL, so a server keeps running when a metric could
+ * not be created.
+ */
+void
+metric_inc(metric *m)
+{
+	if (m) ATOMIC_ADD(&m->value, 1);
+}
+
+void
+metric_add(metric *m, long n)
+{
+	if (m) ATOMIC_ADD(&m->value, n);
+}
+
+void
+metric_set(metric *m, long value)
+{
+	if (m) m->value = value;
+}
+
+static int
+hist_bucket(unsigned long value)
+{
+	int msb = 0;
+
+	if (value < METRIC_HIST_SUB_BUCKETS)
+		return (int)value;
+
+	if (value > 0xffffffffUL)
+		return METRIC_HIST_BUCKETS - 1;
+
+	while ((value >> msb) > 1)
+		msb++;
+
+	return (msb - METRIC_HIST_SUB_BITS + 1) * METRIC_HIST_SUB_BUCKETS +
+	       (int)((value >> (msb - METRIC_HIST_SUB_BITS)) & (METRIC_HIST_SUB_BUCKETS - 1));
+}
+
+/*
+ * The largest value which goes to a bucket.
+ */
+static unsigned long
+hist_bucket_max(int idx)
+{
+	int e = idx / METRIC_HIST_SUB_BUCKETS;
+
+	if (e == 0)
+		return (unsigned long)idx;
+
+	return ((unsigned long)(METRIC_HIST_SUB_BUCKETS + idx % METRIC_HIST_SUB_BUCKETS + 1) << (e - 1)) - 1;
+}
+
+void
+metric_observe(metric *m, unsigned long value)
+{
+	long max;
+
+	if (!m || !m->buckets) return;
+
+	ATOMIC_ADD(&m->buckets[hist_bucket(value)], 1);
+	ATOMIC_ADD(&m->count, 1);
+	ATOMIC_ADD(&m->sum, (long)value);
+
+	while ((max = m->max) < (long)value && !ATOMIC_CAS(&m->max, max, (long)value))
+		;
+}
+
+/*
+ * The value below which pct percent of the observed values are, rounded
+ * up to the end of its bucket. 0 if nothing was observed.
+ */
+long
+metric_percentile(metric *m, double pct)
+{
+	long count, rank, seen = 0;
+	int  i;
+
+	if (!m || !m->buckets || (count = m->count) <= 0)
+		return 0;
+
+	rank = (long)(pct / 100.0 * count + 0.999999);
+	if (rank < 1) rank = 1;
+
+	for (i = 0; i < METRIC_HIST_BUCKETS; i++) {
+		if ((seen += m->buckets[i]) >= rank)
+			return ((long)hist_bucket_max(i) < m->max) ? (long)hist_bucket_max(i) : m->max;
+	}
+
+	return m->max;
+}
+
+/*
+ * Current time in micro seconds, for latencies. Only differences are
+ * meaningful; they are correct across a wrap around.
+ */
+unsigned long
+metrics_now_usec(void)
+{
+#ifdef WIN32
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER        now;
+
+	if (!freq.QuadPart)
+		QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+
+	return (unsigned long)(now.QuadPart * 1000000 / freq.QuadPart);
+#else
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (unsigned long)tv.tv_sec * 1000000UL + (unsigned long)tv.tv_usec;
+#endif
+}
+
+
+/* -------------------------------------------------------------------------------------
+                                        Export
+   ------------------------------------------------------------------------------------- */
+
+/*
+ * Write every metric in the Prometheus text format.
+ * Returns 0 if successful, -1 otherwise.
+ */
+int
+metrics_write(FILE *out)
+{
+	static double quantiles[] = { 50.0, 90.0, 99.0, 99.9 };
+	metric *m;
+	int     i;
+
+	for (m = metrics_list; m; m = m->next) {
+		if (m->help[0])
+			fprintf(out, "# HELP %s %s\n", m->name, m->help);
+
+		switch (m->type) {
+		case METRIC_COUNTER:
+			fprintf(out, "# TYPE %s counter\n%s %ld\n", m->name, m->name, m->value);
+			break;
+
+		case METRIC_GAUGE:
+			fprintf(out, "# TYPE %s gauge\n%s %ld\n", m->name, m->name, m->value);
+			break;
+
+		case METRIC_HISTOGRAM:
+			fprintf(out, "# TYPE %s summary\n", m->name);
+			for (i = 0; i < (int)(sizeof(quantiles) / sizeof(quantiles[0])); i++)
+				fprintf(out, "%s{quantile=\"%g\"} %ld\n",
+				        m->name, quantiles[i] / 100.0, metric_percentile(m, quantiles[i]));
+			fprintf(out, "%s_max %ld\n%s_sum %ld\n%s_count %ld\n",
+			        m->name, m->max, m->name, m->sum, m->name, m->count);
+			break;
+		}
+	}
+
+	return (fflush(out) == 0 && !ferror(out)) ? 0 : -1;
+}
+
+/*
+ * Rewrite the export file. The text goes to a temporary file which is
+ * then renamed, so a reader never sees a partial file.
+ */
+static void
+export_timer(void *opaque)
+{
+	metrics_export *ex = (metrics_export *)opaque;
+	char            tmp[METRICS_FILE_LEN + 8];
+	FILE           *fp;
+	int             rc;
+
+	sprintf(tmp, "%s.tmp", ex->file);
+
+	if (!(fp = fopen(tmp, "w"))) {
+		fprintf(stderr, "metrics: fopen('%s') failed: %s\n", tmp, strerror(errno));
+	}
+	else {
+		rc = metrics_write(fp);
+		if (fclose(fp) != 0 || rc < 0) {
+			fprintf(stderr, "metrics: failed to write '%s'\n", tmp);
+			remove(tmp);
+		}
+		else {
+#ifdef WIN32
+			remove(ex->file);
+#endif
+			if (rename(tmp, ex->file) < 0)
+				fprintf(stderr, "metrics: rename('%s') failed: %s\n", tmp, strerror(errno));
+		}
+	}
+
+	opsec_schedule(ex->env, (time_t)ex->interval * 1000, export_timer, ex);
+}
+
+/*
+ * Write the metrics to file now, and then every interval seconds, from
+ * the main loop of env. An export of env to the same file is restarted;
+ * one to another file is not replaced, and the call fails. The exports of
+ * other environments go on.
+ * Returns 0 if successful, -1 otherwise.
+ */
+int
+metrics_export_start(OpsecEnv *env, char *file, int interval)
+{
+	metrics_export *ex;
+
+	if (!env || !file || !*file || interval <= 0 || strlen(file) >= sizeof(ex->file)) {
+		fprintf(stderr, "metrics_export_start: bad parameters\n");
+		return -1;
+	}
+
+	for (ex = exports; ex; ex = ex->next) {
+		if (ex->env == env && strcmp(ex->file, file) != 0) {
+			fprintf(stderr, "metrics_export_start: the environment already exports to '%s'\n", ex->file);
+			return -1;
+		}
+	}
+
+	metrics_export_stop(env);
+
+	if (!(ex = (metrics_export *)calloc(1, sizeof(metrics_export)))) {
+		fprintf(stderr, "metrics_export_start: out of memory\n");
+		return -1;
+	}
+	ex->env      = env;
+	ex->interval = interval;
+	strcpy(ex->file, file);
+
+	ex->next = exports;
+	exports  = ex;
+
+	export_timer(ex);
+
+	return 0;
+}
+
+/*
+ * Stop the export of env, if any.
+ */
+void
+metrics_export_stop(OpsecEnv *env)
+{
+	metrics_export **pp, *ex;
+
+	for (pp = &exports; (ex = *pp); pp = &ex->next) {
+		if (ex->env == env) {
+			opsec_deschedule(env, export_timer, ex);
+			*pp = ex->next;
+			free(ex);
+			return;
+		}
+	}
+}
+
+/*
+ * Start exporting if OPSEC_METRICS_FILE is set, every
+ * OPSEC_METRICS_INTERVAL seconds.
+ * Returns 0 if successful or not asked for, -1 otherwise.
+ */
+int
+metrics_export_env(OpsecEnv *env)
+{
+	return metrics_export_env_named(env, NULL);
+}
+
+/*
+ * As metrics_export_env(), to the file name followed by '.' and name -
+ * for servers which share a process (see ../sl_host/opsec_sl_host.c).
+ * A shared library server has its own copy of this file, so its own
+ * registry and exports. Servers sharing one copy share the metrics, and
+ * the environment of the host: only the first of them exports.
+ */
+int
+metrics_export_env_named(OpsecEnv *env, char *name)
+{
+	char *file     = getenv(METRICS_FILE_ENV);
+	char *interval = getenv(METRICS_INTERVAL_ENV);
+	char  named[METRICS_FILE_LEN];
+
+	if (!file || !*file)
+		return 0;
+
+	if (name) {
+		if (strlen(file) + strlen(name) + 1 >= sizeof(named)) {
+			fprintf(stderr, "metrics_export_env_named: file name too long\n");
+			return -1;
+		}
+		sprintf(named, "%s.%s", file, name);
+		file = named;
+	}
+
+	return metrics_export_start(env, file, interval ? atoi(interval) : METRICS_DEFAULT_INTERVAL);
+}
@@ -0,0 +1,93 @@
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+/***************************************************************************
+ *                                                                         *
+ * metrics.h : Counters, gauges and histograms for the sample servers      *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2001 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * See metrics.c for further explanations.                                 *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <stdio.h>
+
+#include "opsec/opsec.h"
+
+#define METRICS_NAME_LEN          64
+#define METRICS_HELP_LEN          128
+#define METRICS_FILE_LEN          256
+
+/*
+ * Export file and interval [sec], read by metrics_export_env()
+ */
+#define METRICS_FILE_ENV          "OPSEC_METRICS_FILE"
+#define METRICS_INTERVAL_ENV      "OPSEC_METRICS_INTERVAL"
+#define METRICS_DEFAULT_INTERVAL  10
+
+/*
+ * Histogram buckets: values below 2^METRIC_HIST_SUB_BITS have a bucket
+ * each, every larger power of 2 is split in 2^METRIC_HIST_SUB_BITS equal
+ * buckets. Values of 2^32 and above go to the last bucket.
+ */
+#define METRIC_HIST_SUB_BITS      3
+#define METRIC_HIST_SUB_BUCKETS   (1 << METRIC_HIST_SUB_BITS)
+#define METRIC_HIST_BUCKETS       ((32 - METRIC_HIST_SUB_BITS + 1) * METRIC_HIST_SUB_BUCKETS)
+
+typedef enum {
+	METRIC_COUNTER,
+	METRIC_GAUGE,
+	METRIC_HISTOGRAM
+} metric_type;
+
+typedef struct _metric {
+	char             name[METRICS_NAME_LEN];
+	char             help[METRICS_HELP_LEN];
+	metric_type      type;
+	int              id;                   /* 1, 2, ... in registration order */
+
+	volatile long    value;                /* counter or gauge                */
+
+	volatile long   *buckets;              /* histogram                       */
+	volatile long    count;
+	volatile long    sum;
+	volatile long    max;
+
+	struct _metric  *next;
+} metric;
+
+metric * metrics_counter(char *name, char *help);
+metric * metrics_gauge(char *name, char *help);
+metric * metrics_histogram(char *name, char *help);
+metric * metrics_first(void);
+void     metrics_destroy(void);
+
+void     metric_inc(metric *m);
+void     metric_add(metric *m, long n);
+void     metric_set(metric *m, long value);
+void     metric_observe(metric *m, unsigned long value);
+long     metric_percentile(metric *m, double pct);
+
+unsigned long metrics_now_usec(void);
+
+int      metrics_write(FILE *out);
+int      metrics_export_start(OpsecEnv *env, char *file, int interval);
+void     metrics_export_stop(OpsecEnv *env);
+int      metrics_export_env(OpsecEnv *env);
+int      metrics_export_env_named(OpsecEnv *env, char *name);
+
+#endif
@@ -0,0 +1,806 @@
+/***************************************************************************
+ *                                                                         *
+ * scan_engine.c : Content inspection engines for the CVP servers          *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2001 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * A scan engine inspects a stream of content as it arrives, chunk by      *
+ * chunk, and ends with a verdict: clean, infected (with the name of the   *
+ * threat) or error. Engines implement the scan_engine_ops ABI (see        *
+ * scan_engine.h). Two engines are built in:                               *
+ *                                                                         *
+ *   eicar    - finds the EICAR anti virus test file: the EICAR string at  *
+ *              the start of the content, followed by white space only, at *
+ *              most 128 bytes in all.                                     *
+ *                                                                         *
+ *   patterns - finds any of a set of byte patterns, anywhere in the       *
+ *              content, with an Aho-Corasick automaton (see               *
+ *              aho_corasick.c): one pass over the data whatever the       *
+ *              number of patterns. The patterns are read from the file    *
+ *              given as the engine arguments, one per line:               *
+ *              '<threat name> <pattern in hex>'. '#' starts a comment.    *
+ *                                                                         *
+ * Any other engine is a plugin: a shared library which exports            *
+ * SCAN_ENGINE_ENTRY, loaded with dlopen() (LoadLibrary() on Windows; link *
+ * with -ldl where needed).                                                *
+ *                                                                         *
+ * A scan chain runs several engines on the same stream, in the order      *
+ * they were added. The first engine which finds a threat decides; an      *
+ * engine which has decided gets no more data, so the eicar engine costs   *
+ * nothing past the first 128 bytes. scan_chain_config() builds the chain  *
+ * from a list such as                                                     *
+ *                                                                         *
+ *     eicar,patterns=/etc/cvp/sigs.txt,/opt/av/libav_engine.so=fast       *
+ *                                                                         *
+ * and scan_chain_env() takes the list from OPSEC_SCAN_ENGINES.            *
+ *                                                                         *
+ * A chain is read only once built, so the worker threads of mt_cvp share  *
+ * it. Every stream gets its own scan job, and engines keep the state of a *
+ * stream in their stream object - an engine must accept streams from      *
+ * several threads at a time.                                              *
+ *                                                                         *
+ * Engines may also tell how much of the stream they have cleared - bytes  *
+ * which can no longer be part of a threat (ABI version 2). The patterns   *
+ * engine clears everything but the bytes its automaton is in the middle   *
+ * of, i.e. at most the longest pattern less one byte. scan_job_cleared()  *
+ * is what the whole chain cleared, so a server can pass that data on      *
+ * before the verdict (see ../cvp/cvp_av_server.c).                        *
+ *                                                                         *
+ * scan_opinion() maps a verdict onto the CVP opinion of av_over_cvp.h.    *
+ *                                                                         *
+ ***************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include <ctype.h>
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <dlfcn.h>
+#endif
+
+#include "opsec/opsec.h"
+#include "opsec/av_over_cvp.h"
+
+#include "scan_engine.h"
+#include "aho_corasick.h"
+
+#ifdef WIN32
+#define LIB_OPEN(path)       ((void *)LoadLibrary(path))
+#define LIB_SYM(lib, sym)    ((void *)GetProcAddress((HMODULE)(lib), (sym)))
+#define LIB_CLOSE(lib)       FreeLibrary((HMODULE)(lib))
+#define LIB_ERROR()          "LoadLibrary failed"
+#else
+#define LIB_OPEN(path)       dlopen((path), RTLD_NOW | RTLD_LOCAL)
+#define LIB_SYM(lib, sym)    dlsym((lib), (sym))
+#define LIB_CLOSE(lib)       dlclose(lib)
+#define LIB_ERROR()          dlerror()
+#endif
+
+#define SCAN_LIST_LEN        1024
+#define SCAN_LINE_LEN        4096
+
+
+/* -------------------------------------------------------------------------------------
+                                     EICAR engine
+   ------------------------------------------------------------------------------------- */
+
+#define EICAR_STRING     "X5O!P%@AP[4\\PZX54(P^)7CC)7}$EICAR-STANDARD-ANTIVIRUS-TEST-FILE!$H+H*"
+#define EICAR_LEN        ((long)sizeof(EICAR_STRING) - 1)
+#define EICAR_MAX_SIZE   128
+#define EICAR_THREAT     "EICAR-Test-File"
+
+typedef struct _eicar_stream {
+	long   pos;
+	int    verdict;
+} eicar_stream;
+
+static void *
+eicar_init(char *args)
+{
+	static int engine;
+
+	return &engine;
+}
+
+static void
+eicar_fini(void *engine)
+{
+}
+
+static void *
+eicar_stream_begin(void *engine)
+{
+	return calloc(1, sizeof(eicar_stream));
+}
+
+static int
+eicar_stream_data(void *engine, void *stream, char *data, int len)
+{
+	eicar_stream *es = (eicar_stream *)stream;
+	int           c, i;
+
+	for (i = 0; i < len; i++, es->pos++) {
+		c = (unsigned char)data[i];
+
+		if (es->pos >= EICAR_MAX_SIZE ||
+		    (es->pos <  EICAR_LEN && c != (unsigned char)EICAR_STRING[es->pos]) ||
+		    (es->pos >= EICAR_LEN && c != ' ' && c != '\t' && c != '\r' && c != '\n' && c != 0x1a))
+			return (es->verdict = SCAN_CLEAN);
+	}
+
+	return SCAN_MORE;
+}
+
+static int
+eicar_stream_end(void *engine, void *stream)
+{
+	eicar_stream *es = (eicar_stream *)stream;
+
+	return (es->verdict = (es->pos >= EICAR_LEN) ? SCAN_INFECTED : SCAN_CLEAN);
+}
+
+static int
+eicar_verdict(void *engine, void *stream, char *threat, int size)
+{
+	eicar_stream *es = (eicar_stream *)stream;
+
+	if (es->verdict == SCAN_INFECTED) {
+		strncpy(threat, EICAR_THREAT, size - 1);
+		threat[size - 1] = '\0';
+	}
+	return es->verdict;
+}
+
+static void
+eicar_stream_free(void *engine, void *stream)
+{
+	free(stream);
+}
+
+static scan_engine_ops eicar_ops = {
+	SCAN_ENGINE_ABI_VERSION, "eicar",
+	eicar_init, eicar_fini,
+	eicar_stream_begin, eicar_stream_data, eicar_stream_end, eicar_verdict, eicar_stream_free,
+	NULL                                        /* decides within EICAR_MAX_SIZE bytes */
+};
+
+
+/* -------------------------------------------------------------------------------------
+                                    Patterns engine
+   ------------------------------------------------------------------------------------- */
+
+/*
+ * The patterns are matched with the automaton of aho_corasick.c, whose
+ * outputs are pattern indexes into threats[].
+ */
+typedef struct _pattern_engine {
+	char           **threats;         /* threat name of every pattern       */
+	int              n_patterns;
+	int              patterns_size;
+
+	ac_automaton    *ac;
+} pattern_engine;
+
+typedef struct _pattern_stream {
+	int    node;
+	int    found;                     /* pattern, or -1                     */
+	long   bytes;
+} pattern_stream;
+
+static void
+patterns_fini(void *engine)
+{
+	pattern_engine *pe = (pattern_engine *)engine;
+	int             i;
+
+	if (!pe) return;
+
+	for (i = 0; i < pe->n_patterns; i++)
+		free(pe->threats[i]);
+	free(pe->threats);
+	ac_destroy(pe->ac);
+	free(pe);
+}
+
+static int
+patterns_add(pattern_engine *pe, char *threat, unsigned char *pattern, int len)
+{
+	char **p;
+	int    node;
+
+	if (pe->n_patterns == pe->patterns_size) {
+		if (!(p = (char **)realloc(pe->threats, (pe->patterns_size + 256) * sizeof(char *))))
+			return -1;
+		pe->threats        = p;
+		pe->patterns_size += 256;
+	}
+
+	if ((node = ac_add(pe->ac, pattern, len)) < 0)
+		return -1;
+
+	if (pe->ac->out[node] >= 0)         /* same pattern twice - keep the first */
+		return 0;
+
+	if (!(pe->threats[pe->n_patterns] = strdup(threat)))
+		return -1;
+	pe->ac->out[node] = pe->n_patterns++;
+
+	return 0;
+}
+
+static int
+hex_value(int c)
+{
+	if (c >= '0' && c <= '9') return c - '0';
+	if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+	return -1;
+}
+
+/*
+ * args is the signature file
+ */
+static void *
+patterns_init(char *args)
+{
+	pattern_engine *pe;
+	FILE           *fp;
+	char            line[SCAN_LINE_LEN], *threat, *hex, *p;
+	unsigned char   pattern[SCAN_LINE_LEN / 2];
+	int             len, line_no = 0, hi, lo;
+
+	if (!args || !*args) {
+		fprintf(stderr, "patterns: a signature file is needed (patterns=<file>)\n");
+		return NULL;
+	}
+
+	if (!(fp = fopen(args, "r"))) {
+		fprintf(stderr, "patterns: can not open %s\n", args);
+		return NULL;
+	}
+
+	if (!(pe = (pattern_engine *)calloc(1, sizeof(pattern_engine))) || !(pe->ac = ac_create())) {
+		fclose(fp);
+		patterns_fini(pe);
+		return NULL;
+	}
+
+	while (fgets(line, sizeof(line), fp)) {
+		line_no++;
+
+		if ((p = strchr(line, '#')))
+			*p = '\0';
+
+		for (threat = line; isspace((unsigned char)*threat); threat++)
+			;
+		if (!*threat)
+			continue;
+
+		for (hex = threat; *hex && !isspace((unsigned char)*hex); hex++)
+			;
+		if (*hex)
+			*hex++ = '\0';
+		while (isspace((unsigned char)*hex))
+			hex++;
+
+		for (len = 0; (hi = hex_value(hex[0])) >= 0 && (lo = hex_value(hex[1])) >= 0; hex += 2)
+			pattern[len++] = (unsigned char)(hi << 4 | lo);
+		while (isspace((unsigned char)*hex))
+			hex++;
+
+		if (len == 0 || *hex) {
+			fprintf(stderr, "patterns: %s:%d: bad pattern\n", args, line_no);
+			continue;
+		}
+
+		if (patterns_add(pe, threat, pattern, len) < 0) {
+			fprintf(stderr, "patterns: out of memory\n");
+			fclose(fp);
+			patterns_fini(pe);
+			return NULL;
+		}
+	}
+	fclose(fp);
+
+	if (pe->n_patterns == 0) {
+		fprintf(stderr, "patterns: no patterns in %s\n", args);
+		patterns_fini(pe);
+		return NULL;
+	}
+
+	if (ac_compile(pe->ac, NULL, NULL) < 0) {
+		fprintf(stderr, "patterns: out of memory\n");
+		patterns_fini(pe);
+		return NULL;
+	}
+
+	fprintf(stderr, "patterns: %d patterns, %d states\n", pe->n_patterns, pe->ac->n_nodes);
+	return pe;
+}
+
+static void *
+patterns_stream_begin(void *engine)
+{
+	pattern_stream *ps = (pattern_stream *)calloc(1, sizeof(pattern_stream));
+
+	if (ps)
+		ps->found = -1;
+	return ps;
+}
+
+static int
+patterns_stream_data(void *engine, void *stream, char *data, int len)
+{
+	pattern_engine *pe   = (pattern_engine *)engine;
+	pattern_stream *ps   = (pattern_stream *)stream;
+	int             node = ps->node;
+	int             i;
+
+	for (i = 0; i < len; i++) {
+		node = ac_goto(pe->ac, node, (unsigned char)data[i]);
+		if (pe->ac->out[node] >= 0) {
+			ps->found = pe->ac->out[node];
+			return SCAN_INFECTED;
+		}
+	}
+
+	ps->node   = node;
+	ps->bytes += len;
+	return SCAN_MORE;
+}
+
+static int
+patterns_stream_end(void *engine, void *stream)
+{
+	return (((pattern_stream *)stream)->found >= 0) ? SCAN_INFECTED : SCAN_CLEAN;
+}
+
+static int
+patterns_verdict(void *engine, void *stream, char *threat, int size)
+{
+	pattern_engine *pe = (pattern_engine *)engine;
+	pattern_stream *ps = (pattern_stream *)stream;
+
+	if (ps->found < 0)
+		return SCAN_CLEAN;
+
+	strncpy(threat, pe->threats[ps->found], size - 1);
+	threat[size - 1] = '\0';
+	return SCAN_INFECTED;
+}
+
+static void
+patterns_stream_free(void *engine, void *stream)
+{
+	free(stream);
+}
+
+/*
+ * Everything but the bytes matched by the current node - a pattern found
+ * later starts after them, or is one of them.
+ */
+static long
+patterns_cleared(void *engine, void *stream)
+{
+	pattern_engine *pe = (pattern_engine *)engine;
+	pattern_stream *ps = (pattern_stream *)stream;
+
+	return ps->bytes - pe->ac->depth[ps->node];
+}
+
+static scan_engine_ops patterns_ops = {
+	SCAN_ENGINE_ABI_VERSION, "patterns",
+	patterns_init, patterns_fini,
+	patterns_stream_begin, patterns_stream_data, patterns_stream_end, patterns_verdict, patterns_stream_free,
+	patterns_cleared
+};
+
+static scan_engine_ops *builtin_engines[] = {
+	&eicar_ops,
+	&patterns_ops,
+	NULL
+};
+
+
+/* -------------------------------------------------------------------------------------
+                                        Chains
+   ------------------------------------------------------------------------------------- */
+
+scan_chain *
+scan_chain_create(void)
+{
+	return (scan_chain *)calloc(1, sizeof(scan_chain));
+}
+
+void
+scan_chain_destroy(scan_chain *chain)
+{
+	scan_engine *se;
+
+	if (!chain) return;
+
+	while ((se = chain->first)) {
+		chain->first = se->next;
+		se->ops.fini(se->engine);
+		if (se->lib)
+			LIB_CLOSE(se->lib);
+		free(se);
+	}
+	free(chain);
+}
+
+/*
+ * Add an engine at the end of the chain. name is a built in engine or
+ * the path of a plugin; args go to the engine init().
+ * Returns 0 if successful, -1 otherwise.
+ */
+int
+scan_chain_add(scan_chain *chain, char *name, char *args)
+{
+	scan_engine_entry_func entry;
+	scan_engine_ops       *ops = NULL;
+	scan_engine           *se;
+	void                  *lib = NULL;
+	int                    i;
+
+	if (!chain || !name || !*name) return -1;
+
+	for (i = 0; builtin_engines[i]; i++)
+		if (!strcmp(builtin_engines[i]->name, name))
+			ops = builtin_engines[i];
+
+	if (!ops) {
+		if (!(lib = LIB_OPEN(name))) {
+			fprintf(stderr, "scan_chain_add: can not load %s: %s\n", name, LIB_ERROR());
+			return -1;
+		}
+		if (!(entry = (scan_engine_entry_func)LIB_SYM(lib, SCAN_ENGINE_ENTRY)) || !(ops = entry())) {
+			fprintf(stderr, "scan_chain_add: %s has no %s\n", name, SCAN_ENGINE_ENTRY);
+			LIB_CLOSE(lib);
+			return -1;
+		}
+		if (ops->abi_version < 1 || ops->abi_version > SCAN_ENGINE_ABI_VERSION) {
+			fprintf(stderr, "scan_chain_add: %s is of ABI version %d, not %d\n",
+			        name, ops->abi_version, SCAN_ENGINE_ABI_VERSION);
+			LIB_CLOSE(lib);
+			return -1;
+		}
+	}
+
+	if (!(se = (scan_engine *)calloc(1, sizeof(scan_engine)))) {
+		if (lib) LIB_CLOSE(lib);
+		return -1;
+	}
+
+	/* version 1 engines end before cleared() */
+	if (ops->abi_version == 1)
+		memcpy(&se->ops, ops, offsetof(scan_engine_ops, cleared));
+	else
+		se->ops = *ops;
+
+	if (!(se->engine = ops->init(args))) {
+		fprintf(stderr, "scan_chain_add: %s failed to initialize\n", name);
+		if (lib) LIB_CLOSE(lib);
+		free(se);
+		return -1;
+	}
+	se->lib = lib;
+	strncpy(se->name, ops->name ? ops->name : name, sizeof(se->name) - 1);
+
+	if (chain->last)
+		chain->last->next = se;
+	else
+		chain->first = se;
+	chain->last = se;
+	chain->n_engines++;
+
+	return 0;
+}
+
+/*
+ * Add the engines of a list: 'name[=args],...'.
+ * Returns 0 if successful, -1 otherwise.
+ */
+int
+scan_chain_config(scan_chain *chain, char *list)
+{
+	char  buf[SCAN_LIST_LEN], *name, *next, *args;
+
+	if (!list || strlen(list) >= sizeof(buf)) {
+		fprintf(stderr, "scan_chain_config: bad engine list\n");
+		return -1;
+	}
+	strcpy(buf, list);
+
+	for (name = buf; name; name = next) {
+		if ((next = strchr(name, ',')))
+			*next++ = '\0';
+		if ((args = strchr(name, '=')))
+			*args++ = '\0';
+
+		while (isspace((unsigned char)*name))
+			name++;
+		if (!*name)
+			continue;
+
+		if (scan_chain_add(chain, name, args) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * A chain of the engines listed in OPSEC_SCAN_ENGINES, or of the
+ * default engines. NULL on failure.
+ */
+scan_chain *
+scan_chain_env(void)
+{
+	scan_chain *chain;
+	char       *list = getenv(SCAN_ENGINES_ENV);
+
+	if (!list || !*list)
+		list = SCAN_DEFAULT_ENGINES;
+
+	if (!(chain = scan_chain_create()))
+		return NULL;
+
+	if (scan_chain_config(chain, list) < 0 || chain->n_engines == 0) {
+		fprintf(stderr, "scan_chain_env: no scan engines (%s=%s)\n", SCAN_ENGINES_ENV, list);
+		scan_chain_destroy(chain);
+		return NULL;
+	}
+
+	return chain;
+}
+
+
+/* -------------------------------------------------------------------------------------
+                                         Jobs
+   ------------------------------------------------------------------------------------- */
+
+/*
+ * Start the inspection of a stream. NULL on failure.
+ */
+scan_job *
+scan_job_begin(scan_chain *chain)
+{
+	scan_job    *job;
+	scan_engine *se;
+	int          i;
+
+	if (!chain || !(job = (scan_job *)calloc(1, sizeof(scan_job))))
+		return NULL;
+
+	if (!(job->streams = (void **)calloc(chain->n_engines + 1, sizeof(void *)))) {
+		free(job);
+		return NULL;
+	}
+	job->chain   = chain;
+	job->verdict = SCAN_MORE;
+
+	for (se = chain->first, i = 0; se; se = se->next, i++) {
+		if (!(job->streams[i] = se->ops.stream_begin(se->engine))) {
+			scan_job_free(job);
+			return NULL;
+		}
+		job->pending++;
+	}
+
+	return job;
+}
+
+/*
+ * Take the verdict of engine i, and drop its stream.
+ */
+static void
+job_decide(scan_job *job, scan_engine *se, int i, int verdict)
+{
+	char threat[SCAN_NAME_LEN];
+
+	strcpy(threat, "unknown");
+	if (verdict != SCAN_ERROR)
+		verdict = se->ops.verdict(se->engine, job->streams[i], threat, sizeof(threat));
+
+	if (verdict == SCAN_INFECTED && job->verdict != SCAN_INFECTED) {
+		job->verdict = SCAN_INFECTED;
+		strcpy(job->engine, se->name);
+		strcpy(job->threat, threat);
+	}
+	else if (verdict == SCAN_ERROR) {
+		fprintf(stderr, "scan_job: engine %s failed\n", se->name);
+		job->error = 1;
+	}
+
+	se->ops.stream_free(se->engine, job->streams[i]);
+	job->streams[i] = NULL;
+	job->pending--;
+}
+
+/*
+ * The whole job is decided: drop the remaining streams.
+ */
+static int
+job_finish(scan_job *job)
+{
+	scan_engine *se;
+	int          i;
+
+	for (se = job->chain->first, i = 0; se; se = se->next, i++) {
+		if (job->streams[i]) {
+			se->ops.stream_free(se->engine, job->streams[i]);
+			job->streams[i] = NULL;
+		}
+	}
+	job->pending = 0;
+
+	if (job->verdict != SCAN_INFECTED)
+		job->verdict = job->error ? SCAN_ERROR : SCAN_CLEAN;
+
+	return job->verdict;
+}
+
+/*
+ * Hand a chunk to every engine still reading.
+ * Returns SCAN_MORE, or the verdict once the chain decided.
+ */
+int
+scan_job_data(scan_job *job, char *data, int len)
+{
+	scan_engine *se;
+	int          i, v;
+
+	if (job->verdict != SCAN_MORE)
+		return job->verdict;
+
+	job->bytes += len;
+
+	for (se = job->chain->first, i = 0; se; se = se->next, i++) {
+		if (!job->streams[i])
+			continue;
+
+		if ((v = se->ops.stream_data(se->engine, job->streams[i], data, len)) == SCAN_MORE)
+			continue;
+
+		job_decide(job, se, i, v);
+		if (job->verdict == SCAN_INFECTED)
+			return job_finish(job);
+	}
+
+	return (job->pending == 0) ? job_finish(job) : SCAN_MORE;
+}
+
+/*
+ * End of the stream. Returns the verdict of the chain.
+ */
+int
+scan_job_end(scan_job *job)
+{
+	scan_engine *se;
+	int          i;
+
+	if (job->verdict != SCAN_MORE)
+		return job->verdict;
+
+	for (se = job->chain->first, i = 0; se; se = se->next, i++) {
+		if (!job->streams[i])
+			continue;
+
+		job_decide(job, se, i, se->ops.stream_end(se->engine, job->streams[i]));
+		if (job->verdict == SCAN_INFECTED)
+			break;
+	}
+
+	return job_finish(job);
+}
+
+/*
+ * Bytes from the start of the stream which no engine holds back: all of
+ * them once the chain found the content clean; what every engine still
+ * reading cleared otherwise. Never decreases.
+ */
+long
+scan_job_cleared(scan_job *job)
+{
+	scan_engine *se;
+	long         cleared, c;
+	int          i;
+
+	if (job->verdict == SCAN_CLEAN)
+		job->cleared = job->bytes;
+
+	if (job->verdict != SCAN_MORE)
+		return job->cleared;
+
+	cleared = job->bytes;
+	for (se = job->chain->first, i = 0; se && cleared > job->cleared; se = se->next, i++) {
+		if (!job->streams[i])
+			continue;
+
+		c = se->ops.cleared ? se->ops.cleared(se->engine, job->streams[i]) : 0;
+		if (c < cleared)
+			cleared = c;
+	}
+
+	if (cleared > job->cleared)
+		job->cleared = cleared;
+
+	return job->cleared;
+}
+
+void
+scan_job_free(scan_job *job)
+{
+	if (!job) return;
+
+	if (job->streams && job->chain)
+		job_finish(job);
+	free(job->streams);
+	free(job);
+}
+
+/*
+ * The text which replaces content found infected.
+ * Returns its length.
+ */
+int
+scan_job_notice(scan_job *job, char *buf, int size)
+{
+	char notice[SCAN_NOTICE_LEN];
+
+	sprintf(notice, "This content was removed by the CVP server: %s was found by the %s engine.\r\n",
+	        job->threat, job->engine);
+
+	strncpy(buf, notice, size - 1);
+	buf[size - 1] = '\0';
+
+	return (int)strlen(buf);
+}
+
+
+/* -------------------------------------------------------------------------------------
+                                       Opinions
+   ------------------------------------------------------------------------------------- */
+
+/*
+ * The CVP opinion for a verdict. fix is how the server changed the
+ * content - CVP_CONTENT_MODIFIED, CVP_CONTENT_REPLACED - or 0.
+ */
+int
+scan_opinion(int verdict, int fix)
+{
+	switch (verdict) {
+	case SCAN_CLEAN:
+		return CVP_CONTENT_SAFE | (fix ? fix : CVP_CONTENT_NOT_MODIFIED);
+
+	case SCAN_INFECTED:
+		if (fix)
+			return CVP_CONTENT_SAFE | CVP_ORIGINAL_CONTENT_UNSAFE | fix;
+		return CVP_CONTENT_UNSAFE | CVP_CONTENT_NOT_MODIFIED;
+
+	case SCAN_MORE:
+		/* no verdict yet - nothing can be said of the content */
+		return CVP_CANNOT_HANDLE_REQUEST;
+
+	default:
+		return CVP_CANNOT_HANDLE_REQUEST;
+	}
+}
@@ -0,0 +1,126 @@
+#ifndef _SCAN_ENGINE_H_
+#define _SCAN_ENGINE_H_
+
+/***************************************************************************
+ *                                                                         *
+ * scan_engine.h : Content inspection engines for the CVP servers          *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2001 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * See scan_engine.c for further explanations.                             *
+ *                                                                         *
+ ***************************************************************************/
+
+#define SCAN_ENGINE_ABI_VERSION   2   /* 1: without cleared() */
+
+/*
+ * The function a plugin exports, of type scan_engine_entry_func
+ */
+#define SCAN_ENGINE_ENTRY         "scan_engine_entry"
+
+/*
+ * Engine list, read by scan_chain_env()
+ */
+#define SCAN_ENGINES_ENV          "OPSEC_SCAN_ENGINES"
+#define SCAN_DEFAULT_ENGINES      "eicar"
+
+#define SCAN_NAME_LEN             64
+#define SCAN_NOTICE_LEN           512
+
+/*
+ * Verdicts. stream_data() returns SCAN_MORE until the engine has made up
+ * its mind; an engine which returns a verdict gets no more data.
+ */
+#define SCAN_ERROR               -1
+#define SCAN_CLEAN                0
+#define SCAN_INFECTED             1
+#define SCAN_MORE                 2
+
+/*
+ * The engine ABI. 'engine' is the value returned by init(), shared by all
+ * the streams and all the threads; 'stream' is the value returned by
+ * stream_begin(), used by one thread at a time. A stream goes through
+ * stream_begin, stream_data..., stream_end (unless stream_data already
+ * returned a verdict), verdict and stream_free.
+ *
+ * cleared() may be NULL. Otherwise it tells how many bytes from the start
+ * of the stream can no longer be part of a threat, so they may be passed
+ * on before the verdict; an engine without it holds all the data back
+ * until it decides.
+ */
+typedef struct _scan_engine_ops {
+	int     abi_version;                                       /* SCAN_ENGINE_ABI_VERSION */
+	char   *name;
+
+	void *  (*init)        (char *args);                       /* NULL on failure         */
+	void    (*fini)        (void *engine);
+
+	void *  (*stream_begin)(void *engine);                     /* NULL on failure         */
+	int     (*stream_data) (void *engine, void *stream, char *data, int len);
+	int     (*stream_end)  (void *engine, void *stream);
+	int     (*verdict)     (void *engine, void *stream, char *threat, int size);
+	void    (*stream_free) (void *engine, void *stream);
+
+	long    (*cleared)     (void *engine, void *stream);       /* version 2               */
+} scan_engine_ops;
+
+typedef scan_engine_ops * (*scan_engine_entry_func) (void);
+
+typedef struct _scan_engine {
+	scan_engine_ops       ops;          /* copy, completed for older ABIs   */
+	void                 *engine;
+	void                 *lib;          /* plugin library, NULL if built in */
+	char                  name[SCAN_NAME_LEN];
+	struct _scan_engine  *next;
+} scan_engine;
+
+typedef struct _scan_chain {
+	scan_engine          *first;
+	scan_engine          *last;
+	int                   n_engines;
+} scan_chain;
+
+/*
+ * The inspection of one stream by every engine of a chain
+ */
+typedef struct _scan_job {
+	scan_chain           *chain;
+	void                **streams;      /* NULL once the engine decided     */
+	int                   pending;      /* engines still reading the data   */
+	int                   error;        /* an engine failed                 */
+	int                   verdict;      /* SCAN_MORE until decided          */
+	long                  bytes;
+	long                  cleared;      /* bytes no engine holds back       */
+	char                  engine[SCAN_NAME_LEN];   /* which found the threat */
+	char                  threat[SCAN_NAME_LEN];
+} scan_job;
+
+scan_chain * scan_chain_create(void);
+void         scan_chain_destroy(scan_chain *chain);
+int          scan_chain_add(scan_chain *chain, char *name, char *args);
+int          scan_chain_config(scan_chain *chain, char *list);
+scan_chain * scan_chain_env(void);
+
+scan_job *   scan_job_begin(scan_chain *chain);
+int          scan_job_data(scan_job *job, char *data, int len);
+int          scan_job_end(scan_job *job);
+long         scan_job_cleared(scan_job *job);
+void         scan_job_free(scan_job *job);
+int          scan_job_notice(scan_job *job, char *buf, int size);
+
+int          scan_opinion(int verdict, int fix);
+
+#endif
@@ -0,0 +1,420 @@
+/***************************************************************************
+ *                                                                         *
+ * scan_stream.c : Sample OPSEC CVP Server                                 *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2001 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * The 'scan stream' holds the content of a CVP request while it is being  *
+ * received, inspected and sent back to the client.                        *
+ *                                                                         *
+ * The content is kept in memory as long as it is smaller than the stream  *
+ * threshold. Once the threshold is crossed, the memory is written to a    *
+ * spill file and the rest of the content is appended to that file. Small  *
+ * files therefore never touch the file system, and the disk is only used  *
+ * for content that would not fit in a reasonable amount of memory. A      *
+ * threshold of 0 spills everything, as the older samples did.             *
+ *                                                                         *
+ * A scanner hook may be set on the stream. It is called with every chunk  *
+ * as the chunk is written, so an inspection engine can work on the data   *
+ * as it arrives rather than re-reading the complete file at the end.      *
+ *                                                                         *
+ * The content is read back with scan_stream_peek() and                    *
+ * scan_stream_advance(). Peek returns a pointer to the next bytes without *
+ * consuming them, so a sender that is refused by the CVP flow control     *
+ * simply peeks again on the next clear-to-send signal. For in-memory      *
+ * content the pointer points straight into the stream memory - no copy    *
+ * is made.                                                                *
+ *                                                                         *
+ ***************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#ifdef WIN32
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#define fdopen  _fdopen
+#define close   _close
+#else
+#include <unistd.h>
+#endif
+
+#include "scan_stream.h"
+
+#define SCAN_STREAM_INITIAL_MEM  (16 * 1024)
+
+scan_stream *
+scan_stream_create(int threshold, char *spill_dir)
+{
+	scan_stream *ss = (scan_stream *)calloc(1, sizeof(scan_stream));
+
+	if (!ss) return NULL;
+
+	ss->threshold = (threshold < 0) ? 0 : threshold;
+	if (spill_dir)
+		strncpy(ss->spill_dir, spill_dir, sizeof(ss->spill_dir) - 1);
+
+	return ss;
+}
+
+void
+scan_stream_destroy(scan_stream *ss)
+{
+	if (!ss) return;
+
+	if (ss->spill_fp) {
+		if (fclose(ss->spill_fp) != 0)
+			fprintf(stderr, "scan_stream_destroy: fclose('%s') failed: %s\n",
+			        ss->spill_name, strerror(errno));
+		ss->spill_fp = NULL;
+	}
+
+	if (ss->spill_name[0]) {
+		if (remove(ss->spill_name) < 0)
+			fprintf(stderr, "scan_stream_destroy: remove '%s' failed: %s\n",
+			        ss->spill_name, strerror(errno));
+	}
+
+	free(ss->mem);
+	free(ss->rbuf);
+	free(ss);
+}
+
+void
+scan_stream_set_scanner(scan_stream *ss, scan_stream_scanner scanner, void *opaque)
+{
+	if (!ss) return;
+
+	ss->scanner        = scanner;
+	ss->scanner_opaque = opaque;
+}
+
+/*
+ * Drop the content, and the scanner, so that new content can be written
+ * in its place - e.g. a cleaned or replaced file.
+ */
+int
+scan_stream_reset(scan_stream *ss)
+{
+	if (!ss) return -1;
+
+	if (ss->spill_fp) {
+		fclose(ss->spill_fp);
+		ss->spill_fp = NULL;
+	}
+
+	if (ss->spill_name[0]) {
+		if (remove(ss->spill_name) < 0)
+			fprintf(stderr, "scan_stream_reset: remove '%s' failed: %s\n",
+			        ss->spill_name, strerror(errno));
+		ss->spill_name[0] = '\0';
+	}
+
+	ss->total    = 0;
+	ss->read_pos = 0;
+	ss->rbuf_off = 0;
+	ss->rbuf_len = 0;
+	ss->finished = 0;
+
+	ss->scanner        = NULL;
+	ss->scanner_opaque = NULL;
+
+	return 0;
+}
+
+/*
+ * Create the spill file under a name no other user can claim first -
+ * mkstemp() on POSIX, an exclusive create on Windows - so a file or a
+ * link planted in a shared directory such as /tmp is never opened.
+ */
+static FILE *
+scan_stream_open_spill(scan_stream *ss)
+{
+	FILE *fp;
+	int   fd;
+#ifdef WIN32
+	static long seq = 0;
+	int         tries;
+#endif
+
+	if (strlen(ss->spill_dir) + 32 >= sizeof(ss->spill_name)) {
+		fprintf(stderr, "scan_stream_spill: spill directory name too long\n");
+		return NULL;
+	}
+
+#ifdef WIN32
+	for (tries = 0; ; tries++) {
+		sprintf(ss->spill_name, "%sscan%lx_%lx.tmp", ss->spill_dir,
+		        (unsigned long)GetCurrentProcessId(), (unsigned long)InterlockedIncrement(&seq));
+		fd = _open(ss->spill_name, _O_CREAT | _O_EXCL | _O_RDWR | _O_BINARY, _S_IREAD | _S_IWRITE);
+		if (fd >= 0 || errno != EEXIST || tries >= 16)
+			break;
+	}
+#else
+	sprintf(ss->spill_name, "%sscanXXXXXX", ss->spill_dir);
+	fd = mkstemp(ss->spill_name);
+#endif
+
+	if (fd < 0) {
+		fprintf(stderr, "scan_stream_spill: cannot create '%s': %s\n",
+		        ss->spill_name, strerror(errno));
+		ss->spill_name[0] = '\0';
+		return NULL;
+	}
+
+	if (!(fp = fdopen(fd, "w+b"))) {
+		fprintf(stderr, "scan_stream_spill: fdopen('%s') failed: %s\n",
+		        ss->spill_name, strerror(errno));
+		close(fd);
+		remove(ss->spill_name);
+		ss->spill_name[0] = '\0';
+	}
+
+	return fp;
+}
+
+/*
+ * Move the in-memory content to a spill file.
+ */
+static int
+scan_stream_spill(scan_stream *ss)
+{
+	if (!(ss->spill_fp = scan_stream_open_spill(ss)))
+		return -1;
+
+	if (ss->total > 0 && (long)fwrite(ss->mem, 1, ss->total, ss->spill_fp) != ss->total) {
+		fprintf(stderr, "scan_stream_spill: fwrite(%ld, '%s') failed: %s\n",
+		        ss->total, ss->spill_name, strerror(errno));
+		/* the content stays in memory, the stream is not spilled */
+		fclose(ss->spill_fp);
+		remove(ss->spill_name);
+		ss->spill_fp      = NULL;
+		ss->spill_name[0] = '\0';
+		return -1;
+	}
+
+	free(ss->mem);
+	ss->mem      = NULL;
+	ss->mem_size = 0;
+
+	return 0;
+}
+
+/*
+ * Make room for 'len' more bytes of in-memory content.
+ */
+static int
+scan_stream_grow(scan_stream *ss, int len)
+{
+	long  need = ss->total + len;
+	int   size = ss->mem_size ? ss->mem_size : SCAN_STREAM_INITIAL_MEM;
+	char *mem;
+
+	if (need <= ss->mem_size) return 0;
+
+	/* need is at most the threshold: clamp before doubling could overflow */
+	while (size < need)
+		size = (size > ss->threshold / 2) ? ss->threshold : size * 2;
+	if (size > ss->threshold) size = ss->threshold;
+
+	mem = (char *)realloc(ss->mem, size);
+	if (!mem) return -1;
+
+	ss->mem      = mem;
+	ss->mem_size = size;
+
+	return 0;
+}
+
+/*
+ * Append a chunk of content to the stream, and hand it to the scanner.
+ */
+int
+scan_stream_write(scan_stream *ss, char *buf, int len)
+{
+	if (!ss || ss->finished || len < 0) return -1;
+	if (len == 0) return 0;
+
+	if (!ss->spill_fp && ss->total + len > ss->threshold) {
+		if (scan_stream_spill(ss) < 0)
+			return -1;
+	}
+
+	if (ss->spill_fp) {
+		if ((int)fwrite(buf, 1, len, ss->spill_fp) != len) {
+			fprintf(stderr, "scan_stream_write: fwrite(%d, '%s') failed: %s\n",
+			        len, ss->spill_name, strerror(errno));
+			return -1;
+		}
+	} else {
+		if (scan_stream_grow(ss, len) < 0)
+			return -1;
+		memcpy(ss->mem + ss->total, buf, len);
+	}
+
+	ss->total += len;
+
+	if (ss->scanner)
+		return ss->scanner(ss->scanner_opaque, buf, len);
+
+	return 0;
+}
+
+/*
+ * No more content will be written. Tell the scanner and prepare the stream
+ * for reading.
+ */
+int
+scan_stream_finish(scan_stream *ss)
+{
+	int rc = 0;
+
+	if (!ss || ss->finished) return -1;
+
+	ss->finished = 1;
+
+	if (ss->scanner)
+		rc = ss->scanner(ss->scanner_opaque, NULL, -1);
+
+	if (scan_stream_rewind(ss) < 0)
+		return -1;
+
+	return rc;
+}
+
+/*
+ * Return up to 'max' bytes of content at the current read position, without
+ * consuming them. Returns the number of bytes, 0 at the end of the content
+ * and -1 on error.
+ */
+int
+scan_stream_peek(scan_stream *ss, char **data, int max)
+{
+	long left;
+	int  len;
+
+	if (!ss || !data || max <= 0 || !ss->finished) return -1;
+
+	left = ss->total - ss->read_pos;
+	if (left <= 0) {
+		*data = NULL;
+		return 0;
+	}
+	len = (left < max) ? (int)left : max;
+
+	if (!ss->spill_fp) {
+		*data = ss->mem + ss->read_pos;
+		return len;
+	}
+
+	/* spilled content - serve from the read buffer, refill it if empty */
+	if (ss->rbuf_len == 0) {
+		if (ss->rbuf_size < max) {
+			char *rbuf = (char *)realloc(ss->rbuf, max);
+			if (!rbuf) return -1;
+			ss->rbuf      = rbuf;
+			ss->rbuf_size = max;
+		}
+
+		ss->rbuf_off = 0;
+		ss->rbuf_len = fread(ss->rbuf, 1, len, ss->spill_fp);
+		if (ss->rbuf_len == 0) {
+			fprintf(stderr, "scan_stream_peek: fread('%s') failed: %s\n",
+			        ss->spill_name, ferror(ss->spill_fp) ? strerror(errno) : "unexpected end of file");
+			return -1;
+		}
+	}
+
+	if (len > ss->rbuf_len) len = ss->rbuf_len;
+	*data = ss->rbuf + ss->rbuf_off;
+
+	return len;
+}
+
+/*
+ * Consume 'len' bytes that were returned by scan_stream_peek().
+ */
+void
+scan_stream_advance(scan_stream *ss, int len)
+{
+	if (!ss || len <= 0) return;
+
+	if (ss->spill_fp) {
+		if (len > ss->rbuf_len) len = ss->rbuf_len;
+		ss->rbuf_off += len;
+		ss->rbuf_len -= len;
+	}
+
+	ss->read_pos += len;
+	if (ss->read_pos > ss->total) ss->read_pos = ss->total;
+}
+
+/*
+ * Restart reading from the beginning of the content (e.g. after fixing it).
+ */
+int
+scan_stream_rewind(scan_stream *ss)
+{
+	if (!ss) return -1;
+
+	ss->read_pos = 0;
+	ss->rbuf_off = 0;
+	ss->rbuf_len = 0;
+
+	if (ss->spill_fp) {
+		if (fflush(ss->spill_fp) != 0 || fseek(ss->spill_fp, 0L, SEEK_SET) != 0) {
+			fprintf(stderr, "scan_stream_rewind: fseek('%s') failed: %s\n",
+			        ss->spill_name, strerror(errno));
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int
+scan_stream_is_spilled(scan_stream *ss)
+{
+	return (ss && ss->spill_fp) ? 1 : 0;
+}
+
+/*
+ * 1 once scan_stream_finish() was called - no more data is written.
+ */
+int
+scan_stream_is_finished(scan_stream *ss)
+{
+	return (ss && ss->finished) ? 1 : 0;
+}
+
+long
+scan_stream_size(scan_stream *ss)
+{
+	return ss ? ss->total : 0;
+}
+
+/*
+ * Bytes written which the reader has not consumed yet.
+ */
+long
+scan_stream_left(scan_stream *ss)
+{
+	return ss ? ss->total - ss->read_pos : 0;
+}
@@ -0,0 +1,80 @@
+#ifndef _SCAN_STREAM_H_
+#define _SCAN_STREAM_H_
+
+/***************************************************************************
+ *                                                                         *
+ * scan_stream.h : Sample OPSEC CVP Server                                 *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2001 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * See scan_stream.c for further explanations.                             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <stdio.h>
+
+/*
+ * Default size above which the content is spilled to the disk.
+ */
+#define SCAN_STREAM_DEFAULT_THRESHOLD   (1024 * 1024)
+
+#define SCAN_STREAM_NAME_LEN            256
+
+/*
+ * Scanner hook - called with every chunk as it is written to the stream,
+ * and once more with (NULL, -1) when the stream is finished.
+ */
+typedef int (*scan_stream_scanner) (void *opaque, char *data, int len);
+
+typedef struct _scan_stream {
+	int                  threshold;
+	char                 spill_dir[SCAN_STREAM_NAME_LEN];
+
+	char                *mem;         /* content, while below the threshold */
+	int                  mem_size;
+
+	char                 spill_name[SCAN_STREAM_NAME_LEN];
+	FILE                *spill_fp;    /* content, once spilled              */
+
+	long                 total;       /* bytes written                      */
+	long                 read_pos;    /* bytes consumed by the reader       */
+
+	char                *rbuf;        /* read buffer for spilled content    */
+	int                  rbuf_size;
+	int                  rbuf_off;
+	int                  rbuf_len;
+
+	char                 finished;
+
+	scan_stream_scanner  scanner;
+	void                *scanner_opaque;
+} scan_stream;
+
+scan_stream * scan_stream_create(int threshold, char *spill_dir);
+void          scan_stream_destroy(scan_stream *ss);
+void          scan_stream_set_scanner(scan_stream *ss, scan_stream_scanner scanner, void *opaque);
+int           scan_stream_write(scan_stream *ss, char *buf, int len);
+int           scan_stream_finish(scan_stream *ss);
+int           scan_stream_peek(scan_stream *ss, char **data, int max);
+void          scan_stream_advance(scan_stream *ss, int len);
+int           scan_stream_rewind(scan_stream *ss);
+int           scan_stream_reset(scan_stream *ss);
+int           scan_stream_is_spilled(scan_stream *ss);
+int           scan_stream_is_finished(scan_stream *ss);
+long          scan_stream_size(scan_stream *ss);
+long          scan_stream_left(scan_stream *ss);
+
+#endif
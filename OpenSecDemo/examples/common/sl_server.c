@@ -0,0 +1,144 @@
+/***************************************************************************
+ *                                                                         *
+ * sl_server.c : Entry points of the sample shared library servers         *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2001 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * The entry points of shared_lib_server.h which are the same for every    *
+ * sample server built with OPSEC_SL_SERVER: a library serves a single     *
+ * entity, created in the environment of the host (see                     *
+ * ../sl_host/opsec_sl_host.c) and started, stopped and destroyed there.   *
+ *                                                                         *
+ * A server links this file and defines sl_server_create(), which creates  *
+ * its entity without a port and whatever the entity uses, and             *
+ * sl_server_free(), which frees the latter. It also defines               *
+ * opsec_sl_exp_init_sl() and opsec_sl_exp_close_sl(), which set up and    *
+ * free the state of the library itself.                                   *
+ *                                                                         *
+ * sl_server_peer() tells how a client reached the server. A client in the *
+ * process of the host, whose entity the OPSEC configuration puts on       *
+ * memory comm (see ../sl_host/opsec_sl_host.conf), connects over          *
+ * OPSEC_MEM_COMM: the requests and the replies are passed in memory,      *
+ * without the loopback TCP stack.                                         *
+ *                                                                         *
+ ***************************************************************************/
+
+
+#include <stdio.h>
+#include <string.h>
+#ifdef WIN32
+#include <winsock.h>
+#else
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
+
+#include "opsec/opsec_error.h"
+#include "sl_server.h"
+#include "metrics.h"
+
+static OpsecEntity *sl_server = NULL;
+static OpsecEnv    *sl_env    = NULL;
+
+/*
+ * Create the server entity in the environment of the host. No port is
+ * given: the configuration of the host for srv_name tells how the clients
+ * connect.
+ */
+SL_EXPORT OpsecEntity *
+opsec_sl_exp_init_server_entity(char *srv_name, OpsecEnv *env)
+{
+	if (sl_server) {
+		fprintf(stderr, "%s: the library serves a single entity\n", srv_name);
+		return NULL;
+	}
+
+	if (!(sl_server = sl_server_create(srv_name, env)))
+		return NULL;
+
+	sl_env = env;
+
+	return sl_server;
+}
+
+/*
+ * Destroy the server entity, with what sl_server_create() set up for it.
+ */
+SL_EXPORT void
+opsec_sl_exp_destroy_server_entity(OpsecEntity *server)
+{
+	sl_server_free(sl_env);
+	metrics_export_stop(sl_env);
+	opsec_destroy_entity(server);
+
+	sl_server = NULL;
+	sl_env    = NULL;
+}
+
+/*
+ * Start the server; returns the server entity, NULL on error.
+ */
+SL_EXPORT OpsecEntity *
+opsec_sl_exp_start_server(char *srv_name)
+{
+	if (!sl_server || opsec_start_server(sl_server) < 0) {
+		fprintf(stderr, "%s: cannot start the server (%s)\n",
+		        srv_name, opsec_errno_str(opsec_errno));
+		return NULL;
+	}
+	fprintf(stderr, "\n%s is running\n", srv_name);
+
+	return sl_server;
+}
+
+/*
+ * Stop the server; returns 0 if successful, -1 otherwise.
+ */
+SL_EXPORT int
+opsec_sl_exp_stop_server(char *srv_name)
+{
+	if (!sl_server)
+		return -1;
+
+	return opsec_stop_server(sl_server);
+}
+
+/*
+ * Print how the client of a new session reached the server.
+ */
+void
+sl_server_peer(OpsecSession *session)
+{
+	struct in_addr  addr;
+	unsigned int    ip   = 0;
+	unsigned short  port = 0;
+	int             type = 0;
+
+	if (opsec_get_peer_address(session, &type, &ip, &port) < 0) {
+		fprintf(stderr, "sl_server_peer: no peer address (%s)\n",
+		        opsec_errno_str(opsec_errno));
+		return;
+	}
+
+	if (type == OPSEC_MEM_COMM) {
+		fprintf(stderr, "Session from a client in the process (OPSEC_MEM_COMM)\n");
+		return;
+	}
+
+	addr.s_addr = ip;
+	fprintf(stderr, "Session from %s:%d over %s\n", inet_ntoa(addr), ntohs(port),
+	        (type == OPSEC_AUTH_COMM) ? "authenticated TCP" : "TCP");
+}
@@ -0,0 +1,52 @@
+#ifndef _SL_SERVER_H_
+#define _SL_SERVER_H_
+
+/***************************************************************************
+ *                                                                         *
+ * sl_server.h : Entry points of the sample shared library servers         *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2001 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * See sl_server.c for further explanations.                               *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "opsec/opsec.h"
+#include "opsec/shared_lib_server.h"
+
+#ifdef WIN32
+#define SL_EXPORT  __declspec(dllexport)
+#else
+#define SL_EXPORT
+#endif
+
+SL_EXPORT int           opsec_sl_exp_init_sl(void);
+SL_EXPORT int           opsec_sl_exp_close_sl(void);
+SL_EXPORT OpsecEntity * opsec_sl_exp_init_server_entity(char *srv_name, OpsecEnv *env);
+SL_EXPORT void          opsec_sl_exp_destroy_server_entity(OpsecEntity *server);
+SL_EXPORT OpsecEntity * opsec_sl_exp_start_server(char *srv_name);
+SL_EXPORT int           opsec_sl_exp_stop_server(char *srv_name);
+
+/*
+ * Defined by every server: create the entity, without a port, and free
+ * what it uses once it is destroyed.
+ */
+OpsecEntity * sl_server_create(char *srv_name, OpsecEnv *env);
+void          sl_server_free(OpsecEnv *env);
+
+void          sl_server_peer(OpsecSession *session);
+
+#endif
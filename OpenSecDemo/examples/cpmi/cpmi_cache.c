@@ -0,0 +1,898 @@
+/***************************************************************************
+ *                                                                         *
+ * cpmi_cache.c : Local CPMI object cache.                                 *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-1999 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * The cache holds every object of the database, hashed by table and name  *
+ * and by uid, so reads are answered without a round trip to the server.   *
+ *                                                                         *
+ *  - cpmi_cache_attach() opens the database, registers for change         *
+ *    notifications and then loads all the tables with a single            *
+ *    CPMIDbQueryTables() call. The CPMI library keeps its own object      *
+ *    cache in the cache directory (CPMISessionSetCachePath).              *
+ *  - the notifications are applied to the cache as they arrive: DELETE    *
+ *    drops the object, RENAME rekeys it, CREATE and UPDATE take the       *
+ *    object sent with the notification (or fetch it).                     *
+ *  - the uid, table, name and modification time of every object are       *
+ *    saved to an index file in the cache directory. On the next run, or   *
+ *    after a reconnect, the load is compared against it with the          *
+ *    modification times, telling which objects were created, changed or   *
+ *    deleted while the client was away.                                   *
+ *                                                                         *
+ * The objects known from the index file are in the cache (without an      *
+ * object handle) before the load is done. A session end leaves the cache  *
+ * as it is until the next attach validates it again.                      *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WIN32
+#include <direct.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+
+#include "opsec/opsec.h"
+#include "cpmi/CPMIClient/CPMIClientAPIs.h"
+#include "cpmi/CPMIShared/CPMIErrors.h"
+
+#include "cpmi_cache.h"
+
+/********************************
+ *
+ * Global definitions
+ *
+ ********************************/
+#define CACHE_MIN_BUCKETS   256
+#define INDEX_LINE_LEN      4096
+#define INDEX_HEADER        "# cpmi_cache 1\n"
+
+/*******************************************
+ *
+ * Prototypes
+ *
+ *******************************************/
+static eOpsecHandlerRC
+open_db_CB_cache(HCPMIDB db, cpresult stat, cpmiopid opid, void *info);
+
+static eOpsecHandlerRC
+query_tables_CB(HCPMIDB db, HCPMIRSLT ResIr, cpresult stat, cpmiopid opid, void *info);
+
+static eOpsecHandlerRC
+get_obj_CB(HCPMIDB db, HCPMIOBJ obj, cpresult stat, cpmiopid opid, void *info);
+
+static eOpsecHandlerRC
+notify_CB_cache(HCPMIDB db, HCPMINOTIFYMSG msg, cpresult stat, cpmiopid opid, void *info);
+
+static void save_timer(void *opaque);
+
+
+/**************************************************
+ *
+ * Hashing
+ *
+ **************************************************/
+static unsigned int hash_str(const char *s, unsigned int h)
+{
+    while (*s)
+        h = h * 33 + (unsigned char)*s++;
+
+    return h;
+}
+
+static unsigned int name_hash(const char *table, const char *name)
+{
+    return hash_str(name, hash_str(table, 5381) * 33);
+}
+
+static void hash_link(CpmiCache *cache, CpmiCacheObj *o)
+{
+    unsigned int n = name_hash(o->table, o->name) % cache->n_buckets;
+    unsigned int u = hash_str(o->uid, 5381) % cache->n_buckets;
+
+    o->name_next = cache->by_name[n];
+    cache->by_name[n] = o;
+    o->uid_next = cache->by_uid[u];
+    cache->by_uid[u] = o;
+}
+
+static void hash_unlink(CpmiCache *cache, CpmiCacheObj *o)
+{
+    CpmiCacheObj **p;
+
+    for (p = &cache->by_name[name_hash(o->table, o->name) % cache->n_buckets]; *p; p = &(*p)->name_next)
+        if (*p == o) {
+            *p = o->name_next;
+            break;
+        }
+
+    for (p = &cache->by_uid[hash_str(o->uid, 5381) % cache->n_buckets]; *p; p = &(*p)->uid_next)
+        if (*p == o) {
+            *p = o->uid_next;
+            break;
+        }
+}
+
+/*
+ * keep the chains short: rehash once there are twice as many objects as buckets
+ */
+static void hash_grow(CpmiCache *cache)
+{
+    CpmiCacheObj **by_name, **by_uid, *o;
+    unsigned int n_buckets = cache->n_buckets * 4;
+
+    if (cache->n_objs < cache->n_buckets * 2)
+        return;
+
+    by_name = (CpmiCacheObj **)calloc(n_buckets, sizeof(CpmiCacheObj *));
+    by_uid  = (CpmiCacheObj **)calloc(n_buckets, sizeof(CpmiCacheObj *));
+    if (by_name == NULL || by_uid == NULL) {
+        /* the old tables still work, only slower */
+        free(by_name);
+        free(by_uid);
+        return;
+    }
+
+    free(cache->by_name);
+    free(cache->by_uid);
+    cache->by_name = by_name;
+    cache->by_uid = by_uid;
+    cache->n_buckets = n_buckets;
+
+    for (o = cache->first; o; o = o->next)
+        hash_link(cache, o);
+}
+
+
+/**************************************************
+ *
+ * Cached Objects
+ *
+ **************************************************/
+static void obj_free(CpmiCacheObj *o)
+{
+    if (o->obj)
+        CPMIHandleRelease(o->obj);
+    free(o->table);
+    free(o->name);
+    free(o->uid);
+    free(o);
+}
+
+static CpmiCacheObj *obj_new(const char *table, const char *name, const char *uid, time_t mtime)
+{
+    CpmiCacheObj *o;
+
+    if ( (o = (CpmiCacheObj *)calloc(1, sizeof(CpmiCacheObj))) == NULL)
+        return NULL;
+
+    o->table = strdup(table);
+    o->name  = strdup(name);
+    o->uid   = strdup(uid);
+    o->mtime = mtime;
+
+    if (!o->table || !o->name || !o->uid) {
+        obj_free(o);
+        return NULL;
+    }
+
+    return o;
+}
+
+/*
+ * a new cache entry for an object of the server; holds a reference to it
+ */
+static CpmiCacheObj *obj_from_cpmi(HCPMIOBJ obj)
+{
+    CpmiCacheObj *o = NULL;
+    HCPMITBL    tbl = NULL;
+    const char *table = NULL, *name = NULL, *uid = NULL;
+    time_t      mtime = 0;
+
+    if (CPMIObjGetTbl(obj, &tbl) != CP_S_OK ||
+        CPMITblGetName(tbl, &table) != CP_S_OK ||
+        CPMIObjGetName(obj, &name) != CP_S_OK ||
+        CPMIObjGetUidAsString(obj, &uid) != CP_S_OK ||
+        CPMIObjGetLastModificationTime(obj, &mtime) != CP_S_OK) {
+
+        fprintf(stderr, "obj_from_cpmi: failed to get object data\n");
+    } else if ( (o = obj_new(table, name, uid, mtime)) == NULL) {
+        fprintf(stderr, "obj_from_cpmi: out of memory\n");
+    } else {
+        CPMIHandleAddRef(obj);
+        o->obj = obj;
+    }
+
+    if (tbl)
+        CPMIHandleRelease(tbl);
+
+    return o;
+}
+
+static void obj_insert(CpmiCache *cache, CpmiCacheObj *o)
+{
+    o->prev = cache->last;
+    o->next = NULL;
+    if (cache->last)
+        cache->last->next = o;
+    else
+        cache->first = o;
+    cache->last = o;
+
+    hash_link(cache, o);
+    cache->n_objs++;
+    hash_grow(cache);
+}
+
+static void obj_remove(CpmiCache *cache, CpmiCacheObj *o)
+{
+    hash_unlink(cache, o);
+
+    if (o->prev)
+        o->prev->next = o->next;
+    else
+        cache->first = o->next;
+    if (o->next)
+        o->next->prev = o->prev;
+    else
+        cache->last = o->prev;
+
+    cache->n_objs--;
+    obj_free(o);
+}
+
+/*
+ * give o the key and the object handle of from, and free from
+ */
+static void obj_replace(CpmiCache *cache, CpmiCacheObj *o, CpmiCacheObj *from)
+{
+    char     *s;
+    HCPMIOBJ  obj;
+
+    hash_unlink(cache, o);
+
+    s = o->table; o->table = from->table; from->table = s;
+    s = o->name;  o->name  = from->name;  from->name  = s;
+    s = o->uid;   o->uid   = from->uid;   from->uid   = s;
+    obj = o->obj; o->obj   = from->obj;   from->obj   = obj;
+    o->mtime = from->mtime;
+    o->load  = from->load;
+
+    hash_link(cache, o);
+    obj_free(from);
+}
+
+static void report_change(CpmiCache *cache, CpmiCacheObj *o, int added, tCPMI_NOTIFY_EVENT event)
+{
+    if (cache->change_cb)
+        cache->change_cb(cache, o, added, event, cache->opaque);
+}
+
+static void mark_dirty(CpmiCache *cache)
+{
+    cache->dirty = 1;
+
+    if (!cache->save_scheduled && cache->env) {
+        opsec_schedule(cache->env, CPMI_CACHE_SAVE_DELAY * 1000L, save_timer, cache);
+        cache->save_scheduled = 1;
+    }
+}
+
+/*
+ * Put an object of the server into the cache, replacing the entry of the
+ * same uid (or else of the same table and name)
+ *
+ * returns 0 on success, else -1
+ */
+static int cache_put(CpmiCache *cache, HCPMIOBJ obj, tCPMI_NOTIFY_EVENT event)
+{
+    CpmiCacheObj *o, *old;
+
+    if ( (o = obj_from_cpmi(obj)) == NULL)
+        return -1;
+
+    o->load = cache->load;
+
+    if ( (old = cpmi_cache_find_uid(cache, o->uid)) == NULL)
+        old = cpmi_cache_find(cache, o->table, o->name);
+
+    if (old == NULL) {
+        obj_insert(cache, o);
+        if (!cache->ready)
+            cache->n_new++;
+        report_change(cache, o, 1, eCPMI_NOTIFY_CREATE);
+        mark_dirty(cache);
+        return 0;
+    }
+
+    if (old->mtime == o->mtime && strcmp(old->uid, o->uid) == 0 &&
+        strcmp(old->table, o->table) == 0 && strcmp(old->name, o->name) == 0) {
+        /* unchanged, only take the fresh handle */
+        int first_handle = (old->obj == NULL);
+
+        obj_replace(cache, old, o);
+        if (!cache->ready)
+            cache->n_valid++;
+        if (first_handle)
+            report_change(cache, old, 1, event);
+        return 0;
+    }
+
+    report_change(cache, old, 0, event);
+    obj_replace(cache, old, o);
+    if (!cache->ready)
+        cache->n_changed++;
+    report_change(cache, old, 1, event);
+    mark_dirty(cache);
+
+    return 0;
+}
+
+/*
+ * fetch a single object, for notifications which came without it
+ */
+static void cache_fetch(CpmiCache *cache, const char *table, const char *name)
+{
+    HCPMITBL tbl = NULL;
+    cpmiopid id;
+    cpresult rc;
+
+    if ( (rc = CPMIDbGetTable(cache->db, table, &tbl)) != CP_S_OK ||
+         (rc = CPMITblGetObj(tbl, name, get_obj_CB, cache, &id)) != CP_S_OK)
+        fprintf(stderr, "cache_fetch: failed to get %s from table %s - %s\n",
+                name, table, CPGetErrorMessage(rc));
+
+    if (tbl)
+        CPMIHandleRelease(tbl);
+}
+
+static void release_tables(CpmiCache *cache)
+{
+    unsigned int i;
+
+    for (i = 0; i < cache->n_tbls; i++)
+        CPMIHandleRelease(cache->tbls[i]);
+
+    free(cache->tbls);
+    cache->tbls = NULL;
+    cache->n_tbls = 0;
+}
+
+/*
+ * the load is done: whatever it did not see was deleted meanwhile
+ */
+static void load_done(CpmiCache *cache)
+{
+    CpmiCacheObj *o, *next;
+
+    for (o = cache->first; o; o = next) {
+        next = o->next;
+        if (o->load != cache->load) {
+            report_change(cache, o, 0, eCPMI_NOTIFY_DELETE);
+            obj_remove(cache, o);
+            cache->n_gone++;
+            mark_dirty(cache);
+        }
+    }
+
+    release_tables(cache);
+    cache->ready = 1;
+
+    fprintf(stderr, "load_done: %u objects: %u valid, %u changed, %u new, %u deleted\n",
+            cache->n_objs, cache->n_valid, cache->n_changed, cache->n_new, cache->n_gone);
+
+    if (cache->dirty)
+        cpmi_cache_save(cache);
+
+    if (cache->ready_cb)
+        cache->ready_cb(cache, CP_S_OK, cache->opaque);
+}
+
+static void load_failed(CpmiCache *cache, cpresult stat)
+{
+    release_tables(cache);
+
+    if (cache->ready_cb)
+        cache->ready_cb(cache, stat, cache->opaque);
+}
+
+
+/**************************************************
+ *
+ * Index File
+ *
+ **************************************************/
+
+/*
+ * Read the index file of a previous run: one line per object,
+ * "uid <tab> modification time <tab> table <tab> name"
+ */
+static void index_read(CpmiCache *cache)
+{
+    FILE *fp;
+    char  line[INDEX_LINE_LEN];
+    char *uid, *mtime, *table, *name, *end;
+    CpmiCacheObj *o;
+
+    if ( (fp = fopen(cache->index_file, "r")) == NULL)
+        return;
+
+    while (fgets(line, sizeof(line), fp)) {
+        if (line[0] == '#')
+            continue;
+        if ( (end = strchr(line, '\n')) != NULL)
+            *end = '\0';
+
+        uid = line;
+        if ( (mtime = strchr(uid, '\t')) == NULL ||
+             (table = strchr(++mtime, '\t')) == NULL ||
+             (name = strchr(++table, '\t')) == NULL) {
+            fprintf(stderr, "index_read: %s: bad line\n", cache->index_file);
+            continue;
+        }
+        mtime[-1] = table[-1] = '\0';
+        *name++ = '\0';
+
+        if (cpmi_cache_find_uid(cache, uid))
+            continue;
+
+        if ( (o = obj_new(table, name, uid, (time_t)strtol(mtime, NULL, 10))) == NULL) {
+            fprintf(stderr, "index_read: out of memory\n");
+            break;
+        }
+        obj_insert(cache, o);
+    }
+
+    fclose(fp);
+}
+
+/*
+ * Save the index file
+ *
+ * returns 0 on success, else -1
+ */
+int cpmi_cache_save(CpmiCache *cache)
+{
+    FILE *fp;
+    char  tmp[INDEX_LINE_LEN];
+    CpmiCacheObj *o;
+    int   rc = 0;
+
+    sprintf(tmp, "%.*s.tmp", (int)sizeof(tmp) - 8, cache->index_file);
+
+    if ( (fp = fopen(tmp, "w")) == NULL) {
+        fprintf(stderr, "cpmi_cache_save: cannot create %s\n", tmp);
+        return -1;
+    }
+
+    fputs(INDEX_HEADER, fp);
+    for (o = cache->first; o; o = o->next)
+        fprintf(fp, "%s\t%ld\t%s\t%s\n", o->uid, (long)o->mtime, o->table, o->name);
+
+    if (fclose(fp) != 0)
+        rc = -1;
+
+#ifdef WIN32
+    remove(cache->index_file);
+#endif
+    if (rc == 0 && rename(tmp, cache->index_file) != 0)
+        rc = -1;
+
+    if (rc < 0) {
+        fprintf(stderr, "cpmi_cache_save: failed to write %s\n", cache->index_file);
+        remove(tmp);
+        return -1;
+    }
+
+    cache->dirty = 0;
+    return 0;
+}
+
+static void save_timer(void *opaque)
+{
+    CpmiCache *cache = (CpmiCache *)opaque;
+
+    cache->save_scheduled = 0;
+    if (cache->dirty)
+        cpmi_cache_save(cache);
+}
+
+
+/**************************************************
+ *
+ * Cache Interface
+ *
+ **************************************************/
+
+/*
+ * Create a cache kept in the directory path, with the objects of the
+ * index file left by a previous run
+ */
+CpmiCache *cpmi_cache_create(const char *path, CpmiCacheReady_CB ready_cb,
+                             CpmiCacheChange_CB change_cb, void *opaque)
+{
+    CpmiCache *cache;
+    size_t     len = strlen(path);
+
+    if ( (cache = (CpmiCache *)calloc(1, sizeof(CpmiCache))) == NULL)
+        return NULL;
+
+    cache->n_buckets = CACHE_MIN_BUCKETS;
+    cache->by_name   = (CpmiCacheObj **)calloc(cache->n_buckets, sizeof(CpmiCacheObj *));
+    cache->by_uid    = (CpmiCacheObj **)calloc(cache->n_buckets, sizeof(CpmiCacheObj *));
+    cache->path       = strdup(path);
+    cache->index_file = (char *)malloc(len + sizeof(CPMI_CACHE_INDEX_FILE) + 1);
+
+    if (!cache->by_name || !cache->by_uid || !cache->path || !cache->index_file) {
+        fprintf(stderr, "cpmi_cache_create: out of memory\n");
+        cpmi_cache_destroy(cache);
+        return NULL;
+    }
+
+    sprintf(cache->index_file, "%s%s%s", path,
+            (len && (path[len - 1] == '/' || path[len - 1] == '\\')) ? "" : "/",
+            CPMI_CACHE_INDEX_FILE);
+
+    /* the directory may exist already */
+#ifdef WIN32
+    _mkdir(path);
+#else
+    mkdir(path, 0700);
+#endif
+
+    cache->ready_cb  = ready_cb;
+    cache->change_cb = change_cb;
+    cache->opaque    = opaque;
+
+    index_read(cache);
+
+    return cache;
+}
+
+
+void cpmi_cache_destroy(CpmiCache *cache)
+{
+    CpmiCacheObj *o, *next;
+
+    if (cache == NULL)
+        return;
+
+    if (cache->save_scheduled)
+        opsec_deschedule(cache->env, save_timer, cache);
+    if (cache->dirty)
+        cpmi_cache_save(cache);
+
+    for (o = cache->first; o; o = next) {
+        next = o->next;
+        obj_free(o);
+    }
+
+    release_tables(cache);
+    free(cache->by_name);
+    free(cache->by_uid);
+    free(cache->path);
+    free(cache->index_file);
+    free(cache);
+}
+
+
+/*
+ * Load (or validate) the cache over a bound session, and keep it current
+ * from then on
+ */
+eOpsecHandlerRC cpmi_cache_attach(CpmiCache *cache, OpsecSession *session)
+{
+    cpresult res;
+    cpmiopid id;
+
+    cache->session = session;
+    cache->env     = opsec_get_session_env(session);
+    cache->ready   = 0;
+    cache->load++;
+    cache->n_valid = cache->n_changed = cache->n_new = cache->n_gone = 0;
+
+    if ( (res = CPMISessionSetCachePath(session, cache->path)) != CP_S_OK)
+        fprintf(stderr, "cpmi_cache_attach: cannot use cache path %s - %s\n",
+                cache->path, CPGetErrorMessage(res));
+
+    res = CPMIDbOpen(session, "", eCPMI_DB_OM_READ, open_db_CB_cache, cache, &id);
+
+    if (res != CP_S_OK) {
+        fprintf(stderr, "cpmi_cache_attach: failed to open database - %s\n", CPGetErrorMessage(res));
+        return OPSEC_SESSION_END;
+    }
+
+    return OPSEC_SESSION_OK;
+}
+
+/*
+ * The session of the cache ended. The objects remain readable until the
+ * next attach validates them.
+ */
+void cpmi_cache_detach(CpmiCache *cache)
+{
+    release_tables(cache);
+
+    cache->session = NULL;
+    cache->db      = NULL;
+    cache->ready   = 0;
+}
+
+
+CpmiCacheObj *cpmi_cache_find(const CpmiCache *cache, const char *table, const char *name)
+{
+    CpmiCacheObj *o = cache->by_name[name_hash(table, name) % cache->n_buckets];
+
+    for ( ; o; o = o->name_next)
+        if (strcmp(o->name, name) == 0 && strcmp(o->table, table) == 0)
+            return o;
+
+    return NULL;
+}
+
+CpmiCacheObj *cpmi_cache_find_uid(const CpmiCache *cache, const char *uid)
+{
+    CpmiCacheObj *o = cache->by_uid[hash_str(uid, 5381) % cache->n_buckets];
+
+    for ( ; o; o = o->uid_next)
+        if (strcmp(o->uid, uid) == 0)
+            return o;
+
+    return NULL;
+}
+
+
+/**************************************************
+ *
+ * CPMI Call-Back Functions
+ *
+ **************************************************/
+
+/*
+ * Open DB CB
+ */
+static eOpsecHandlerRC
+open_db_CB_cache(HCPMIDB db, cpresult stat, cpmiopid opid, void *info)
+{
+    CpmiCache      *cache = (CpmiCache *)info;
+    HCPMIITERTBL    TblIter = NULL;
+    HCPMITBL        Tbl = NULL;
+    const char    **queries = NULL;
+    unsigned int    size = 0, events;
+    cpmiopid        id;
+    cpresult        rc;
+
+    if (CP_FAILED(stat)) {
+        fprintf(stderr, "open_db_CB_cache: failed to open DataBase - %s.\n", CPGetErrorMessage(stat));
+        load_failed(cache, stat);
+        return OPSEC_SESSION_END;
+    }
+
+    cache->db = db;
+
+    /*
+     * register before loading, so that no change after the query is missed
+     */
+    events =
+        eCPMI_NOTIFY_DELETE |
+        eCPMI_NOTIFY_UPDATE |
+        eCPMI_NOTIFY_RENAME |
+        eCPMI_NOTIFY_CREATE ;
+
+    rc = CPMIDbRegisterEvent(db, NULL, NULL, events, eCPMI_FLAG_SEND_OBJECT,
+                             notify_CB_cache, cache, &cache->notify_id);
+    if (rc != CP_S_OK) {
+        fprintf(stderr, "open_db_CB_cache: failed to register for notifications - %s\n",
+                CPGetErrorMessage(rc));
+        load_failed(cache, rc);
+        return OPSEC_SESSION_END;
+    }
+
+    /*
+     * query all the tables at once
+     */
+    if ( (rc = CPMIDbIterTables(db, &TblIter)) != CP_S_OK) {
+        fprintf(stderr, "open_db_CB_cache: failed to create table iterator\n");
+        load_failed(cache, rc);
+        return OPSEC_SESSION_END;
+    }
+
+    while (CPMIIterTblIsDone(TblIter) == CP_S_FALSE) {
+        if (CPMIIterTblGetNext(TblIter, &Tbl) != CP_S_OK || Tbl == NULL)
+            break;
+
+        if (cache->n_tbls == size) {
+            HCPMITBL *tbls;
+
+            size = size ? size * 2 : 64;
+            if ( (tbls = (HCPMITBL *)realloc(cache->tbls, size * sizeof(HCPMITBL))) == NULL) {
+                CPMIHandleRelease(Tbl);
+                break;
+            }
+            cache->tbls = tbls;
+        }
+        cache->tbls[cache->n_tbls++] = Tbl;
+    }
+
+    CPMIHandleRelease(TblIter);
+
+    /* NULL queries: all the objects */
+    if (cache->n_tbls == 0 ||
+        (queries = (const char **)calloc(cache->n_tbls, sizeof(const char *))) == NULL) {
+        fprintf(stderr, "open_db_CB_cache: no tables to load\n");
+        load_failed(cache, CP_E_FAIL);
+        return OPSEC_SESSION_END;
+    }
+
+    rc = CPMIDbQueryTables(db, cache->tbls, queries, cache->n_tbls, query_tables_CB, cache, &id);
+    free(queries);
+
+    if (rc != CP_S_OK) {
+        fprintf(stderr, "open_db_CB_cache: failed to query tables - %s\n", CPGetErrorMessage(rc));
+        load_failed(cache, rc);
+        return OPSEC_SESSION_END;
+    }
+
+    return OPSEC_SESSION_OK;
+}
+
+
+/*
+ * Query Tables CB - the objects of all the tables
+ */
+static eOpsecHandlerRC
+query_tables_CB(HCPMIDB db, HCPMIRSLT ResIr, cpresult stat, cpmiopid opid, void *info)
+{
+    CpmiCache    *cache = (CpmiCache *)info;
+    HCPMIITEROBJ  ObjIter;
+    HCPMIOBJ      Obj;
+
+    if (CP_FAILED(stat)) {
+        fprintf(stderr, "query_tables_CB: failed to query - %s.\n", CPGetErrorMessage(stat));
+        load_failed(cache, stat);
+        return OPSEC_SESSION_END;
+    }
+
+    if ( (stat = CPMIResultIterObj(ResIr, &ObjIter)) != CP_S_OK) {
+        fprintf(stderr, "query_tables_CB: Cannot get Object iteration handle - %s\n",
+                CPGetErrorMessage(stat));
+        load_failed(cache, stat);
+        return OPSEC_SESSION_END;
+    }
+
+    while (CPMIIterObjIsDone(ObjIter) != CP_S_OK) {
+        CPMIIterObjGetNext(ObjIter, &Obj);
+        if (!Obj) {
+            fprintf(stderr, "query_tables_CB: Cannot Get Object\n");
+            break;
+        }
+
+        cache_put(cache, Obj, eCPMI_NOTIFY_UPDATE);
+        CPMIHandleRelease(Obj);
+    }
+
+    CPMIHandleRelease(ObjIter);
+
+    if (!cache->ready)
+        load_done(cache);
+
+    return OPSEC_SESSION_OK;
+}
+
+
+/*
+ * Get Object CB - an object fetched for a notification
+ */
+static eOpsecHandlerRC
+get_obj_CB(HCPMIDB db, HCPMIOBJ obj, cpresult stat, cpmiopid opid, void *info)
+{
+    if (CP_FAILED(stat)) {
+        /* it may be gone again, a DELETE notification follows then */
+        fprintf(stderr, "get_obj_CB: failed to get object - %s.\n", CPGetErrorMessage(stat));
+        return OPSEC_SESSION_OK;
+    }
+
+    cache_put((CpmiCache *)info, obj, eCPMI_NOTIFY_UPDATE);
+
+    return OPSEC_SESSION_OK;
+}
+
+
+/*
+ * Notify CB - apply a change of the database
+ */
+static eOpsecHandlerRC
+notify_CB_cache(HCPMIDB db, HCPMINOTIFYMSG msg, cpresult stat, cpmiopid opid, void *info)
+{
+    CpmiCache          *cache = (CpmiCache *)info;
+    CpmiCacheObj       *o = NULL;
+    tCPMI_NOTIFY_EVENT  event;
+    const char         *tbl_name = NULL, *obj_name = NULL, *old_name = NULL, *uid = NULL;
+    HCPMIOBJ            obj = NULL;
+
+    if (CP_FAILED(stat)) {
+        /* the registration is released when the session ends */
+        if (stat == CPMI_E_OPERATION_MEM_CLEANUP)
+            return OPSEC_SESSION_OK;
+
+        fprintf(stderr, "notify_CB_cache: failed to get notification - %s.\n", CPGetErrorMessage(stat));
+        return OPSEC_SESSION_END;
+    }
+
+    /* registration acknowledge */
+    if (msg == NULL)
+        return OPSEC_SESSION_OK;
+
+    if (CPMINotifyGetEvent(msg, &event)         != CP_S_OK ||
+        CPMINotifyGetTblName(msg, &tbl_name)    != CP_S_OK ||
+        CPMINotifyGetObjName(msg, &obj_name)    != CP_S_OK ||
+        !tbl_name || !obj_name) {
+
+        fprintf(stderr, "notify_CB_cache: Failed to get notification data\n");
+        return OPSEC_SESSION_OK;
+    }
+
+    if (CPMINotifyGetUid(msg, &uid) == CP_S_OK && uid)
+        o = cpmi_cache_find_uid(cache, uid);
+
+    switch (event) {
+    case eCPMI_NOTIFY_DELETE:
+        if (o == NULL)
+            o = cpmi_cache_find(cache, tbl_name, obj_name);
+        if (o) {
+            report_change(cache, o, 0, event);
+            obj_remove(cache, o);
+            mark_dirty(cache);
+        }
+        break;
+
+    case eCPMI_NOTIFY_RENAME:
+        if (o == NULL && CPMINotifyGetOldName(msg, &old_name) == CP_S_OK && old_name)
+            o = cpmi_cache_find(cache, tbl_name, old_name);
+        if (o && CPMINotifyGetObj(msg, &obj) == CP_S_OK && obj) {
+            cache_put(cache, obj, event);
+            CPMIHandleRelease(obj);
+        } else {
+            /* drop the old name until the object under the new one arrives */
+            if (o) {
+                report_change(cache, o, 0, eCPMI_NOTIFY_DELETE);
+                obj_remove(cache, o);
+                mark_dirty(cache);
+            }
+            cache_fetch(cache, tbl_name, obj_name);
+        }
+        break;
+
+    case eCPMI_NOTIFY_CREATE:
+    case eCPMI_NOTIFY_UPDATE:
+        if (CPMINotifyGetObj(msg, &obj) == CP_S_OK && obj) {
+            cache_put(cache, obj, event);
+            CPMIHandleRelease(obj);
+        } else
+            cache_fetch(cache, tbl_name, obj_name);
+        break;
+
+    default:
+        break;
+    }
+
+    return OPSEC_SESSION_OK;
+}
@@ -0,0 +1,119 @@
+#ifndef CPMI_CACHE_H
+#define CPMI_CACHE_H
+
+/***************************************************************************
+ *                                                                         *
+ * cpmi_cache.h : Local CPMI object cache.                                 *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-1999 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * See cpmi_cache.c for further explanations.                              *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <time.h>
+
+#include "../../include/cpmi/CPMIClient/CPMIClientAPIs.h"
+#include "../../include/opsec/opsec.h"
+
+#define CPMI_CACHE_INDEX_FILE   "cpmi_cache.idx"
+#define CPMI_CACHE_SAVE_DELAY   5       /* seconds from a change to saving the index */
+
+typedef struct _CpmiCacheObj CpmiCacheObj;
+typedef struct _CpmiCache    CpmiCache;
+
+/*
+ * A cached object. obj is NULL while the object is only known from the
+ * index file of a previous run and has not been validated yet.
+ */
+struct _CpmiCacheObj {
+    char          *table;
+    char          *name;
+    char          *uid;
+    time_t         mtime;           /* CPMIObjGetLastModificationTime */
+    HCPMIOBJ       obj;
+    unsigned int   load;            /* load which last saw the object */
+    void          *user;            /* for the users of the cache (cpmi_index) */
+
+    CpmiCacheObj  *name_next;       /* hash chains */
+    CpmiCacheObj  *uid_next;
+    CpmiCacheObj  *prev;            /* all objects */
+    CpmiCacheObj  *next;
+};
+
+/*
+ * Called when the initial load (or the validation after a reconnect) is
+ * done, with stat CP_S_OK or the error which failed it.
+ */
+typedef void (*CpmiCacheReady_CB)(CpmiCache *cache, cpresult stat, void *opaque);
+
+/*
+ * Called for every change of the cache: with added == 0 before an object
+ * is removed or modified, with added == 1 once it is (back) in the cache
+ * or once an object known from the index file gets its handle.
+ * event is the notification which caused the change; changes found while
+ * loading are reported as CREATE, UPDATE or DELETE.
+ */
+typedef void (*CpmiCacheChange_CB)(CpmiCache *cache, CpmiCacheObj *obj, int added,
+                                   tCPMI_NOTIFY_EVENT event, void *opaque);
+
+struct _CpmiCache {
+    char               *path;
+    char               *index_file;
+
+    OpsecSession       *session;
+    OpsecEnv           *env;
+    HCPMIDB             db;
+    cpmiopid            notify_id;
+    HCPMITBL           *tbls;           /* queried by the current load */
+    unsigned int        n_tbls;
+    int                 ready;          /* loaded and in sync with the server */
+    unsigned int        load;
+
+    CpmiCacheObj      **by_name;
+    CpmiCacheObj      **by_uid;
+    unsigned int        n_buckets;
+    unsigned int        n_objs;
+    CpmiCacheObj       *first;
+    CpmiCacheObj       *last;
+
+    int                 dirty;
+    int                 save_scheduled;
+
+    /* outcome of the last load */
+    unsigned int        n_valid;        /* unchanged since the index was saved */
+    unsigned int        n_changed;
+    unsigned int        n_new;
+    unsigned int        n_gone;
+
+    CpmiCacheReady_CB   ready_cb;
+    CpmiCacheChange_CB  change_cb;
+    void               *opaque;
+};
+
+CpmiCache    *cpmi_cache_create(const char *path, CpmiCacheReady_CB ready_cb,
+                                CpmiCacheChange_CB change_cb, void *opaque);
+void          cpmi_cache_destroy(CpmiCache *cache);
+
+eOpsecHandlerRC cpmi_cache_attach(CpmiCache *cache, OpsecSession *session);
+void          cpmi_cache_detach(CpmiCache *cache);
+
+CpmiCacheObj *cpmi_cache_find(const CpmiCache *cache, const char *table, const char *name);
+CpmiCacheObj *cpmi_cache_find_uid(const CpmiCache *cache, const char *uid);
+
+int           cpmi_cache_save(CpmiCache *cache);
+
+#endif /* CPMI_CACHE_H */
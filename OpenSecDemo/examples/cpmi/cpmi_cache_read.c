@@ -0,0 +1,186 @@
+
+#include <stdio.h>
+#include <string.h>
+
+#include "opsec/opsec.h"
+#include "opsec/opsec_error.h"
+#include "cpmi/CPMIClient/CPMIClientAPIs.h"
+
+#include "cpmi_client.h"
+#include "cpmi_cache.h"
+#include "cpmi_index.h"
+
+/********************************
+ *
+ * Global definitions
+ *
+ ********************************/
+#define DEFAULT_CACHE_DIR       "./CPMICache/"
+#define CACHE_RECONNECT_DELAY   5       /* seconds */
+
+static CpmiCache   *cache = NULL;
+static CpmiIndex   *cache_index = NULL;
+static OpsecEnv    *cache_env = NULL;
+static OpsecEntity *cache_client = NULL;
+static OpsecEntity *cache_server = NULL;
+
+/*******************************************
+ *
+ * Prototypes
+ *
+ *******************************************/
+static void cache_ready(CpmiCache *cache, cpresult stat, void *opaque);
+
+static void cache_change(CpmiCache *cache, CpmiCacheObj *obj, int added,
+                         tCPMI_NOTIFY_EVENT event, void *opaque);
+
+static void reconnect(void *opaque);
+
+static void print_cached(CpmiCacheObj *obj, void *opaque);
+
+/*****************************************************************/
+eOpsecHandlerRC cached_read(OpsecSession *session)
+{
+    const char *path;
+
+    cache_env    = opsec_get_session_env(session);
+    cache_client = opsec_get_own_entity(session);
+    cache_server = opsec_get_peer_entity(session);
+
+    if (cache == NULL) {
+        if ( (path = opsec_get_conf(cache_env, "cache_dir", NULL)) == NULL)
+            path = DEFAULT_CACHE_DIR;
+
+        if ( (cache = cpmi_cache_create(path, cache_ready, cache_change, NULL)) == NULL) {
+            fprintf(stderr, "cached_read: failed to create cache in %s\n", path);
+            return OPSEC_SESSION_END;
+        }
+
+        if ( (cache_index = cpmi_index_create(cache)) == NULL) {
+            fprintf(stderr, "cached_read: failed to create index\n");
+            return OPSEC_SESSION_END;
+        }
+
+        fprintf(stderr, "cached_read: %u objects in the index of %s\n", cache->n_objs, path);
+    }
+
+    return cpmi_cache_attach(cache, session);
+}
+
+
+/*
+ * The session ended: keep the cache and reconnect
+ */
+void cached_read_end(OpsecSession *session)
+{
+    if (cache == NULL || cache->session != session)
+        return;
+
+    cpmi_cache_detach(cache);
+
+    fprintf(stderr, "cached_read_end: %u objects remain cached, reconnecting in %d seconds\n",
+            cache->n_objs, CACHE_RECONNECT_DELAY);
+
+    opsec_schedule(cache_env, CACHE_RECONNECT_DELAY * 1000L, reconnect, NULL);
+}
+
+
+/**************************************************
+ *
+ * Internal Functions Implementation
+ *
+ **************************************************/
+static void reconnect(void *opaque)
+{
+    OpsecSession *session = NULL;
+
+    CPMISessionNew(cache_client, cache_server, 0, &session);
+    if (!session) {
+        fprintf(stderr, "reconnect: CPMISessionNew failed - %s\n", opsec_errno_str(opsec_errno));
+        opsec_schedule(cache_env, CACHE_RECONNECT_DELAY * 1000L, reconnect, NULL);
+    }
+}
+
+
+static void print_cached(CpmiCacheObj *obj, void *opaque)
+{
+    fprintf(stdout, "%s %s %s\n", obj->uid, obj->table, obj->name);
+}
+
+
+/*
+ * The cache is loaded: answer the read from it
+ */
+static void cache_ready(CpmiCache *cache, cpresult stat, void *opaque)
+{
+    const char   *table, *object, *ip_str, *type;
+    CpmiCacheObj *o;
+    unsigned long ip;
+    unsigned int  n = 0;
+
+    if (CP_FAILED(stat)) {
+        fprintf(stderr, "cache_ready: failed to load the cache - %s\n", CPGetErrorMessage(stat));
+        return;
+    }
+
+    table  = opsec_get_conf(cache_env, "table", NULL);
+    object = opsec_get_conf(cache_env, "object", NULL);
+    ip_str = opsec_get_conf(cache_env, "ip", NULL);
+    type   = opsec_get_conf(cache_env, "type", NULL);
+
+    if (ip_str) {
+        if (cpmi_index_parse_ip(ip_str, &ip) < 0)
+            fprintf(stderr, "cache_ready: bad address %s\n", ip_str);
+        else
+            fprintf(stdout, "%d objects contain %s\n",
+                    cpmi_index_containing_ip(cache_index, ip, 1, print_cached, NULL), ip_str);
+        return;
+    }
+
+    if (type) {
+        fprintf(stdout, "%d objects of type %s\n",
+                cpmi_index_by_type(cache_index, type, print_cached, NULL), type);
+        return;
+    }
+
+    if (table && object) {
+        if ( (o = cpmi_cache_find(cache, table, object)) == NULL) {
+            fprintf(stdout, "Object %s was not found in table %s\n", object, table);
+            return;
+        }
+        if (o->obj)
+            print_obj(o->obj, 2);
+        fprintf(stdout, "Member of %d groups\n",
+                cpmi_index_groups_of(cache_index, table, object, 1, print_cached, NULL));
+        return;
+    }
+
+    for (o = cache->first; o; o = o->next) {
+        if (table && strcmp(o->table, table) != 0)
+            continue;
+        print_cached(o, NULL);
+        n++;
+    }
+    fprintf(stdout, "%u objects\n", n);
+}
+
+
+/*
+ * Keep the index current and print the changes applied to the loaded cache
+ */
+static void cache_change(CpmiCache *cache, CpmiCacheObj *obj, int added,
+                         tCPMI_NOTIFY_EVENT event, void *opaque)
+{
+    if (cache_index)
+        cpmi_index_change(cache_index, obj, added);
+
+    if (!cache->ready)
+        return;
+
+    if (added)
+        fprintf(stdout, "%s: Table: %s  Object: %s\n",
+                event == eCPMI_NOTIFY_CREATE ? "CREATE" :
+                event == eCPMI_NOTIFY_RENAME ? "RENAME" : "UPDATE", obj->table, obj->name);
+    else if (event == eCPMI_NOTIFY_DELETE)
+        fprintf(stdout, "DELETE: Table: %s  Object: %s\n", obj->table, obj->name);
+}
@@ -15,6 +15,10 @@ eOpsecHandlerRC create_plain_host(OpsecSession *session);
 
 eOpsecHandlerRC delete_plain_host(OpsecSession *session);
 
+eOpsecHandlerRC cached_read(OpsecSession *session);
+
+void cached_read_end(OpsecSession *session);
+
 void print_obj(HCPMIOBJ Obj, long width);
 
 
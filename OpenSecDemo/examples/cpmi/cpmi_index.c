@@ -0,0 +1,640 @@
+/***************************************************************************
+ *                                                                         *
+ * cpmi_index.c : Secondary indexes over the local CPMI object cache.      *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-1999 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * The cache already finds an object by table and name or by uid. The      *
+ * index adds inverted indexes on values taken from the objects once,      *
+ * when they enter the cache, so that queries need no field walks:         *
+ *                                                                         *
+ *  - type:   the schema class of the object                               *
+ *  - member: the objects referenced from the containers of an object      *
+ *            (the members of a group), posting the group on each member   *
+ *  - ip:     the addresses of the object ("ipaddr", with "netmask" for    *
+ *            networks, and "ipaddr_first" .. "ipaddr_last"), posting the  *
+ *            object on every /16 its range touches. Ranges wider than     *
+ *            IP_MAX_BUCKETS such prefixes go to a single list which is    *
+ *            checked by every address query.                              *
+ *                                                                         *
+ * A term keeps the array of the entries posted on it, an entry the terms  *
+ * it is posted on with its position in each, so both adding and removing  *
+ * an entry take time in the number of its terms only.                     *
+ *                                                                         *
+ * The index follows the cache through cpmi_index_change(), to be called   *
+ * from the change callback of the cache.                                  *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "opsec/opsec.h"
+#include "cpmi/CPMIClient/CPMIClientAPIs.h"
+
+#include "cpmi_index.h"
+
+/********************************
+ *
+ * Global definitions
+ *
+ ********************************/
+#define INDEX_MIN_BUCKETS   1024
+#define IP_BUCKET_SHIFT     16
+#define IP_MAX_BUCKETS      64
+
+typedef enum { TermType, TermMember, TermIp, TermWide } eTermKind;
+
+struct _CpmiIndexTerm {
+    eTermKind         kind;
+    char             *key;
+    unsigned int      hash;
+    CpmiIndexEntry  **entries;
+    unsigned int      n_entries;
+    unsigned int      size;
+    CpmiIndexTerm    *next;
+};
+
+/*******************************************
+ *
+ * Prototypes
+ *
+ *******************************************/
+static int visit_groups(CpmiIndex *index, const char *table, const char *name,
+                        int transitive, CpmiIndexVisit visit, void *opaque);
+
+
+/**************************************************
+ *
+ * Terms
+ *
+ **************************************************/
+static unsigned int term_hash(eTermKind kind, const char *key)
+{
+    unsigned int h = 5381 + kind;
+
+    while (*key)
+        h = h * 33 + (unsigned char)*key++;
+
+    return h;
+}
+
+static CpmiIndexTerm *term_find(const CpmiIndex *index, eTermKind kind, const char *key)
+{
+    unsigned int   h = term_hash(kind, key);
+    CpmiIndexTerm *t = index->terms[h % index->n_buckets];
+
+    for ( ; t; t = t->next)
+        if (t->hash == h && t->kind == kind && strcmp(t->key, key) == 0)
+            return t;
+
+    return NULL;
+}
+
+static void term_grow(CpmiIndex *index)
+{
+    CpmiIndexTerm **terms, *t, *next;
+    unsigned int    i, n_buckets = index->n_buckets * 4;
+
+    if (index->n_terms < index->n_buckets * 2)
+        return;
+
+    if ( (terms = (CpmiIndexTerm **)calloc(n_buckets, sizeof(CpmiIndexTerm *))) == NULL)
+        return;
+
+    for (i = 0; i < index->n_buckets; i++)
+        for (t = index->terms[i]; t; t = next) {
+            next = t->next;
+            t->next = terms[t->hash % n_buckets];
+            terms[t->hash % n_buckets] = t;
+        }
+
+    free(index->terms);
+    index->terms = terms;
+    index->n_buckets = n_buckets;
+}
+
+static CpmiIndexTerm *term_get(CpmiIndex *index, eTermKind kind, const char *key)
+{
+    CpmiIndexTerm *t;
+
+    if ( (t = term_find(index, kind, key)) != NULL)
+        return t;
+
+    if ( (t = (CpmiIndexTerm *)calloc(1, sizeof(CpmiIndexTerm))) == NULL ||
+         (t->key = strdup(key)) == NULL) {
+        free(t);
+        return NULL;
+    }
+
+    t->kind = kind;
+    t->hash = term_hash(kind, key);
+    t->next = index->terms[t->hash % index->n_buckets];
+    index->terms[t->hash % index->n_buckets] = t;
+    index->n_terms++;
+    term_grow(index);
+
+    return t;
+}
+
+static void term_free(CpmiIndexTerm *t)
+{
+    free(t->entries);
+    free(t->key);
+    free(t);
+}
+
+static void term_drop(CpmiIndex *index, CpmiIndexTerm *t)
+{
+    CpmiIndexTerm **p;
+
+    for (p = &index->terms[t->hash % index->n_buckets]; *p; p = &(*p)->next)
+        if (*p == t) {
+            *p = t->next;
+            break;
+        }
+
+    index->n_terms--;
+    term_free(t);
+}
+
+
+/**************************************************
+ *
+ * Postings
+ *
+ **************************************************/
+
+/*
+ * post entry on the term kind/key
+ *
+ * returns 0 on success, else -1
+ */
+static int post(CpmiIndex *index, CpmiIndexEntry *e, eTermKind kind, const char *key)
+{
+    CpmiIndexTerm *t;
+
+    if ( (t = term_get(index, kind, key)) == NULL)
+        return -1;
+
+    /*
+     * a group may hold the same member twice; an entry is posted on all
+     * its terms before the next entry, so a repeat is the last one
+     */
+    if (t->n_entries && t->entries[t->n_entries - 1] == e)
+        return 0;
+
+    if (t->n_entries == t->size) {
+        unsigned int     size = t->size ? t->size * 2 : 4;
+        CpmiIndexEntry **entries = (CpmiIndexEntry **)realloc(t->entries, size * sizeof(CpmiIndexEntry *));
+
+        if (entries == NULL)
+            return -1;
+        t->entries = entries;
+        t->size = size;
+    }
+
+    if (e->n_terms == e->terms_size) {
+        unsigned int    size = e->terms_size ? e->terms_size * 2 : 4;
+        CpmiIndexTerm **terms = (CpmiIndexTerm **)realloc(e->terms, size * sizeof(CpmiIndexTerm *));
+        unsigned int   *pos;
+
+        if (terms == NULL)
+            return -1;
+        e->terms = terms;
+        if ( (pos = (unsigned int *)realloc(e->term_pos, size * sizeof(unsigned int))) == NULL)
+            return -1;
+        e->term_pos = pos;
+        e->terms_size = size;
+    }
+
+    e->terms[e->n_terms] = t;
+    e->term_pos[e->n_terms] = t->n_entries;
+    e->n_terms++;
+    t->entries[t->n_entries++] = e;
+
+    return 0;
+}
+
+/*
+ * remove entry from all its terms, dropping the terms left empty
+ */
+static void unpost(CpmiIndex *index, CpmiIndexEntry *e)
+{
+    unsigned int i, j, pos;
+
+    for (i = 0; i < e->n_terms; i++) {
+        CpmiIndexTerm  *t = e->terms[i];
+        CpmiIndexEntry *moved;
+
+        pos = e->term_pos[i];
+        moved = t->entries[--t->n_entries];
+        t->entries[pos] = moved;
+
+        /* tell the entry moved into the hole its new position */
+        if (moved != e)
+            for (j = 0; j < moved->n_terms; j++)
+                if (moved->terms[j] == t) {
+                    moved->term_pos[j] = pos;
+                    break;
+                }
+
+        if (t->n_entries == 0)
+            term_drop(index, t);
+    }
+
+    e->n_terms = 0;
+}
+
+
+/**************************************************
+ *
+ * Object Values
+ *
+ **************************************************/
+
+/*
+ * parse a dotted quad into a host order address
+ *
+ * returns 0 on success, else -1
+ */
+int cpmi_index_parse_ip(const char *str, unsigned long *ip)
+{
+    unsigned int a, b, c, d;
+    char         extra;
+
+    if (sscanf(str, "%u.%u.%u.%u%c", &a, &b, &c, &d, &extra) != 4 ||
+        a > 255 || b > 255 || c > 255 || d > 255)
+        return -1;
+
+    *ip = ((unsigned long)a << 24) | ((unsigned long)b << 16) | ((unsigned long)c << 8) | d;
+    return 0;
+}
+
+static int get_ip_field(HCPMIOBJ obj, const char *field, unsigned long *ip)
+{
+    tCPMI_FIELD_VALUE Val;
+    int               rc = -1;
+
+    if (CPMIObjGetFieldValueByName(obj, field, &Val) != CP_S_OK)
+        return -1;
+
+    if (Val.fvt == eCPMI_FVT_CTSTR && Val.ctstrFv)
+        rc = cpmi_index_parse_ip(Val.ctstrFv, ip);
+
+    CPMIReleaseFieldValue(&Val);
+    return rc;
+}
+
+static void add_range(CpmiIndexEntry *e, unsigned long first, unsigned long last)
+{
+    if (e->n_ranges < CPMI_INDEX_MAX_RANGES && first <= last) {
+        e->first[e->n_ranges] = first;
+        e->last[e->n_ranges] = last;
+        e->n_ranges++;
+    }
+}
+
+static void get_ranges(CpmiIndexEntry *e)
+{
+    HCPMIOBJ      obj = e->obj->obj;
+    unsigned long ip, mask, last;
+
+    if (get_ip_field(obj, "ipaddr", &ip) == 0) {
+        if (get_ip_field(obj, "netmask", &mask) == 0)
+            add_range(e, ip & mask, (ip | ~mask) & 0xffffffffUL);
+        else
+            add_range(e, ip, ip);
+    }
+
+    if (get_ip_field(obj, "ipaddr_first", &ip) == 0 &&
+        get_ip_field(obj, "ipaddr_last", &last) == 0)
+        add_range(e, ip, last);
+}
+
+static void post_member(CpmiIndex *index, CpmiIndexEntry *e, tCPMI_FIELD_VALUE *Val)
+{
+    const char *table = NULL, *name = NULL;
+    char       *key;
+
+    if (Val->fvt != eCPMI_FVT_REF || !Val->refFv ||
+        CPMIRefGetTableName(Val->refFv, &table) != CP_S_OK || !table ||
+        CPMIRefGetObjectName(Val->refFv, &name) != CP_S_OK || !name)
+        return;
+
+    if ( (key = (char *)malloc(strlen(table) + strlen(name) + 2)) == NULL)
+        return;
+    sprintf(key, "%s\t%s", table, name);
+    post(index, e, TermMember, key);
+    free(key);
+}
+
+/*
+ * post the entry on the members held by the containers of its object
+ */
+static void get_members(CpmiIndex *index, CpmiIndexEntry *e, HCPMICLASS Class)
+{
+    HCPMIITERFLD      FldIter;
+    HCPMIFLD          Fld;
+    tCPMI_FIELD_VALUE Val, Elm;
+
+    if (CPMIClassIterFields(Class, &FldIter) != CP_S_OK)
+        return;
+
+    while (CPMIIterFldIsDone(FldIter) != CP_S_OK) {
+        CPMIIterFldGetNext(FldIter, &Fld);
+        if (!Fld)
+            break;
+
+        if (CPMIObjGetFieldValue(e->obj->obj, Fld, &Val) == CP_S_OK) {
+            if (Val.fvt == eCPMI_FVT_CNTR && Val.cntrFv) {
+                HCPMIITERCNTR ElmIter;
+
+                if (CPMICntrIterElements(Val.cntrFv, &ElmIter) == CP_S_OK) {
+                    while (CPMIIterCntrIsDone(ElmIter) != CP_S_OK &&
+                           CPMIIterCntrGetNext(ElmIter, &Elm) == CP_S_OK) {
+                        post_member(index, e, &Elm);
+                        CPMIReleaseFieldValue(&Elm);
+                    }
+                    CPMIHandleRelease(ElmIter);
+                }
+            } else if (Val.fvt == eCPMI_FVT_ORDERED_CNTR && Val.ordcntrFv) {
+                HCPMIITERORDCNTR OrdElmIter;
+
+                if (CPMIOrderCntrIterElements(Val.ordcntrFv, &OrdElmIter) == CP_S_OK) {
+                    while (CPMIIterOrdCntrIsDone(OrdElmIter) != CP_S_OK &&
+                           CPMIIterOrdCntrGetNext(OrdElmIter, &Elm) == CP_S_OK) {
+                        post_member(index, e, &Elm);
+                        CPMIReleaseFieldValue(&Elm);
+                    }
+                    CPMIHandleRelease(OrdElmIter);
+                }
+            }
+            CPMIReleaseFieldValue(&Val);
+        }
+
+        CPMIHandleRelease(Fld);
+    }
+
+    CPMIHandleRelease(FldIter);
+}
+
+static void post_ranges(CpmiIndex *index, CpmiIndexEntry *e)
+{
+    unsigned long prefix;
+    unsigned int  i;
+    char          key[16];
+
+    for (i = 0; i < e->n_ranges; i++) {
+        if ((e->last[i] >> IP_BUCKET_SHIFT) - (e->first[i] >> IP_BUCKET_SHIFT) >= IP_MAX_BUCKETS) {
+            post(index, e, TermWide, "");
+            continue;
+        }
+
+        for (prefix = e->first[i] >> IP_BUCKET_SHIFT; prefix <= e->last[i] >> IP_BUCKET_SHIFT; prefix++) {
+            sprintf(key, "%lu", prefix);
+            post(index, e, TermIp, key);
+        }
+    }
+}
+
+static void entry_free(CpmiIndex *index, CpmiIndexEntry *e)
+{
+    unpost(index, e);
+    e->obj->user = NULL;
+
+    free(e->type);
+    free(e->terms);
+    free(e->term_pos);
+    free(e);
+    index->n_entries--;
+}
+
+static void entry_build(CpmiIndex *index, CpmiCacheObj *obj)
+{
+    CpmiIndexEntry *e;
+    HCPMICLASS      Class = NULL;
+    const char     *type = NULL;
+
+    if ( (e = (CpmiIndexEntry *)calloc(1, sizeof(CpmiIndexEntry))) == NULL) {
+        fprintf(stderr, "entry_build: out of memory\n");
+        return;
+    }
+
+    e->obj = obj;
+    obj->user = e;
+    index->n_entries++;
+
+    if (CPMIObjGetClass(obj->obj, &Class) == CP_S_OK) {
+        if (CPMIClassGetName(Class, &type) == CP_S_OK && type && (e->type = strdup(type)) != NULL)
+            post(index, e, TermType, e->type);
+        get_members(index, e, Class);
+        CPMIHandleRelease(Class);
+    }
+
+    get_ranges(e);
+    post_ranges(index, e);
+}
+
+
+/**************************************************
+ *
+ * Index Interface
+ *
+ **************************************************/
+
+/*
+ * Create the index of a cache, of the objects it already has
+ */
+CpmiIndex *cpmi_index_create(CpmiCache *cache)
+{
+    CpmiIndex    *index;
+    CpmiCacheObj *o;
+
+    if ( (index = (CpmiIndex *)calloc(1, sizeof(CpmiIndex))) == NULL)
+        return NULL;
+
+    index->cache = cache;
+    index->n_buckets = INDEX_MIN_BUCKETS;
+    if ( (index->terms = (CpmiIndexTerm **)calloc(index->n_buckets, sizeof(CpmiIndexTerm *))) == NULL) {
+        free(index);
+        return NULL;
+    }
+
+    for (o = cache->first; o; o = o->next)
+        cpmi_index_change(index, o, 1);
+
+    return index;
+}
+
+
+void cpmi_index_destroy(CpmiIndex *index)
+{
+    CpmiCacheObj  *o;
+    CpmiIndexTerm *t, *next;
+    unsigned int   i;
+
+    if (index == NULL)
+        return;
+
+    for (o = index->cache->first; o; o = o->next)
+        if (o->user)
+            entry_free(index, (CpmiIndexEntry *)o->user);
+
+    /* all gone with their entries, unless posting ran out of memory */
+    for (i = 0; i < index->n_buckets; i++)
+        for (t = index->terms[i]; t; t = next) {
+            next = t->next;
+            term_free(t);
+        }
+
+    free(index->terms);
+    free(index);
+}
+
+
+/*
+ * Follow a change of the cache (see CpmiCacheChange_CB): drop the entry
+ * of an object which is removed or modified, build it again once the
+ * object is (back) in the cache
+ */
+void cpmi_index_change(CpmiIndex *index, CpmiCacheObj *obj, int added)
+{
+    if (obj->user)
+        entry_free(index, (CpmiIndexEntry *)obj->user);
+
+    if (added && obj->obj)
+        entry_build(index, obj);
+}
+
+
+/*
+ * The objects of the given schema class
+ *
+ * returns the number of objects visited
+ */
+int cpmi_index_by_type(CpmiIndex *index, const char *type,
+                       CpmiIndexVisit visit, void *opaque)
+{
+    CpmiIndexTerm *t = term_find(index, TermType, type);
+    unsigned int   i;
+
+    if (t == NULL)
+        return 0;
+
+    for (i = 0; i < t->n_entries; i++)
+        visit(t->entries[i]->obj, opaque);
+
+    return (int)t->n_entries;
+}
+
+
+static int visit_ip_term(CpmiIndex *index, CpmiIndexTerm *t, unsigned long ip, int with_groups,
+                         CpmiIndexVisit visit, void *opaque)
+{
+    CpmiIndexEntry *e;
+    unsigned int    i, j;
+    int             n = 0;
+
+    for (i = 0; t && i < t->n_entries; i++) {
+        e = t->entries[i];
+        if (e->mark == index->mark)
+            continue;
+
+        for (j = 0; j < e->n_ranges; j++)
+            if (e->first[j] <= ip && ip <= e->last[j])
+                break;
+        if (j == e->n_ranges)
+            continue;
+
+        e->mark = index->mark;
+        visit(e->obj, opaque);
+        n++;
+
+        if (with_groups)
+            n += visit_groups(index, e->obj->table, e->obj->name, 1, visit, opaque);
+    }
+
+    return n;
+}
+
+/*
+ * The objects whose addresses contain ip (host order), and if
+ * with_groups the groups which contain those, directly or not
+ *
+ * returns the number of objects visited
+ */
+int cpmi_index_containing_ip(CpmiIndex *index, unsigned long ip, int with_groups,
+                             CpmiIndexVisit visit, void *opaque)
+{
+    char key[16];
+    int  n;
+
+    index->mark++;
+
+    sprintf(key, "%lu", ip >> IP_BUCKET_SHIFT);
+    n  = visit_ip_term(index, term_find(index, TermIp, key), ip, with_groups, visit, opaque);
+    n += visit_ip_term(index, term_find(index, TermWide, ""), ip, with_groups, visit, opaque);
+
+    return n;
+}
+
+
+static int visit_groups(CpmiIndex *index, const char *table, const char *name,
+                        int transitive, CpmiIndexVisit visit, void *opaque)
+{
+    CpmiIndexTerm  *t;
+    CpmiIndexEntry *e;
+    char           *key;
+    unsigned int    i;
+    int             n = 0;
+
+    if ( (key = (char *)malloc(strlen(table) + strlen(name) + 2)) == NULL)
+        return 0;
+    sprintf(key, "%s\t%s", table, name);
+    t = term_find(index, TermMember, key);
+    free(key);
+
+    for (i = 0; t && i < t->n_entries; i++) {
+        e = t->entries[i];
+        if (e->mark == index->mark)
+            continue;
+
+        e->mark = index->mark;
+        visit(e->obj, opaque);
+        n++;
+
+        if (transitive)
+            n += visit_groups(index, e->obj->table, e->obj->name, 1, visit, opaque);
+    }
+
+    return n;
+}
+
+/*
+ * The groups which contain the object table/name, and if transitive
+ * also the groups which contain those
+ *
+ * returns the number of groups visited
+ */
+int cpmi_index_groups_of(CpmiIndex *index, const char *table, const char *name,
+                         int transitive, CpmiIndexVisit visit, void *opaque)
+{
+    index->mark++;
+
+    return visit_groups(index, table, name, transitive, visit, opaque);
+}
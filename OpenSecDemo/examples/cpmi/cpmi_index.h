@@ -0,0 +1,81 @@
+#ifndef CPMI_INDEX_H
+#define CPMI_INDEX_H
+
+/***************************************************************************
+ *                                                                         *
+ * cpmi_index.h : Secondary indexes over the local CPMI object cache.      *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-1999 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * See cpmi_index.c for further explanations.                              *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "cpmi_cache.h"
+
+#define CPMI_INDEX_MAX_RANGES   2
+
+typedef struct _CpmiIndex      CpmiIndex;
+typedef struct _CpmiIndexTerm  CpmiIndexTerm;
+typedef struct _CpmiIndexEntry CpmiIndexEntry;
+
+/*
+ * Called for every object found by a query
+ */
+typedef void (*CpmiIndexVisit)(CpmiCacheObj *obj, void *opaque);
+
+/*
+ * The index data of one cached object (CpmiCacheObj.user)
+ */
+struct _CpmiIndexEntry {
+    CpmiCacheObj   *obj;
+    char           *type;                       /* schema class name */
+    unsigned long   first[CPMI_INDEX_MAX_RANGES];   /* addresses, host order */
+    unsigned long   last[CPMI_INDEX_MAX_RANGES];
+    unsigned int    n_ranges;
+
+    CpmiIndexTerm **terms;                      /* the entry is posted on */
+    unsigned int   *term_pos;                   /* its position in each */
+    unsigned int    n_terms;
+    unsigned int    terms_size;
+
+    unsigned int    mark;                       /* last query which visited it */
+};
+
+struct _CpmiIndex {
+    CpmiCache       *cache;
+    CpmiIndexTerm  **terms;                     /* hash of the terms */
+    unsigned int     n_buckets;
+    unsigned int     n_terms;
+    unsigned int     n_entries;
+    unsigned int     mark;
+};
+
+CpmiIndex *cpmi_index_create(CpmiCache *cache);
+void       cpmi_index_destroy(CpmiIndex *index);
+
+void       cpmi_index_change(CpmiIndex *index, CpmiCacheObj *obj, int added);
+
+int        cpmi_index_by_type(CpmiIndex *index, const char *type,
+                              CpmiIndexVisit visit, void *opaque);
+int        cpmi_index_containing_ip(CpmiIndex *index, unsigned long ip, int with_groups,
+                                    CpmiIndexVisit visit, void *opaque);
+int        cpmi_index_groups_of(CpmiIndex *index, const char *table, const char *name,
+                                int transitive, CpmiIndexVisit visit, void *opaque);
+
+int        cpmi_index_parse_ip(const char *str, unsigned long *ip);
+
+#endif /* CPMI_INDEX_H */
@@ -33,6 +33,11 @@
  *                            notifications on changes in the database     * 
  *  cpmi_create_obj.c - demonstrate how to create and delete a simple      *
  *                      object.                                            *
+ *  cpmi_cache.c - local object cache, loaded once and kept current by     *
+ *                 notifications.                                          *
+ *  cpmi_index.c - type, address and group membership indexes over the     *
+ *                 cache.                                                  *
+ *  cpmi_cache_read.c - answers object reads from the cache.               *
  *  cpmi_client.h - header files for this program.                         *
  *  cpmi.conf - configuration file for this program.                       * 
  *************************************************************************** 
@@ -53,6 +58,14 @@ options:
   -d [-v host <host name>] - delete plain host from database
      if -v is used, delete the host with 'host name' (if exists) 
      otherwise this client uses defaults.
+
+  -o [-v cache_dir <dir>] [-v table <table name> [-v object <object name>]]
+     load the local object cache (validating the one left in 'dir' by a
+     previous run), print the object 'object name' of 'table name' from
+     it (or list the cached objects) and then keep it current, printing
+     the changes. A lost session is reconnected.
+     -v ip <a.b.c.d> lists the objects containing the address (and the
+     groups containing those) and -v type <class> the objects of a class.
   
  ***************************************************************************/
 
@@ -92,7 +105,8 @@ typedef enum { ActionNone,
                 ActionGetStatus,
                 ActionGetNotification,
                 ActionCreatePlainHost,
-                ActionDeletePlainHost
+                ActionDeletePlainHost,
+                ActionCachedRead
 } eCpmiAction;
 
 eCpmiAction action = ActionNone;
@@ -247,7 +261,8 @@ cpmi_end_handler(OpsecSession *session)
     /*
      *  Destruction of the session
      */
-    
+    if (action == ActionCachedRead)
+        cached_read_end(session);
 }
 
 /*
@@ -284,6 +299,9 @@ bind_server_CB(OpsecSession *session,cpresult stat,void *info)
         
     case ActionDeletePlainHost:
         return delete_plain_host(session);
+
+    case ActionCachedRead:
+        return cached_read(session);
         
     default:
         return OPSEC_SESSION_END;
@@ -312,6 +330,11 @@ static void Usage(char *ProgName)
     fprintf(stderr, "  -d [-v host <host name>] - delete plain host from database\n");
     fprintf(stderr, "     if -v is used, delete the host with 'host name' (if exists)\n");
     fprintf(stderr, "     otherwise this client uses defaults. \n\n");
+    fprintf(stderr, "  -o [-v cache_dir <dir>] [-v table <table name> [-v object <object name>]]\n");
+    fprintf(stderr, "     load the local object cache, print 'object name' of 'table name' from it\n");
+    fprintf(stderr, "     (or list the cached objects) and keep it current, printing the changes\n");
+    fprintf(stderr, "     -v ip <a.b.c.d> lists the objects containing the address, -v type <class>\n");
+    fprintf(stderr, "     the objects of a class\n\n");
     
     exit(1);
 }
@@ -348,6 +371,11 @@ static int parse_command_line(int ac, char *av[])
                 action = ActionDeletePlainHost;
                 not_end = 0;
                 break;
+
+            case 'o':
+                action = ActionCachedRead;
+                not_end = 0;
+                break;
                 
             default:
                 Usage(av[0]);
@@ -20,15 +20,46 @@
  *                                                                         *
  * The server operates as followes:                                        *
  *                                                                         *
- *   1. Receives all data from the client.                                 *
+ *   1. Receives the data from the client. Every chunk is inspected by a   *
+ *      chain of scan engines as it arrives (see ../common/scan_engine.c). *
+ *      The engines are listed in OPSEC_SCAN_ENGINES; by default only the  *
+ *      EICAR test file is found.                                          *
  *                                                                         *
- *   2. Processes the file and determines the data safty.                  *
+ *   2. Passes the data back as the return mode of the request allows:     *
  *                                                                         *
- *   3. Sends a reply and the file back to the client.                     *
- *      Note that since the server asks for the whole data stream          *
- *      before it starts processing it, the file must be sent back         *
- *      (modified or not) since the client does not hold a copy            *
- *      of the file.                                                       *
+ *      CVP_SEND_SAFE_DATA - the data the engines cleared (see             *
+ *        scan_job_cleared) is passed on at once; only the tail they are   *
+ *        still undecided about is held back.                              *
+ *      CVP_REPLY_ANYTIME - the same: the client would take unscanned      *
+ *        data, but the undecided tail is held back so that it can be      *
+ *        replaced.                                                        *
+ *      CVP_REPLY_FIRST - all the data is held back until the reply.       *
+ *                                                                         *
+ *      The data goes out through a cvp flow (see ../common/cvp_flow.c).   *
+ *      While the client does not take it, the server stops reading.       *
+ *                                                                         *
+ *   3. Sends the reply as soon as the engines decided - often before the  *
+ *      end of the file - and then the rest of the data. Infected content  *
+ *      is replaced by a notice when the client allows the server to       *
+ *      modify it; what was already passed on stays, and the opinion then  *
+ *      says the content was modified.                                     *
+ *                                                                         *
+ *   The held data is kept in memory up to the memory threshold. Beyond it *
+ *   the server falls back to buffering: the rest of the file goes to a    *
+ *   scan stream (see ../common/scan_stream.c), spilled to the disk, and   *
+ *   is sent once the whole file was received. Note that the file must be  *
+ *   sent back (modified or not) since the client does not hold a copy of  *
+ *   the file.                                                             *
+ *                                                                         *
+ * Usage: cvp_av_server [-m <memory threshold in bytes>]                   *
+ *                                                                         *
+ * Built with OPSEC_SL_SERVER, the server is a shared library which runs   *
+ * in the process of its clients (see ../sl_host/opsec_sl_host.c).         *
+ *                                                                         *
+ * The server counts requests, chunks and bytes, and the time of every     *
+ * request, to the reply and to the first byte sent back. Set              *
+ * OPSEC_METRICS_FILE to have them written to that file (see               *
+ * ../common/metrics.c).                                                   *
  *                                                                         *
  ***************************************************************************/
 
@@ -49,39 +80,81 @@
 #include "opsec/cvp.h"
 #include "opsec/av_over_cvp.h"
 
+#include "../common/scan_stream.h"
+#include "../common/metrics.h"
+#include "../common/scan_engine.h"
+#include "../common/cvp_flow.h"
+#ifdef OPSEC_SL_SERVER
+#include "../common/sl_server.h"
+#endif
+
 
 /*
    Global definitions
  */
 #define	DEFAULT_CHUNK_SIZE	4096
 
+/*
+   Data waiting in the flow before the server stops reading from the client
+ */
+#define	FLOW_HIGH_WATER		(256 * 1024)
+
+/*
+   The directory for content that is spilled to the disk
+ */
+#ifdef WIN32
+#define   SPILL_DIR   "c:\\temp\\"
+#else
+#define   SPILL_DIR   "/tmp/"
+#endif
+
 /*
    The following structure will be hanged on the session opaque
  */
 struct srv_opaque {
-	char  *s_filename;
-	char   s_tempname[L_tmpnam];
-	FILE  *s_fp;
+	char        *s_filename;
+	scan_job    *s_job;
+	cvp_flow    *s_flow;     /* the data, back to the client           */
 
 	int    action;
+	int    ret_mode;
 	int    s_chunk_size;
 
-	char   s_buf[DEFAULT_CHUNK_SIZE];
-	int    s_buf_len;
-	char   s_buf_full;
+	/* streaming - the data which was received and not passed on yet */
+	char  *s_hold;
+	int    s_hold_size;
+	int    s_hold_off;
+	int    s_hold_len;
+	long   s_passed;         /* bytes passed on                        */
 
-	char   s_eof;
-	char   s_sending;
+	/* buffering - the rest of the file, once too much was held */
+	scan_stream *s_stream;
+
+	unsigned long s_start;   /* of the request [usec], for the metrics */
+
+	char   s_eof;            /* the whole file was received            */
+	char   s_replied;
+	char   s_drop;           /* infected content, which is replaced    */
+	char   s_suspended;      /* not reading, the client is slow        */
+	char   s_done;
 };
 
 #define SO(session) ((struct srv_opaque*)SESSION_OPAQUE(session))
 
 char *ProgName = "Unknown";
+int   mem_threshold = SCAN_STREAM_DEFAULT_THRESHOLD;
+
+/*
+   The scan engines, shared by all the sessions
+ */
+static scan_chain *engines = NULL;
 
 /*
- * Prototypes
+   Metrics (see ../common/metrics.c)
  */
- static int cts_signal_handler(OpsecSession *session, int flow);
+static metric *m_sessions, *m_requests, *m_chunks_in, *m_bytes_in,
+              *m_chunks_out, *m_bytes_out, *m_send_refused, *m_request_usec,
+              *m_reply_usec, *m_first_byte_usec, *m_infected;
 
 
  /* -----------------------------------------------------------------------------
@@ -205,13 +278,118 @@ void print_request_parameters(char *filename, int ftype, int proto, char *comman
 	return;
 }
 
+ /* -----------------------------------------------------------------------------
+  |  hold_append:
+  |  ------------
+  |
+  |  Description:
+  |  ------------
+  |  Append data to the held data of the session, growing the buffer as needed.
+  |
+  |  Parameters:
+  |  -----------
+  |  session - Pointer to an OpsecSession object.
+  |  buf     - the data.
+  |  len     - data length.
+  |
+  |  Returned value:
+  |  ---------------
+  |  0 if successful, -1 otherwise.
+   ----------------------------------------------------------------------------- */
+static int hold_append(OpsecSession *session, char *buf, int len)
+{
+	char *hold;
+	int   size;
+
+	/* move the held data to the start of the buffer, before growing it */
+	if (SO(session)->s_hold_off > 0 &&
+	    SO(session)->s_hold_off + SO(session)->s_hold_len + len > SO(session)->s_hold_size) {
+		memmove(SO(session)->s_hold, SO(session)->s_hold + SO(session)->s_hold_off, SO(session)->s_hold_len);
+		SO(session)->s_hold_off = 0;
+	}
+
+	if (SO(session)->s_hold_len + len > SO(session)->s_hold_size) {
+		for (size = DEFAULT_CHUNK_SIZE; size < SO(session)->s_hold_len + len; size *= 2)
+			;
+		if (!(hold = (char *)realloc(SO(session)->s_hold, size))) {
+			fprintf(stderr, "%s: hold_append: out of memory (%d bytes)\n", ProgName, size);
+			return -1;
+		}
+		SO(session)->s_hold      = hold;
+		SO(session)->s_hold_size = size;
+	}
+
+	memcpy(SO(session)->s_hold + SO(session)->s_hold_off + SO(session)->s_hold_len, buf, len);
+	SO(session)->s_hold_len += len;
+
+	return 0;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  hold_spill:
+  |  -----------
+  |
+  |  Description:
+  |  ------------
+  |  Fall back to buffering: move the held data to a scan stream, which spills
+  |  to the disk. The rest of the file goes to the scan stream too, and is sent
+  |  once the whole file was received.
+  |
+  |  Parameters:
+  |  -----------
+  |  session - Pointer to an OpsecSession object.
+  |
+  |  Returned value:
+  |  ---------------
+  |  0 if successful, -1 otherwise.
+   ----------------------------------------------------------------------------- */
+static int hold_spill(OpsecSession *session)
+{
+	fprintf(stderr, "hold_spill: %d bytes held, buffering the rest of the file\n",
+	        SO(session)->s_hold_len);
+
+	SO(session)->s_stream = scan_stream_create(mem_threshold, SPILL_DIR);
+	if (SO(session)->s_stream == NULL) {
+		fprintf(stderr, "%s: scan_stream_create failed\n", ProgName);
+		return -1;
+	}
+
+	if (scan_stream_write(SO(session)->s_stream, SO(session)->s_hold + SO(session)->s_hold_off,
+	                      SO(session)->s_hold_len) < 0) {
+		fprintf(stderr, "%s: scan_stream_write(%d) failed\n", ProgName, SO(session)->s_hold_len);
+		return -1;
+	}
+
+	free(SO(session)->s_hold);
+	SO(session)->s_hold      = NULL;
+	SO(session)->s_hold_size = SO(session)->s_hold_off = SO(session)->s_hold_len = 0;
+
+	return 0;
+}
+
 int fix_file(OpsecSession *session)
 {
+	scan_stream *ss = SO(session)->s_stream;
+	char         notice[SCAN_NOTICE_LEN];
+	int          len;
+
 	/* 
-	   In real life Anti-Virus's, this function fixes the data stream,
-	   if any viruses are found in it.
-	   This sample does not contain any logic for cleanning files.
+	   In real life Anti-Virus's, this function cleans the data which was not
+	   passed on yet. This sample replaces it with a notice, and drops the rest
+	   of the file.
 	 */
+	len = scan_job_notice(SO(session)->s_job, notice, sizeof(notice));
+	SO(session)->s_drop = 1;
+
+	if (ss == NULL) {
+		SO(session)->s_hold_off = SO(session)->s_hold_len = 0;
+		return (hold_append(session, notice, len) < 0) ? OPSEC_SESSION_ERR : OPSEC_SESSION_OK;
+	}
+
+	if (scan_stream_reset(ss) < 0 || scan_stream_write(ss, notice, len) < 0 ||
+	    (SO(session)->s_eof && scan_stream_finish(ss) < 0))
+		return OPSEC_SESSION_ERR;
+
 	return OPSEC_SESSION_OK;
 }
 
@@ -221,9 +399,8 @@ int fix_file(OpsecSession *session)
   |
   |  Description:
   |  ------------
-  |  Determined if the file is ok.
+  |  Determined if the file is ok, from the verdict of the scan engines.
   |  A log message and warning will be sent, according to the processing result.
-  |  In real life this function will do the real processing of the file.
   |
   |  Note that in this case, the server is the only one holding the data
   |  (the client does not hold a copy of it). Thus, the server has to send
@@ -241,49 +418,67 @@ int fix_file(OpsecSession *session)
    ----------------------------------------------------------------------------- */
 static int process_file(OpsecSession *session, int *opinion, char *log_msg, char *warning)
 {
-	char *filename = SO(session)->s_filename;
+	scan_job *job = SO(session)->s_job;
 
-	/* Is this an infected file ? */
-	if (strncmp(filename, "virus", 5) == 0) {
-		fprintf(stderr, "process_file: Found virus in file !\n");
+	switch (job->verdict) {
+	case SCAN_INFECTED:
+		fprintf(stderr, "process_file: Found %s in file !\n", job->threat);
+		metric_inc(m_infected);
 
-		/* Is the server allowd to fix the virus ? */
+		/* Is the server allowd to fix the file ? */
 		if (SO(session)->action != CVP_RDWR) {
 
-			*opinion = CVP_CONTENT_UNSAFE | CVP_CONTENT_NOT_MODIFIED;
-			sprintf(log_msg, "Found virus. CVP server is not allowed to modify content.");
+			*opinion = scan_opinion(SCAN_INFECTED, 0);
+			sprintf(log_msg, "Found %s (%s engine). CVP server is not allowed to modify content.",
+			        job->threat, job->engine);
 			strcpy(warning, "file was scanned and found infected");
 		}
+		else if (fix_file(session) != OPSEC_SESSION_OK) {
+
+			fprintf(stderr, "process_file: failed to replace the infected content\n");
+			return OPSEC_SESSION_ERR;
+		}
+		else if (SO(session)->s_passed > 0) {
+			/* the start of the file was already passed on */
+			*opinion = scan_opinion(SCAN_INFECTED, CVP_CONTENT_MODIFIED);
+			sprintf(log_msg, "CVP server cut file infected with %s (%s engine) after %ld bytes",
+			        job->threat, job->engine, SO(session)->s_passed);
+			strcpy(warning, "file was scanned and the infected content was replaced");
+		}
 		else {
-			/* Fix the file */
-			fix_file(session);
-			*opinion = CVP_CONTENT_SAFE | CVP_ORIGINAL_CONTENT_UNSAFE | CVP_CONTENT_MODIFIED;
-			
-			sprintf(log_msg, "CVP server fixed infected file");
-			strcpy(warning, "file was scanned and fixed");
+			*opinion = scan_opinion(SCAN_INFECTED, CVP_CONTENT_REPLACED);
+			sprintf(log_msg, "CVP server replaced file infected with %s (%s engine)",
+			        job->threat, job->engine);
+			strcpy(warning, "file was scanned and the infected content was replaced");
 		}
-	}
-	else {
+		break;
+
+	case SCAN_CLEAN:
 		/* File is ok */
-		*opinion = CVP_CONTENT_SAFE | CVP_CONTENT_NOT_MODIFIED;
+		*opinion = scan_opinion(SCAN_CLEAN, 0);
 
-		sprintf(log_msg, "files beginning with '%c' are known to be safe", filename[0]);
+		sprintf(log_msg, "%ld bytes scanned by %d engines", job->bytes, engines->n_engines);
 		strcpy(warning, "file was scanned and found safe");
+		break;
+
+	default:
+		*opinion = scan_opinion(SCAN_ERROR, 0);
+
+		sprintf(log_msg, "scan engine failure");
+		strcpy(warning, "file could not be scanned");
+		break;
 	}
 
-	/* then start sending the file */
-	SO(session)->s_sending = 1;
-	
 	return OPSEC_SESSION_OK;
 }
 
  /* -----------------------------------------------------------------------------
-  |  process_and_send:
-  |  -----------------
+  |  send_reply:
+  |  -----------
   |
   |  Description:
   |  ------------
-  |  Process the complete file, send a reply, and follow with the file content.
+  |  Form the opinion once the scan engines decided, and send the reply.
   |
   |  Parameters:
   |  -----------
@@ -293,19 +488,16 @@ static int process_file(OpsecSession *session, int *opinion, char *log_msg, char
   |  ---------------
   |  OPSEC_SESSION_OK if successful, OPSEC_SESSION_ERR otherwise.
    ----------------------------------------------------------------------------- */
-static int process_and_send(OpsecSession *session)
+static int send_reply(OpsecSession *session)
 {
 	OpsecInfo *info     = NULL;
-	char      *filename = SO(session)->s_filename;
 	char       log_msg[4096];
 	char       warning[4096];
 	int        opinion = 0;
 	int        rc = OPSEC_SESSION_OK;
 
-	/*
-	   Here, the server should scan the file.
-	 */
-	process_file(session, &opinion, log_msg, warning);
+	if (process_file(session, &opinion, log_msg, warning) != OPSEC_SESSION_OK)
+		return OPSEC_SESSION_ERR;
 
 	/* create and populate the OpsecInfo */
 	if (!(info = opsec_info_init()))
@@ -313,40 +505,97 @@ static int process_and_send(OpsecSession *session)
 	opsec_info_set(info, "warning", warning, NULL);
 
 	/* send the reply */
-	fprintf(stderr, "process_and_send: Will send reply\n log: %s\n warning: %s\n",
-			(log_msg) ? log_msg : "none" , (warning) ? warning : "none");
+	fprintf(stderr, "send_reply: Will send reply (%ld of %ld bytes passed on)\n log: %s\n warning: %s\n",
+			SO(session)->s_passed, SO(session)->s_job->bytes, log_msg, warning);
 	rc = cvp_send_reply(session, opinion, log_msg, info);
 
 	opsec_info_destroy(info);
 
 	if (rc != OPSEC_SESSION_OK) {
-		fprintf(stderr, "process_and_send: Failed to send reply\n");
+		fprintf(stderr, "send_reply: Failed to send reply\n");
 		return OPSEC_SESSION_ERR;
 	}
 
-	/* send the file */
-	fprintf(stderr, "process_and_send: Will send file to client\n");
+	SO(session)->s_replied = 1;
+	metric_observe(m_reply_usec, metrics_now_usec() - SO(session)->s_start);
 
-	/* open the scratch file */
-	SO(session)->s_fp = fopen(SO(session)->s_tempname, "rb");
-	if (SO(session)->s_fp == NULL) {
-		fprintf(stderr, "%s: fopen('%s', 'rb') failed: %s\n",
-			ProgName, SO(session)->s_tempname, strerror(errno));
-		return OPSEC_SESSION_ERR;
+	return OPSEC_SESSION_OK;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  send_data:
+  |  ----------
+  |
+  |  Description:
+  |  ------------
+  |  Pass data on to the client. What the client cannot take now is kept by
+  |  the flow (see ../common/cvp_flow.c), and sent on the next cts signals.
+  |
+  |  Parameters:
+  |  -----------
+  |  session - Pointer to an OpsecSession object.
+  |  buf     - the data.
+  |  len     - data length.
+  |
+  |  Returned value:
+  |  ---------------
+  |  0 if successful, -1 otherwise.
+   ----------------------------------------------------------------------------- */
+static int send_data(OpsecSession *session, char *buf, int len)
+{
+	if (SO(session)->s_passed == 0)
+		metric_observe(m_first_byte_usec, metrics_now_usec() - SO(session)->s_start);
+
+	if (cvp_flow_write(SO(session)->s_flow, buf, len) < 0) {
+		fprintf(stderr, "%s: send_data: failed to send %d bytes\n", ProgName, len);
+		return -1;
 	}
+	SO(session)->s_passed += len;
 
-	/* and send it */
-	return cts_signal_handler(session, DST_FLOW);
+	return 0;
 }
 
  /* -----------------------------------------------------------------------------
-  |  send_chunk:
+  |  unsent:
+  |  -------
+  |
+  |  Description:
+  |  ------------
+  |  The bytes received, or replacing the infected content, which were not
+  |  passed on yet.
+  |
+  |  Parameters:
   |  -----------
+  |  session - Pointer to an OpsecSession object.
+  |
+  |  Returned value:
+  |  ---------------
+  |  Number of bytes.
+   ----------------------------------------------------------------------------- */
+static long unsent(OpsecSession *session)
+{
+	scan_stream *ss = SO(session)->s_stream;
+
+	if (ss == NULL)
+		return SO(session)->s_hold_len;
+
+	return scan_stream_left(ss);
+}
+
+ /* -----------------------------------------------------------------------------
+  |  pump:
+  |  -----
   |
   |  Description:
   |  ------------
-  |  Send a single chunk to the client.
-  |  Alternate between reading data from the scratch file and sending the data.
+  |  Move the request forward, after every chunk, EOF and cts signal:
+  |
+  |  - Send the reply once the scan engines decided.
+  |  - Pass on the data the return mode allows - the cleared data before
+  |    the reply, all of it after the reply. When buffering, the scan stream
+  |    is sent once the whole file was received, as the client takes it.
+  |  - Send EOF once everything was passed on.
+  |  - Stop reading from the client while too much data waits in the flow.
   |
   |  Parameters:
   |  -----------
@@ -356,51 +605,96 @@ static int process_and_send(OpsecSession *session)
   |  ---------------
   |  OPSEC_SESSION_OK if successful, OPSEC_SESSION_ERR otherwise.
    ----------------------------------------------------------------------------- */
-static int send_chunk(OpsecSession *session)
+static int pump(OpsecSession *session)
 {
-	FILE *fp  = SO(session)->s_fp;
-	char *buf = SO(session)->s_buf;
-
-	/* need to read data from file ? */
-	if (! SO(session)->s_buf_full) {
-		fprintf(stderr, "send_chunk: Reading data from file\n");
-		SO(session)->s_buf_len = fread(buf, 1, SO(session)->s_chunk_size, fp);
-
-		if (SO(session)->s_buf_len == 0) {
-			/* fread error ? */
-			if (ferror(fp)) {
-				fprintf(stderr, "%s: fread('%s') failed: %s\n",
-					ProgName, SO(session)->s_tempname, strerror(errno));
-				return OPSEC_SESSION_ERR;
-			}
+	scan_job *job  = SO(session)->s_job;
+	cvp_flow *flow = SO(session)->s_flow;
+	char     *buf  = NULL;
+	long      n;
+	int       room, len = 0;
+
+	/* the reply goes out as soon as the engines decided */
+	if (!SO(session)->s_replied && job->verdict != SCAN_MORE) {
+		if (send_reply(session) != OPSEC_SESSION_OK)
+			return OPSEC_SESSION_ERR;
+	}
+
+	if (SO(session)->s_stream == NULL) {
+
+		/* streaming - how much of the held data may go now ? */
+		if (SO(session)->s_replied)
+			n = SO(session)->s_hold_len;
+		else switch (SO(session)->ret_mode) {
+		case CVP_REPLY_FIRST:
+			n = 0;
+			break;
+		case CVP_SEND_SAFE_DATA:
+			/* only safe data before the reply - what the engines cleared */
+			n = scan_job_cleared(job) - SO(session)->s_passed;
+			break;
+		case CVP_REPLY_ANYTIME:
+		default:
+			/*
+			   The client would take unscanned data too, but what may still
+			   turn out to be part of a threat is held back all the same, so
+			   that it can be replaced.
+			 */
+			n = scan_job_cleared(job) - SO(session)->s_passed;
+			break;
+		}
 
-			/* reached end of file */
-			fprintf(stderr, "send_chunk: Reached the end of file\n");
-			SO(session)->s_buf_len = -1;
-			SO(session)->s_eof = 1;
-			buf = NULL;
+		if (n > SO(session)->s_hold_len)
+			n = SO(session)->s_hold_len;
+
+		if (n > 0) {
+			if (send_data(session, SO(session)->s_hold + SO(session)->s_hold_off, (int)n) < 0)
+				return OPSEC_SESSION_ERR;
+			SO(session)->s_hold_off += (int)n;
+			SO(session)->s_hold_len -= (int)n;
 		}
 
-		/* have something to send */
-		SO(session)->s_buf_full = 1;
+		/* too much held back - buffer the rest of the file */
+		if (!SO(session)->s_replied && SO(session)->s_hold_len > mem_threshold && hold_spill(session) < 0)
+			return OPSEC_SESSION_ERR;
 	}
+	else if (SO(session)->s_eof && SO(session)->s_replied) {
 
-	/* send data */
-	fprintf(stderr, "send_chunk: Will try to send chunk (len = %d)\n",
-			SO(session)->s_buf_len);
-	if (cvp_send_chunk_to_dst(session, buf, SO(session)->s_buf_len) == 0) {
+		/* buffering - send the scan stream, as the client takes it */
+		while ((room = cvp_flow_room(flow)) > 0 &&
+		       (len = scan_stream_peek(SO(session)->s_stream, &buf, room)) > 0) {
+			if (send_data(session, buf, len) < 0)
+				return OPSEC_SESSION_ERR;
+			scan_stream_advance(SO(session)->s_stream, len);
+		}
 
-		/* just sent eof ? */
-		if (buf == NULL)
-			/* send completed */
-			SO(session)->s_sending = 0;
+		if (len < 0) {
+			fprintf(stderr, "%s: pump: failed to read the scan stream\n", ProgName);
+			return OPSEC_SESSION_ERR;
+		}
+	}
+
+	/* everything was passed on */
+	if (SO(session)->s_eof && SO(session)->s_replied && !cvp_flow_at_eof(flow) && unsent(session) == 0) {
+		fprintf(stderr, "pump: Reached the end of file (%ld bytes sent)\n", SO(session)->s_passed);
+		if (cvp_flow_eof(flow) < 0)
+			return OPSEC_SESSION_ERR;
+	}
 
-		/* no data to send till we read more */
-		SO(session)->s_buf_full = 0;
+	if (cvp_flow_done(flow) && !SO(session)->s_done) {
+		SO(session)->s_done = 1;
+		metric_observe(m_request_usec, metrics_now_usec() - SO(session)->s_start);
 	}
-	else {
-		fprintf(stderr, "send_chunk: Failed to send. Waiting for next cts signal\n");	
-		/* wait for next clear to send signal */
+
+	/* a slow client - stop reading until it took most of the data */
+	if (!SO(session)->s_eof) {
+		if (!SO(session)->s_suspended && cvp_flow_pending(flow) > FLOW_HIGH_WATER) {
+			opsec_suspend_session_read(session);
+			SO(session)->s_suspended = 1;
+		}
+		else if (SO(session)->s_suspended && cvp_flow_pending(flow) < FLOW_HIGH_WATER / 2) {
+			opsec_resume_session_read(session);
+			SO(session)->s_suspended = 0;
+		}
 	}
 
 	return OPSEC_SESSION_OK;
@@ -418,9 +712,9 @@ static int send_chunk(OpsecSession *session)
   |  Description:
   |  ------------
   |  This is the CVP server's request handler.
-  |  This server, first gets all the data from client and stores it in a local file,
-  |  then it processes the whole file, sends a reply and sends the (possibly modified)
-  |  data back.
+  |  This server scans the data as it arrives, and passes it back as the return
+  |  mode of the request allows; the reply is sent as soon as the scan engines
+  |  decided.
   |
   |  Parameters:
   |  -----------
@@ -440,6 +734,9 @@ static int request_handler(OpsecSession *session, OpsecInfo *info)
 
 	fprintf(stderr, "CVP server request handler invoked\n");
 
+	SO(session)->s_start = metrics_now_usec();
+	metric_inc(m_requests);
+
 	/*
 	 * Retrieve request parameters
 	 */
@@ -448,7 +745,11 @@ static int request_handler(OpsecSession *session, OpsecInfo *info)
 
 	print_request_parameters(filename, ftype, proto, command, action);
 
-	SO(session)->action = action;
+	SO(session)->action   = action;
+	SO(session)->ret_mode = ret_mode;
+	fprintf(stderr, "request_handler: Return mode %s\n",
+	        (ret_mode == CVP_REPLY_FIRST)    ? "CVP_REPLY_FIRST" :
+	        (ret_mode == CVP_SEND_SAFE_DATA) ? "CVP_SEND_SAFE_DATA" : "CVP_REPLY_ANYTIME");
 	
 	/*
 	   keep file name (the pointer is not valid after the return)
@@ -471,15 +772,17 @@ static int request_handler(OpsecSession *session, OpsecInfo *info)
 	if (cvp_change_buffer_status(session, CVP_TRANSFER_SRV, CVP_INFINITY) < 0)
 		return OPSEC_SESSION_ERR;
 
-	/* choose a file name for the local copy ... */
-	(void)tmpnam(SO(session)->s_tempname);
-	fprintf(stderr, "request_handler: Temporary file name: %s\n", SO(session)->s_tempname);
+	/* the flow that passes the data back */
+	SO(session)->s_flow = cvp_flow_create(session, 0, SO(session)->s_chunk_size);
+	if (SO(session)->s_flow == NULL) {
+		fprintf(stderr, "%s: cvp_flow_create failed\n", ProgName);
+		return OPSEC_SESSION_ERR;
+	}
 
-	/* ..and open it */
-	SO(session)->s_fp = fopen(SO(session)->s_tempname, "wb");
-	if (SO(session)->s_fp == NULL) {
-		fprintf(stderr, "%s: fopen('%s', 'wb') failed: %s\n",
-			ProgName, SO(session)->s_tempname, strerror(errno));
+	/* and the scan job that inspects the data */
+	SO(session)->s_job = scan_job_begin(engines);
+	if (SO(session)->s_job == NULL) {
+		fprintf(stderr, "%s: scan_job_begin failed\n", ProgName);
 		return OPSEC_SESSION_ERR;
 	}
 
@@ -493,8 +796,9 @@ static int request_handler(OpsecSession *session, OpsecInfo *info)
   |  Description:
   |  ------------
   |  This is the CVP server's chunk handler.
-  |  It accumulates all incoming chunks in the local scratch file.
-  |  When EOF arrives, it starts the processing of the local scratch file.
+  |  It hands every incoming chunk to the scan engines, holds it until it may
+  |  be passed on (or buffers it in the scan stream), and moves the request
+  |  forward.
   |
   |  Parameters:
   |  -----------
@@ -512,26 +816,39 @@ static int chunk_handler(OpsecSession *session, char *buf, int len)
 
 	if (buf == NULL) {	/* EOF received ? */
 		fprintf(stderr, "chunk_handler: Received EOF\n");
-		/* close the scratch file.. */
-		if (fclose(SO(session)->s_fp) != 0) {
-			fprintf(stderr, "%s: fclose('%s') failed: %s\n",
-				ProgName, SO(session)->s_tempname, strerror(errno));
+		SO(session)->s_eof = 1;
+		scan_job_end(SO(session)->s_job);
+
+		/* finish the scan stream, when buffering */
+		if (SO(session)->s_stream && !scan_stream_is_finished(SO(session)->s_stream) &&
+		    scan_stream_finish(SO(session)->s_stream) < 0) {
+			fprintf(stderr, "%s: scan_stream_finish failed\n", ProgName);
 			return OPSEC_SESSION_ERR;
 		}
-		SO(session)->s_fp = NULL;
 
-		/* .. and process it */
-		return process_and_send(session);
+		return pump(session);
 	}
 
 	fprintf(stderr, "chunk_handler: Received chunk (buff = %x, len = %d\n", buf, len);
-	if ((int)fwrite(buf, 1, len, SO(session)->s_fp) != len) {
-		fprintf(stderr, "%s: fwrite(%d, '%s') failed: %s\n",
-			ProgName, len, SO(session)->s_tempname,	strerror(errno));
-		return OPSEC_SESSION_ERR;
+	metric_inc(m_chunks_in);
+	metric_add(m_bytes_in, len);
+
+	/* the rest of an infected file is dropped */
+	if (SO(session)->s_drop)
+		return OPSEC_SESSION_OK;
+
+	scan_job_data(SO(session)->s_job, buf, len);
+
+	if (SO(session)->s_stream) {
+		if (scan_stream_write(SO(session)->s_stream, buf, len) < 0) {
+			fprintf(stderr, "%s: scan_stream_write(%d) failed\n", ProgName, len);
+			return OPSEC_SESSION_ERR;
+		}
 	}
+	else if (hold_append(session, buf, len) < 0)
+		return OPSEC_SESSION_ERR;
 	
-	return OPSEC_SESSION_OK;
+	return pump(session);
 }
 
  /* -----------------------------------------------------------------------------
@@ -541,7 +858,7 @@ static int chunk_handler(OpsecSession *session, char *buf, int len)
   |  Description:
   |  ------------
   |  This is the CVP server's clear_to_send signal handler.
-  |  It sends one chunk and waits for the next cts signal.
+  |  The flow sends what it kept, then the request moves forward.
   |
   |  Parameters:
   |  -----------
@@ -553,23 +870,18 @@ static int chunk_handler(OpsecSession *session, char *buf, int len)
    ----------------------------------------------------------------------------- */
 static int cts_signal_handler(OpsecSession *session, int flow)
 {
-	int	rc = OPSEC_SESSION_OK;
-
 	fprintf(stderr, "CVP server cts signal handler invoked\n");
 
 	/* Check CTS direction */
-	if( !(flow & DST_FLOW) )
+	if( !(flow & DST_FLOW) || SO(session)->s_flow == NULL )
 		return OPSEC_SESSION_OK;
 	
-	/* are we trying to send something ? */
-	if (SO(session)->s_sending == 0)
-		return OPSEC_SESSION_OK;
-
-	/* send a single chunk */
-	if ((rc = send_chunk(session)) != OPSEC_SESSION_OK)
+	if (cvp_flow_cts(SO(session)->s_flow) < 0) {
 		fprintf(stderr, "cts_signal_handler: Failed to send chunk\n");
+		return OPSEC_SESSION_ERR;
+	}
 
-	return rc;
+	return pump(session);
 }
 
  /* -----------------------------------------------------------------------------
@@ -592,8 +904,13 @@ static int cts_signal_handler(OpsecSession *session, int flow)
 static int start_handler(OpsecSession *session)
 {
 	fprintf(stderr, "CVP server start handler invoked\n");
+#ifdef OPSEC_SL_SERVER
+	sl_server_peer(session);
+#endif
 
 	SESSION_OPAQUE(session) = (void*)calloc(1, sizeof(struct srv_opaque));
+	if (SESSION_OPAQUE(session))
+		metric_add(m_sessions, 1);
 	
 	return OPSEC_SESSION_OK;
 }
@@ -605,8 +922,8 @@ static int start_handler(OpsecSession *session)
   |  Description:
   |  ------------
   |  This is the CVP server's end handler.
-  |  Deallocate the per session application-level storage
-  |  remove the scratch file, if used.
+  |  Deallocate the per session application-level storage, the flow
+  |  and the scan stream (this removes the spill file, if used).
   |
   |  Parameters:
   |  -----------
@@ -618,27 +935,28 @@ static int start_handler(OpsecSession *session)
    ----------------------------------------------------------------------------- */
 static void end_handler(OpsecSession *session)
 {
+	long   sends, refused;
+	double bytes;
+
 	fprintf(stderr, "CVP server end handler invoked\n\n");
 
-	/* close the scratch file */
-	if (SO(session)->s_fp) {
-		if (fclose(SO(session)->s_fp) != 0)
-			fprintf(stderr, "%s: fclose('%s') failed: %s\n",
-				ProgName, SO(session)->s_tempname,
-				strerror(errno));
-		SO(session)->s_fp = NULL; 
+	if (SO(session)->s_flow) {
+		cvp_flow_get_stats(SO(session)->s_flow, &sends, &refused, &bytes);
+		metric_add(m_chunks_out, sends);
+		metric_add(m_send_refused, refused);
+		metric_add(m_bytes_out, (long)bytes);
+		cvp_flow_print_stats(SO(session)->s_flow, stderr);
+		cvp_flow_destroy(SO(session)->s_flow);
 	}
 
-	if (SO(session)->s_tempname[0]) {
+	scan_stream_destroy(SO(session)->s_stream);
+	SO(session)->s_stream = NULL;
 
-		/* remove the scratch file */
-		if (remove(SO(session)->s_tempname) < 0) {
-			fprintf(stderr, "%s: remove '%s' failed: %s\n",
-				ProgName, SO(session)->s_tempname,
-				strerror(errno));
-		}
-		SO(session)->s_tempname[0] = '\0';
-	}
+	scan_job_free(SO(session)->s_job);
+	SO(session)->s_job = NULL;
+
+	if (SO(session)->s_hold)
+		free(SO(session)->s_hold);
 
 	/* free memory */
 	if(SO(session)->s_filename)
@@ -646,9 +964,148 @@ static void end_handler(OpsecSession *session)
 
 	free(SESSION_OPAQUE(session));
 	SESSION_OPAQUE(session) = NULL;
+	metric_add(m_sessions, -1);
+}
+
+ /* -----------------------------------------------------------------------------
+  |  create_metrics:
+  |  ---------------
+  |
+  |  Description:
+  |  ------------
+  |  Creates the metrics of the server, and exports them if
+  |  OPSEC_METRICS_FILE is set (see ../common/metrics.c).
+  |
+  |  Parameters:
+  |  -----------
+  |  env  - returned by a call to opsec_init.
+  |  name - appended to the export file name, or NULL.
+  |
+  |  Returned value:
+  |  ---------------
+  |  None.
+   ----------------------------------------------------------------------------- */
+static void create_metrics(OpsecEnv *env, char *name)
+{
+	m_sessions     = metrics_gauge("cvp_sessions", "CVP sessions open");
+	m_requests     = metrics_counter("cvp_requests_total", "CVP requests received");
+	m_chunks_in    = metrics_counter("cvp_chunks_in_total", "chunks received from the client");
+	m_bytes_in     = metrics_counter("cvp_bytes_in_total", "bytes received from the client");
+	m_chunks_out   = metrics_counter("cvp_chunks_out_total", "chunks sent back");
+	m_bytes_out    = metrics_counter("cvp_bytes_out_total", "bytes sent back");
+	m_send_refused = metrics_counter("cvp_send_refused_total", "chunks refused by the flow control");
+	m_request_usec = metrics_histogram("cvp_request_usec", "request to last chunk sent back [usec]");
+	m_reply_usec   = metrics_histogram("cvp_reply_usec", "request to reply [usec]");
+	m_first_byte_usec = metrics_histogram("cvp_first_byte_usec", "request to first byte sent back [usec]");
+	m_infected     = metrics_counter("cvp_infected_total", "requests found infected by the scan engines");
+
+	if (metrics_export_env_named(env, name) < 0)
+		fprintf(stderr, "%s: metrics are not exported\n", ProgName);
 }
 
 
+#ifdef OPSEC_SL_SERVER
+
+/* -------------------------------------------------------------------------------------
+                             S H A R E D   L I B R A R Y
+   ------------------------------------------------------------------------------------- */
+
+/*
+   Built with OPSEC_SL_SERVER, the server is a shared library with the entry
+   points of shared_lib_server.h. It runs in the main loop of the application
+   that loads it (see ../sl_host/opsec_sl_host.c). The entry points shared
+   by the sample servers are in ../common/sl_server.c; the ones below are
+   those of the CVP server.
+ */
+
+ /* -----------------------------------------------------------------------------
+  |  opsec_sl_exp_init_sl:
+  |  ---------------------
+  |
+  |  Description:
+  |  ------------
+  |  Called when the library is loaded. Loads the scan engines, from
+  |  OPSEC_SCAN_ENGINES as the program does.
+  |
+  |  Parameters:
+  |  -----------
+  |  None.
+  |
+  |  Returned value:
+  |  ---------------
+  |  0 if successful, -1 otherwise.
+   ----------------------------------------------------------------------------- */
+SL_EXPORT int opsec_sl_exp_init_sl(void)
+{
+	ProgName = "cvp_av_server";
+
+	if (!(engines = scan_chain_env())) {
+		fprintf(stderr, "%s: no scan engines\n", ProgName);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Called before the library is unloaded */
+SL_EXPORT int opsec_sl_exp_close_sl(void)
+{
+	scan_chain_destroy(engines);
+	engines = NULL;
+	metrics_destroy();
+
+	return 0;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  sl_server_create:
+  |  -----------------
+  |
+  |  Description:
+  |  ------------
+  |  Creates the server entity in the environment of the host, for
+  |  opsec_sl_exp_init_server_entity (see ../common/sl_server.c). The
+  |  metrics are exported to OPSEC_METRICS_FILE.<srv_name>.
+  |
+  |  Parameters:
+  |  -----------
+  |  srv_name - the entity name.
+  |  env      - the environment of the host.
+  |
+  |  Returned value:
+  |  ---------------
+  |  The server entity, NULL on error.
+   ----------------------------------------------------------------------------- */
+OpsecEntity *sl_server_create(char *srv_name, OpsecEnv *env)
+{
+	OpsecEntity *server;
+
+	server = opsec_init_entity(env, CVP_SERVER,
+	                                OPSEC_ENTITY_NAME, srv_name,
+	                                CVP_REQUEST_HANDLER, request_handler,
+	                                CVP_SERVER_CHUNK_HANDLER, chunk_handler,
+	                                CVP_CTS_SIGNAL_HANDLER, cts_signal_handler,
+	                                OPSEC_SESSION_START_HANDLER, start_handler,
+	                                OPSEC_SESSION_END_HANDLER, end_handler,
+	                                OPSEC_EOL);
+	if (server == NULL) {
+		fprintf(stderr, "%s: opsec_init_entity failed (%s)\n",
+			ProgName, opsec_errno_str(opsec_errno));
+		return NULL;
+	}
+
+	create_metrics(env, srv_name);
+
+	return server;
+}
+
+/* The entity uses nothing more than the library */
+void sl_server_free(OpsecEnv *env)
+{
+}
+
+#else
+
 /* -------------------------------------------------------------------------------------
                                         M A I N
    ------------------------------------------------------------------------------------- */
@@ -659,6 +1116,17 @@ int main(int ac, char *av[])
 
 	ProgName = av[0];
 
+	if (ac == 3 && !strcmp(av[1], "-m"))
+		mem_threshold = atoi(av[2]);
+
+	/*
+	 * Load the scan engines
+	 */
+	if (!(engines = scan_chain_env())) {
+		fprintf(stderr, "%s: no scan engines\n", ProgName);
+		exit(1);
+	}
+
 	/*
 	 * Create environment
 	 */
@@ -695,6 +1163,8 @@ int main(int ac, char *av[])
 	}
 	fprintf(stderr, "\nServer is running\n");
 
+	create_metrics(env, NULL);
+
 	opsec_mainloop(env);
 
 	fprintf(stderr, "%s: opsec_mainloop returned\n", ProgName);
@@ -702,8 +1172,13 @@ int main(int ac, char *av[])
 	/*
 	 * Destroy OPSEC server entity and environment
 	 */
+	metrics_export_stop(env);
 	opsec_destroy_entity(server);
 	opsec_env_destroy(env);
+	scan_chain_destroy(engines);
+	metrics_destroy();
 
 	return 0;
 }
+
+#endif
@@ -0,0 +1,676 @@
+/***************************************************************************
+ *                                                                         *
+ * cvp_cache.c : Sample OPSEC CVP Server                                   *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2001 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * The cache repository of the CVP caching server.                         *
+ *                                                                         *
+ * The repository has three parts:                                         *
+ *                                                                         *
+ *   1. The URL index - a hash table from the request URL to an entry. The *
+ *      entries are also linked in LRU order.                              *
+ *                                                                         *
+ *   2. The body table - a hash table from the content hash (and size) of  *
+ *      a body to the place it is stored in. Bodies are content addressed: *
+ *      identical content stored under several URLs is kept only once.     *
+ *      Bodies are reference counted by the URL entries that point to them *
+ *      and by the sessions that are currently reading them.               *
+ *                                                                         *
+ *   3. The segment store - bodies are appended to segment files on the    *
+ *      disk. A new segment is started when the active one is full. A      *
+ *      segment file is removed once none of its bodies is used any more.  *
+ *                                                                         *
+ * The repository has a byte budget for the distinct bodies it holds. When *
+ * a new body pushes it over the budget, the least recently used URL       *
+ * entries are evicted.                                                    *
+ *                                                                         *
+ * Bodies are populated as they stream through the server: a cache_writer  *
+ * accumulates the chunks and hashes them on the way. Objects larger than  *
+ * the maximal object size are not cached. The index itself is kept only   *
+ * in memory - segments left over by a previous run are overwritten.       *
+ *                                                                         *
+ ***************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "cvp_cache.h"
+
+#define CACHE_INITIAL_BUCKETS   1024
+#define CACHE_COMPARE_BUF       4096
+
+#define FNV_OFFSET_BASIS        2166136261UL
+#define FNV_PRIME               16777619UL
+
+static unsigned long
+fnv_update(unsigned long hash, char *data, long len)
+{
+	long i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= (unsigned char)data[i];
+		hash  = (hash * FNV_PRIME) & 0xffffffffUL;
+	}
+
+	return hash;
+}
+
+static unsigned long
+url_hash(char *url)
+{
+	return fnv_update(FNV_OFFSET_BASIS, url, (long)strlen(url));
+}
+
+cvp_cache *
+cvp_cache_create(char *prefix, long budget, long segment_size, long max_object)
+{
+	cvp_cache *cache = (cvp_cache *)calloc(1, sizeof(cvp_cache));
+
+	if (!cache) return NULL;
+
+	/* room for "seg<n>.dat" after the prefix in the segment names */
+	if (prefix && strlen(prefix) + 32 > sizeof(cache->prefix)) {
+		fprintf(stderr, "cvp_cache: segment prefix '%s' too long\n", prefix);
+		free(cache);
+		return NULL;
+	}
+
+	if (prefix)
+		strcpy(cache->prefix, prefix);
+
+	cache->budget       = (budget > 0)       ? budget       : CVP_CACHE_DEFAULT_BUDGET;
+	cache->segment_size = (segment_size > 0) ? segment_size : CVP_CACHE_DEFAULT_SEGMENT;
+	cache->max_object   = (max_object > 0)   ? max_object   : CVP_CACHE_DEFAULT_MAX_OBJECT;
+	if (cache->max_object > cache->budget)
+		cache->max_object = cache->budget;
+
+	cache->n_url_buckets  = CACHE_INITIAL_BUCKETS;
+	cache->n_body_buckets = CACHE_INITIAL_BUCKETS;
+	cache->urls   = (cache_entry **)calloc(cache->n_url_buckets, sizeof(cache_entry *));
+	cache->bodies = (cache_body **)calloc(cache->n_body_buckets, sizeof(cache_body *));
+	cache->active = -1;
+
+	if (!cache->urls || !cache->bodies) {
+		free(cache->urls);
+		free(cache->bodies);
+		free(cache);
+		return NULL;
+	}
+
+	return cache;
+}
+
+/* -------------------------------------------------------------------------------------
+                                    Segment store
+   ------------------------------------------------------------------------------------- */
+
+static void
+segment_drop(cvp_cache *cache, int id)
+{
+	cache_segment *seg = cache->segments[id];
+
+	if (!seg) return;
+
+	if (remove(seg->name) < 0)
+		fprintf(stderr, "cvp_cache: remove '%s' failed: %s\n", seg->name, strerror(errno));
+
+	free(seg);
+	cache->segments[id] = NULL;
+}
+
+static int
+segment_roll(cvp_cache *cache)
+{
+	cache_segment  *seg;
+	cache_segment **segments;
+	FILE           *fp;
+	int             old = cache->active;
+
+	segments = (cache_segment **)realloc(cache->segments,
+	                                     (cache->n_segments + 1) * sizeof(cache_segment *));
+	if (!segments) return -1;
+	cache->segments = segments;
+
+	seg = (cache_segment *)calloc(1, sizeof(cache_segment));
+	if (!seg) return -1;
+	sprintf(seg->name, "%sseg%d.dat", cache->prefix, cache->n_segments);
+
+	/* the active segment stays usable until the new one is open */
+	if (!(fp = fopen(seg->name, "wb"))) {
+		fprintf(stderr, "cvp_cache: fopen('%s', 'wb') failed: %s\n", seg->name, strerror(errno));
+		free(seg);
+		return -1;
+	}
+
+	if (cache->active_fp)
+		fclose(cache->active_fp);
+	cache->active_fp = fp;
+
+	cache->segments[cache->n_segments] = seg;
+	cache->active = cache->n_segments++;
+
+	/* the previous segment may already be unused */
+	if (old >= 0 && cache->segments[old] && cache->segments[old]->live == 0)
+		segment_drop(cache, old);
+
+	return 0;
+}
+
+static int
+segment_append(cvp_cache *cache, char *data, long len, int *id, long *offset)
+{
+	cache_segment *seg = (cache->active >= 0) ? cache->segments[cache->active] : NULL;
+
+	if (!seg || (seg->size > 0 && seg->size + len > cache->segment_size)) {
+		if (segment_roll(cache) < 0)
+			return -1;
+		seg = cache->segments[cache->active];
+	}
+
+	if ((long)fwrite(data, 1, len, cache->active_fp) != len || fflush(cache->active_fp) != 0) {
+		fprintf(stderr, "cvp_cache: fwrite(%ld, '%s') failed: %s\n", len, seg->name, strerror(errno));
+		return -1;
+	}
+
+	*id     = cache->active;
+	*offset = seg->size;
+
+	seg->size += len;
+	seg->live += len;
+
+	return 0;
+}
+
+/* -------------------------------------------------------------------------------------
+                                      Body table
+   ------------------------------------------------------------------------------------- */
+
+static void
+body_free(cvp_cache *cache, cache_body *body)
+{
+	cache_body   **pp = &cache->bodies[body->hash & (cache->n_body_buckets - 1)];
+	cache_segment *seg;
+
+	while (*pp && *pp != body) pp = &(*pp)->hnext;
+	if (*pp) *pp = body->hnext;
+
+	cache->n_bodies--;
+	cache->bytes -= body->size;
+
+	seg = cache->segments[body->segment];
+	if (seg) {
+		seg->live -= body->size;
+		if (seg->live == 0 && body->segment != cache->active)
+			segment_drop(cache, body->segment);
+	}
+
+	free(body);
+}
+
+static void
+body_unref(cvp_cache *cache, cache_body *body)
+{
+	if (--body->refcnt == 0)
+		body_free(cache, body);
+}
+
+/*
+ * Compare a stored body with the given content. Only called when the hash
+ * and the size are equal, so this is rare.
+ */
+static int
+body_equals(cvp_cache *cache, cache_body *body, char *data)
+{
+	char  buf[CACHE_COMPARE_BUF];
+	FILE *fp;
+	long  left = body->size;
+	int   equal = 1;
+	int   n;
+
+	if (!(fp = cvp_cache_body_open(cache, body)))
+		return 0;
+
+	while (equal && left > 0) {
+		n = (left < (long)sizeof(buf)) ? (int)left : (int)sizeof(buf);
+		if ((int)fread(buf, 1, n, fp) != n || memcmp(buf, data, n))
+			equal = 0;
+		data += n;
+		left -= n;
+	}
+
+	fclose(fp);
+
+	return equal;
+}
+
+static cache_body *
+body_find(cvp_cache *cache, unsigned long hash, char *data, long size)
+{
+	cache_body *body = cache->bodies[hash & (cache->n_body_buckets - 1)];
+
+	for (; body; body = body->hnext)
+		if (body->hash == hash && body->size == size && body_equals(cache, body, data))
+			return body;
+
+	return NULL;
+}
+
+static void
+body_table_grow(cvp_cache *cache)
+{
+	cache_body **bodies;
+	cache_body  *body, *next;
+	int          n = cache->n_body_buckets * 2;
+	int          i;
+
+	bodies = (cache_body **)calloc(n, sizeof(cache_body *));
+	if (!bodies) return;	/* keep the current table */
+
+	for (i = 0; i < cache->n_body_buckets; i++) {
+		for (body = cache->bodies[i]; body; body = next) {
+			next = body->hnext;
+			body->hnext = bodies[body->hash & (n - 1)];
+			bodies[body->hash & (n - 1)] = body;
+		}
+	}
+
+	free(cache->bodies);
+	cache->bodies         = bodies;
+	cache->n_body_buckets = n;
+}
+
+static cache_body *
+body_store(cvp_cache *cache, unsigned long hash, char *data, long size)
+{
+	cache_body *body = (cache_body *)calloc(1, sizeof(cache_body));
+
+	if (!body) return NULL;
+
+	if (segment_append(cache, data, size, &body->segment, &body->offset) < 0) {
+		free(body);
+		return NULL;
+	}
+
+	body->hash   = hash;
+	body->size   = size;
+	body->refcnt = 1;
+
+	if (cache->n_bodies >= 2 * cache->n_body_buckets)
+		body_table_grow(cache);
+
+	body->hnext = cache->bodies[hash & (cache->n_body_buckets - 1)];
+	cache->bodies[hash & (cache->n_body_buckets - 1)] = body;
+
+	cache->n_bodies++;
+	cache->bytes += size;
+
+	return body;
+}
+
+/* -------------------------------------------------------------------------------------
+                                   URL index and LRU
+   ------------------------------------------------------------------------------------- */
+
+static void
+lru_unlink(cvp_cache *cache, cache_entry *entry)
+{
+	if (entry->lru_prev) entry->lru_prev->lru_next = entry->lru_next;
+	else cache->lru_first = entry->lru_next;
+
+	if (entry->lru_next) entry->lru_next->lru_prev = entry->lru_prev;
+	else cache->lru_last = entry->lru_prev;
+
+	entry->lru_prev = entry->lru_next = NULL;
+}
+
+static void
+lru_push_front(cvp_cache *cache, cache_entry *entry)
+{
+	entry->lru_prev = NULL;
+	entry->lru_next = cache->lru_first;
+
+	if (cache->lru_first) cache->lru_first->lru_prev = entry;
+	else cache->lru_last = entry;
+
+	cache->lru_first = entry;
+}
+
+static cache_entry *
+entry_find(cvp_cache *cache, char *url, unsigned long hash)
+{
+	cache_entry *entry = cache->urls[hash & (cache->n_url_buckets - 1)];
+
+	for (; entry; entry = entry->hnext)
+		if (entry->url_hash == hash && !strcmp(entry->url, url))
+			return entry;
+
+	return NULL;
+}
+
+static void
+url_table_grow(cvp_cache *cache)
+{
+	cache_entry **urls;
+	cache_entry  *entry, *next;
+	int           n = cache->n_url_buckets * 2;
+	int           i;
+
+	urls = (cache_entry **)calloc(n, sizeof(cache_entry *));
+	if (!urls) return;	/* keep the current table */
+
+	for (i = 0; i < cache->n_url_buckets; i++) {
+		for (entry = cache->urls[i]; entry; entry = next) {
+			next = entry->hnext;
+			entry->hnext = urls[entry->url_hash & (n - 1)];
+			urls[entry->url_hash & (n - 1)] = entry;
+		}
+	}
+
+	free(cache->urls);
+	cache->urls          = urls;
+	cache->n_url_buckets = n;
+}
+
+static void
+entry_evict(cvp_cache *cache, cache_entry *entry)
+{
+	cache_entry **pp = &cache->urls[entry->url_hash & (cache->n_url_buckets - 1)];
+
+	while (*pp && *pp != entry) pp = &(*pp)->hnext;
+	if (*pp) *pp = entry->hnext;
+
+	lru_unlink(cache, entry);
+	cache->n_entries--;
+
+	body_unref(cache, entry->body);
+	free(entry->url);
+	free(entry);
+}
+
+/*
+ * Evict least recently used entries until the cache is within its budget.
+ * 'keep' (the entry just stored) is never evicted.
+ */
+static void
+cache_enforce_budget(cvp_cache *cache, cache_entry *keep)
+{
+	cache_entry *victim;
+
+	while (cache->bytes > cache->budget && (victim = cache->lru_last) && victim != keep) {
+		fprintf(stderr, "cvp_cache: evicting '%s' (%ld bytes)\n", victim->url, victim->body->size);
+		entry_evict(cache, victim);
+		cache->evictions++;
+	}
+}
+
+/* -------------------------------------------------------------------------------------
+                                       Public API
+   ------------------------------------------------------------------------------------- */
+
+ /* -----------------------------------------------------------------------------
+  |  cvp_cache_lookup:
+  |  -----------------
+  |
+  |  Description:
+  |  ------------
+  |  Finds the body cached for 'url' and marks the entry as recently used.
+  |  The caller gets a reference to the body and must release it with
+  |  cvp_cache_body_release() once it is done reading it.
+  |
+  |  Returned value:
+  |  ---------------
+  |  The cached body, or NULL if 'url' is not in the cache.
+   ----------------------------------------------------------------------------- */
+cache_body *
+cvp_cache_lookup(cvp_cache *cache, char *url)
+{
+	cache_entry *entry;
+
+	if (!cache || !url) return NULL;
+
+	entry = entry_find(cache, url, url_hash(url));
+	if (!entry) {
+		cache->misses++;
+		return NULL;
+	}
+
+	lru_unlink(cache, entry);
+	lru_push_front(cache, entry);
+
+	entry->body->refcnt++;
+	cache->hits++;
+
+	return entry->body;
+}
+
+/*
+ * Open the segment file of 'body', positioned at the start of the body.
+ */
+FILE *
+cvp_cache_body_open(cvp_cache *cache, cache_body *body)
+{
+	cache_segment *seg;
+	FILE          *fp;
+
+	if (!cache || !body || !(seg = cache->segments[body->segment]))
+		return NULL;
+
+	if (!(fp = fopen(seg->name, "rb"))) {
+		fprintf(stderr, "cvp_cache: fopen('%s', 'rb') failed: %s\n", seg->name, strerror(errno));
+		return NULL;
+	}
+
+	if (fseek(fp, body->offset, SEEK_SET) != 0) {
+		fclose(fp);
+		return NULL;
+	}
+
+	return fp;
+}
+
+void
+cvp_cache_body_release(cvp_cache *cache, cache_body *body)
+{
+	if (!cache || !body) return;
+
+	body_unref(cache, body);
+}
+
+cache_writer *
+cvp_cache_writer_begin(cvp_cache *cache, char *url)
+{
+	cache_writer *writer;
+
+	if (!cache || !url) return NULL;
+
+	writer = (cache_writer *)calloc(1, sizeof(cache_writer));
+	if (!writer) return NULL;
+
+	writer->cache = cache;
+	writer->hash  = FNV_OFFSET_BASIS;
+	writer->url   = strdup(url);
+	if (!writer->url) {
+		free(writer);
+		return NULL;
+	}
+
+	return writer;
+}
+
+/*
+ * Add a chunk to the body being accumulated. Objects that grow beyond the
+ * maximal object size are silently dropped (they are not an error - they
+ * are just not cached).
+ */
+int
+cvp_cache_writer_add(cache_writer *writer, char *data, int len)
+{
+	if (!writer || len < 0) return -1;
+
+	if (writer->too_large || len == 0)
+		return 0;
+
+	if (writer->len + len > writer->cache->max_object) {
+		writer->too_large = 1;
+		free(writer->buf);
+		writer->buf      = NULL;
+		writer->buf_size = 0;
+		return 0;
+	}
+
+	if (writer->len + len > writer->buf_size) {
+		long  size = writer->buf_size ? writer->buf_size : CACHE_COMPARE_BUF;
+		char *buf;
+
+		while (size < writer->len + len) size *= 2;
+		if (size > writer->cache->max_object) size = writer->cache->max_object;
+
+		if (!(buf = (char *)realloc(writer->buf, size)))
+			return -1;
+		writer->buf      = buf;
+		writer->buf_size = size;
+	}
+
+	memcpy(writer->buf + writer->len, data, len);
+	writer->len  += len;
+	writer->hash  = fnv_update(writer->hash, data, len);
+
+	return 0;
+}
+
+/*
+ * The body is complete - store it (or share an identical stored body) and
+ * point the URL entry at it. The writer is freed.
+ */
+int
+cvp_cache_writer_commit(cache_writer *writer)
+{
+	cvp_cache   *cache;
+	cache_body  *body;
+	cache_entry *entry;
+	unsigned long uhash;
+
+	if (!writer) return -1;
+
+	cache = writer->cache;
+
+	if (writer->too_large || writer->len == 0) {
+		cvp_cache_writer_abort(writer);
+		return 0;
+	}
+
+	body = body_find(cache, writer->hash, writer->buf, writer->len);
+	if (body) {
+		body->refcnt++;
+		cache->dedups++;
+	}
+	else if (!(body = body_store(cache, writer->hash, writer->buf, writer->len))) {
+		cvp_cache_writer_abort(writer);
+		return -1;
+	}
+
+	uhash = url_hash(writer->url);
+	entry = entry_find(cache, writer->url, uhash);
+	if (entry) {
+		/* replace the previous content of this url */
+		body_unref(cache, entry->body);
+		entry->body = body;
+		lru_unlink(cache, entry);
+	}
+	else {
+		if (!(entry = (cache_entry *)calloc(1, sizeof(cache_entry)))) {
+			body_unref(cache, body);
+			cvp_cache_writer_abort(writer);
+			return -1;
+		}
+
+		if (cache->n_entries >= 2 * cache->n_url_buckets)
+			url_table_grow(cache);
+
+		entry->url      = writer->url;
+		entry->url_hash = uhash;
+		entry->body     = body;
+		entry->hnext    = cache->urls[uhash & (cache->n_url_buckets - 1)];
+		cache->urls[uhash & (cache->n_url_buckets - 1)] = entry;
+		cache->n_entries++;
+
+		writer->url = NULL;	/* owned by the entry now */
+	}
+	lru_push_front(cache, entry);
+	cache->stores++;
+
+	cache_enforce_budget(cache, entry);
+
+	cvp_cache_writer_abort(writer);
+
+	return 0;
+}
+
+void
+cvp_cache_writer_abort(cache_writer *writer)
+{
+	if (!writer) return;
+
+	free(writer->url);
+	free(writer->buf);
+	free(writer);
+}
+
+void
+cvp_cache_print_stats(cvp_cache *cache, FILE *fp)
+{
+	if (!cache || !fp) return;
+
+	fprintf(fp, "cvp_cache: %d entries, %d bodies, %ld/%ld bytes, "
+	            "%ld hits, %ld misses, %ld stores, %ld dedups, %ld evictions\n",
+	        cache->n_entries, cache->n_bodies, cache->bytes, cache->budget,
+	        cache->hits, cache->misses, cache->stores, cache->dedups, cache->evictions);
+}
+
+void
+cvp_cache_destroy(cvp_cache *cache)
+{
+	int i;
+
+	if (!cache) return;
+
+	while (cache->lru_first)
+		entry_evict(cache, cache->lru_first);
+
+	if (cache->active_fp)
+		fclose(cache->active_fp);
+
+	for (i = 0; i < cache->n_segments; i++)
+		segment_drop(cache, i);
+
+	/* bodies still referenced by readers are dropped with the cache */
+	for (i = 0; i < cache->n_body_buckets; i++) {
+		cache_body *body, *next;
+		for (body = cache->bodies[i]; body; body = next) {
+			next = body->hnext;
+			free(body);
+		}
+	}
+
+	free(cache->segments);
+	free(cache->urls);
+	free(cache->bodies);
+	free(cache);
+}
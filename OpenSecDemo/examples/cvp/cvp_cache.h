@@ -0,0 +1,123 @@
+#ifndef _CVP_CACHE_H_
+#define _CVP_CACHE_H_
+
+/***************************************************************************
+ *                                                                         *
+ * cvp_cache.h : Sample OPSEC CVP Server                                   *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2001 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * See cvp_cache.c for further explanations.                               *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <stdio.h>
+
+#define CVP_CACHE_DEFAULT_BUDGET       (64L * 1024 * 1024)
+#define CVP_CACHE_DEFAULT_SEGMENT      (8L * 1024 * 1024)
+#define CVP_CACHE_DEFAULT_MAX_OBJECT   (1L * 1024 * 1024)
+
+#define CVP_CACHE_NAME_LEN             256
+
+/*
+ * A cached body, stored once per distinct content.
+ */
+typedef struct _cache_body {
+	struct _cache_body  *hnext;       /* content hash chain           */
+	unsigned long        hash;        /* content hash (FNV-1a)        */
+	long                 size;
+	int                  segment;     /* segment file id              */
+	long                 offset;      /* offset in the segment file   */
+	int                  refcnt;      /* url entries + active readers */
+} cache_body;
+
+/*
+ * A URL index entry. Entries are kept in LRU order.
+ */
+typedef struct _cache_entry {
+	struct _cache_entry *hnext;       /* url hash chain               */
+	struct _cache_entry *lru_prev;
+	struct _cache_entry *lru_next;
+	unsigned long        url_hash;
+	char                *url;
+	cache_body          *body;
+} cache_entry;
+
+typedef struct _cache_segment {
+	char   name[CVP_CACHE_NAME_LEN];
+	long   size;                      /* bytes written               */
+	long   live;                      /* bytes of bodies still used  */
+} cache_segment;
+
+typedef struct _cvp_cache {
+	char            prefix[CVP_CACHE_NAME_LEN];
+	long            budget;           /* bytes of distinct bodies     */
+	long            segment_size;
+	long            max_object;
+
+	cache_entry   **urls;
+	int             n_url_buckets;
+	int             n_entries;
+
+	cache_body    **bodies;
+	int             n_body_buckets;
+	int             n_bodies;
+	long            bytes;
+
+	cache_entry    *lru_first;        /* most recently used           */
+	cache_entry    *lru_last;         /* least recently used          */
+
+	cache_segment **segments;         /* indexed by segment id        */
+	int             n_segments;
+	int             active;           /* segment being appended to    */
+	FILE           *active_fp;
+
+	/* statistics */
+	long            hits;
+	long            misses;
+	long            stores;
+	long            dedups;
+	long            evictions;
+} cvp_cache;
+
+/*
+ * Accumulates a body while it streams through the server.
+ */
+typedef struct _cache_writer {
+	cvp_cache      *cache;
+	char           *url;
+	char           *buf;
+	long            len;
+	long            buf_size;
+	unsigned long   hash;
+	char            too_large;
+} cache_writer;
+
+cvp_cache    * cvp_cache_create(char *prefix, long budget, long segment_size, long max_object);
+void           cvp_cache_destroy(cvp_cache *cache);
+
+cache_body   * cvp_cache_lookup(cvp_cache *cache, char *url);
+FILE         * cvp_cache_body_open(cvp_cache *cache, cache_body *body);
+void           cvp_cache_body_release(cvp_cache *cache, cache_body *body);
+
+cache_writer * cvp_cache_writer_begin(cvp_cache *cache, char *url);
+int            cvp_cache_writer_add(cache_writer *writer, char *data, int len);
+int            cvp_cache_writer_commit(cache_writer *writer);
+void           cvp_cache_writer_abort(cache_writer *writer);
+
+void           cvp_cache_print_stats(cvp_cache *cache, FILE *fp);
+
+#endif
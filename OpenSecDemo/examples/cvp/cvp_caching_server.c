@@ -30,6 +30,14 @@
  *                 The server will add the received data to its cache      *
  *                 repository.                                             *
  *                                                                         *
+ * The cache repository (see cvp_cache.c) is keyed by the request URL. The *
+ * bodies are stored once per distinct content in segment files, and the   *
+ * least recently used URLs are evicted when the cache exceeds its byte    *
+ * budget.                                                                 *
+ *                                                                         *
+ * Usage: cvp_caching_server [-b <budget>] [-o <max object size>]          *
+ *                           [-p <segment file prefix>]                    *
+ *                                                                         *
  ***************************************************************************/
 
 #include <stdio.h>
@@ -49,6 +57,9 @@
 #include "opsec/cvp.h"
 #include "opsec/av_over_cvp.h"
 
+#include "cvp_cache.h"
+#include "../common/cvp_flow.h"
+
 
 /*
    Global definitions (arbitrarily chosen)
@@ -64,6 +75,15 @@
 #define SEND_TO_SRC  1
 #define LET_THROUGH  2
 
+/*
+   The prefix of the cache segment files
+ */
+#ifdef WIN32
+#define   CACHE_PREFIX   "c:\\temp\\cvp_cache_"
+#else
+#define   CACHE_PREFIX   "/tmp/cvp_cache_"
+#endif
+
 /*
    The following structure will be hanged on the session opaque
  */
@@ -72,20 +92,24 @@ struct srv_opaque {
 	int    allow_send_to_src;
 	char   seen_eof;
 
-	FILE  *cache_file;
-	int	   s_chunk_size;
+	char  *s_url;
+
+	cache_body   *cache_body;     /* cache hit being sent to the source */
+	FILE         *cache_file;
+	long          cache_left;     /* bytes of the body not read yet     */
+
+	cache_writer *cache_writer;   /* response being added to the cache  */
 
-	char  *s_buf;
-	int	   s_buf_len;
-	char   s_buf_full;
+	cvp_flow     *src_flow;       /* the cached body to the source      */
+	char         *s_buf;          /* read buffer, of the largest send   */
 
 	char   s_src_sending;
 };
 
 #define SO(sess) ((struct srv_opaque*)SESSION_OPAQUE(sess))
 
-char *cache_file = "url_file.htm";
-char *ProgName   = "Unknown";
+cvp_cache *cache    = NULL;
+char      *ProgName = "Unknown";
 
 
 /*
@@ -97,8 +121,7 @@ char *ProgName   = "Unknown";
 /*
  * Cache API
  *
- * The following two API's are place-holders for caching data.
- * In this sample they were naivly implemented, and do not really perform caching.
+ * The following two API's connect the CVP sessions to the cache repository.
  */
 
  /* -----------------------------------------------------------------------------
@@ -108,8 +131,9 @@ char *ProgName   = "Unknown";
   |  Description:
   |  ------------
   |  'is_in_cache' checks wheather certain data exists in the cache repository.
-  |  Since this server constantly sends the same cache data, this function just
-  |  opens the file, containing the URL page, which will be sent.
+  |  On a hit, the session holds a reference to the cached body (so it is not
+  |  removed while it is being sent) and the segment file containing it is
+  |  opened at the start of the body.
   |
   |  Parameters:
   |  -----------
@@ -122,12 +146,22 @@ char *ProgName   = "Unknown";
   |
   |  Returned value:
   |  ---------------
-  |  '1' if URL file is successfuly opened, 0 otherwise.
+  |  '1' if the URL is cached and its body was successfuly opened, 0 otherwise.
    ----------------------------------------------------------------------------- */
 int is_in_cache(OpsecSession *session, char *filename, int ftype, int proto, char *command, int action)
 {
-	if (!(SO(session)->cache_file = fopen(cache_file, "r")))
+	cache_body *body;
+
+	if (!filename || !(body = cvp_cache_lookup(cache, filename)))
+		return 0;
+
+	if (!(SO(session)->cache_file = cvp_cache_body_open(cache, body))) {
+		cvp_cache_body_release(cache, body);
 		return 0;
+	}
+
+	SO(session)->cache_body = body;
+	SO(session)->cache_left = body->size;
 
 	return 1;
 }
@@ -139,7 +173,9 @@ int is_in_cache(OpsecSession *session, char *filename, int ftype, int proto, cha
   |  Description:
   |  ------------
   |  'accomulate_data' stores data into the server's cache repository.
-  |  Note that this function perform no real action in this sample.
+  |  The data is added to the session cache writer; the body is committed to
+  |  the repository when EOF is received. A failure to cache is not a
+  |  failure of the session - the response is simply not cached.
   |
   |  Parameters:
   |  -----------
@@ -153,6 +189,15 @@ int is_in_cache(OpsecSession *session, char *filename, int ftype, int proto, cha
    ----------------------------------------------------------------------------- */
 int accomulate_data(OpsecSession *session, char *buff, int len)
 {
+	if (!SO(session)->cache_writer)
+		return OPSEC_SESSION_OK;
+
+	if (cvp_cache_writer_add(SO(session)->cache_writer, buff, len) < 0) {
+		fprintf(stderr, "accomulate_data: Failed to cache data, response will not be cached\n");
+		cvp_cache_writer_abort(SO(session)->cache_writer);
+		SO(session)->cache_writer = NULL;
+	}
+
 	return OPSEC_SESSION_OK;
 }
 
@@ -240,44 +285,6 @@ void print_request_parameters(char *filename, int ftype, int proto, char *comman
 	return;
 }
 
- /* -----------------------------------------------------------------------------
-  |  set_cts_size:
-  |  -------------
-  |
-  |  Description:
-  |  ------------
-  |  Tune the CLEAR_TO_SEND mechanism - we want to send chunks of
-  |  DEFAULT_CHUNK_SIZE, or as much as possible if this is too big.
-  |
-  |  Parameters:
-  |  -----------
-  |  session - Pointer to an OpsecSession object.
-  |
-  |  Returned value:
-  |  ---------------
-  |  The smaller of DEFAULT_CHUNK_SIZE and the maximum possible chunk size.
-   ----------------------------------------------------------------------------- */
-static int set_cts_size(OpsecSession *session)
-{
-	int	size = DEFAULT_CHUNK_SIZE;
-
-	/*
-	 * return value will be the minimum between the input 'size'
-	 * argument and the maximum allowed quantity (dependednt on the client)
-	 */
-	size = cvp_cts_src_chunk_size(session, size);
-	if (size < 0) {
-		fprintf(stderr, "%s: could not set cts size\n", ProgName);
-		return OPSEC_SESSION_ERR;
-	}
-
-	/* store for future usage */
-	SO(session)->s_chunk_size = size;
-	
-	return size;
-}
-
-
 /* -------------------------------------------------------------------------------------
                            LET_THROUGH, working mode functions
    ------------------------------------------------------------------------------------- */
@@ -335,10 +342,11 @@ static int let_through_request_handler(OpsecSession *session)
   |  Description:
   |  ------------
   |  This function sends data to the connection source.
-  |  It consists of a 'while' loop which reads data from the url_file
-  |  (in 'chunk_size' chunks) and sends it to the client.
+  |  It reads the cached body while the source flow has room for it
+  |  (see ../common/cvp_flow.c) and hands it to the flow, then the EOF.
   |  
-  |  If sending fails, it will wait to the next clear-to-send signal.
+  |  When the client is full, the flow keeps what it could not send and
+  |  sends it on the next clear-to-send signal.
   |
   |  Parameters:
   |  -----------
@@ -350,72 +358,38 @@ static int let_through_request_handler(OpsecSession *session)
    ----------------------------------------------------------------------------- */
 static int send_to_src_send_data(OpsecSession *session)
 {
-	int rc = OPSEC_SESSION_OK;
+	cvp_flow *flow = SO(session)->src_flow;
+	int       room, n, len;
 
-	while (rc == OPSEC_SESSION_OK) {
+	while (SO(session)->cache_left > 0 && (room = cvp_flow_room(flow)) > 0) {
 
-		/* Do we need to read from file ? */
-		if (!(SO(session)->s_buf_full)) {
-		
-		SO(session)->s_buf_len = fread (SO(session)->s_buf,
-		                                1,
-		                                SO(session)->s_chunk_size,
-		                                SO(session)->cache_file);
-
-			if (SO(session)->s_buf_len == 0) {
+		/* the segment file holds other bodies too - read only this one */
+		n = (SO(session)->cache_left < room) ? (int)SO(session)->cache_left : room;
 
-			
-				/* fread error ? */
-				if (ferror(SO(session)->cache_file)) {
-					fprintf(stderr, "send_to_src_send_data: Fread failed\n");
-					return OPSEC_SESSION_ERR;
-				}
-
-				/* reached end of file */
-				fprintf(stderr, "send_to_src_send_data: Reached the end of file\n");
-				SO(session)->s_buf_len  = -1;
-			}
-			else
-				/* have something to send */
-				SO(session)->s_buf_full = 1;
+		len = fread(SO(session)->s_buf, 1, n, SO(session)->cache_file);
+		if (len == 0) {
+			fprintf(stderr, "send_to_src_send_data: Fread failed\n");
+			return OPSEC_SESSION_ERR;
 		}
+		SO(session)->cache_left -= len;
 
-		/* send data */
-		fprintf(stderr, "send_to_src_send_data: Will try to send chunk (len = %d)\n",
-				SO(session)->s_buf_len);
-
-		/* should send EOF ? */
-		if(SO(session)->s_buf_len == -1) {
-
-			if(cvp_send_chunk_to_src(session, NULL, -1))
-				fprintf(stderr, "send_to_src_send_data: Failed to send EOF to dst\n");
-			else
-				fprintf(stderr, "send_to_src_send_data: Sent EOF to dst\n");
-			
-			/* just sent eof */
-			SO(session)->s_src_sending = 0;
-		
-			break;
+		if (cvp_flow_write(flow, SO(session)->s_buf, len) < 0) {
+			fprintf(stderr, "send_to_src_send_data: Failed to send chunk\n");
+			return OPSEC_SESSION_ERR;
 		}
+	}
 
-		rc = cvp_send_chunk_to_src(session, SO(session)->s_buf, SO(session)->s_buf_len);
-		if(rc == 0) {
-			fprintf(stderr, "send_to_src_send_data: Sent %d bytes to client\n", SO(session)->s_buf_len);
+	/* reached end of the cached body */
+	if (SO(session)->cache_left == 0 && !cvp_flow_at_eof(flow)) {
+		fprintf(stderr, "send_to_src_send_data: Reached the end of file\n");
+		if (cvp_flow_eof(flow) < 0)
+			return OPSEC_SESSION_ERR;
+	}
 
-			/* no data to send till we read more */
-			SO(session)->s_buf_full = 0;
-			SO(session)->s_buf_len = -1;
-		}
-		else {
-			/* Failed to send chunk */
-			fprintf(stderr, "send_to_src_send_data: Failed to send. Waiting for next cts signal\n");	
-			if ((rc == CVP_DATA_FLOW_DIRECTION_ERR) || (rc == CVP_SEND_TO_SRC_DISABLED)) {
-				fprintf(stderr, "send_to_src_send_data: Illegal status (%d)\n", rc);
-				return OPSEC_SESSION_ERR;
-			}
-			/* wait for next clear to send signal */
-			break;
-		}
+	if (cvp_flow_done(flow)) {
+		fprintf(stderr, "send_to_src_send_data: Sent EOF to src\n");
+		cvp_flow_print_stats(flow, stderr);
+		SO(session)->s_src_sending = 0;
 	}
 
 	return OPSEC_SESSION_OK;
@@ -446,11 +420,13 @@ static int send_to_src_request_handler(OpsecSession *session)
 	fprintf(stderr, "send_to_src_request_handler invoked\n");
 
 	/* tune clear-to-send signal */
-	if (set_cts_size(session) < 0)
+	if (!(SO(session)->src_flow = cvp_flow_create(session, 1, DEFAULT_CHUNK_SIZE))) {
+		fprintf(stderr, "%s: could not set cts size\n", ProgName);
 		return OPSEC_SESSION_ERR;
+	}
 
-	if (! (SO(session)->s_buf = (char *)calloc(SO(session)->s_chunk_size+1, sizeof(char))) ) {
-		fprintf(stderr, "send_to_src_request_handler: Calloc failed. exiting.\n");
+	if (! (SO(session)->s_buf = (char *)malloc(cvp_flow_max_chunk(SO(session)->src_flow))) ) {
+		fprintf(stderr, "send_to_src_request_handler: Malloc failed. exiting.\n");
 		exit(MALLOC_ERR);
 	}
 
@@ -540,6 +516,7 @@ static int send_to_src_chunk_handler(OpsecSession *session, char *chunk, int len
   |  The handler, instructs the client to send all the data to the server.
   |  Since this is a cache server, it assumes the data is safe
   |  (and therefore, sends a 'safe data' reply).
+  |  A cache writer is started for the URL of the response.
   |
   |  Parameters:
   |  -----------
@@ -567,6 +544,10 @@ int send_to_dst_request_handler(OpsecSession *session)
 	if (cvp_send_reply(session, opinion, "Cache server: Assuming safe data", NULL) != 0)
 		return OPSEC_SESSION_ERR;
 
+	/* responses without a URL can not be looked up, so they are not cached */
+	if (SO(session)->s_url)
+		SO(session)->cache_writer = cvp_cache_writer_begin(cache, SO(session)->s_url);
+
 	return OPSEC_SESSION_OK;
 }
 
@@ -581,7 +562,8 @@ int send_to_dst_request_handler(OpsecSession *session)
   |  The handler stores each chunk it receives.
   |  No modification of the data is done.
   |
-  |  When EOF is received, the handler invokes the CTS handler.
+  |  When EOF is received, the handler commits the data to the cache
+  |  repository and invokes the CTS handler.
   |
   |  Parameters:
   |  -----------
@@ -605,6 +587,13 @@ int send_to_dst_chunk_handler(OpsecSession *session, char *chunk, int len)
 	else { /* received EOF */
 		fprintf(stderr, "send_to_dst_chunk_handler: Received EOF\n");
 		SO(session)->seen_eof = 1;
+
+		if (SO(session)->cache_writer) {
+			if (cvp_cache_writer_commit(SO(session)->cache_writer) < 0)
+				fprintf(stderr, "send_to_dst_chunk_handler: Failed to cache response\n");
+			SO(session)->cache_writer = NULL;
+			cvp_cache_print_stats(cache, stderr);
+		}
 			
 		cts_signal_handler(session, DST_FLOW);
 	}
@@ -714,6 +703,12 @@ static int request_handler(OpsecSession *session, OpsecInfo *info)
 
 	fprintf(stderr, "request_handler: Direction = %s\n", direction);
 
+	/* the URL is the cache key of both the request and the response */
+	if (filename && !(SO(session)->s_url = strdup(filename))) {
+		fprintf(stderr, "request_handler: strdup failed. exiting.\n");
+		exit(MALLOC_ERR);
+	}
+
 	/* Check source flow availability */
 	src_flow = opsec_info_get(info, "allow_send_to_source", NULL);
 	if(!src_flow || strcmp(src_flow, "true")) {
@@ -829,7 +824,8 @@ static int cts_signal_handler(OpsecSession *session, int flow)
 	}
 
 	if ((flow & SRC_FLOW) && (SO(session)->s_src_sending))
-		if ((send_to_src_send_data(session)) != OPSEC_SESSION_OK) {
+		if (cvp_flow_cts(SO(session)->src_flow) < 0 ||
+		    (send_to_src_send_data(session)) != OPSEC_SESSION_OK) {
 			fprintf(stderr, "cts_signal_handler: failed to send data to source\n");
 			return OPSEC_SESSION_ERR;
 		}
@@ -870,8 +866,9 @@ static int start_handler(OpsecSession *session)
   |  Description:
   |  ------------
   |  This is the CVP server's end handler.
-  |  It deallocate the per session application-level storage and
-  |  removes the cache file, if used.
+  |  It deallocate the per session application-level storage,
+  |  closes the cache file and releases the cached body, if used.
+  |  A response that did not reach EOF is not cached.
   |
   |  Parameters:
   |  -----------
@@ -885,12 +882,25 @@ static void end_handler(OpsecSession *session)
 {
 	fprintf(stderr, "CVP server end handler invoked\n");
 
+	if (!SO(session))
+		return;
+
+	/* drop an incomplete response */
+	cvp_cache_writer_abort(SO(session)->cache_writer);
+	SO(session)->cache_writer = NULL;
+
 	/* close the cache file */
 	if (SO(session)->cache_file) {
 		if (fclose(SO(session)->cache_file) != 0)
 			fprintf(stderr, "%s: fclose failed: %s\n", ProgName, strerror(errno));
 		SO(session)->cache_file = NULL; 
 	}
+	cvp_cache_body_release(cache, SO(session)->cache_body);
+	SO(session)->cache_body = NULL;
+
+	free(SO(session)->s_url);
+	free(SO(session)->s_buf);
+	cvp_flow_destroy(SO(session)->src_flow);
 
 	if (SESSION_OPAQUE(session)) {
 		free(SESSION_OPAQUE(session));
@@ -908,9 +918,35 @@ main(int ac, char *av[])
 {
 	OpsecEnv    *env = NULL;
 	OpsecEntity *server = NULL;
+	char        *prefix = CACHE_PREFIX;
+	long         budget = CVP_CACHE_DEFAULT_BUDGET,
+	             max_object = CVP_CACHE_DEFAULT_MAX_OBJECT;
+	int          i;
 
 	ProgName = av[0];
 
+	for (i = 1; i < ac; i++) {
+		if (!strcmp(av[i], "-b") && i + 1 < ac)
+			budget = atol(av[++i]);
+		else if (!strcmp(av[i], "-o") && i + 1 < ac)
+			max_object = atol(av[++i]);
+		else if (!strcmp(av[i], "-p") && i + 1 < ac)
+			prefix = av[++i];
+		else {
+			fprintf(stderr, "Usage: %s [-b <budget>] [-o <max object size>] [-p <segment file prefix>]\n", ProgName);
+			exit(OPSEC_ERR);
+		}
+	}
+
+	/*
+	 * Create the cache repository
+	 */
+	cache = cvp_cache_create(prefix, budget, CVP_CACHE_DEFAULT_SEGMENT, max_object);
+	if (cache == NULL) {
+		fprintf(stderr, "%s: cvp_cache_create failed\n", ProgName);
+		exit(MALLOC_ERR);
+	}
+
 	/*
 	 * Create environment
 	 */
@@ -953,6 +989,9 @@ main(int ac, char *av[])
 	opsec_destroy_entity(server);
 	opsec_env_destroy(env);
 
+	cvp_cache_print_stats(cache, stderr);
+	cvp_cache_destroy(cache);
+
 	fprintf(stderr, "%s: opsec_mainloop returned\n", ProgName);
 	
 	return 0;
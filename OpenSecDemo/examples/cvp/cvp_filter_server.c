@@ -22,7 +22,10 @@
  *                                                                         *
  * 1. The server asks the client for chunks of agreed size, one by one     *
  *                                                                         *
- * 2. When the server accumulates a full chunk it process it               *
+ * 2. When the server accumulates a full chunk it process it: the chunk    *
+ *    goes through the scan engines listed in OPSEC_SCAN_ENGINES (see      *
+ *    ../common/scan_engine.c). Once a threat is found, the chunk and the  *
+ *    rest of the content are dropped                                      *
  *                                                                         *
  * 3. Modified chunks are sent to the client                               *
  *                                                                         *
@@ -50,6 +53,9 @@
 #include "opsec/cvp.h"
 #include "opsec/av_over_cvp.h"
 
+#include "../common/cvp_flow.h"
+#include "../common/scan_engine.h"
+
 
 /*
  * Global definitions
@@ -59,9 +65,11 @@
 
 #define MODIFIED_CHUNK          1
 #define CHUNK_OK                0
+#define DROPPED_CHUNK           2
 
 #define SENT_CHUNK              0
 #define DIDNT_SEND_CHUNK        1
+#define SEND_CHUNK_ERR         -1
 
 /*
  * The following structure will be hanged on the session opaque
@@ -77,10 +85,17 @@ struct srv_opaque {
 	char   s_sending;               /* a flag indicating that there is data waiting to be sent       */
 	int    modified;                /* a flag indicating whether the server modified the data stream */
 	char   *file_name;              /* the name of the inspected file                                */
+	cvp_flow *dst_flow;             /* the modified chunks to the destination                        */
+	scan_job *job;                  /* the inspection of the data stream                             */
 };
 
 #define SO(session) ((struct srv_opaque*)SESSION_OPAQUE(session))
 
+/*
+ * The scan engines, shared by all the sessions
+ */
+static scan_chain *engines = NULL;
+
 
  /* -----------------------------------------------------------------------------
   |  set_cts_size:
@@ -210,8 +225,9 @@ void print_request_parameters(char *filename, int ftype, int proto, char *comman
  |
  | Description:
  | ------------
- | This function sends a chunk to the client. If it fails to send the chunk it waits for the 
- | next clear to send event. 
+ | This function sends a chunk to the client through the destination flow (see
+ | ../common/cvp_flow.c). What the client cannot take now is kept by the flow and
+ | sent on the next clear to send events.
  | 
  | Parameters:
  | -----------
@@ -219,19 +235,21 @@ void print_request_parameters(char *filename, int ftype, int proto, char *comman
  | 
  | Returned value:
  | ---------------
- | SENT_CHUNK or DIDNT_SEND_CHUNK  
+ | SENT_CHUNK once all of the chunk was sent, DIDNT_SEND_CHUNK while a part of it
+ | waits for a clear to send event, SEND_CHUNK_ERR on error.
  --------------------------------------------------------------------------------------- */
 
 static int send_chunk(OpsecSession *session) 
 {
-	int   rc = 0;
- 
-	rc = cvp_send_chunk_to_dst(session, SO(session)->curr_chunk, SO(session)->curr_chunk_len);
-	if  (rc != 0) {
-
+	if (!SO(session)->s_sending) {
+		if (cvp_flow_write(SO(session)->dst_flow, SO(session)->curr_chunk, SO(session)->curr_chunk_len) < 0)
+			return SEND_CHUNK_ERR;
 		SO(session)->s_sending = 1;
-       	        return DIDNT_SEND_CHUNK;
-       	}
+	}
+
+	if (cvp_flow_pending(SO(session)->dst_flow) > 0)
+		return DIDNT_SEND_CHUNK;
+
 	SO(session)->s_sending = 0;
 	return SENT_CHUNK;	
 }
@@ -263,7 +281,7 @@ static int send_reply_and_eof(OpsecSession *session)
 	 * send EOF
 	 */
 
-        rc = cvp_send_chunk_to_dst(session, NULL, -1);
+        rc = cvp_flow_eof(SO(session)->dst_flow);
 	if (rc != 0)
 		return OPSEC_SESSION_ERR;
 
@@ -271,12 +289,13 @@ static int send_reply_and_eof(OpsecSession *session)
 	 * form and send the opnion
 	 */
 
-	if (SO(session)->modified)
-       		opinion =  CVP_CONTENT_SAFE | CVP_CONTENT_MODIFIED;
-        else
-                opinion =  CVP_CONTENT_SAFE | CVP_CONTENT_NOT_MODIFIED;
+	opinion = scan_opinion(SO(session)->job->verdict, SO(session)->modified ? CVP_CONTENT_MODIFIED : 0);
 
-        sprintf(log, "filter server finshed inspecting file %s", SO(session)->file_name);
+	if (SO(session)->job->verdict == SCAN_INFECTED)
+		sprintf(log, "filter server dropped the content of file %s from %s (%s engine)",
+		        SO(session)->file_name, SO(session)->job->threat, SO(session)->job->engine);
+	else
+		sprintf(log, "filter server finshed inspecting file %s", SO(session)->file_name);
         rc = cvp_send_reply(session, opinion, log, NULL);
         if (rc != 0) {
 
@@ -341,7 +360,9 @@ static int flow_control(OpsecSession *session)
  |
  | Description:
  | ------------
- | This function should contain the core filter technology in a real server.
+ | This function hands the chunk to the scan engines. Once they find a threat,
+ | the chunk and the rest of the content are dropped - the part of the threat in
+ | the previous chunks was already passed on, but without its end.
  |
  | Parameters:
  | -----------
@@ -356,10 +377,16 @@ static int flow_control(OpsecSession *session)
 static int filter_process_and_send(OpsecSession *session) 
 {
 	int rc = SENT_CHUNK;
+	int verdict;
 
-	/*
-	 * Here we would have implamented the filter
-	 */
+	verdict = scan_job_data(SO(session)->job, SO(session)->curr_chunk, SO(session)->curr_chunk_len);
+	if (SO(session)->got_eof)
+		verdict = scan_job_end(SO(session)->job);
+
+	if (verdict == SCAN_INFECTED) {
+		SO(session)->curr_chunk_status = DROPPED_CHUNK;
+		SO(session)->modified = 1;
+	}
 	
 	if (SO(session)->curr_chunk_status == MODIFIED_CHUNK) {
 
@@ -373,6 +400,8 @@ static int filter_process_and_send(OpsecSession *session)
 
                		return (OPSEC_SESSION_OK);
                 }
+		if (rc == SEND_CHUNK_ERR)
+			return OPSEC_SESSION_ERR;
 	}
 	return flow_control(session);
 }
@@ -455,6 +484,14 @@ static int request_handler(OpsecSession *session, OpsecInfo *info)
 	if (set_cts_size(session) < 0)
 		return OPSEC_SESSION_ERR;
 
+	SO(session)->dst_flow = cvp_flow_create(session, 0, SO(session)->s_chunk_size);
+	if (!SO(session)->dst_flow)
+		return OPSEC_SESSION_ERR;
+
+	SO(session)->job = scan_job_begin(engines);
+	if (!SO(session)->job)
+		return OPSEC_SESSION_ERR;
+
 	/*
 	 * Ask the client for the first chunk
 	 */
@@ -536,7 +573,12 @@ static int cts_signal_handler(OpsecSession *session, int flow)
 
 	fprintf(stderr, "CVP server cts handler invoked\n");
 
-	/* If we have data to send, send it */
+	/* Send what the destination flow holds, including the EOF */
+
+	if ((flow & DST_FLOW) && SO(session)->dst_flow && cvp_flow_cts(SO(session)->dst_flow) < 0)
+		return OPSEC_SESSION_ERR;
+
+	/* If the chunk is sent, let the data flow again */
 
 	if (SO(session)->s_sending) {
 
@@ -550,6 +592,8 @@ static int cts_signal_handler(OpsecSession *session, int flow)
 
 			return (OPSEC_SESSION_OK);
                 }
+		if (rc == SEND_CHUNK_ERR)
+			return OPSEC_SESSION_ERR;
 		rc = flow_control(session);
 	}        
 	return rc;
@@ -618,6 +662,11 @@ static void end_handler(OpsecSession *session)
 		free (SO(session)->curr_chunk);
 	if (SO(session)->file_name)
 		free(SO(session)->file_name);
+	if (SO(session)->dst_flow) {
+		cvp_flow_print_stats(SO(session)->dst_flow, stderr);
+		cvp_flow_destroy(SO(session)->dst_flow);
+	}
+	scan_job_free(SO(session)->job);
 	free(SESSION_OPAQUE(session));
 	SESSION_OPAQUE(session) = NULL;
 }
@@ -634,6 +683,14 @@ int main(int ac, char *av[])
 	
 	ProgName = av[0];
 
+	/*
+	 * Load the scan engines
+	 */
+	if (!(engines = scan_chain_env())) {
+		fprintf(stderr, "%s: no scan engines\n", ProgName);
+		exit(1);
+	}
+
 	/*
 	 * Create environment
 	 */
@@ -679,6 +736,7 @@ int main(int ac, char *av[])
 	 */
 	opsec_destroy_entity(server);
 	opsec_env_destroy(env);
+	scan_chain_destroy(engines);
 
 	return 0;
 }
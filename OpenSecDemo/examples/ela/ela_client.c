@@ -22,6 +22,12 @@
  * made sure using the OPSEC_SESSION_ESTABLISHED_HANDLER).                 *
  * Generally, external log events will cause the client's logs sending.    *
  *                                                                         *
+ * Started with -n <count>, the client instead emits <count> logs through  *
+ * the batched producer of ela_producer.c, sending them in batches of      *
+ * -b <size> logs or every -f <ms> milliseconds.                           *
+ * With -s <dir>, logs which cannot be sent are spooled to <dir> and the   *
+ * client reconnects after losing the session, replaying the spool first.  *
+ *                                                                         *
  * Note that most definitions and values in this application are chosen    *
  * for the sake of this sample and will be replaced in real life           *
  * applications.                                                           *
@@ -43,6 +49,8 @@
 #include "opsec/ela.h"
 #include "opsec/ela_opsec.h"
 
+#include "ela_producer.h"
+
 /*
     --------------------
      Global definitions
@@ -56,12 +64,30 @@ typedef struct _Info{
 	OpsecEntity	*server;
 	OpsecEntity	*client;
 	Ela_CONTEXT	*ctx;
+	ElaProducer	*producer;
+	ElaSpool	*spool;
+	OpsecEnv	*env;
+	OpsecSession	*session;	/* NULL while disconnected */
+	int		done;
 }Info;
 
 #define SESSION_INFO(s) ((Info *)SESSION_OPAQUE(s))
 
 #define ELA_PORT  18187
 
+/*
+   Producer settings, see -n, -b and -f
+ */
+#define EMIT_CHUNK      1000    /* logs emitted per scheduling round */
+#define LOG_POOL_SIZE   4096
+#define RECONNECT_DELAY 5       /* [sec] with a spool */
+
+static int  n_logs         = 0;
+static int  n_emitted      = 0;
+static int  batch_size     = 256;
+static long flush_interval = 200;   /* [ms] */
+static char *spool_dir     = NULL;
+
 
 /*
  * Although the next two structures relate to Ela_CONTEXT they can be
@@ -70,8 +96,15 @@ typedef struct _Info{
 struct _FormatFields{
 	Ela_FF *product;
 	Ela_FF *user;
+	Ela_FF *info_url;
+	Ela_FF *src;
 }FormatFields;
 
+/*
+   The fields of compose_and_send_log, for the producer
+ */
+static ElaTemplate *LogTemplate = NULL;
+
 struct _Resolvers{
 	Ela_ResInfo *uid2name;
 	Ela_ResInfo *comp;
@@ -84,6 +117,9 @@ struct _Resolvers{
 #define INFO_ID 2
 #define SRC_IP  "127.0.0.1"
 
+void pong_handler(OpsecSession *session, unsigned int bitmask, OpsecInfo *info,
+                  long interval_time, int status, void *opq);
+
 
 /*
     ------------------
@@ -147,6 +183,67 @@ int compose_and_send_log(OpsecSession *session, int user_id)
 	return rc;
 }
 
+ /* -----------------------------------------------------------------------------
+  |  emit_logs:
+  |  ----------
+  |
+  |  Description:
+  |  ------------
+  |  Emits the next EMIT_CHUNK logs of the -n run through the producer and
+  |  reschedules itself until all of them were emitted and sent, whether a
+  |  session is up or not. Waits while the producer is busy. Once done, pings
+  |  the server, which closes the session.
+  |
+  |  Parameters:
+  |  -----------
+  |  info_ - the Info structure of the client.
+  |
+  |  Returned value:
+  |  ---------------
+  |  None.
+   ----------------------------------------------------------------------------- */
+void emit_logs(void *info_)
+{
+	Info         *info     = (Info *)info_;
+	ElaProducer  *producer = info->producer;
+	int           idx, rc  = ELA_PRODUCER_OK;
+
+	for (idx = 0; idx < EMIT_CHUNK && n_emitted < n_logs; idx++) {
+		rc = ela_producer_emit(producer, LogTemplate,
+		                       PROD_ID, n_emitted % 3 + 1, INFO_ID, inet_addr(SRC_IP));
+		if (rc != ELA_PRODUCER_OK)
+			break;
+		n_emitted++;
+	}
+
+	if (rc == ELA_PRODUCER_ERR) {
+		fprintf(stderr, "emit_logs: Failed to emit log %d\n", n_emitted);
+		n_logs = n_emitted;
+	}
+
+	if (n_emitted == n_logs)
+		ela_producer_flush(producer);
+
+	if (n_emitted < n_logs || !ela_producer_idle(producer) || !info->session) {
+		/*
+		   Give the queue time to drain when the producer cannot take more
+		 */
+		opsec_schedule(producer->env,
+		               (rc == ELA_PRODUCER_BUSY || n_emitted == n_logs) ? (long)ELA_PRODUCER_RETRY : 0L,
+		               emit_logs, info);
+		return;
+	}
+
+	fprintf(stdout, "emit_logs: %lu logs sent in %lu flushes, %lu failed, "
+	                "%lu busy, %lu congested, %lu spooled, %lu dropped, %lu logs created\n",
+	        producer->n_sent, producer->n_flushes, producer->n_failed,
+	        producer->n_busy, producer->n_congested, producer->n_spilled,
+	        producer->n_dropped, LogTemplate->n_created);
+
+	info->done = 1;
+	opsec_ping_peer(info->session, 1000L, pong_handler, NULL);
+}
+
  /* -----------------------------------------------------------------------------
   |  activate_client:
   |  ---------------
@@ -175,6 +272,11 @@ void activate_client(void *info_)
 	if(!(session = ela_new_session(info->client, info->server, info->ctx)))
 	{
 		fprintf(stderr, "Unable to create session (%s)!\n", opsec_errno_str(-1));
+		if (info->spool) {
+			opsec_schedule(info->env, RECONNECT_DELAY * 1000L,
+			               activate_client, info);
+			return;
+		}
 		exit(1);
 	}
 
@@ -245,10 +347,17 @@ void pong_handler(OpsecSession *session,
    ----------------------------------------------------------------------------- */
 int session_established_handler(OpsecSession *session)
 {
-	int idx;
+	int   idx;
+	Info *info = SESSION_INFO(session);
 	
 	fprintf(stdout, "session_established_handler: Session is active\n");
 
+	if (info->producer) {
+		info->session = session;
+		ela_producer_attach(info->producer, session);
+		return OPSEC_SESSION_OK;
+	}
+
 	for (idx = 1; idx <= 3; idx++)
 		if (compose_and_send_log(session, idx) < 0){
 			fprintf(stderr, "session_established_handler: Failed to send log %d\n", idx);
@@ -296,6 +405,8 @@ Ela_CONTEXT *init_ela_ctx()
 	 */
 	FormatFields.product = ela_ff_create(ctx, "product", ELA_VT_INDEX);
 	FormatFields.user    = ela_ff_create(ctx, "user"   , ELA_VT_INDEX);
+	FormatFields.info_url = ela_ff_create(ctx, "info_url", ELA_VT_INDEX);
+	FormatFields.src      = ela_ff_create(ctx, "src"     , ELA_VT_IP);
 
 	/*
 	   Resolver used for compression
@@ -313,6 +424,19 @@ Ela_CONTEXT *init_ela_ctx()
 	ela_resentry_add(ctx, Resolvers.uid2name, ELA_VT_INDEX, 1, ELA_VT_STRING, "Keith Emerson");
 	ela_resentry_add(ctx, Resolvers.uid2name, ELA_VT_INDEX, 2, ELA_VT_STRING, "Greg Lake");
 	ela_resentry_add(ctx, Resolvers.uid2name, ELA_VT_INDEX, 3, ELA_VT_STRING, "Carl Palmer");
+
+	/*
+	   The producer template: the fields of compose_and_send_log, in order
+	 */
+	if (!(LogTemplate = ela_template_create(ctx, LOG_POOL_SIZE)) ||
+	    ela_template_add_field(LogTemplate, FormatFields.product , ELA_VT_INDEX, Resolvers.comp) ||
+	    ela_template_add_field(LogTemplate, FormatFields.user    , ELA_VT_INDEX, Resolvers.uid2name) ||
+	    ela_template_add_field(LogTemplate, FormatFields.info_url, ELA_VT_INDEX, Resolvers.comp) ||
+	    ela_template_add_field(LogTemplate, FormatFields.src     , ELA_VT_IP   , NULL))
+	{
+		fprintf(stderr, "Unable to create log template!\n");
+		exit(1);
+	}
 	
 	return ctx;
 }
@@ -358,7 +482,28 @@ int start_handler(OpsecSession *session)
    ----------------------------------------------------------------------------- */
 void end_handler(OpsecSession *session)
 {
+	Info *info = SESSION_INFO(session);
+
 	printf("\nELA End_Handler was invoked\n");
+
+	if (!info || !info->producer)
+		return;
+
+	ela_producer_detach(info->producer);
+	info->session = NULL;
+
+	if (info->done)
+		return;
+
+	if (!info->spool) {
+		/* without a spool the run ends with the session */
+		opsec_deschedule(opsec_get_session_env(session), emit_logs, info);
+		return;
+	}
+
+	fprintf(stderr, "end_handler: reconnecting in %d seconds\n", RECONNECT_DELAY);
+	opsec_schedule(opsec_get_session_env(session), RECONNECT_DELAY * 1000L,
+	               activate_client, info);
 }
 
  /* -----------------------------------------------------------------------------
@@ -383,6 +528,9 @@ void end_handler(OpsecSession *session)
    ----------------------------------------------------------------------------- */
 void FreeData(OpsecEnv *env, OpsecEntity *server, OpsecEntity *client, Ela_CONTEXT *ctx)
 {
+	/* log template */
+	if(LogTemplate)	ela_template_destroy(LogTemplate);
+
 	/* context */
 	if(ctx)	ela_context_destroy(ctx);
 
@@ -406,9 +554,32 @@ int main(int ac, char *av[])
 	Ela_CONTEXT   *ctx;
 	
 	Info info;
+	int  idx;
 		
 	prog_name = av[0];
 
+	/*
+	 * Producer run: -n <count> [-b <batch size>] [-f <flush interval ms>]
+	 *               [-s <spool dir>]
+	 */
+	for (idx = 1; idx + 1 < ac; idx += 2) {
+		if (!strcmp(av[idx], "-n"))
+			n_logs = atoi(av[idx + 1]);
+		else if (!strcmp(av[idx], "-b"))
+			batch_size = atoi(av[idx + 1]);
+		else if (!strcmp(av[idx], "-f"))
+			flush_interval = atol(av[idx + 1]);
+		else if (!strcmp(av[idx], "-s"))
+			spool_dir = av[idx + 1];
+		else
+			break;
+	}
+	if (idx < ac) {
+		fprintf(stderr, "Usage: %s [-n <count>] [-b <batch size>] [-f <flush interval ms>]"
+		                " [-s <spool dir>]\n", prog_name);
+		exit(1);
+	}
+
 	/*
 	 * Create environment
 	 */
@@ -449,6 +620,32 @@ int main(int ac, char *av[])
 	info.server = server;
 	info.client = client;
 	info.ctx    = ctx;
+	info.producer = NULL;
+	info.spool    = NULL;
+	info.env      = env;
+	info.session  = NULL;
+	info.done     = 0;
+
+	/*
+	 * Producer run: the logs are emitted from the start, the spool holds them
+	 * until a session is up
+	 */
+	if (n_logs > 0) {
+		if (spool_dir &&
+		    (!(info.spool = ela_spool_open(spool_dir, 0)) ||
+		     ela_spool_register(info.spool, LogTemplate) < 0))
+		{
+			fprintf(stderr, "%s: Unable to open spool in %s\n", prog_name, spool_dir);
+			exit(1);
+		}
+		if (!(info.producer = ela_producer_create(env, batch_size, flush_interval,
+		                                          4 * batch_size, info.spool)))
+		{
+			fprintf(stderr, "%s: Unable to create producer\n", prog_name);
+			exit(1);
+		}
+		opsec_schedule(env, 0L, emit_logs, (void *)&info);
+	}
 
 	/*
 	 * The following schedules the activate client function,
@@ -464,6 +661,16 @@ int main(int ac, char *av[])
 
 	printf("\n%s: opsec_mainloop returned\n", prog_name);
 
+	/*
+	 * Logs still waiting go to the spool, for the next run
+	 */
+	if (info.producer) {
+		opsec_deschedule(env, emit_logs, (void *)&info);
+		ela_producer_destroy(info.producer);
+	}
+	if (info.spool)
+		ela_spool_close(info.spool);
+
 	/*
 	 *  Free the OPSEC entities, environment, context
 	 *  and other memory allocations before exiting.
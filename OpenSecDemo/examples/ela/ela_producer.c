@@ -0,0 +1,742 @@
+/***************************************************************************
+ *                                                                         *
+ * ela_producer.c : Batched ELA log producer                               *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2000 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * A producer for log sources which emit many events of the same shape.    *
+ *                                                                         *
+ * A template lists the format fields of a kind of event once. Emitting    *
+ * an event takes a log from the pool of the template, adds the values in  *
+ * template order and appends it to the pending batch. Once sent, the      *
+ * fields are removed again and the log returns to the pool, so a steady   *
+ * stream of events does not create and destroy a log per event.           *
+ *                                                                         *
+ * The batch is sent when batch_size logs wait, or flush_interval ms after *
+ * the first of them was emitted. While opsec_get_queue_state reports the  *
+ * outgoing queue of the session as full, the batch waits and emitting     *
+ * fails with ELA_PRODUCER_BUSY once max_pending logs are waiting.         *
+ *                                                                         *
+ * With a spool (ela_spool.c), logs are written to disk instead while the  *
+ * session is down or the batch is full, and those waiting in the batch    *
+ * when the session ends are written out too. Once attached to a new       *
+ * session, the producer replays the spool segment by segment, pinging the *
+ * server behind each one; the segment is removed when the pong arrives,   *
+ * and read again if it does not. New logs keep going to the spool until   *
+ * it is empty, so the server receives them in order.                      *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#include "opsec/opsec.h"
+#include "opsec/opsec_error.h"
+#include "opsec/ela.h"
+#include "opsec/ela_opsec.h"
+
+#include "ela_producer.h"
+
+static void flush_timer(void *opaque);
+
+/*
+    ----------------
+     Template pools
+    ----------------
+ */
+
+ /* -----------------------------------------------------------------------------
+  |  ela_template_create:
+  |  --------------------
+  |
+  |  Description:
+  |  ------------
+  |  Creates an empty template.
+  |
+  |  Parameters:
+  |  -----------
+  |  ctx       - returned by a call to ela_context_create.
+  |  pool_size - maximal number of idle logs kept for reuse.
+  |
+  |  Returned value:
+  |  ---------------
+  |  Pointer to ElaTemplate if successful, NULL otherwise.
+   ----------------------------------------------------------------------------- */
+ElaTemplate *ela_template_create(Ela_CONTEXT *ctx, int pool_size)
+{
+	ElaTemplate *tmpl;
+
+	if (!(tmpl = (ElaTemplate *)calloc(1, sizeof(ElaTemplate))))
+		return NULL;
+
+	tmpl->ctx       = ctx;
+	tmpl->pool_size = (pool_size > 0) ? pool_size : 1;
+	tmpl->spool_id  = -1;
+
+	if (!(tmpl->pool = (Ela_LOG **)calloc(tmpl->pool_size, sizeof(Ela_LOG *)))) {
+		free(tmpl);
+		return NULL;
+	}
+
+	return tmpl;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  ela_template_add_field:
+  |  -----------------------
+  |
+  |  Description:
+  |  ------------
+  |  Appends a format field to a template. Values are passed to
+  |  ela_producer_emit in the order the fields were added.
+  |
+  |  Parameters:
+  |  -----------
+  |  tmpl - returned by a call to ela_template_create.
+  |  ff   - returned by a call to ela_ff_create.
+  |  type - the value type the format field was created with.
+  |  res  - resolver of the field, may be NULL.
+  |
+  |  Returned value:
+  |  ---------------
+  |  0 if successful, -1 otherwise.
+   ----------------------------------------------------------------------------- */
+int ela_template_add_field(ElaTemplate *tmpl, Ela_FF *ff, Ela_VtType type, Ela_ResInfo *res)
+{
+	if (!tmpl || !ff || tmpl->n_fields >= ELA_TEMPLATE_MAX_FIELDS)
+		return -1;
+
+	/*
+	   Logs in the pool must not hold fields of a different shape
+	 */
+	if (tmpl->n_pool || tmpl->n_created)
+		return -1;
+
+	tmpl->ff[tmpl->n_fields]   = ff;
+	tmpl->type[tmpl->n_fields] = type;
+	tmpl->res[tmpl->n_fields]  = res;
+	tmpl->n_fields++;
+
+	return 0;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  ela_template_destroy:
+  |  ---------------------
+  |
+  |  Description:
+  |  ------------
+  |  Destroys a template and the logs in its pool. The format fields and
+  |  resolvers belong to the context and are left alone.
+  |
+  |  Parameters:
+  |  -----------
+  |  tmpl - returned by a call to ela_template_create.
+  |
+  |  Returned value:
+  |  ---------------
+  |  None.
+   ----------------------------------------------------------------------------- */
+void ela_template_destroy(ElaTemplate *tmpl)
+{
+	if (!tmpl)
+		return;
+
+	while (tmpl->n_pool)
+		ela_log_destroy(tmpl->pool[--tmpl->n_pool]);
+
+	free(tmpl->pool);
+	free(tmpl);
+}
+
+static Ela_LOG *template_get_log(ElaTemplate *tmpl)
+{
+	Ela_LOG *log;
+
+	if (tmpl->n_pool)
+		return tmpl->pool[--tmpl->n_pool];
+
+	if ((log = ela_log_create(tmpl->ctx)))
+		tmpl->n_created++;
+
+	return log;
+}
+
+/*
+   Strip the fields of the template and keep the log, or destroy it once the
+   pool is full
+ */
+static void template_put_log(ElaTemplate *tmpl, Ela_LOG *log)
+{
+	int i;
+
+	if (tmpl->n_pool >= tmpl->pool_size) {
+		ela_log_destroy(log);
+		return;
+	}
+
+	for (i = 0; i < tmpl->n_fields; i++)
+		ela_log_remove_field(log, tmpl->ff[i]);
+
+	tmpl->pool[tmpl->n_pool++] = log;
+}
+
+static int is_string(Ela_VtType type)
+{
+	return type == ELA_VT_STRING || type == ELA_VT_STRING64 || type == ELA_VT_STRING_ID;
+}
+
+/*
+   Take the values of the template fields from the argument list
+ */
+static void template_get_args(ElaTemplate *tmpl, va_list *ap, Ela_val *values)
+{
+	int i;
+
+	for (i = 0; i < tmpl->n_fields; i++) {
+		switch (tmpl->type[i]) {
+		case ELA_VT_STRING:
+		case ELA_VT_STRING64:
+		case ELA_VT_STRING_ID:
+			values[i].str = va_arg(*ap, char *);
+			break;
+		case ELA_VT_FLOAT:
+			values[i].dbl = va_arg(*ap, double);
+			break;
+		case ELA_VT_MASK:
+		case ELA_VT_BUFF:
+		case ELA_VT_LOGID:
+		case ELA_VT_ELA_OBJ:
+			values[i].ptr = va_arg(*ap, void *);
+			break;
+		case ELA_VT_PORT:
+			values[i].h = (unsigned short)va_arg(*ap, int);
+			break;
+		default:
+			/* INT, IP, INDEX, TIME, DURATION, PROTO */
+			values[i].n = va_arg(*ap, int);
+			break;
+		}
+	}
+}
+
+/*
+   Add the value of field i, by its type
+ */
+static int template_add_value(ElaTemplate *tmpl, Ela_LOG *log, int i, Ela_val *v)
+{
+	Ela_FF      *ff  = tmpl->ff[i];
+	Ela_ResInfo *res = tmpl->res[i];
+
+	switch (tmpl->type[i]) {
+	case ELA_VT_STRING:
+	case ELA_VT_STRING64:
+	case ELA_VT_STRING_ID:
+		return ela_log_add_field(log, ff, res, v->str);
+	case ELA_VT_FLOAT:
+		return ela_log_add_field(log, ff, res, v->dbl);
+	case ELA_VT_MASK:
+	case ELA_VT_BUFF:
+	case ELA_VT_LOGID:
+	case ELA_VT_ELA_OBJ:
+		return ela_log_add_field(log, ff, res, v->ptr);
+	case ELA_VT_PORT:
+		return ela_log_add_field(log, ff, res, (int)v->h);
+	default:
+		return ela_log_add_field(log, ff, res, v->n);
+	}
+}
+
+static Ela_LOG *template_compose(ElaTemplate *tmpl, Ela_val *values)
+{
+	Ela_LOG *log;
+	int      i, rc = OPSEC_SESSION_OK;
+
+	if (!(log = template_get_log(tmpl))) {
+		fprintf(stderr, "template_compose: Unable to create log\n");
+		return NULL;
+	}
+
+	for (i = 0; i < tmpl->n_fields; i++)
+		rc |= template_add_value(tmpl, log, i, &values[i]);
+
+	if (rc != OPSEC_SESSION_OK) {
+		fprintf(stderr, "template_compose: Error while adding fields to log\n");
+		template_put_log(tmpl, log);
+		return NULL;
+	}
+
+	return log;
+}
+
+/*
+    ------------------
+     Batched producer
+    ------------------
+ */
+
+static void pending_pop(ElaProducer *producer)
+{
+	ElaPending *p = &producer->pending[producer->head];
+	int         i;
+
+	if (p->own_strings)
+		for (i = 0; i < p->tmpl->n_fields; i++)
+			if (is_string(p->tmpl->type[i]))
+				free(p->values[i].str);
+
+	template_put_log(p->tmpl, p->log);
+	p->log         = NULL;
+	p->tmpl        = NULL;
+	p->own_strings = 0;
+
+	producer->head = (producer->head + 1) % producer->max_pending;
+	producer->n_pending--;
+}
+
+static int spill(ElaProducer *producer, ElaTemplate *tmpl, Ela_val *values)
+{
+	if (ela_spool_append(producer->spool, tmpl, values) < 0) {
+		producer->n_dropped++;
+		return ELA_PRODUCER_ERR;
+	}
+
+	producer->n_spilled++;
+	return ELA_PRODUCER_OK;
+}
+
+/*
+   Move the whole batch to the spool, oldest first
+ */
+static void spill_pending(ElaProducer *producer)
+{
+	ElaPending *p;
+
+	while (producer->n_pending) {
+		p = &producer->pending[producer->head];
+		spill(producer, p->tmpl, p->values);
+		pending_pop(producer);
+	}
+}
+
+static void schedule_flush(ElaProducer *producer, long delay)
+{
+	if (producer->flush_scheduled)
+		return;
+
+	opsec_schedule(producer->env, delay, flush_timer, producer);
+	producer->flush_scheduled = 1;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  ela_producer_create:
+  |  --------------------
+  |
+  |  Description:
+  |  ------------
+  |  Creates a producer. Logs are sent once it is attached to a session.
+  |
+  |  Parameters:
+  |  -----------
+  |  env            - returned by a call to opsec_init.
+  |  batch_size     - number of waiting logs which triggers a flush.
+  |  flush_interval - maximal time in milliseconds a log waits for its batch.
+  |  max_pending    - maximal number of waiting logs.
+  |  spool          - returned by a call to ela_spool_open, or NULL.
+  |
+  |  Returned value:
+  |  ---------------
+  |  Pointer to ElaProducer if successful, NULL otherwise.
+   ----------------------------------------------------------------------------- */
+ElaProducer *ela_producer_create(OpsecEnv *env, int batch_size, long flush_interval,
+                                 int max_pending, ElaSpool *spool)
+{
+	ElaProducer *producer;
+
+	if (!(producer = (ElaProducer *)calloc(1, sizeof(ElaProducer))))
+		return NULL;
+
+	producer->env            = env;
+	producer->spool          = spool;
+	producer->batch_size     = (batch_size > 0) ? batch_size : 1;
+	producer->flush_interval = (flush_interval > 0) ? flush_interval : 1;
+	producer->max_pending    = (max_pending >= producer->batch_size) ? max_pending
+	                                                                 : producer->batch_size;
+
+	if (!(producer->pending = (ElaPending *)calloc(producer->max_pending, sizeof(ElaPending)))) {
+		free(producer);
+		return NULL;
+	}
+
+	return producer;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  ela_producer_destroy:
+  |  ---------------------
+  |
+  |  Description:
+  |  ------------
+  |  Destroys a producer. Logs not sent yet go to the spool, or are dropped
+  |  when there is none.
+  |
+  |  Parameters:
+  |  -----------
+  |  producer - returned by a call to ela_producer_create.
+  |
+  |  Returned value:
+  |  ---------------
+  |  None.
+   ----------------------------------------------------------------------------- */
+void ela_producer_destroy(ElaProducer *producer)
+{
+	if (!producer)
+		return;
+
+	ela_producer_detach(producer);
+
+	free(producer->pending);
+	free(producer);
+}
+
+ /* -----------------------------------------------------------------------------
+  |  ela_producer_attach:
+  |  --------------------
+  |
+  |  Description:
+  |  ------------
+  |  Starts sending on an established session, beginning with the spool.
+  |
+  |  Parameters:
+  |  -----------
+  |  producer - returned by a call to ela_producer_create.
+  |  session  - returned by a call to ela_new_session.
+  |
+  |  Returned value:
+  |  ---------------
+  |  None.
+   ----------------------------------------------------------------------------- */
+void ela_producer_attach(ElaProducer *producer, OpsecSession *session)
+{
+	producer->session      = session;
+	producer->ping_pending = 0;
+
+	if (producer->spool)
+		ela_spool_rewind(producer->spool);
+
+	ela_producer_flush(producer);
+}
+
+ /* -----------------------------------------------------------------------------
+  |  ela_producer_detach:
+  |  --------------------
+  |
+  |  Description:
+  |  ------------
+  |  The session ended: stop sending. Waiting logs go to the spool, or are
+  |  dropped when there is none, and an unacknowledged spool segment will be
+  |  replayed from its start.
+  |
+  |  Parameters:
+  |  -----------
+  |  producer - returned by a call to ela_producer_create.
+  |
+  |  Returned value:
+  |  ---------------
+  |  None.
+   ----------------------------------------------------------------------------- */
+void ela_producer_detach(ElaProducer *producer)
+{
+	producer->session      = NULL;
+	producer->ping_pending = 0;
+
+	if (producer->flush_scheduled) {
+		opsec_deschedule(producer->env, flush_timer, producer);
+		producer->flush_scheduled = 0;
+	}
+
+	if (producer->spool) {
+		ela_spool_rewind(producer->spool);
+		spill_pending(producer);
+		return;
+	}
+
+	if (producer->n_pending)
+		fprintf(stderr, "ela_producer_detach: dropping %d logs\n", producer->n_pending);
+
+	while (producer->n_pending) {
+		producer->n_dropped++;
+		pending_pop(producer);
+	}
+}
+
+ /* -----------------------------------------------------------------------------
+  |  ela_producer_emit:
+  |  ------------------
+  |
+  |  Description:
+  |  ------------
+  |  Composes a log from a template and appends it to the batch, or to the
+  |  spool while logs wait there or the batch cannot be sent.
+  |  The values follow the template, one per field, of the C type matching
+  |  the field type (int, char *, double or a pointer).
+  |
+  |  Parameters:
+  |  -----------
+  |  producer - returned by a call to ela_producer_create.
+  |  tmpl     - returned by a call to ela_template_create.
+  |  ...      - the field values.
+  |
+  |  Returned value:
+  |  ---------------
+  |  ELA_PRODUCER_OK if successful, ELA_PRODUCER_BUSY if the batch is full and
+  |  cannot be sent now, ELA_PRODUCER_ERR otherwise.
+   ----------------------------------------------------------------------------- */
+int ela_producer_emit(ElaProducer *producer, ElaTemplate *tmpl, ...)
+{
+	Ela_val     values[ELA_TEMPLATE_MAX_FIELDS];
+	ElaPending *p;
+	Ela_LOG    *log;
+	va_list     ap;
+	int         i, rc;
+
+	if (!producer || !tmpl)
+		return ELA_PRODUCER_ERR;
+
+	va_start(ap, tmpl);
+	template_get_args(tmpl, &ap, values);
+	va_end(ap);
+
+	/*
+	   Keep the order: nothing overtakes the logs in the spool
+	 */
+	if (producer->spool && (!producer->session || !ela_spool_empty(producer->spool))) {
+		if ((rc = spill(producer, tmpl, values)) == ELA_PRODUCER_OK)
+			producer->n_emitted++;
+		return rc;
+	}
+
+	if (producer->n_pending >= producer->max_pending) {
+		ela_producer_flush(producer);
+		if (producer->n_pending >= producer->max_pending) {
+			if (!producer->spool) {
+				producer->n_busy++;
+				return ELA_PRODUCER_BUSY;
+			}
+			spill_pending(producer);
+			if ((rc = spill(producer, tmpl, values)) == ELA_PRODUCER_OK)
+				producer->n_emitted++;
+			return rc;
+		}
+	}
+
+	if (!(log = template_compose(tmpl, values)))
+		return ELA_PRODUCER_ERR;
+
+	p = &producer->pending[(producer->head + producer->n_pending) % producer->max_pending];
+	p->log  = log;
+	p->tmpl = tmpl;
+	memcpy(p->values, values, tmpl->n_fields * sizeof(Ela_val));
+
+	/*
+	   The strings belong to the caller, the spool may need them later
+	 */
+	if (producer->spool) {
+		p->own_strings = 1;
+		for (i = 0; i < tmpl->n_fields; i++)
+			if (is_string(tmpl->type[i]) && p->values[i].str)
+				p->values[i].str = strdup(p->values[i].str);
+	}
+
+	producer->n_pending++;
+	producer->n_emitted++;
+
+	if (producer->n_pending >= producer->batch_size)
+		ela_producer_flush(producer);
+	else
+		schedule_flush(producer, producer->flush_interval);
+
+	return ELA_PRODUCER_OK;
+}
+
+/*
+   The server answered the ping sent behind the last log of a spool segment
+ */
+static void segment_pong(OpsecSession *session, unsigned int bitmask, OpsecInfo *info,
+                         time_t interval_time, int status, void *opaque)
+{
+	ElaProducer *producer = (ElaProducer *)opaque;
+
+	if (session != producer->session || !producer->ping_pending)
+		return;
+
+	producer->ping_pending = 0;
+
+	if (status == PING_PEER_STAT_OK)
+		ela_spool_ack(producer->spool);
+	else {
+		fprintf(stderr, "segment_pong: Segment %lu not acknowledged (%d), replaying it\n",
+		        producer->spool->first_seq, status);
+		ela_spool_rewind(producer->spool);
+	}
+
+	ela_producer_flush(producer);
+}
+
+/*
+   Send logs of the oldest spool segment while the queue takes them.
+   At its end, ping the server and wait for the pong.
+ */
+static int replay(ElaProducer *producer)
+{
+	ElaTemplate *tmpl;
+	Ela_val      values[ELA_TEMPLATE_MAX_FIELDS];
+	Ela_LOG     *log;
+	int          rc, n = 0;
+
+	while (!producer->ping_pending) {
+
+		if (opsec_get_queue_state(producer->session) != 0) {
+			producer->n_congested++;
+			break;
+		}
+
+		if ((rc = ela_spool_read(producer->spool, &tmpl, values)) < 0)
+			continue;
+
+		if (rc == 0) {
+			/* on failure the flush is retried, and reaches the end of the segment again */
+			producer->ping_pending = 1;
+			if (opsec_ping_peer(producer->session, ELA_PRODUCER_ACK_TIMEOUT, segment_pong, producer) < 0) {
+				fprintf(stderr, "replay: opsec_ping_peer failed (%s), retrying\n",
+				        opsec_errno_str(opsec_errno));
+				producer->ping_pending = 0;
+			}
+			break;
+		}
+
+		if (!(log = template_compose(tmpl, values))) {
+			producer->n_dropped++;
+			continue;
+		}
+
+		if (ela_send_log(producer->session, log) < 0)
+			producer->n_failed++;
+		else {
+			producer->n_sent++;
+			n++;
+		}
+
+		template_put_log(tmpl, log);
+	}
+
+	return n;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  ela_producer_flush:
+  |  -------------------
+  |
+  |  Description:
+  |  ------------
+  |  Sends the waiting logs, oldest first, then replays the spool, until
+  |  nothing is left or the outgoing queue of the session is full. In the
+  |  latter case another attempt is scheduled ELA_PRODUCER_RETRY ms later.
+  |
+  |  Parameters:
+  |  -----------
+  |  producer - returned by a call to ela_producer_create.
+  |
+  |  Returned value:
+  |  ---------------
+  |  The number of logs sent.
+   ----------------------------------------------------------------------------- */
+int ela_producer_flush(ElaProducer *producer)
+{
+	ElaPending *p;
+	int         n = 0;
+
+	if (!producer || !producer->session)
+		return 0;
+
+	if (producer->flush_scheduled) {
+		opsec_deschedule(producer->env, flush_timer, producer);
+		producer->flush_scheduled = 0;
+	}
+
+	if (producer->n_pending)
+		producer->n_flushes++;
+
+	while (producer->n_pending) {
+
+		if (opsec_get_queue_state(producer->session) != 0) {
+			producer->n_congested++;
+			break;
+		}
+
+		p = &producer->pending[producer->head];
+
+		if (ela_send_log(producer->session, p->log) < 0)
+			producer->n_failed++;
+		else {
+			producer->n_sent++;
+			n++;
+		}
+
+		pending_pop(producer);
+	}
+
+	if (!producer->n_pending && producer->spool && !ela_spool_empty(producer->spool))
+		n += replay(producer);
+
+	if (producer->n_pending ||
+	    (producer->spool && !ela_spool_empty(producer->spool) && !producer->ping_pending))
+		schedule_flush(producer, (long)ELA_PRODUCER_RETRY);
+
+	return n;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  ela_producer_idle:
+  |  ------------------
+  |
+  |  Description:
+  |  ------------
+  |  Tells whether every emitted log was handed to the session.
+  |
+  |  Parameters:
+  |  -----------
+  |  producer - returned by a call to ela_producer_create.
+  |
+  |  Returned value:
+  |  ---------------
+  |  1 if nothing waits in the batch or the spool, 0 otherwise.
+   ----------------------------------------------------------------------------- */
+int ela_producer_idle(ElaProducer *producer)
+{
+	return !producer->n_pending &&
+	       (!producer->spool || (ela_spool_empty(producer->spool) && !producer->ping_pending));
+}
+
+static void flush_timer(void *opaque)
+{
+	ElaProducer *producer = (ElaProducer *)opaque;
+
+	producer->flush_scheduled = 0;
+	ela_producer_flush(producer);
+}
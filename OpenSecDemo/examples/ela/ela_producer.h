@@ -0,0 +1,101 @@
+/***************************************************************************
+ *                                                                         *
+ * ela_producer.h : Batched ELA log producer                               *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2000 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef _ELA_PRODUCER_H
+#define _ELA_PRODUCER_H
+
+#include "opsec/opsec.h"
+#include "opsec/ela.h"
+#include "opsec/ela_opsec.h"
+
+#include "ela_spool.h"
+
+#define ELA_TEMPLATE_MAX_FIELDS  16
+#define ELA_PRODUCER_RETRY       100     /* [ms] wait while the queue is full */
+#define ELA_PRODUCER_ACK_TIMEOUT 10000   /* [ms] for the ping behind a segment */
+
+/*
+ * ela_producer_emit return values
+ */
+#define ELA_PRODUCER_OK           0
+#define ELA_PRODUCER_ERR         -1
+#define ELA_PRODUCER_BUSY        -2      /* max_pending logs wait, and no spool */
+
+/*
+   A fixed list of format fields, and a pool of logs holding them
+ */
+typedef struct _ElaTemplate{
+	Ela_CONTEXT  *ctx;
+	int           n_fields;
+	Ela_FF       *ff[ELA_TEMPLATE_MAX_FIELDS];
+	Ela_VtType    type[ELA_TEMPLATE_MAX_FIELDS];
+	Ela_ResInfo  *res[ELA_TEMPLATE_MAX_FIELDS];
+
+	Ela_LOG     **pool;              /* logs without fields, ready for reuse */
+	int           n_pool;
+	int           pool_size;
+	unsigned long n_created;
+
+	int           spool_id;          /* -1 until registered with a spool */
+}ElaTemplate;
+
+typedef struct _ElaPending{
+	Ela_LOG      *log;
+	ElaTemplate  *tmpl;
+	Ela_val       values[ELA_TEMPLATE_MAX_FIELDS];  /* kept for the spool */
+	int           own_strings;
+}ElaPending;
+
+typedef struct _ElaProducer{
+	OpsecSession *session;           /* NULL while disconnected */
+	OpsecEnv     *env;
+	ElaSpool     *spool;             /* optional */
+	int           ping_pending;      /* a spool segment awaits its pong */
+	int           batch_size;        /* flush once that many logs wait */
+	long          flush_interval;    /* [ms] or after that long */
+	int           max_pending;
+
+	ElaPending   *pending;           /* ring of composed logs */
+	int           head;
+	int           n_pending;
+	int           flush_scheduled;
+
+	/* statistics */
+	unsigned long n_emitted;
+	unsigned long n_sent;
+	unsigned long n_failed;
+	unsigned long n_busy;
+	unsigned long n_flushes;
+	unsigned long n_congested;
+	unsigned long n_spilled;         /* written to the spool */
+	unsigned long n_dropped;
+}ElaProducer;
+
+ElaTemplate *ela_template_create(Ela_CONTEXT *ctx, int pool_size);
+int          ela_template_add_field(ElaTemplate *tmpl, Ela_FF *ff, Ela_VtType type, Ela_ResInfo *res);
+void         ela_template_destroy(ElaTemplate *tmpl);
+
+ElaProducer *ela_producer_create(OpsecEnv *env, int batch_size, long flush_interval,
+                                 int max_pending, ElaSpool *spool);
+void         ela_producer_destroy(ElaProducer *producer);
+void         ela_producer_attach(ElaProducer *producer, OpsecSession *session);
+void         ela_producer_detach(ElaProducer *producer);
+int          ela_producer_emit(ElaProducer *producer, ElaTemplate *tmpl, ...);
+int          ela_producer_flush(ElaProducer *producer);
+int          ela_producer_idle(ElaProducer *producer);
+
+#endif /* _ELA_PRODUCER_H */
@@ -0,0 +1,551 @@
+/***************************************************************************
+ *                                                                         *
+ * ela_spool.c : On-disk spool of ELA logs                                 *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2000 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * The spool keeps the logs the producer could not send, in the order they *
+ * were emitted, in numbered append-only segment files:                    *
+ *                                                                         *
+ *   <dir>/ela_spool.00000001, ela_spool.00000002, ...                     *
+ *                                                                         *
+ * A record is one line: the spool id of the template of the log and its   *
+ * field values, separated by tabs ('\', tab and new line are escaped in   *
+ * strings). Each record is flushed to the file as it is appended, and a   *
+ * segment is closed once it grows beyond segment_size.                    *
+ *                                                                         *
+ * Segments are read back oldest first. A segment is removed only when     *
+ * acknowledged (ela_spool_ack), after the server answered a ping sent     *
+ * behind its last log; rewinding reads the first segment again, so logs   *
+ * are delivered at least once. The number of the oldest segment is kept   *
+ * in <dir>/ela_spool.head, so the spool survives a restart.               *
+ *                                                                         *
+ * Templates are identified by the order they were registered in, which    *
+ * therefore must not change between runs.                                 *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "opsec/opsec.h"
+#include "opsec/ela.h"
+#include "opsec/ela_opsec.h"
+
+#include "ela_producer.h"
+#include "ela_spool.h"
+
+#define SPOOL_PATH_MAX  1024
+
+static void spool_path(ElaSpool *spool, const char *name, char *path)
+{
+	sprintf(path, "%s/%s", spool->dir, name);
+}
+
+static void segment_path(ElaSpool *spool, unsigned long seq, char *path)
+{
+	char name[32];
+
+	sprintf(name, ELA_SPOOL_SEGMENT_FMT, seq);
+	spool_path(spool, name, path);
+}
+
+/*
+   Keep the number of the oldest segment, replacing the head file at once
+ */
+static int write_head(ElaSpool *spool)
+{
+	char  path[SPOOL_PATH_MAX], tmp[SPOOL_PATH_MAX];
+	FILE *fp;
+
+	spool_path(spool, ELA_SPOOL_HEAD_FILE, path);
+	sprintf(tmp, "%s.tmp", path);
+
+	if (!(fp = fopen(tmp, "w")))
+		return -1;
+
+	fprintf(fp, "%lu\n", spool->first_seq);
+
+	if (fclose(fp) != 0 || rename(tmp, path) != 0) {
+		remove(tmp);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void rotate(ElaSpool *spool)
+{
+	if (spool->wfp) {
+		fclose(spool->wfp);
+		spool->wfp = NULL;
+	}
+
+	if (spool->wsize) {
+		spool->write_seq++;
+		spool->wsize = 0;
+	}
+}
+
+ /* -----------------------------------------------------------------------------
+  |  ela_spool_open:
+  |  ---------------
+  |
+  |  Description:
+  |  ------------
+  |  Opens the spool kept in a directory, picking up the segments left
+  |  by a previous run. New logs always go to a new segment.
+  |
+  |  Parameters:
+  |  -----------
+  |  dir          - an existing directory.
+  |  segment_size - segment size limit in bytes, 0 for ELA_SPOOL_SEGMENT_SIZE.
+  |
+  |  Returned value:
+  |  ---------------
+  |  Pointer to ElaSpool if successful, NULL otherwise.
+   ----------------------------------------------------------------------------- */
+ElaSpool *ela_spool_open(const char *dir, long segment_size)
+{
+	ElaSpool *spool;
+	char      path[SPOOL_PATH_MAX];
+	FILE     *fp;
+
+	if (!dir || strlen(dir) > SPOOL_PATH_MAX - 64)
+		return NULL;
+
+	if (!(spool = (ElaSpool *)calloc(1, sizeof(ElaSpool))))
+		return NULL;
+
+	if (!(spool->dir = strdup(dir))) {
+		free(spool);
+		return NULL;
+	}
+
+	spool->segment_size = (segment_size > 0) ? segment_size : ELA_SPOOL_SEGMENT_SIZE;
+	spool->first_seq    = 1;
+
+	spool_path(spool, ELA_SPOOL_HEAD_FILE, path);
+	if ((fp = fopen(path, "r"))) {
+		if (fscanf(fp, "%lu", &spool->first_seq) != 1 || spool->first_seq == 0)
+			spool->first_seq = 1;
+		fclose(fp);
+	}
+
+	/*
+	   The segments are numbered without gaps: find the end
+	 */
+	for (spool->write_seq = spool->first_seq; ; spool->write_seq++) {
+		segment_path(spool, spool->write_seq, path);
+		if (!(fp = fopen(path, "r")))
+			break;
+		fclose(fp);
+	}
+
+	if (spool->write_seq > spool->first_seq)
+		fprintf(stderr, "ela_spool_open: %lu segments to replay in %s\n",
+		        spool->write_seq - spool->first_seq, dir);
+
+	if (write_head(spool) < 0) {
+		fprintf(stderr, "ela_spool_open: Unable to write to %s\n", dir);
+		free(spool->dir);
+		free(spool);
+		return NULL;
+	}
+
+	return spool;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  ela_spool_close:
+  |  ----------------
+  |
+  |  Description:
+  |  ------------
+  |  Closes the spool. Its segments stay on disk for the next run.
+  |
+  |  Parameters:
+  |  -----------
+  |  spool - returned by a call to ela_spool_open.
+  |
+  |  Returned value:
+  |  ---------------
+  |  None.
+   ----------------------------------------------------------------------------- */
+void ela_spool_close(ElaSpool *spool)
+{
+	if (!spool)
+		return;
+
+	if (spool->wfp)
+		fclose(spool->wfp);
+	if (spool->rfp)
+		fclose(spool->rfp);
+
+	free(spool->line);
+	free(spool->dir);
+	free(spool);
+}
+
+ /* -----------------------------------------------------------------------------
+  |  ela_spool_register:
+  |  -------------------
+  |
+  |  Description:
+  |  ------------
+  |  Gives a template its spool id. Templates with fields which cannot be
+  |  written out (masks, buffers, log ids and objects) are refused.
+  |
+  |  Parameters:
+  |  -----------
+  |  spool - returned by a call to ela_spool_open.
+  |  tmpl  - returned by a call to ela_template_create, with all its fields.
+  |
+  |  Returned value:
+  |  ---------------
+  |  0 if successful, -1 otherwise.
+   ----------------------------------------------------------------------------- */
+int ela_spool_register(ElaSpool *spool, ElaTemplate *tmpl)
+{
+	int i;
+
+	if (!spool || !tmpl || spool->n_templates >= ELA_SPOOL_MAX_TEMPLATES)
+		return -1;
+
+	for (i = 0; i < tmpl->n_fields; i++) {
+		switch (tmpl->type[i]) {
+		case ELA_VT_MASK:
+		case ELA_VT_BUFF:
+		case ELA_VT_LOGID:
+		case ELA_VT_ELA_OBJ:
+			return -1;
+		default:
+			break;
+		}
+	}
+
+	tmpl->spool_id = spool->n_templates;
+	spool->templates[spool->n_templates++] = tmpl;
+
+	return 0;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  ela_spool_empty:
+  |  ----------------
+  |
+  |  Description:
+  |  ------------
+  |  Tells whether any log waits in the spool.
+  |
+  |  Parameters:
+  |  -----------
+  |  spool - returned by a call to ela_spool_open.
+  |
+  |  Returned value:
+  |  ---------------
+  |  1 if the spool is empty, 0 otherwise.
+   ----------------------------------------------------------------------------- */
+int ela_spool_empty(ElaSpool *spool)
+{
+	return spool->first_seq == spool->write_seq && spool->wsize == 0;
+}
+
+static void write_string(FILE *fp, const char *s)
+{
+	for (; s && *s; s++) {
+		switch (*s) {
+		case '\\': fputs("\\\\", fp); break;
+		case '\t': fputs("\\t", fp);  break;
+		case '\n': fputs("\\n", fp);  break;
+		default:   putc(*s, fp);      break;
+		}
+	}
+}
+
+ /* -----------------------------------------------------------------------------
+  |  ela_spool_append:
+  |  -----------------
+  |
+  |  Description:
+  |  ------------
+  |  Appends a log to the last segment.
+  |
+  |  Parameters:
+  |  -----------
+  |  spool  - returned by a call to ela_spool_open.
+  |  tmpl   - a template registered with the spool.
+  |  values - the field values of the log, in template order.
+  |
+  |  Returned value:
+  |  ---------------
+  |  0 if successful, -1 otherwise.
+   ----------------------------------------------------------------------------- */
+int ela_spool_append(ElaSpool *spool, ElaTemplate *tmpl, Ela_val *values)
+{
+	char path[SPOOL_PATH_MAX];
+	int  i;
+
+	if (tmpl->spool_id < 0 || tmpl->spool_id >= spool->n_templates ||
+	    spool->templates[tmpl->spool_id] != tmpl)
+		return -1;
+
+	if (!spool->wfp) {
+		segment_path(spool, spool->write_seq, path);
+		if (!(spool->wfp = fopen(path, "a"))) {
+			fprintf(stderr, "ela_spool_append: Unable to open %s\n", path);
+			return -1;
+		}
+	}
+
+	fprintf(spool->wfp, "%d", tmpl->spool_id);
+
+	for (i = 0; i < tmpl->n_fields; i++) {
+		putc('\t', spool->wfp);
+		switch (tmpl->type[i]) {
+		case ELA_VT_STRING:
+		case ELA_VT_STRING64:
+		case ELA_VT_STRING_ID:
+			write_string(spool->wfp, values[i].str);
+			break;
+		case ELA_VT_FLOAT:
+			fprintf(spool->wfp, "%.17g", values[i].dbl);
+			break;
+		case ELA_VT_PORT:
+			fprintf(spool->wfp, "%u", (unsigned int)values[i].h);
+			break;
+		default:
+			fprintf(spool->wfp, "%d", values[i].n);
+			break;
+		}
+	}
+	putc('\n', spool->wfp);
+
+	if (fflush(spool->wfp) != 0 || ferror(spool->wfp)) {
+		fprintf(stderr, "ela_spool_append: Write to segment %lu failed\n", spool->write_seq);
+		return -1;
+	}
+
+	spool->wsize = ftell(spool->wfp);
+	spool->n_spooled++;
+
+	if (spool->wsize >= spool->segment_size)
+		rotate(spool);
+
+	return 0;
+}
+
+/*
+   Read one line of any length into spool->line, without the new line
+ */
+static int read_line(ElaSpool *spool)
+{
+	int   len = 0;
+	char *p;
+
+	for (;;) {
+		if (spool->line_size - len < 2) {
+			if (!(p = (char *)realloc(spool->line, spool->line_size + 256)))
+				return -1;
+			spool->line       = p;
+			spool->line_size += 256;
+		}
+
+		if (!fgets(spool->line + len, spool->line_size - len, spool->rfp))
+			return len ? 0 : -1;
+
+		len += strlen(spool->line + len);
+
+		if (spool->line[len - 1] == '\n') {
+			spool->line[len - 1] = '\0';
+			return 0;
+		}
+	}
+}
+
+/*
+   Undo the escapes of a string in place
+ */
+static void unescape(char *s)
+{
+	char *d = s;
+
+	for (; *s; s++) {
+		if (*s == '\\' && s[1]) {
+			s++;
+			*d++ = (*s == 't') ? '\t' : (*s == 'n') ? '\n' : *s;
+		} else
+			*d++ = *s;
+	}
+	*d = '\0';
+}
+
+ /* -----------------------------------------------------------------------------
+  |  ela_spool_read:
+  |  ---------------
+  |
+  |  Description:
+  |  ------------
+  |  Reads the next log of the oldest segment. The last segment is closed
+  |  before it is read, so logs appended meanwhile go to a new one.
+  |  String values point into the spool and are valid until the next read.
+  |
+  |  Parameters:
+  |  -----------
+  |  spool  - returned by a call to ela_spool_open.
+  |  tmpl   - set to the template of the log.
+  |  values - filled with the field values of the log.
+  |
+  |  Returned value:
+  |  ---------------
+  |  1 if a log was read, 0 at the end of the segment, -1 if the record was
+  |  corrupt and skipped.
+   ----------------------------------------------------------------------------- */
+int ela_spool_read(ElaSpool *spool, ElaTemplate **tmpl, Ela_val *values)
+{
+	char         path[SPOOL_PATH_MAX];
+	char        *field, *next;
+	ElaTemplate *t;
+	int          id, i;
+
+	if (!spool->rfp) {
+		if (ela_spool_empty(spool))
+			return 0;
+
+		if (spool->first_seq == spool->write_seq)
+			rotate(spool);
+
+		segment_path(spool, spool->first_seq, path);
+		if (!(spool->rfp = fopen(path, "r")))
+			return 0;
+	}
+
+	if (read_line(spool) < 0)
+		return 0;
+
+	id = (int)strtol(spool->line, &next, 10);
+	if (next == spool->line || id < 0 || id >= spool->n_templates) {
+		spool->n_corrupt++;
+		return -1;
+	}
+	t = spool->templates[id];
+
+	for (i = 0; i < t->n_fields; i++) {
+		if (*next != '\t') {
+			spool->n_corrupt++;
+			return -1;
+		}
+		field = next + 1;
+		if ((next = strchr(field, '\t')))
+			*next = '\0';
+
+		switch (t->type[i]) {
+		case ELA_VT_STRING:
+		case ELA_VT_STRING64:
+		case ELA_VT_STRING_ID:
+			unescape(field);
+			values[i].str = field;
+			break;
+		case ELA_VT_FLOAT:
+			values[i].dbl = strtod(field, NULL);
+			break;
+		case ELA_VT_PORT:
+			values[i].h = (unsigned short)strtoul(field, NULL, 10);
+			break;
+		default:
+			values[i].n = (int)strtol(field, NULL, 10);
+			break;
+		}
+
+		if (next)
+			*next = '\t';
+		else
+			next = field + strlen(field);
+	}
+
+	if (*next) {
+		spool->n_corrupt++;
+		return -1;
+	}
+
+	*tmpl = t;
+	spool->n_replayed++;
+
+	return 1;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  ela_spool_ack:
+  |  --------------
+  |
+  |  Description:
+  |  ------------
+  |  The logs of the oldest segment were delivered: remove it.
+  |
+  |  Parameters:
+  |  -----------
+  |  spool - returned by a call to ela_spool_open.
+  |
+  |  Returned value:
+  |  ---------------
+  |  0 if successful, -1 otherwise.
+   ----------------------------------------------------------------------------- */
+int ela_spool_ack(ElaSpool *spool)
+{
+	char path[SPOOL_PATH_MAX];
+
+	if (spool->first_seq == spool->write_seq)
+		return -1;
+
+	if (spool->rfp) {
+		fclose(spool->rfp);
+		spool->rfp = NULL;
+	}
+
+	segment_path(spool, spool->first_seq, path);
+	remove(path);
+
+	spool->first_seq++;
+	spool->n_acked++;
+
+	return write_head(spool);
+}
+
+ /* -----------------------------------------------------------------------------
+  |  ela_spool_rewind:
+  |  -----------------
+  |
+  |  Description:
+  |  ------------
+  |  The delivery of the oldest segment is not known: read it again from
+  |  its start.
+  |
+  |  Parameters:
+  |  -----------
+  |  spool - returned by a call to ela_spool_open.
+  |
+  |  Returned value:
+  |  ---------------
+  |  None.
+   ----------------------------------------------------------------------------- */
+void ela_spool_rewind(ElaSpool *spool)
+{
+	if (spool->rfp) {
+		fclose(spool->rfp);
+		spool->rfp = NULL;
+	}
+}
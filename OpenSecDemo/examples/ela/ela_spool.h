@@ -0,0 +1,64 @@
+/***************************************************************************
+ *                                                                         *
+ * ela_spool.h : On-disk spool of ELA logs                                 *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2000 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+#ifndef _ELA_SPOOL_H
+#define _ELA_SPOOL_H
+
+#include <stdio.h>
+
+#include "opsec/ela.h"
+
+#define ELA_SPOOL_MAX_TEMPLATES   32
+#define ELA_SPOOL_SEGMENT_SIZE    (1024L * 1024L)   /* rotate after that many bytes */
+#define ELA_SPOOL_HEAD_FILE       "ela_spool.head"
+#define ELA_SPOOL_SEGMENT_FMT     "ela_spool.%08lu"
+
+struct _ElaTemplate;
+
+typedef struct _ElaSpool{
+	char                *dir;
+	long                 segment_size;
+	struct _ElaTemplate *templates[ELA_SPOOL_MAX_TEMPLATES];
+	int                  n_templates;
+
+	unsigned long        first_seq;     /* oldest segment not acknowledged */
+	unsigned long        write_seq;     /* segment appended to */
+	FILE                *wfp;
+	long                 wsize;
+
+	FILE                *rfp;           /* reading first_seq */
+	char                *line;
+	int                  line_size;
+
+	/* statistics */
+	unsigned long        n_spooled;
+	unsigned long        n_replayed;
+	unsigned long        n_corrupt;
+	unsigned long        n_acked;       /* segments */
+}ElaSpool;
+
+ElaSpool *ela_spool_open(const char *dir, long segment_size);
+void      ela_spool_close(ElaSpool *spool);
+int       ela_spool_register(ElaSpool *spool, struct _ElaTemplate *tmpl);
+
+int       ela_spool_empty(ElaSpool *spool);
+int       ela_spool_append(ElaSpool *spool, struct _ElaTemplate *tmpl, Ela_val *values);
+int       ela_spool_read(ElaSpool *spool, struct _ElaTemplate **tmpl, Ela_val *values);
+int       ela_spool_ack(ElaSpool *spool);
+void      ela_spool_rewind(ElaSpool *spool);
+
+#endif /* _ELA_SPOOL_H */
@@ -0,0 +1,626 @@
+/***************************************************************************
+ *                                                                         *
+ * lea_consumer.c : Batched, checkpointed LEA log consumer                 *
+ *                                                                         *
+ * Records are formatted into a fixed number of bounded batch buffers, one *
+ * record per line in the "field=value" format. Names and values are       *
+ * resolved through the session's resolution cache (lea_resolve.c) if the  *
+ * application attached one. A full batch is handed to a sink supplied by  *
+ * the application. After the sink accepts a batch, the position following *
+ * its last record (lea_get_record_pos) and the log file it came from      *
+ * (lea_get_logfile_desc) are saved to a checkpoint file.                  *
+ * LeaConsumerOpen() resumes from that position with LEA_AT_POS, so a      *
+ * restart loses no records and reads again only those of batches the sink *
+ * had not accepted yet.                                                   *
+ *                                                                         *
+ * When the sink falls behind and all batch buffers are waiting for it,    *
+ * the LEA session is suspended with lea_session_suspend(). The consumer   *
+ * keeps retrying the sink from a timer and resumes the session once all   *
+ * waiting batches were accepted. Records which still arrive after the     *
+ * session was suspended go to heap batches, so none are dropped.          *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "lea_consumer.h"
+#include "lea_resolve.h"
+
+#define LEA_CONSUMER_RETRY       1     /* [sec] between sink retries       */
+#define LEA_CONSUMER_LINE_SIZE   1024  /* initial record formatting buffer */
+
+/*
+ * Function prototypes
+ */
+static LeaBatch * GetBatch(LeaConsumer *pConsumer, int nMinSize);
+static void       PutBatch(LeaConsumer *pConsumer, LeaBatch *pBatch);
+static void       QueueCurrent(LeaConsumer *pConsumer);
+static int        DrainPending(LeaConsumer *pConsumer);
+static void       RetryTimer(void *pOpaque);
+static void       FlushTimer(void *pOpaque);
+static int        LineAppend(LeaConsumer *pConsumer, int *pnLen, char *szStr);
+
+
+/*
+ * Creates a consumer with nBatches buffers of nBatchSize bytes each.
+ * A partially filled batch is flushed every nFlushInterval seconds
+ * (0 flushes only full batches).
+ */
+LeaConsumer *
+LeaConsumerCreate(OpsecEnv *pEnv, char *szCheckpoint, int nBatches, int nBatchSize,
+                  int nFlushInterval, LeaSinkFunc pfnSink, void *pSinkOpaque)
+{
+	LeaConsumer *pConsumer;
+	int i;
+
+	if (!pEnv || !szCheckpoint || !pfnSink || nBatches < 1 || nBatchSize < 1 ||
+	    strlen(szCheckpoint) + 5 > LEA_CONSUMER_NAME_LEN)
+	{
+		fprintf(stderr, "LeaConsumerCreate: invalid parameters\n");
+		return NULL;
+	}
+
+	if ((pConsumer = (LeaConsumer *)calloc(1, sizeof(LeaConsumer))) == NULL)
+	{
+		fprintf(stderr, "LeaConsumerCreate: out of memory\n");
+		return NULL;
+	}
+
+	pConsumer->pEnv           = pEnv;
+	pConsumer->pfnSink        = pfnSink;
+	pConsumer->pSinkOpaque    = pSinkOpaque;
+	pConsumer->nBatches       = nBatches;
+	pConsumer->nBatchSize     = nBatchSize;
+	strcpy(pConsumer->szCheckpoint, szCheckpoint);
+
+	pConsumer->pBatches = (LeaBatch *)calloc(nBatches, sizeof(LeaBatch));
+	pConsumer->nLineSize = LEA_CONSUMER_LINE_SIZE;
+	pConsumer->pLine = (char *)malloc(pConsumer->nLineSize);
+	if (!pConsumer->pBatches || !pConsumer->pLine)
+	{
+		fprintf(stderr, "LeaConsumerCreate: out of memory\n");
+		LeaConsumerDestroy(pConsumer);
+		return NULL;
+	}
+
+	for (i=0; i<nBatches; i++)
+	{
+		if ((pConsumer->pBatches[i].pBuf = (char *)malloc(nBatchSize)) == NULL)
+		{
+			fprintf(stderr, "LeaConsumerCreate: out of memory\n");
+			LeaConsumerDestroy(pConsumer);
+			return NULL;
+		}
+		pConsumer->pBatches[i].nSize = nBatchSize;
+		pConsumer->pBatches[i].pNext = pConsumer->pFree;
+		pConsumer->pFree = &pConsumer->pBatches[i];
+	}
+
+	pConsumer->nFlushInterval = nFlushInterval;
+	if (nFlushInterval > 0)
+		opsec_periodic_schedule(pEnv, nFlushInterval * 1000L, FlushTimer, pConsumer);
+
+	return pConsumer;
+}
+
+/*
+ * Flushes what the sink accepts and frees the consumer.
+ * Batches the sink did not accept are lost, but since the checkpoint
+ * was not advanced past them they are read again on the next run.
+ */
+void
+LeaConsumerDestroy(LeaConsumer *pConsumer)
+{
+	LeaBatch *pBatch;
+	int i;
+
+	if (!pConsumer)
+		return;
+
+	if (pConsumer->pBatches)
+		LeaConsumerClose(pConsumer);
+
+	while ((pBatch = pConsumer->pPendingFirst) != NULL)
+	{
+		pConsumer->pPendingFirst = pBatch->pNext;
+		if (pBatch->bOverflow)
+		{
+			free(pBatch->pBuf);
+			free(pBatch);
+		}
+	}
+
+	if (pConsumer->pCurrent && pConsumer->pCurrent->bOverflow)
+	{
+		free(pConsumer->pCurrent->pBuf);
+		free(pConsumer->pCurrent);
+	}
+
+	if (pConsumer->pBatches)
+	{
+		for (i=0; i<pConsumer->nBatches; i++)
+			if (pConsumer->pBatches[i].pBuf) free(pConsumer->pBatches[i].pBuf);
+		free(pConsumer->pBatches);
+	}
+
+	if (pConsumer->pLine) free(pConsumer->pLine);
+	free(pConsumer);
+}
+
+/*
+ * Opens a LEA session. If the checkpoint file holds a position the
+ * session starts there (LEA_AT_POS), otherwise it starts at the beginning
+ * of szLogFile.
+ */
+OpsecSession *
+LeaConsumerOpen(LeaConsumer *pConsumer, OpsecEntity *pClient, OpsecEntity *pServer,
+                int nMode, char *szLogFile, int bSuspended)
+{
+	OpsecSession *pSession;
+	LeaCheckpoint *pCkpt = &pConsumer->ckpt;
+
+	if (LeaCheckpointLoad(pConsumer->szCheckpoint, pCkpt) == OPSEC_SESSION_OK)
+	{
+		printf("LeaConsumerOpen: resuming %s (fileid %d) at position %d\n",
+		       pCkpt->szFilename, pCkpt->nFileId, pCkpt->nPos);
+
+		if (pCkpt->nFileId > 0)
+		{
+			pSession = bSuspended ?
+				lea_new_suspended_session(pClient, pServer, nMode, LEA_NORMAL_FILEID,
+				                          (long)pCkpt->nFileId, LEA_AT_POS, pCkpt->nPos) :
+				lea_new_session(pClient, pServer, nMode, LEA_NORMAL_FILEID,
+				                (long)pCkpt->nFileId, LEA_AT_POS, pCkpt->nPos);
+		}
+		else
+		{
+			pSession = bSuspended ?
+				lea_new_suspended_session(pClient, pServer, nMode, LEA_FILENAME,
+				                          pCkpt->szFilename, LEA_AT_POS, pCkpt->nPos) :
+				lea_new_session(pClient, pServer, nMode, LEA_FILENAME,
+				                pCkpt->szFilename, LEA_AT_POS, pCkpt->nPos);
+		}
+	}
+	else
+	{
+		pSession = bSuspended ?
+			lea_new_suspended_session(pClient, pServer, nMode, LEA_FILENAME, szLogFile, LEA_AT_START) :
+			lea_new_session(pClient, pServer, nMode, LEA_FILENAME, szLogFile, LEA_AT_START);
+	}
+
+	pConsumer->pSession = pSession;
+	return pSession;
+}
+
+/*
+ * Stops the timers and makes a last attempt to flush. Should be called
+ * from the OPSEC_SESSION_END_HANDLER; the session is not used afterwards.
+ */
+int
+LeaConsumerClose(LeaConsumer *pConsumer)
+{
+	int rc;
+
+	if (pConsumer->bClosed)
+		return (pConsumer->nPending ? LEA_SINK_BUSY : LEA_SINK_OK);
+
+	if (pConsumer->nFlushInterval > 0)
+		opsec_deschedule(pConsumer->pEnv, FlushTimer, pConsumer);
+	if (pConsumer->bRetry)
+		opsec_deschedule(pConsumer->pEnv, RetryTimer, pConsumer);
+
+	pConsumer->bRetry   = 0;
+	pConsumer->bClosed  = 1;
+	pConsumer->pSession = NULL;
+
+	if ((rc = LeaConsumerFlush(pConsumer)) != LEA_SINK_OK)
+		fprintf(stderr, "LeaConsumerClose: %d batches were not written\n", pConsumer->nPending);
+
+	return rc;
+}
+
+/*
+ * Formats a record and adds it to the current batch.
+ * Should be called from the LEA_RECORD_HANDLER.
+ */
+int
+LeaConsumerRecord(LeaConsumer *pConsumer, OpsecSession *pSession, lea_record *pRec)
+{
+	lea_logdesc *pLogDesc = lea_get_logfile_desc(pSession);
+	LeaBatch *pBatch;
+	char szNum[64];
+	char *szAttrib;
+	char *szResValue;
+	int nPos = lea_get_record_pos(pSession);
+	int nLen = 0;
+	int i;
+
+	pConsumer->pSession = pSession;
+
+	/* the strings of the previous record are no longer used */
+	LeaResolveNewRecord(pSession);
+
+	/*
+	 * Format the record: general information, then every field
+	 */
+	sprintf(szNum, "loc=%d filename=", nPos-1);
+	if (LineAppend(pConsumer, &nLen, szNum) != OPSEC_SESSION_OK ||
+	    LineAppend(pConsumer, &nLen, (pLogDesc->filename ? pLogDesc->filename : "(null)")) != OPSEC_SESSION_OK)
+		return OPSEC_SESSION_ERR;
+
+	sprintf(szNum, " fileid=%d", pLogDesc->fileid);
+	if (LineAppend(pConsumer, &nLen, szNum) != OPSEC_SESSION_OK)
+		return OPSEC_SESSION_ERR;
+
+	for (i=0; i<pRec->n_fields; i++)
+	{
+		szAttrib = LeaResolveAttr(pSession, pRec->fields[i].lea_attr_id);
+		szResValue = LeaResolveField(pSession, &pRec->fields[i]);
+
+		if (LineAppend(pConsumer, &nLen, " ") != OPSEC_SESSION_OK ||
+		    LineAppend(pConsumer, &nLen, (szAttrib ? szAttrib : "(null)")) != OPSEC_SESSION_OK ||
+		    LineAppend(pConsumer, &nLen, "=") != OPSEC_SESSION_OK ||
+		    LineAppend(pConsumer, &nLen, (szResValue ? szResValue : "(null)")) != OPSEC_SESSION_OK)
+			return OPSEC_SESSION_ERR;
+	}
+
+	if (LineAppend(pConsumer, &nLen, "\n") != OPSEC_SESSION_OK)
+		return OPSEC_SESSION_ERR;
+
+	/*
+	 * Add it to the current batch, queueing the batch if it is full
+	 */
+	if (pConsumer->pCurrent && pConsumer->pCurrent->nLen + nLen > pConsumer->pCurrent->nSize)
+		QueueCurrent(pConsumer);
+
+	if (!pConsumer->pCurrent && (pConsumer->pCurrent = GetBatch(pConsumer, nLen)) == NULL)
+		return OPSEC_SESSION_ERR;
+
+	pBatch = pConsumer->pCurrent;
+	memcpy(pBatch->pBuf + pBatch->nLen, pConsumer->pLine, nLen);
+	pBatch->nLen += nLen;
+	pBatch->nRecords++;
+	pConsumer->nRecords++;
+
+	pBatch->ckpt.bValid  = 1;
+	pBatch->ckpt.nFileId = pLogDesc->fileid;
+	pBatch->ckpt.nPos    = nPos;
+	strncpy(pBatch->ckpt.szFilename, (pLogDesc->filename ? pLogDesc->filename : ""), LEA_CONSUMER_NAME_LEN-1);
+	pBatch->ckpt.szFilename[LEA_CONSUMER_NAME_LEN-1] = '\0';
+
+	/*
+	 * Stop reading while the sink can not keep up
+	 */
+	if (!pConsumer->pFree && pConsumer->nPending > 0 && !pConsumer->bSuspended)
+	{
+		if (lea_session_suspend(pSession) == OPSEC_SESSION_OK)
+		{
+			pConsumer->bSuspended = 1;
+			pConsumer->nSuspends++;
+		}
+		else
+			fprintf(stderr, "LeaConsumerRecord: failed to suspend the session\n");
+	}
+
+	return OPSEC_SESSION_OK;
+}
+
+/*
+ * Hands the current batch and every waiting batch to the sink.
+ * Should be called on end of file, log switch and session end.
+ * Returns LEA_SINK_OK if nothing is left waiting.
+ */
+int
+LeaConsumerFlush(LeaConsumer *pConsumer)
+{
+	if (pConsumer->pCurrent && pConsumer->pCurrent->nRecords > 0)
+		QueueCurrent(pConsumer);
+
+	return DrainPending(pConsumer);
+}
+
+void
+LeaConsumerPrintStats(LeaConsumer *pConsumer)
+{
+	printf("Consumer: %ld records, %ld batches written, %ld sink busy, %ld overflow batches, %ld suspends\n",
+	       pConsumer->nRecords, pConsumer->nFlushes, pConsumer->nBusy,
+	       pConsumer->nOverflows, pConsumer->nSuspends);
+	if (pConsumer->ckpt.bValid)
+		printf("Consumer: checkpoint %s (fileid %d) at position %d\n",
+		       pConsumer->ckpt.szFilename, pConsumer->ckpt.nFileId, pConsumer->ckpt.nPos);
+}
+
+/*
+ * Reads a checkpoint file. The file has the lines
+ *   fileid <fileid>
+ *   pos <position>
+ *   filename <name>
+ */
+int
+LeaCheckpointLoad(char *szFile, LeaCheckpoint *pCkpt)
+{
+	FILE *pFile;
+	char  szLine[LEA_CONSUMER_NAME_LEN + 16];
+	int   nFound = 0;
+	int   nLen;
+
+	memset(pCkpt, 0, sizeof(LeaCheckpoint));
+
+	if ((pFile = fopen(szFile, "r")) == NULL)
+		return OPSEC_SESSION_ERR;
+
+	while (fgets(szLine, sizeof(szLine), pFile))
+	{
+		nLen = strlen(szLine);
+		while (nLen > 0 && (szLine[nLen-1] == '\n' || szLine[nLen-1] == '\r'))
+			szLine[--nLen] = '\0';
+
+		if (sscanf(szLine, "fileid %d", &pCkpt->nFileId) == 1)
+			nFound |= 1;
+		else if (sscanf(szLine, "pos %d", &pCkpt->nPos) == 1)
+			nFound |= 2;
+		else if (strncmp(szLine, "filename ", 9) == 0)
+		{
+			strncpy(pCkpt->szFilename, szLine + 9, LEA_CONSUMER_NAME_LEN-1);
+			nFound |= 4;
+		}
+	}
+	fclose(pFile);
+
+	if (nFound != 7 || pCkpt->nPos < 0)
+	{
+		fprintf(stderr, "LeaCheckpointLoad: %s is not a valid checkpoint file\n", szFile);
+		memset(pCkpt, 0, sizeof(LeaCheckpoint));
+		return OPSEC_SESSION_ERR;
+	}
+
+	pCkpt->bValid = 1;
+	return OPSEC_SESSION_OK;
+}
+
+/*
+ * Writes a checkpoint file. The checkpoint is written to a temporary
+ * file which then replaces the old one, so a crash leaves either the old
+ * or the new checkpoint behind.
+ */
+int
+LeaCheckpointSave(char *szFile, LeaCheckpoint *pCkpt)
+{
+	FILE *pFile;
+	char  szTmp[LEA_CONSUMER_NAME_LEN + 8];
+	int   nErr;
+
+	sprintf(szTmp, "%s.tmp", szFile);
+
+	if ((pFile = fopen(szTmp, "w")) == NULL)
+	{
+		fprintf(stderr, "LeaCheckpointSave: failed to create %s\n", szTmp);
+		return OPSEC_SESSION_ERR;
+	}
+
+	fprintf(pFile, "fileid %d\npos %d\nfilename %s\n",
+	        pCkpt->nFileId, pCkpt->nPos, pCkpt->szFilename);
+	nErr = (fflush(pFile) != 0 || ferror(pFile));
+	if (fclose(pFile) != 0 || nErr)
+	{
+		fprintf(stderr, "LeaCheckpointSave: failed to write %s\n", szTmp);
+		remove(szTmp);
+		return OPSEC_SESSION_ERR;
+	}
+
+#ifdef WIN32
+	/* rename() does not replace an existing file */
+	remove(szFile);
+#endif
+	if (rename(szTmp, szFile) != 0)
+	{
+		fprintf(stderr, "LeaCheckpointSave: failed to rename %s to %s\n", szTmp, szFile);
+		remove(szTmp);
+		return OPSEC_SESSION_ERR;
+	}
+
+	return OPSEC_SESSION_OK;
+}
+
+/*
+ * A sink writing batches to a stdio stream (pOpaque is a FILE *).
+ */
+int
+LeaFileSink(void *pOpaque, char *pData, int nLen, int nRecords)
+{
+	FILE *pFile = (FILE *)pOpaque;
+
+	if (fwrite(pData, 1, nLen, pFile) != (size_t)nLen || fflush(pFile) != 0)
+		return LEA_SINK_ERR;
+
+	return LEA_SINK_OK;
+}
+
+/*
+ * Takes a batch from the free list. When all batches are in use, or the
+ * record does not fit into one, a batch is allocated from the heap.
+ */
+static LeaBatch *
+GetBatch(LeaConsumer *pConsumer, int nMinSize)
+{
+	LeaBatch *pBatch;
+	int nSize;
+
+	if (pConsumer->pFree && nMinSize <= pConsumer->nBatchSize)
+	{
+		pBatch = pConsumer->pFree;
+		pConsumer->pFree = pBatch->pNext;
+	}
+	else
+	{
+		nSize = (nMinSize > pConsumer->nBatchSize ? nMinSize : pConsumer->nBatchSize);
+		if ((pBatch = (LeaBatch *)calloc(1, sizeof(LeaBatch))) == NULL ||
+		    (pBatch->pBuf = (char *)malloc(nSize)) == NULL)
+		{
+			fprintf(stderr, "GetBatch: out of memory\n");
+			if (pBatch) free(pBatch);
+			return NULL;
+		}
+		pBatch->nSize = nSize;
+		pBatch->bOverflow = 1;
+		pConsumer->nOverflows++;
+	}
+
+	pBatch->nLen = 0;
+	pBatch->nRecords = 0;
+	pBatch->ckpt.bValid = 0;
+	pBatch->pNext = NULL;
+	return pBatch;
+}
+
+static void
+PutBatch(LeaConsumer *pConsumer, LeaBatch *pBatch)
+{
+	if (pBatch->bOverflow)
+	{
+		free(pBatch->pBuf);
+		free(pBatch);
+		return;
+	}
+
+	pBatch->pNext = pConsumer->pFree;
+	pConsumer->pFree = pBatch;
+}
+
+/*
+ * Moves the current batch to the end of the waiting list
+ * and tries to hand it to the sink.
+ */
+static void
+QueueCurrent(LeaConsumer *pConsumer)
+{
+	LeaBatch *pBatch = pConsumer->pCurrent;
+
+	if (!pBatch)
+		return;
+
+	pConsumer->pCurrent = NULL;
+	pBatch->pNext = NULL;
+	if (pConsumer->pPendingLast)
+		pConsumer->pPendingLast->pNext = pBatch;
+	else
+		pConsumer->pPendingFirst = pBatch;
+	pConsumer->pPendingLast = pBatch;
+	pConsumer->nPending++;
+
+	/* while a retry is scheduled the sink is known to be busy */
+	if (!pConsumer->bRetry)
+		DrainPending(pConsumer);
+}
+
+/*
+ * Hands the waiting batches to the sink, in order, advancing the
+ * checkpoint after each accepted batch. Schedules a retry if the sink
+ * is busy and resumes the session once nothing is left waiting.
+ */
+static int
+DrainPending(LeaConsumer *pConsumer)
+{
+	LeaBatch *pBatch;
+	LeaCheckpoint *pLast = NULL;
+	int rc = LEA_SINK_OK;
+
+	while ((pBatch = pConsumer->pPendingFirst) != NULL)
+	{
+		rc = pConsumer->pfnSink(pConsumer->pSinkOpaque, pBatch->pBuf, pBatch->nLen, pBatch->nRecords);
+		if (rc != LEA_SINK_OK)
+		{
+			if (rc == LEA_SINK_BUSY)
+				pConsumer->nBusy++;
+			else
+				fprintf(stderr, "DrainPending: sink failed to write %d records, will retry\n",
+				        pBatch->nRecords);
+			break;
+		}
+
+		pConsumer->nFlushes++;
+		pConsumer->ckpt = pBatch->ckpt;
+		pLast = &pConsumer->ckpt;
+
+		pConsumer->pPendingFirst = pBatch->pNext;
+		if (!pConsumer->pPendingFirst)
+			pConsumer->pPendingLast = NULL;
+		pConsumer->nPending--;
+		PutBatch(pConsumer, pBatch);
+	}
+
+	/* one checkpoint write covers all the batches written above */
+	if (pLast && pLast->bValid)
+		LeaCheckpointSave(pConsumer->szCheckpoint, pLast);
+
+	if (pConsumer->pPendingFirst)
+	{
+		if (!pConsumer->bRetry && !pConsumer->bClosed)
+		{
+			opsec_schedule(pConsumer->pEnv, LEA_CONSUMER_RETRY * 1000L, RetryTimer, pConsumer);
+			pConsumer->bRetry = 1;
+		}
+		return rc;
+	}
+
+	if (pConsumer->bSuspended && pConsumer->pSession)
+	{
+		if (lea_session_resume(pConsumer->pSession) == OPSEC_SESSION_OK)
+			pConsumer->bSuspended = 0;
+		else
+			fprintf(stderr, "DrainPending: failed to resume the session\n");
+	}
+
+	return LEA_SINK_OK;
+}
+
+static void
+RetryTimer(void *pOpaque)
+{
+	LeaConsumer *pConsumer = (LeaConsumer *)pOpaque;
+
+	pConsumer->bRetry = 0;
+	DrainPending(pConsumer);
+}
+
+/*
+ * Bounds the delay of records in a partially filled batch.
+ */
+static void
+FlushTimer(void *pOpaque)
+{
+	LeaConsumer *pConsumer = (LeaConsumer *)pOpaque;
+
+	if (!pConsumer->bRetry)
+		LeaConsumerFlush(pConsumer);
+}
+
+/*
+ * Appends a string to the record formatting buffer.
+ */
+static int
+LineAppend(LeaConsumer *pConsumer, int *pnLen, char *szStr)
+{
+	int nLen = strlen(szStr);
+	int nSize;
+	char *pLine;
+
+	if (*pnLen + nLen > pConsumer->nLineSize)
+	{
+		nSize = pConsumer->nLineSize * 2;
+		while (nSize < *pnLen + nLen)
+			nSize *= 2;
+		if ((pLine = (char *)realloc(pConsumer->pLine, nSize)) == NULL)
+		{
+			fprintf(stderr, "LineAppend: out of memory\n");
+			return OPSEC_SESSION_ERR;
+		}
+		pConsumer->pLine = pLine;
+		pConsumer->nLineSize = nSize;
+	}
+
+	memcpy(pConsumer->pLine + *pnLen, szStr, nLen);
+	*pnLen += nLen;
+	return OPSEC_SESSION_OK;
+}
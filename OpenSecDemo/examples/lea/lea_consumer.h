@@ -0,0 +1,103 @@
+#ifndef _LEA_CONSUMER_H_
+#define _LEA_CONSUMER_H_
+
+/***************************************************************************
+ *                                                                         *
+ * lea_consumer.h : Batched, checkpointed LEA log consumer                 *
+ *                                                                         *
+ * See lea_consumer.c for further explanations.                            *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "opsec/lea.h"
+#include "opsec/opsec.h"
+
+#define LEA_CONSUMER_NAME_LEN    256
+
+/*
+ * Return values of a sink
+ */
+#define LEA_SINK_OK              0     /* the batch was written            */
+#define LEA_SINK_BUSY            1     /* try again later                  */
+#define LEA_SINK_ERR            -1     /* the batch can not be written     */
+
+/*
+ * A sink receives a buffer of formatted records, one record per line.
+ * It must not keep a pointer to the buffer after it returns.
+ */
+typedef int (*LeaSinkFunc)(void *pOpaque, char *pData, int nLen, int nRecords);
+
+/*
+ * Where to resume reading the log from.
+ */
+typedef struct _LeaCheckpoint {
+	int   bValid;
+	int   nFileId;
+	char  szFilename[LEA_CONSUMER_NAME_LEN];
+	int   nPos;                               /* of the next record to read */
+} LeaCheckpoint;
+
+/*
+ * A buffer of formatted records.
+ */
+typedef struct _LeaBatch {
+	char              *pBuf;
+	int                nSize;
+	int                nLen;
+	int                nRecords;
+	int                bOverflow;             /* heap batch, not pooled     */
+	LeaCheckpoint      ckpt;                  /* after the last record      */
+	struct _LeaBatch  *pNext;
+} LeaBatch;
+
+typedef struct _LeaConsumer {
+	OpsecEnv          *pEnv;
+	OpsecSession      *pSession;
+
+	LeaSinkFunc        pfnSink;
+	void              *pSinkOpaque;
+
+	char               szCheckpoint[LEA_CONSUMER_NAME_LEN];
+	LeaCheckpoint      ckpt;                  /* last persisted checkpoint  */
+
+	LeaBatch          *pBatches;              /* nBatches of nBatchSize     */
+	int                nBatches;
+	int                nBatchSize;
+	LeaBatch          *pFree;
+	LeaBatch          *pCurrent;              /* being filled               */
+	LeaBatch          *pPendingFirst;         /* full, waiting for the sink */
+	LeaBatch          *pPendingLast;
+	int                nPending;
+
+	char              *pLine;                 /* record formatting buffer   */
+	int                nLineSize;
+
+	int                nFlushInterval;        /* [sec], 0 for none          */
+	int                bSuspended;            /* suspended by the consumer  */
+	int                bRetry;                /* a retry is scheduled       */
+	int                bClosed;               /* the session has ended      */
+
+	/* statistics */
+	long               nRecords;
+	long               nFlushes;
+	long               nBusy;
+	long               nOverflows;
+	long               nSuspends;
+} LeaConsumer;
+
+LeaConsumer  * LeaConsumerCreate(OpsecEnv *pEnv, char *szCheckpoint, int nBatches, int nBatchSize,
+                                 int nFlushInterval, LeaSinkFunc pfnSink, void *pSinkOpaque);
+void           LeaConsumerDestroy(LeaConsumer *pConsumer);
+OpsecSession * LeaConsumerOpen(LeaConsumer *pConsumer, OpsecEntity *pClient, OpsecEntity *pServer,
+                               int nMode, char *szLogFile, int bSuspended);
+int            LeaConsumerClose(LeaConsumer *pConsumer);
+int            LeaConsumerRecord(LeaConsumer *pConsumer, OpsecSession *pSession, lea_record *pRec);
+int            LeaConsumerFlush(LeaConsumer *pConsumer);
+void           LeaConsumerPrintStats(LeaConsumer *pConsumer);
+
+int            LeaCheckpointLoad(char *szFile, LeaCheckpoint *pCkpt);
+int            LeaCheckpointSave(char *szFile, LeaCheckpoint *pCkpt);
+
+int            LeaFileSink(void *pOpaque, char *pData, int nLen, int nRecords);
+
+#endif
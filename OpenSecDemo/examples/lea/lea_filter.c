@@ -2,7 +2,9 @@
  *                                                                         *
  * This example program configures a LEA Client. It shows how to use the   *
  * filtering ability of the LEA protocol. Records received by the          *
- * application are printed to the output.                                  *
+ * application are printed to the output in batches (see lea_consumer.c).  *
+ * The position of the last printed record is kept in a checkpoint file    *
+ * and a restarted client continues from there.                            *
  *                                                                         *
  * The rulebase applied by this example is as follows:                     *
  * Rule 1: service belongs to {nbdatagram, nbsession} and dest belongs to  *
@@ -15,6 +17,9 @@
  *         "sys_msgs"                                                      *
  * Rule 5 (implied): unconditionally drop                                  *
  *                                                                         *
+ * Alternatively, the rulebase is compiled from a rules file given with    *
+ * -f (see lea_rules.c and lea_filter.rules).                              *
+ *                                                                         *
  ***************************************************************************/
 
 #include <stdio.h>
@@ -23,6 +28,9 @@
 #include "opsec/lea.h"
 #include "opsec/lea_filter.h"
 #include "opsec/opsec.h"
+#include "lea_consumer.h"
+#include "lea_resolve.h"
+#include "lea_rules.h"
 
 #ifdef WIN32
 #	include <winsock.h>
@@ -55,14 +63,23 @@ LeaFilterPredicate * CreateRule4Pred();
 /*
  *	Global definitions 
  */
-LeaFilterRulebase * g_pRbase = NULL;            /* global rulebase */
+#define CHECKPOINT_FILE    "lea_filter.ckpt"
+#define BATCHES            4                    /* batch buffers            */
+#define BATCH_SIZE         65536                /* bytes per batch buffer   */
+#define FLUSH_INTERVAL     1                    /* [sec]                    */
+#define RESOLVE_ENTRIES    8192                 /* resolved values cached   */
+
+LeaFilterRulebase * g_pRbase    = NULL;         /* global rulebase */
+LeaRules          * g_pRules    = NULL;         /* rulebase compiled from a file */
+LeaConsumer       * g_pConsumer = NULL;         /* batches the records */
 
 /*
  * MAIN
  *
  * In this example, the LEA Client receives log records from 
- * fw.log in ONLINE mode, starting with the first record in the file.
- * The parameter passed to main() is the number of logs to be read.
+ * fw.log in ONLINE mode, starting with the first record in the file,
+ * or after the last record printed by a previous run.
+ * Usage: lea_filter [-c <checkpoint file>] [-f <rules file>]
  */
 int 
 main(int argc, char *argv[])
@@ -72,6 +89,31 @@ main(int argc, char *argv[])
 	OpsecSession   *pSession = NULL;
 	OpsecEnv       *pEnv     = NULL;
 	int             nId      = 0;
+	int             i;
+	char           *szCheckpoint = CHECKPOINT_FILE;
+	char           *szRules      = NULL;
+
+	for (i=1; i<argc; i++)
+	{
+		if (!strcmp(argv[i], "-c") && i+1 < argc)
+			szCheckpoint = argv[++i];
+		else if (!strcmp(argv[i], "-f") && i+1 < argc)
+			szRules = argv[++i];
+		else
+		{
+			fprintf(stderr, "Usage: %s [-c <checkpoint file>] [-f <rules file>]\n", argv[0]);
+			exit(-1);
+		}
+	}
+
+	/*
+	 *  Compile the rules file before connecting, so that errors show up at once
+	 */
+	if (szRules && !(g_pRules = LeaRulesLoad(szRules)))
+	{
+		fprintf(stderr, "%s: failed to load the rules from %s\n", argv[0], szRules);
+		exit(-1);
+	}
 
 	if ((pEnv = opsec_init(OPSEC_EOL)) == NULL)
 	{
@@ -105,22 +147,56 @@ main(int argc, char *argv[])
 		exit(-1);
 	}
 
+	if (!(g_pConsumer = LeaConsumerCreate(pEnv, szCheckpoint, BATCHES, BATCH_SIZE,
+	                                      FLUSH_INTERVAL, LeaFileSink, stdout)))
+	{
+		fprintf(stderr, "%s: failed to create the record consumer\n", argv[0]);
+		CleanUpEnvironment(pEnv, pClient, pServer);
+		exit(-1);
+	}
+
 	/*
-	 *  Create session
+	 *  Create session, at the checkpoint if there is one
 	 */
-	if(!(pSession = lea_new_suspended_session(pClient, pServer, LEA_ONLINE, LEA_FILENAME, LEA_NORMAL, LEA_AT_START)))
+	if(!(pSession = LeaConsumerOpen(g_pConsumer, pClient, pServer, LEA_ONLINE, LEA_NORMAL, 1)))
 	{
 		fprintf(stderr, "%s: failed to start reading log file\n", argv[0]);
+		LeaConsumerDestroy(g_pConsumer);
 		CleanUpEnvironment(pEnv, pClient, pServer);
 		exit(-1);
 	}
 
-	g_pRbase = CreateOfflineRulebase();
+	if (g_pRules)
+	{
+		/* the session is resumed now if no acknowledgement will come */
+		switch (LeaRulesRegister(pSession, g_pRules))
+		{
+		case LEA_RULES_PENDING:
+			break;
+		case OPSEC_SESSION_OK:
+			lea_session_resume(pSession);
+			break;
+		default:
+			fprintf(stderr, "%s: failed to register the rules from %s\n", argv[0], szRules);
+			LeaConsumerDestroy(g_pConsumer);
+			LeaRulesDestroy(g_pRules);
+			CleanUpEnvironment(pEnv, pClient, pServer);
+			exit(-1);
+		}
+	}
+	else
+	{
+		g_pRbase = CreateOfflineRulebase();
 
-	lea_filter_rulebase_register(pSession, g_pRbase, &nId);
+		lea_filter_rulebase_register(pSession, g_pRbase, &nId);
+	}
 
 	opsec_mainloop(pEnv);
 
+	LeaConsumerPrintStats(g_pConsumer);
+	LeaConsumerDestroy(g_pConsumer);
+	LeaRulesDestroy(g_pRules);
+
 	/*
 	 *  Free the OPSEC entities and the environment before exiting.
 	 */
@@ -148,6 +224,9 @@ CleanUpEnvironment(OpsecEnv *env, OpsecEntity *client, OpsecEntity *server)
 int LeaStartHandler(OpsecSession *session)
 {
 	printf("LeaStartHandler: start handler has been called\n");
+
+	/* cache attribute names and resolved values for this session */
+	LeaResolveAttach(session, RESOLVE_ENTRIES, 0);
 	return OPSEC_SESSION_OK;
 }
 
@@ -157,48 +236,21 @@ int LeaStartHandler(OpsecSession *session)
 int LeaEndHandler(OpsecSession *session)
 {
 	printf("LeaEndHandler: end handler has been called\n");
+	LeaConsumerClose(g_pConsumer);
+	LeaResolvePrintStats(session);
+	LeaResolveDetach(session);
 	return OPSEC_SESSION_OK;
 }
 
 /*
  * This event handles the log record event.
- * Each log record is printed in a single line.
+ * Each log record is added to the current batch as a single line.
  * Each log field has the "field=value" format, separated by spaces.
  */
 int
 LeaRecordHandler(OpsecSession *pSession, lea_record *pRec, int pnAttribPerm[])
 {
-	int i;
-	char *szResValue;
-	char *szAttrib; 
-    lea_logdesc *pLogDesc = lea_get_logfile_desc(pSession);
-
-	/*
-	 * Print general log record information
-	 */
-	printf("loc=%d filename=%s fileid=%d", 
-	       lea_get_record_pos(pSession)-1,
-	       (pLogDesc->filename ? pLogDesc->filename : "(null)"),
-	       pLogDesc->fileid);
-
-	/*
-	 * Loop over all records fields
-	 */
-	for (i=0; i<pRec->n_fields; i++)
-	{
-		/*
-		 * Print each field
-		 */
-		szAttrib = lea_attr_name(pSession, pRec->fields[i].lea_attr_id);		
-		szResValue = lea_resolve_field(pSession, pRec->fields[i]);
-		printf(" %s=%s", szAttrib, szResValue);
-	}
-
-	/*
-	 * End of line
-	 */
-	printf("\n");	
-	return OPSEC_SESSION_OK;
+	return LeaConsumerRecord(g_pConsumer, pSession, pRec);
 }
 
 /*
@@ -207,6 +259,7 @@ LeaRecordHandler(OpsecSession *pSession, lea_record *pRec, int pnAttribPerm[])
 int LeaDictionaryHandler(OpsecSession *session, int dict_id, LEA_VT val_type, int n_d_entries)
 {
 	printf("LeaDictionaryHandler: dictionary handler has been called\n");
+	LeaResolveDictChanged(session, dict_id, val_type);
 	return OPSEC_SESSION_OK;
 }
 
@@ -216,6 +269,7 @@ int LeaDictionaryHandler(OpsecSession *session, int dict_id, LEA_VT val_type, in
 int
 LeaEofHandler(OpsecSession *pSession)
 {
+	LeaConsumerFlush(g_pConsumer);
 	printf("The log file has ended\n");
 	return OPSEC_SESSION_OK;
 }
@@ -226,6 +280,8 @@ LeaEofHandler(OpsecSession *pSession)
 int
 LeaSwitchHandler(OpsecSession *pSession)
 {
+	LeaConsumerFlush(g_pConsumer);
+	LeaResolveInvalidate(pSession);
 	printf("The log file has been switched\n");
 	return OPSEC_SESSION_OK;
 }
@@ -241,6 +297,10 @@ LeaFilterQueryAckHandler(OpsecSession *pSession, int nFilterId, eLeaFilterAction
 	       (nAction==LEA_FILTER_REGISTER ? "registration" : "unregistration"),
 	       (nResult==OPSEC_SESSION_OK ? "OPSEC_SESSION_OK" : "OPSEC_SESSION_ERR") );
 
+	/* a rulebase from a file may fall back to local filtering */
+	if (g_pRules && nAction==LEA_FILTER_REGISTER)
+		LeaRulesAck(pSession, g_pRules, nResult);
+
 	lea_session_resume(pSession);
 
 	return OPSEC_SESSION_OK;
@@ -36,6 +36,7 @@
 #include "opsec/lea_filter.h"
 #include "opsec/lea_filter_ext.h"
 #include "opsec/opsec.h"
+#include "lea_resolve.h"
 
 #ifdef WIN32
 #	include <winsock.h>
@@ -76,6 +77,8 @@ int                  g_bFilterApplied   = 0;    /* flags if the filter has been
 int                  g_nId;                     /* rulebase ID */
 int                  g_bFilterOnServer	= 0;    /* is the filter on the server or on the client? */
 
+#define RESOLVE_ENTRIES      16384                  /* dictionary entries and resolved values cached */
+
 /*
  * MAIN
  *
@@ -179,6 +182,9 @@ CleanUpEnvironment(OpsecEnv *env, OpsecEntity *client, OpsecEntity *server)
 int LeaStartHandler(OpsecSession *pSession)
 {
 	printf("LeaStartHandler: start handler has been called\n");
+
+	/* cache dictionaries, attribute names and resolved values for this session */
+	LeaResolveAttach(pSession, RESOLVE_ENTRIES, 1);
 	return OPSEC_SESSION_OK;
 }
 
@@ -188,6 +194,8 @@ int LeaStartHandler(OpsecSession *pSession)
 int LeaEndHandler(OpsecSession *pSession)
 {
 	printf("LeaEndHandler: end handler has been called\n");
+	LeaResolvePrintStats(pSession);
+	LeaResolveDetach(pSession);
 	return OPSEC_SESSION_OK;
 }
 
@@ -204,6 +212,9 @@ LeaRecordHandler(OpsecSession *pSession, lea_record *pRec, int pnAttribPerm[])
 	char        *szAttrib; 
 	lea_logdesc *pLogDesc    = lea_get_logfile_desc(pSession);
 
+	/* the strings of the previous record are no longer used */
+	LeaResolveNewRecord(pSession);
+
 	/*
 	 * Print general log record information
 	 */
@@ -220,8 +231,8 @@ LeaRecordHandler(OpsecSession *pSession, lea_record *pRec, int pnAttribPerm[])
 		/*
 		 * Print each field
 		 */
-		szAttrib = lea_attr_name(pSession, pRec->fields[i].lea_attr_id);		
-		szResValue = lea_resolve_field(pSession, pRec->fields[i]);
+		szAttrib = LeaResolveAttr(pSession, pRec->fields[i].lea_attr_id);
+		szResValue = LeaResolveField(pSession, &pRec->fields[i]);
 		printf(" %s=%s", szAttrib, szResValue);
 	}
 
@@ -248,12 +259,14 @@ LeaRecordHandler(OpsecSession *pSession, lea_record *pRec, int pnAttribPerm[])
  */
 int LeaDictionaryHandler(OpsecSession *pSession, int nDictId, LEA_VT nValType, int nEntries)
 {
-	lea_dict_iter *pIter;
-	lea_dict_entry *pEntry;
+	lea_value_t value;
 	LeaFilterRulebase *pRbase;
 	
 	printf("LeaDictionaryHandler: dictionary handler has been called\n");
 
+	/* (re)load the dictionary into the resolution cache */
+	LeaResolveDictChanged(pSession, nDictId, nValType);
+
 	/* if the filter is alrady applied, bail out now */
 	if (g_bFilterApplied)
 		return OPSEC_SESSION_OK;
@@ -262,86 +275,33 @@ int LeaDictionaryHandler(OpsecSession *pSession, int nDictId, LEA_VT nValType, i
 	{
 	case LEA_VT_TCP_PORT:
 		/* look for "nbsession" */
-
-		/* do we have the port already? */
-		if (g_nSvcNbsession!=0)
-			return OPSEC_SESSION_OK;
-
-		/* create iterator */
-		if ((pIter = lea_dict_iter_create(pSession, nDictId, 0))==NULL)
+		if (g_nSvcNbsession==0 &&
+		    LeaResolveLookupName(pSession, nDictId, "nbsession", &value)==LEA_FOUND)
 		{
-			fprintf(stderr, "LeaDictionaryHandler: failed to create dictionary iterator\n");
-			return OPSEC_SESSION_ERR;
-		}
-
-		/* loop over all entries */
-		while (pEntry = lea_dict_iter_next(pIter))
-		{
-			/* compare entry to "nbsession" */
-			if (!strcmp(pEntry->lea_d_name, "nbsession"))
-			{
-				/* save port number */
-				g_nSvcNbsession = pEntry->lea_d_value.ush_value;
-				printf("LeaDictionaryHandler: found entry for nbsession: port # is %d", g_nSvcNbsession);
-				lea_dict_iter_destroy(pIter);
-				pIter = NULL;
-				break;
-			}
+			/* save port number */
+			g_nSvcNbsession = value.ush_value;
+			printf("LeaDictionaryHandler: found entry for nbsession: port # is %d\n", g_nSvcNbsession);
 		}
-		
-		lea_dict_iter_destroy(pIter);
 		break;
 		
 	case LEA_VT_UDP_PORT:
 		/* look for "nbdatagram" and "nbname" */
-
-		/* do we have the ports already? */
-		if ((g_nSvcNbdatagram!=0) && (g_nSvcNbname!=0))
-			return OPSEC_SESSION_OK;
-
-		/* create iterator */
-		if ((pIter = lea_dict_iter_create(pSession, nDictId, 0))==NULL)		
+		if (g_nSvcNbdatagram==0 &&
+		    LeaResolveLookupName(pSession, nDictId, "nbdatagram", &value)==LEA_FOUND)
 		{
-			fprintf(stderr, "LeaDictionaryHandler: failed to create dictionary iterator\n");
-			return OPSEC_SESSION_ERR;
+			/* save port number */
+			g_nSvcNbdatagram = value.ush_value;
+			printf("LeaDictionaryHandler: found entry for nbdatagram: port # is %d\n", g_nSvcNbdatagram);
 		}
 
-		/* loop over all entries */
-		while (pEntry = lea_dict_iter_next(pIter))
+		if (g_nSvcNbname==0 &&
+		    LeaResolveLookupName(pSession, nDictId, "nbname", &value)==LEA_FOUND)
 		{
-			/* compare entry to "nbdatagram" and "nbname" */
-
-			/* nbdatagram */
-			if (g_nSvcNbdatagram==0)
-			{
-				if (!strcmp(pEntry->lea_d_name, "nbdatagram"))
-				{
-					/* save port number */
-					g_nSvcNbdatagram = pEntry->lea_d_value.ush_value;
-					printf("LeaDictionaryHandler: found entry for nbdatagram: port # is %d", g_nSvcNbdatagram);
-					lea_dict_iter_destroy(pIter);
-					pIter = NULL;
-					continue;
-				}
-			}
-
-			/* nbname */
-			if (g_nSvcNbname==0)
-			{
-				if (!strcmp(pEntry->lea_d_name, "nbname"))
-				{
-					/* save port number */
-					g_nSvcNbname = pEntry->lea_d_value.ush_value;
-					printf("LeaDictionaryHandler: found entry for nbname: port # is %d", g_nSvcNbname);
-					lea_dict_iter_destroy(pIter);
-					pIter = NULL;
-					break;
-				}
-			}
+			/* save port number */
+			g_nSvcNbname = value.ush_value;
+			printf("LeaDictionaryHandler: found entry for nbname: port # is %d\n", g_nSvcNbname);
 		}
 
-		if (pIter) lea_dict_iter_destroy(pIter);
-
 		/* do we have all information for the rulebase? */
 		if ((g_nSvcNbsession!=0) && (g_nSvcNbdatagram!=0) && (g_nSvcNbname!=0))
 		{
@@ -384,6 +344,7 @@ LeaEofHandler(OpsecSession *pSession)
 int
 LeaSwitchHandler(OpsecSession *pSession)
 {
+	LeaResolveInvalidate(pSession);
 	printf("The log file has been switched\n");
 	return OPSEC_SESSION_OK;
 }
@@ -0,0 +1,665 @@
+/***************************************************************************
+ *                                                                         *
+ * lea_resolve.c : Per-session LEA resolution cache                        *
+ *                                                                         *
+ * lea_attr_name() and lea_resolve_field() are called for every field of   *
+ * every record. This cache keeps their results for the session, so that   *
+ * after the first records an attribute name is an array lookup and a      *
+ * resolved value is a hash lookup:                                        *
+ *                                                                         *
+ *  - attribute names are kept in an array indexed by lea_attr_id.         *
+ *  - values of fields with a dictionary are kept by (dictionary, value),  *
+ *    values of fields without one only for types with a small domain      *
+ *    (actions, interfaces, protocols, ports...) by (attribute, value).    *
+ *    Strings, times and other fields are always passed to the library.    *
+ *                                                                         *
+ * The cache is filled lazily from the library calls, or, when created     *
+ * eager, by reading each dictionary with lea_dict_iter_* as it arrives.   *
+ * A preloaded dictionary resolves a value to its entry name and can also  *
+ * be searched by name (LeaResolveLookupName) instead of being scanned.    *
+ *                                                                         *
+ * The cache is kept in the session opaque. The application should call    *
+ * LeaResolveDictChanged() from its LEA_DICT_HANDLER and                   *
+ * LeaResolveInvalidate() from its LEA_SWITCH_HANDLER. Entries and names   *
+ * are allocated from blocks which are reused after the cache is flushed.  *
+ *                                                                         *
+ * The strings returned stay valid until the next record: a full cache is  *
+ * only flushed by LeaResolveNewRecord(), which the LEA_RECORD_HANDLER     *
+ * calls before it resolves anything. Until then, values which do not fit  *
+ * are passed to the library without being cached.                         *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "lea_resolve.h"
+
+#define CACHE(pSession) ((LeaResolveCache *)SESSION_OPAQUE(pSession))
+
+/*
+ * Function prototypes
+ */
+static void              Flush(LeaResolveCache *pCache);
+static void            * Alloc(LeaResolveCache *pCache, int nSize);
+static char            * Intern(LeaResolveCache *pCache, char *szStr);
+static int               ValueKey(LEA_VT nType, lea_value_t *pValue, unsigned int *pulKey);
+static void              SetValue(LEA_VT nType, unsigned int ulKey, lea_value_t *pValue);
+static int               SmallDomain(LEA_VT nType);
+static unsigned long     ValueHash(int nDict, int nAttr, LEA_VT nType, unsigned int ulValue);
+static unsigned long     NameHash(int nDict, char *szName);
+static LeaResolveEntry * AddEntry(LeaResolveCache *pCache, int nDict, int nAttr, LEA_VT nType,
+                                  unsigned int ulValue, char *szName, int bByName);
+static int               SetAttrName(LeaResolveCache *pCache, int nAttrId, char *szName);
+static int               LoadDict(LeaResolveCache *pCache, OpsecSession *pSession, int nDictId);
+static int               ScanDict(OpsecSession *pSession, int nDictId, char *szName, lea_value_t *pValue);
+
+
+/*
+ * Creates a resolution cache for the session, holding up to nMaxEntries
+ * resolved values. Should be called from the OPSEC_SESSION_START_HANDLER.
+ */
+LeaResolveCache *
+LeaResolveAttach(OpsecSession *pSession, int nMaxEntries, int bEager)
+{
+	LeaResolveCache *pCache;
+
+	if (nMaxEntries < 1)
+	{
+		fprintf(stderr, "LeaResolveAttach: invalid parameters\n");
+		return NULL;
+	}
+
+	if ((pCache = (LeaResolveCache *)calloc(1, sizeof(LeaResolveCache))) == NULL)
+	{
+		fprintf(stderr, "LeaResolveAttach: out of memory\n");
+		return NULL;
+	}
+
+	pCache->nMaxEntries = nMaxEntries;
+	pCache->bEager      = bEager;
+	pCache->nBuckets    = 64;
+	while (pCache->nBuckets < nMaxEntries)
+		pCache->nBuckets *= 2;
+
+	pCache->ppBuckets     = (LeaResolveEntry **)calloc(pCache->nBuckets, sizeof(LeaResolveEntry *));
+	pCache->ppNameBuckets = (LeaResolveEntry **)calloc(pCache->nBuckets, sizeof(LeaResolveEntry *));
+	if (!pCache->ppBuckets || !pCache->ppNameBuckets)
+	{
+		fprintf(stderr, "LeaResolveAttach: out of memory\n");
+		if (pCache->ppBuckets) free(pCache->ppBuckets);
+		if (pCache->ppNameBuckets) free(pCache->ppNameBuckets);
+		free(pCache);
+		return NULL;
+	}
+
+	SESSION_OPAQUE(pSession) = pCache;
+	return pCache;
+}
+
+/*
+ * Frees the session's resolution cache.
+ * Should be called from the OPSEC_SESSION_END_HANDLER.
+ */
+void
+LeaResolveDetach(OpsecSession *pSession)
+{
+	LeaResolveCache *pCache = CACHE(pSession);
+	LeaResolveBlock *pBlock;
+
+	if (!pCache)
+		return;
+
+	while ((pBlock = pCache->pBlocks) != NULL)
+	{
+		pCache->pBlocks = pBlock->pNext;
+		free(pBlock->pData);
+		free(pBlock);
+	}
+
+	if (pCache->ppAttrNames) free(pCache->ppAttrNames);
+	free(pCache->ppBuckets);
+	free(pCache->ppNameBuckets);
+	free(pCache);
+
+	SESSION_OPAQUE(pSession) = NULL;
+}
+
+/*
+ * Drops everything the cache holds.
+ */
+void
+LeaResolveInvalidate(OpsecSession *pSession)
+{
+	LeaResolveCache *pCache = CACHE(pSession);
+
+	if (pCache)
+		Flush(pCache);
+}
+
+/*
+ * Flushes the cache if it is full. Should be called from the
+ * LEA_RECORD_HANDLER before the fields are resolved, as the strings of
+ * the previous record are no longer in use then.
+ */
+void
+LeaResolveNewRecord(OpsecSession *pSession)
+{
+	LeaResolveCache *pCache = CACHE(pSession);
+
+	if (pCache && pCache->nEntries >= pCache->nMaxEntries)
+		Flush(pCache);
+}
+
+/*
+ * Drops the values of a dictionary which has been (re)sent, and reads
+ * it again if the cache is eager.
+ */
+void
+LeaResolveDictChanged(OpsecSession *pSession, int nDictId, LEA_VT nValType)
+{
+	LeaResolveCache *pCache = CACHE(pSession);
+	LeaResolveEntry **ppEntry;
+	int i;
+
+	if (!pCache)
+		return;
+
+	for (i=0; i<pCache->nBuckets; i++)
+	{
+		ppEntry = &pCache->ppBuckets[i];
+		while (*ppEntry)
+		{
+			if ((*ppEntry)->nDict == nDictId)
+			{
+				*ppEntry = (*ppEntry)->pNext;
+				pCache->nEntries--;
+			}
+			else
+				ppEntry = &(*ppEntry)->pNext;
+		}
+
+		ppEntry = &pCache->ppNameBuckets[i];
+		while (*ppEntry)
+		{
+			if ((*ppEntry)->nDict == nDictId)
+				*ppEntry = (*ppEntry)->pNameNext;
+			else
+				ppEntry = &(*ppEntry)->pNameNext;
+		}
+	}
+
+	if (nDictId == LEA_ATTRIB_ID && pCache->ppAttrNames)
+		memset(pCache->ppAttrNames, 0, pCache->nAttrNames * sizeof(char *));
+
+	if (nDictId >= 0 && nDictId < LEA_RESOLVE_MAX_DICTS)
+	{
+		pCache->anDictType[nDictId]   = nValType;
+		pCache->abDictLoaded[nDictId] = 0;
+		if (pCache->bEager)
+			LoadDict(pCache, pSession, nDictId);
+	}
+}
+
+/*
+ * Returns the name of an attribute, as lea_attr_name() does.
+ */
+char *
+LeaResolveAttr(OpsecSession *pSession, int nAttrId)
+{
+	LeaResolveCache *pCache = CACHE(pSession);
+	char *szName;
+
+	if (!pCache || nAttrId < 0)
+		return lea_attr_name(pSession, nAttrId);
+
+	if (nAttrId < pCache->nAttrNames && pCache->ppAttrNames[nAttrId])
+	{
+		pCache->nAttrHits++;
+		return pCache->ppAttrNames[nAttrId];
+	}
+
+	pCache->nAttrMisses++;
+	if ((szName = lea_attr_name(pSession, nAttrId)) == NULL)
+		return NULL;
+
+	if (SetAttrName(pCache, nAttrId, szName) != OPSEC_SESSION_OK)
+		return szName;
+
+	return pCache->ppAttrNames[nAttrId];
+}
+
+/*
+ * Returns the formatted value of a field, as lea_resolve_field() does.
+ */
+char *
+LeaResolveField(OpsecSession *pSession, lea_field *pField)
+{
+	LeaResolveCache *pCache = CACHE(pSession);
+	LeaResolveEntry *pEntry;
+	unsigned int ulValue;
+	int nDict = pField->lea_dictionary;
+	int nAttr = -1;
+	char *szName;
+
+	if (!pCache)
+		return lea_resolve_field(pSession, *pField);
+
+	if (!ValueKey(pField->lea_val_type, &pField->lea_value, &ulValue) ||
+	    (nDict == LEA_NO_DICT && !SmallDomain(pField->lea_val_type)))
+	{
+		pCache->nUncached++;
+		return lea_resolve_field(pSession, *pField);
+	}
+
+	if (nDict == LEA_NO_DICT)
+		nAttr = pField->lea_attr_id;
+
+	for (pEntry = pCache->ppBuckets[ValueHash(nDict, nAttr, pField->lea_val_type, ulValue) & (pCache->nBuckets-1)];
+	     pEntry;
+	     pEntry = pEntry->pNext)
+	{
+		if (pEntry->ulValue == ulValue && pEntry->nDict == nDict &&
+		    pEntry->nAttr == nAttr && pEntry->nType == pField->lea_val_type)
+		{
+			pCache->nValueHits++;
+			return pEntry->szName;
+		}
+	}
+
+	pCache->nValueMisses++;
+	if ((szName = lea_resolve_field(pSession, *pField)) == NULL)
+		return NULL;
+
+	/* a full cache is flushed on the next record (see LeaResolveNewRecord) */
+	if (pCache->nEntries >= pCache->nMaxEntries)
+	{
+		pCache->nUncached++;
+		return szName;
+	}
+
+	if ((pEntry = AddEntry(pCache, nDict, nAttr, pField->lea_val_type, ulValue, szName, 0)) == NULL)
+		return szName;
+
+	return pEntry->szName;
+}
+
+/*
+ * Looks a dictionary entry up by name. The dictionary is preloaded on
+ * first use; if it can not be, it is scanned.
+ * Returns LEA_FOUND and the entry value in pValue, or LEA_NOT_FOUND.
+ */
+int
+LeaResolveLookupName(OpsecSession *pSession, int nDictId, char *szName, lea_value_t *pValue)
+{
+	LeaResolveCache *pCache = CACHE(pSession);
+	LeaResolveEntry *pEntry;
+	unsigned long nHash;
+
+	if (!pCache || nDictId < 0 || nDictId >= LEA_RESOLVE_MAX_DICTS ||
+	    pCache->anDictType[nDictId] == LEA_VT_NONE)
+		return ScanDict(pSession, nDictId, szName, pValue);
+
+	if (!pCache->abDictLoaded[nDictId] && LoadDict(pCache, pSession, nDictId) != OPSEC_SESSION_OK)
+		return ScanDict(pSession, nDictId, szName, pValue);
+
+	nHash = NameHash(nDictId, szName);
+	for (pEntry = pCache->ppNameBuckets[nHash & (pCache->nBuckets-1)]; pEntry; pEntry = pEntry->pNameNext)
+	{
+		if (pEntry->nNameHash == nHash && pEntry->nDict == nDictId && !strcmp(pEntry->szName, szName))
+		{
+			SetValue(pEntry->nType, pEntry->ulValue, pValue);
+			return LEA_FOUND;
+		}
+	}
+
+	return LEA_NOT_FOUND;
+}
+
+void
+LeaResolvePrintStats(OpsecSession *pSession)
+{
+	LeaResolveCache *pCache = CACHE(pSession);
+
+	if (!pCache)
+		return;
+
+	printf("Resolution cache: attributes %ld hits %ld misses, values %ld hits %ld misses %ld uncached, "
+	       "%d entries, %ld flushes\n",
+	       pCache->nAttrHits, pCache->nAttrMisses, pCache->nValueHits, pCache->nValueMisses,
+	       pCache->nUncached, pCache->nEntries, pCache->nFlushes);
+}
+
+/*
+ * Empties the cache, keeping the storage blocks for reuse.
+ */
+static void
+Flush(LeaResolveCache *pCache)
+{
+	LeaResolveBlock *pBlock;
+
+	memset(pCache->ppBuckets, 0, pCache->nBuckets * sizeof(LeaResolveEntry *));
+	memset(pCache->ppNameBuckets, 0, pCache->nBuckets * sizeof(LeaResolveEntry *));
+	if (pCache->ppAttrNames)
+		memset(pCache->ppAttrNames, 0, pCache->nAttrNames * sizeof(char *));
+	memset(pCache->abDictLoaded, 0, sizeof(pCache->abDictLoaded));
+
+	for (pBlock = pCache->pBlocks; pBlock; pBlock = pBlock->pNext)
+		pBlock->nUsed = 0;
+	pCache->pCurBlock = pCache->pBlocks;
+
+	pCache->nEntries = 0;
+	pCache->nFlushes++;
+}
+
+static void *
+Alloc(LeaResolveCache *pCache, int nSize)
+{
+	LeaResolveBlock *pBlock = pCache->pCurBlock;
+	LeaResolveBlock *pNew;
+	void *p;
+
+	nSize = (nSize + 7) & ~7;
+
+	/* move on to the next block which has room */
+	while (pBlock && pBlock->nUsed + nSize > pBlock->nSize)
+	{
+		pBlock = pBlock->pNext;
+		if (pBlock)
+			pCache->pCurBlock = pBlock;
+	}
+
+	if (!pBlock)
+	{
+		if ((pNew = (LeaResolveBlock *)calloc(1, sizeof(LeaResolveBlock))) == NULL)
+			return NULL;
+		pNew->nSize = (nSize > LEA_RESOLVE_BLOCK_SIZE ? nSize : LEA_RESOLVE_BLOCK_SIZE);
+		if ((pNew->pData = (char *)malloc(pNew->nSize)) == NULL)
+		{
+			free(pNew);
+			return NULL;
+		}
+
+		/* blocks are appended, so a flush reuses them in order */
+		if (pCache->pCurBlock)
+		{
+			while (pCache->pCurBlock->pNext)
+				pCache->pCurBlock = pCache->pCurBlock->pNext;
+			pCache->pCurBlock->pNext = pNew;
+		}
+		else
+			pCache->pBlocks = pNew;
+		pCache->pCurBlock = pBlock = pNew;
+	}
+
+	p = pBlock->pData + pBlock->nUsed;
+	pBlock->nUsed += nSize;
+	return p;
+}
+
+static char *
+Intern(LeaResolveCache *pCache, char *szStr)
+{
+	char *szCopy;
+
+	if ((szCopy = (char *)Alloc(pCache, strlen(szStr) + 1)) == NULL)
+		return NULL;
+
+	strcpy(szCopy, szStr);
+	return szCopy;
+}
+
+/*
+ * Extracts a scalar value. Returns 0 for strings and other values which
+ * are not kept in the cache.
+ */
+static int
+ValueKey(LEA_VT nType, lea_value_t *pValue, unsigned int *pulKey)
+{
+	switch (nType)
+	{
+	case LEA_VT_DIRECTION:
+	case LEA_VT_IP_PROTO:
+		*pulKey = pValue->uch_value;
+		return 1;
+
+	case LEA_VT_TCP_PORT:
+	case LEA_VT_UDP_PORT:
+	case LEA_VT_USHORT:
+		*pulKey = pValue->ush_value;
+		return 1;
+
+	case LEA_VT_ACTION:
+	case LEA_VT_INTERFACE:
+	case LEA_VT_ALERT:
+	case LEA_VT_RULE:
+	case LEA_VT_INT:
+		*pulKey = (unsigned int)pValue->i_value;
+		return 1;
+
+	case LEA_VT_IP_ADDR:
+	case LEA_VT_RPC_PROG:
+	case LEA_VT_HEX:
+	case LEA_VT_TIME:
+	case LEA_VT_MASK:
+	case LEA_VT_DURATION_TIME:
+		*pulKey = pValue->ul_value;
+		return 1;
+
+	default:
+		return 0;
+	}
+}
+
+static void
+SetValue(LEA_VT nType, unsigned int ulKey, lea_value_t *pValue)
+{
+	memset(pValue, 0, sizeof(lea_value_t));
+
+	switch (nType)
+	{
+	case LEA_VT_DIRECTION:
+	case LEA_VT_IP_PROTO:
+		pValue->uch_value = (unsigned char)ulKey;
+		break;
+
+	case LEA_VT_TCP_PORT:
+	case LEA_VT_UDP_PORT:
+	case LEA_VT_USHORT:
+		pValue->ush_value = (unsigned short)ulKey;
+		break;
+
+	case LEA_VT_ACTION:
+	case LEA_VT_INTERFACE:
+	case LEA_VT_ALERT:
+	case LEA_VT_RULE:
+	case LEA_VT_INT:
+		pValue->i_value = (int)ulKey;
+		break;
+
+	default:
+		pValue->ul_value = ulKey;
+		break;
+	}
+}
+
+/*
+ * Types whose values can be cached without a dictionary.
+ */
+static int
+SmallDomain(LEA_VT nType)
+{
+	switch (nType)
+	{
+	case LEA_VT_ACTION:
+	case LEA_VT_INTERFACE:
+	case LEA_VT_ALERT:
+	case LEA_VT_RULE:
+	case LEA_VT_DIRECTION:
+	case LEA_VT_IP_PROTO:
+	case LEA_VT_TCP_PORT:
+	case LEA_VT_UDP_PORT:
+		return 1;
+
+	default:
+		return 0;
+	}
+}
+
+static unsigned long
+ValueHash(int nDict, int nAttr, LEA_VT nType, unsigned int ulValue)
+{
+	unsigned long h = (unsigned long)ulValue * 2654435761UL;
+
+	h ^= ((unsigned long)(nDict + 1) << 20) ^ ((unsigned long)(nAttr + 1) << 8) ^ (unsigned long)nType;
+	return h ^ (h >> 15);
+}
+
+static unsigned long
+NameHash(int nDict, char *szName)
+{
+	unsigned long h = 2166136261UL ^ (unsigned long)nDict;
+
+	while (*szName)
+		h = (h ^ (unsigned char)*szName++) * 16777619UL;
+
+	return h;
+}
+
+static LeaResolveEntry *
+AddEntry(LeaResolveCache *pCache, int nDict, int nAttr, LEA_VT nType,
+         unsigned int ulValue, char *szName, int bByName)
+{
+	LeaResolveEntry *pEntry;
+	unsigned long nHash;
+
+	if ((pEntry = (LeaResolveEntry *)Alloc(pCache, sizeof(LeaResolveEntry))) == NULL ||
+	    (pEntry->szName = Intern(pCache, szName)) == NULL)
+	{
+		fprintf(stderr, "AddEntry: out of memory\n");
+		return NULL;
+	}
+
+	pEntry->nDict     = nDict;
+	pEntry->nAttr     = nAttr;
+	pEntry->nType     = nType;
+	pEntry->ulValue   = ulValue;
+	pEntry->pNameNext = NULL;
+
+	nHash = ValueHash(nDict, nAttr, nType, ulValue) & (pCache->nBuckets-1);
+	pEntry->pNext = pCache->ppBuckets[nHash];
+	pCache->ppBuckets[nHash] = pEntry;
+
+	if (bByName)
+	{
+		pEntry->nNameHash = NameHash(nDict, szName);
+		nHash = pEntry->nNameHash & (pCache->nBuckets-1);
+		pEntry->pNameNext = pCache->ppNameBuckets[nHash];
+		pCache->ppNameBuckets[nHash] = pEntry;
+	}
+
+	pCache->nEntries++;
+	return pEntry;
+}
+
+static int
+SetAttrName(LeaResolveCache *pCache, int nAttrId, char *szName)
+{
+	char **ppNames;
+	int nSize;
+
+	if (nAttrId >= pCache->nAttrNames)
+	{
+		nSize = (pCache->nAttrNames ? pCache->nAttrNames : 64);
+		while (nSize <= nAttrId)
+			nSize *= 2;
+
+		if ((ppNames = (char **)realloc(pCache->ppAttrNames, nSize * sizeof(char *))) == NULL)
+		{
+			fprintf(stderr, "SetAttrName: out of memory\n");
+			return OPSEC_SESSION_ERR;
+		}
+		memset(ppNames + pCache->nAttrNames, 0, (nSize - pCache->nAttrNames) * sizeof(char *));
+		pCache->ppAttrNames = ppNames;
+		pCache->nAttrNames  = nSize;
+	}
+
+	if ((pCache->ppAttrNames[nAttrId] = Intern(pCache, szName)) == NULL)
+	{
+		fprintf(stderr, "SetAttrName: out of memory\n");
+		return OPSEC_SESSION_ERR;
+	}
+
+	return OPSEC_SESSION_OK;
+}
+
+/*
+ * Reads all the entries of a dictionary into the cache. The entries of
+ * the attributes dictionary also fill the attribute names.
+ */
+static int
+LoadDict(LeaResolveCache *pCache, OpsecSession *pSession, int nDictId)
+{
+	lea_dict_iter *pIter;
+	lea_dict_entry *pEntry;
+	LEA_VT nType = pCache->anDictType[nDictId];
+	unsigned int ulValue;
+
+	if (nDictId == LEA_ATTRIB_ID)
+		nType = LEA_VT_INT;
+
+	if ((pIter = lea_dict_iter_create(pSession, nDictId, 0)) == NULL)
+		return OPSEC_SESSION_ERR;
+
+	while ((pEntry = lea_dict_iter_next(pIter)) != NULL)
+	{
+		if (!pEntry->lea_d_name || !ValueKey(nType, &pEntry->lea_d_value, &ulValue))
+			continue;
+
+		if (pCache->nEntries >= pCache->nMaxEntries)
+		{
+			fprintf(stderr, "LoadDict: dictionary %d does not fit into the cache\n", nDictId);
+			lea_dict_iter_destroy(pIter);
+			return OPSEC_SESSION_ERR;
+		}
+
+		if (AddEntry(pCache, nDictId, -1, nType, ulValue, pEntry->lea_d_name, 1) == NULL ||
+		    (nDictId == LEA_ATTRIB_ID && pEntry->lea_d_attrib >= 0 &&
+		     SetAttrName(pCache, pEntry->lea_d_attrib, pEntry->lea_d_name) != OPSEC_SESSION_OK))
+		{
+			lea_dict_iter_destroy(pIter);
+			return OPSEC_SESSION_ERR;
+		}
+	}
+
+	lea_dict_iter_destroy(pIter);
+	pCache->abDictLoaded[nDictId] = 1;
+	return OPSEC_SESSION_OK;
+}
+
+/*
+ * Looks a dictionary entry up by name without the cache.
+ */
+static int
+ScanDict(OpsecSession *pSession, int nDictId, char *szName, lea_value_t *pValue)
+{
+	lea_dict_iter *pIter;
+	lea_dict_entry *pEntry;
+	int rc = LEA_NOT_FOUND;
+
+	if ((pIter = lea_dict_iter_create(pSession, nDictId, 0)) == NULL)
+		return LEA_NOT_FOUND;
+
+	while ((pEntry = lea_dict_iter_next(pIter)) != NULL)
+	{
+		if (pEntry->lea_d_name && !strcmp(pEntry->lea_d_name, szName))
+		{
+			*pValue = pEntry->lea_d_value;
+			rc = LEA_FOUND;
+			break;
+		}
+	}
+
+	lea_dict_iter_destroy(pIter);
+	return rc;
+}
@@ -0,0 +1,81 @@
+#ifndef _LEA_RESOLVE_H_
+#define _LEA_RESOLVE_H_
+
+/***************************************************************************
+ *                                                                         *
+ * lea_resolve.h : Per-session LEA resolution cache                        *
+ *                                                                         *
+ * See lea_resolve.c for further explanations.                             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "opsec/lea.h"
+#include "opsec/opsec.h"
+
+#define LEA_RESOLVE_MAX_DICTS    64      /* dictionary ids which can be preloaded */
+#define LEA_RESOLVE_BLOCK_SIZE   16384   /* string and entry storage block        */
+
+/*
+ * A resolved value. Values of dictionary fields are shared by all the
+ * attributes using the dictionary (nAttr is -1), values of other fields
+ * are kept per attribute.
+ */
+typedef struct _LeaResolveEntry {
+	int                       nDict;
+	int                       nAttr;
+	LEA_VT                    nType;
+	unsigned int              ulValue;
+	char                     *szName;
+	unsigned long             nNameHash;
+	struct _LeaResolveEntry  *pNext;          /* value hash chain                   */
+	struct _LeaResolveEntry  *pNameNext;      /* name hash chain, preloaded entries */
+} LeaResolveEntry;
+
+/*
+ * Storage for entries and names, reused after the cache is flushed.
+ */
+typedef struct _LeaResolveBlock {
+	struct _LeaResolveBlock  *pNext;
+	int                       nSize;
+	int                       nUsed;
+	char                     *pData;
+} LeaResolveBlock;
+
+typedef struct _LeaResolveCache {
+	char                    **ppAttrNames;    /* indexed by lea_attr_id             */
+	int                       nAttrNames;
+
+	LeaResolveEntry         **ppBuckets;
+	LeaResolveEntry         **ppNameBuckets;
+	int                       nBuckets;       /* power of 2                         */
+	int                       nEntries;
+	int                       nMaxEntries;
+
+	LEA_VT                    anDictType[LEA_RESOLVE_MAX_DICTS];
+	char                      abDictLoaded[LEA_RESOLVE_MAX_DICTS];
+	int                       bEager;         /* preload on dictionary events       */
+
+	LeaResolveBlock          *pBlocks;
+	LeaResolveBlock          *pCurBlock;
+
+	/* statistics */
+	long                      nAttrHits;
+	long                      nAttrMisses;
+	long                      nValueHits;
+	long                      nValueMisses;
+	long                      nUncached;
+	long                      nFlushes;
+} LeaResolveCache;
+
+LeaResolveCache * LeaResolveAttach(OpsecSession *pSession, int nMaxEntries, int bEager);
+void              LeaResolveDetach(OpsecSession *pSession);
+void              LeaResolveInvalidate(OpsecSession *pSession);
+void              LeaResolveNewRecord(OpsecSession *pSession);
+void              LeaResolveDictChanged(OpsecSession *pSession, int nDictId, LEA_VT nValType);
+char            * LeaResolveAttr(OpsecSession *pSession, int nAttrId);
+char            * LeaResolveField(OpsecSession *pSession, lea_field *pField);
+int               LeaResolveLookupName(OpsecSession *pSession, int nDictId, char *szName,
+                                       lea_value_t *pValue);
+void              LeaResolvePrintStats(OpsecSession *pSession);
+
+#endif
@@ -0,0 +1,797 @@
+/***************************************************************************
+ *                                                                         *
+ * lea_rules.c : LEA filter rulebase compiler                              *
+ *                                                                         *
+ * Compiles a text file of filter rules into a LeaFilterRulebase, so that  *
+ * filters can be changed without rebuilding the LEA client. Rules are     *
+ * applied in the order they appear; a record matching no rule is          *
+ * dropped. One rule per line, '#' starts a comment:                       *
+ *                                                                         *
+ *   register server | local | auto                                        *
+ *   pass | drop [if <condition> [and <condition>]...]                     *
+ *   pass_fields | drop_fields <field>[,<field>]... [if ...]               *
+ *                                                                         *
+ * A condition is                                                          *
+ *                                                                         *
+ *   [not] <field> exists                                                  *
+ *   [not] <field> = | != | < | <= | > | >= <type>:<value>                 *
+ *   [not] <field> in <type>:{<value>[, <value>]...}                       *
+ *   [not] <field> in <type>:<low>..<high>                                 *
+ *   [not] <field> in mask:<address>/<mask>                                *
+ *   [not] <field> contains <string>                                       *
+ *                                                                         *
+ * Types are string, istring, int, ip, proto (tcp, udp, icmp or a number), *
+ * tcp_port, udp_port, service, service_group, host, host_group and        *
+ * user_group. Values with spaces or special characters are quoted.        *
+ * For example:                                                            *
+ *                                                                         *
+ *   drop if service in service:{nbdatagram, nbsession} \                  *
+ *        and dest in mask:0.0.0.255/0.0.0.255                             *
+ *   pass if proto = proto:udp                                             *
+ *                                                                         *
+ * A line ending with a backslash is continued on the next line.           *
+ *                                                                         *
+ * "register" selects where the rulebase is applied. Rules applied by the  *
+ * LEA server cut the number of records sent to the client, so "server"    *
+ * is the default. "auto" registers with the server and falls back to      *
+ * local filtering if the server rejects the rulebase.                     *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include "lea_rules.h"
+
+#ifdef WIN32
+#	include <winsock.h>
+#else
+#	include <netinet/in.h>
+#	include <arpa/inet.h>
+#endif
+
+/*
+ * Tokens
+ */
+#define TOK_END      0
+#define TOK_WORD     1
+#define TOK_STRING   2
+#define TOK_PUNCT    3
+
+/*
+ * Kinds of values
+ */
+#define KIND_STRING  0
+#define KIND_INT     1
+#define KIND_IP      2
+#define KIND_PROTO   3
+#define KIND_MASK    4
+
+typedef struct _RulesLexer {
+	char   *szFile;
+	int     nLine;
+	char   *p;
+	int     nTok;
+	char    szTok[LEA_RULES_TOKEN_LEN];
+} RulesLexer;
+
+typedef struct _RulesType {
+	char   *szName;
+	LEA_VT  nType;
+	int     nKind;
+} RulesType;
+
+static RulesType g_aTypes[] = {
+	{ "string",        LEA_VT_STRING,          KIND_STRING },
+	{ "istring",       LEA_VT_ISTRING,         KIND_STRING },
+	{ "int",           LEA_VT_INT,             KIND_INT    },
+	{ "ip",            LEA_VT_IP_ADDR,         KIND_IP     },
+	{ "proto",         LEA_VT_IP_PROTO,        KIND_PROTO  },
+	{ "tcp_port",      LEA_VT_TCP_PORT,        KIND_INT    },
+	{ "udp_port",      LEA_VT_UDP_PORT,        KIND_INT    },
+	{ "service",       LEA_VT_SR_SERVICE,      KIND_STRING },
+	{ "service_group", LEA_VT_SR_SERVICEGROUP, KIND_STRING },
+	{ "host",          LEA_VT_SR_HOSTNAME,     KIND_STRING },
+	{ "host_group",    LEA_VT_SR_HOSTGROUP,    KIND_STRING },
+	{ "user_group",    LEA_VT_SR_USERGROUP,    KIND_STRING },
+	{ "mask",          LEA_VT_IP_ADDR,         KIND_MASK   },
+	{ NULL,            LEA_VT_NONE,            0           }
+};
+
+/*
+ * Function prototypes
+ */
+static int                  NextToken(RulesLexer *pLex);
+static int                  IsWord(RulesLexer *pLex, char *szWord);
+static int                  IsPunct(RulesLexer *pLex, char *szPunct);
+static void                 ParseError(RulesLexer *pLex, char *szMsg);
+static int                  ParseLine(RulesLexer *pLex, LeaRules *pRules);
+static LeaFilterRule      * ParseRule(RulesLexer *pLex, eLeaFilterRuleAction nAction);
+static LeaFilterPredicate * ParseCondition(RulesLexer *pLex);
+static RulesType          * ParseType(RulesLexer *pLex);
+static lea_value_ex_t     * MakeValue(RulesLexer *pLex, RulesType *pType, char *szValue);
+static int                  ParseAddress(RulesLexer *pLex, char *szValue, unsigned int *pnAddr);
+
+
+/*
+ * Reads and compiles a rules file.
+ * Returns NULL (after printing the reason) if the file has errors.
+ */
+LeaRules *
+LeaRulesLoad(char *szFile)
+{
+	LeaRules   *pRules;
+	RulesLexer  lex;
+	FILE       *pFile;
+	char        szLine[LEA_RULES_MAX_LINE];
+	int         nErrors = 0;
+	int         nLen    = 0;
+
+	if ((pFile = fopen(szFile, "r")) == NULL)
+	{
+		fprintf(stderr, "LeaRulesLoad: failed to open %s\n", szFile);
+		return NULL;
+	}
+
+	if ((pRules = (LeaRules *)calloc(1, sizeof(LeaRules))) == NULL ||
+	    (pRules->pRbase = lea_filter_rulebase_create()) == NULL)
+	{
+		fprintf(stderr, "LeaRulesLoad: failed to create rulebase object\n");
+		if (pRules) free(pRules);
+		fclose(pFile);
+		return NULL;
+	}
+	pRules->nMode = LEA_RULES_SERVER;
+
+	memset(&lex, 0, sizeof(lex));
+	lex.szFile = szFile;
+
+	while (fgets(szLine + nLen, sizeof(szLine) - nLen, pFile))
+	{
+		lex.nLine++;
+
+		nLen = strlen(szLine);
+		while (nLen > 0 && (szLine[nLen-1] == '\n' || szLine[nLen-1] == '\r'))
+			szLine[--nLen] = '\0';
+
+		/* a line ending with a backslash continues on the next one */
+		if (nLen > 0 && szLine[nLen-1] == '\\' && nLen < (int)sizeof(szLine) - 1)
+		{
+			szLine[nLen-1] = ' ';
+			continue;
+		}
+
+		lex.p = szLine;
+		if (ParseLine(&lex, pRules) != OPSEC_SESSION_OK)
+			nErrors++;
+		nLen = 0;
+	}
+	fclose(pFile);
+
+	if (nErrors)
+	{
+		fprintf(stderr, "LeaRulesLoad: %d errors in %s\n", nErrors, szFile);
+		LeaRulesDestroy(pRules);
+		return NULL;
+	}
+
+	return pRules;
+}
+
+void
+LeaRulesDestroy(LeaRules *pRules)
+{
+	if (!pRules)
+		return;
+
+	if (pRules->pRbase) lea_filter_rulebase_destroy(pRules->pRbase);
+	free(pRules);
+}
+
+/*
+ * Registers the rulebase where the file asked for. Returns
+ * LEA_RULES_PENDING if the result will arrive with the
+ * LEA_FILTER_QUERY_ACK event; pass it to LeaRulesAck() then.
+ */
+int
+LeaRulesRegister(OpsecSession *pSession, LeaRules *pRules)
+{
+	if (pRules->nMode == LEA_RULES_LOCAL)
+	{
+		if (lea_filter_rulebase_register_local(pSession, pRules->pRbase) != OPSEC_SESSION_OK)
+		{
+			fprintf(stderr, "LeaRulesRegister: failed to register the rulebase locally\n");
+			return OPSEC_SESSION_ERR;
+		}
+		pRules->bLocal = 1;
+		return OPSEC_SESSION_OK;
+	}
+
+	if (lea_filter_rulebase_register(pSession, pRules->pRbase, &pRules->nFilterId) != OPSEC_SESSION_OK)
+	{
+		fprintf(stderr, "LeaRulesRegister: failed to send the rulebase to the server\n");
+		return (pRules->nMode == LEA_RULES_AUTO ? LeaRulesAck(pSession, pRules, OPSEC_SESSION_ERR)
+		                                        : OPSEC_SESSION_ERR);
+	}
+
+	return LEA_RULES_PENDING;
+}
+
+/*
+ * Handles the server's answer to the registration. In auto mode a
+ * rejected rulebase is registered locally instead.
+ */
+int
+LeaRulesAck(OpsecSession *pSession, LeaRules *pRules, int nResult)
+{
+	if (nResult == OPSEC_SESSION_OK)
+	{
+		pRules->bOnServer = 1;
+		return OPSEC_SESSION_OK;
+	}
+
+	if (pRules->nMode != LEA_RULES_AUTO)
+	{
+		fprintf(stderr, "LeaRulesAck: the server rejected the rulebase (%d)\n", nResult);
+		return OPSEC_SESSION_ERR;
+	}
+
+	printf("LeaRulesAck: the server did not accept the rulebase (%d), filtering locally\n", nResult);
+	if (lea_filter_rulebase_register_local(pSession, pRules->pRbase) != OPSEC_SESSION_OK)
+	{
+		fprintf(stderr, "LeaRulesAck: failed to register the rulebase locally\n");
+		return OPSEC_SESSION_ERR;
+	}
+
+	pRules->bLocal = 1;
+	return OPSEC_SESSION_OK;
+}
+
+/*
+ * Reads the next token of the line into pLex->szTok.
+ */
+static int
+NextToken(RulesLexer *pLex)
+{
+	char *p = pLex->p;
+	int n = 0;
+
+	while (*p && isspace((unsigned char)*p))
+		p++;
+
+	if (!*p || *p == '#')
+	{
+		pLex->p = p;
+		pLex->szTok[0] = '\0';
+		return (pLex->nTok = TOK_END);
+	}
+
+	if (*p == '"')
+	{
+		p++;
+		while (*p && *p != '"' && n < LEA_RULES_TOKEN_LEN-1)
+			pLex->szTok[n++] = *p++;
+		if (*p != '"')
+		{
+			pLex->p = p + strlen(p);
+			pLex->szTok[0] = '\0';
+			ParseError(pLex, "unterminated or too long string");
+			return (pLex->nTok = TOK_END);
+		}
+		pLex->szTok[n] = '\0';
+		pLex->p = p + 1;
+		return (pLex->nTok = TOK_STRING);
+	}
+
+	if (isalnum((unsigned char)*p) || strchr("_/.-*@", *p))
+	{
+		while (*p && (isalnum((unsigned char)*p) || strchr("_/.-*@", *p)) && n < LEA_RULES_TOKEN_LEN-1)
+			pLex->szTok[n++] = *p++;
+		pLex->szTok[n] = '\0';
+		pLex->p = p;
+		return (pLex->nTok = TOK_WORD);
+	}
+
+	/* punctuation: one character, or two for != <= >= */
+	pLex->szTok[n++] = *p++;
+	if (*p == '=' && strchr("!<>", pLex->szTok[0]))
+		pLex->szTok[n++] = *p++;
+	pLex->szTok[n] = '\0';
+	pLex->p = p;
+	return (pLex->nTok = TOK_PUNCT);
+}
+
+static int
+IsWord(RulesLexer *pLex, char *szWord)
+{
+	return (pLex->nTok == TOK_WORD && !strcmp(pLex->szTok, szWord));
+}
+
+static int
+IsPunct(RulesLexer *pLex, char *szPunct)
+{
+	return (pLex->nTok == TOK_PUNCT && !strcmp(pLex->szTok, szPunct));
+}
+
+static void
+ParseError(RulesLexer *pLex, char *szMsg)
+{
+	if (pLex->szTok[0])
+		fprintf(stderr, "%s:%d: %s near \"%s\"\n", pLex->szFile, pLex->nLine, szMsg, pLex->szTok);
+	else
+		fprintf(stderr, "%s:%d: %s\n", pLex->szFile, pLex->nLine, szMsg);
+}
+
+static int
+ParseLine(RulesLexer *pLex, LeaRules *pRules)
+{
+	LeaFilterRule *pRule;
+	eLeaFilterRuleAction nAction;
+
+	if (NextToken(pLex) == TOK_END)
+		return OPSEC_SESSION_OK;
+
+	if (IsWord(pLex, "register"))
+	{
+		NextToken(pLex);
+		if (IsWord(pLex, "server"))
+			pRules->nMode = LEA_RULES_SERVER;
+		else if (IsWord(pLex, "local"))
+			pRules->nMode = LEA_RULES_LOCAL;
+		else if (IsWord(pLex, "auto"))
+			pRules->nMode = LEA_RULES_AUTO;
+		else
+		{
+			ParseError(pLex, "expected server, local or auto");
+			return OPSEC_SESSION_ERR;
+		}
+
+		if (NextToken(pLex) != TOK_END)
+		{
+			ParseError(pLex, "unexpected text");
+			return OPSEC_SESSION_ERR;
+		}
+		return OPSEC_SESSION_OK;
+	}
+
+	if (IsWord(pLex, "pass"))
+		nAction = LEA_FILTER_ACTION_PASS;
+	else if (IsWord(pLex, "drop"))
+		nAction = LEA_FILTER_ACTION_DROP;
+	else if (IsWord(pLex, "pass_fields"))
+		nAction = LEA_FILTER_ACTION_PASS_FIELDS;
+	else if (IsWord(pLex, "drop_fields"))
+		nAction = LEA_FILTER_ACTION_DROP_FIELDS;
+	else
+	{
+		ParseError(pLex, "expected register or a rule action");
+		return OPSEC_SESSION_ERR;
+	}
+
+	if ((pRule = ParseRule(pLex, nAction)) == NULL)
+		return OPSEC_SESSION_ERR;
+
+	/* insert rule object into rulebase object */
+	if (lea_filter_rulebase_add_rule(pRules->pRbase, pRule) != OPSEC_SESSION_OK)
+	{
+		ParseError(pLex, "failed to add rule to rulebase");
+		lea_filter_rule_destroy(pRule);
+		return OPSEC_SESSION_ERR;
+	}
+
+	/* decrease rules reference count */
+	lea_filter_rule_destroy(pRule);
+	pRules->nRules++;
+	return OPSEC_SESSION_OK;
+}
+
+/*
+ * Parses what follows the action of a rule and builds the rule object.
+ */
+static LeaFilterRule *
+ParseRule(RulesLexer *pLex, eLeaFilterRuleAction nAction)
+{
+	LeaFilterRule *pRule;
+	LeaFilterPredicate *pPred;
+	char aszFields[LEA_RULES_MAX_FIELDS][LEA_RULES_TOKEN_LEN];
+	char *apszFields[LEA_RULES_MAX_FIELDS];
+	int nFields = 0;
+
+	NextToken(pLex);
+
+	if (nAction == LEA_FILTER_ACTION_PASS_FIELDS || nAction == LEA_FILTER_ACTION_DROP_FIELDS)
+	{
+		/* the list of fields */
+		for (;;)
+		{
+			if (pLex->nTok != TOK_WORD && pLex->nTok != TOK_STRING)
+			{
+				ParseError(pLex, "expected a field name");
+				return NULL;
+			}
+			if (nFields == LEA_RULES_MAX_FIELDS)
+			{
+				ParseError(pLex, "too many fields");
+				return NULL;
+			}
+			strcpy(aszFields[nFields], pLex->szTok);
+			apszFields[nFields] = aszFields[nFields];
+			nFields++;
+
+			NextToken(pLex);
+			if (!IsPunct(pLex, ","))
+				break;
+			NextToken(pLex);
+		}
+
+		pRule = lea_filter_rule_create(nAction, nFields, apszFields);
+	}
+	else
+		pRule = lea_filter_rule_create(nAction);
+
+	if (pRule == NULL)
+	{
+		ParseError(pLex, "failed to create rule object");
+		return NULL;
+	}
+
+	if (pLex->nTok == TOK_END)
+		return pRule;
+
+	if (!IsWord(pLex, "if"))
+	{
+		ParseError(pLex, "expected if");
+		lea_filter_rule_destroy(pRule);
+		return NULL;
+	}
+
+	/* the conditions */
+	do
+	{
+		NextToken(pLex);
+		if ((pPred = ParseCondition(pLex)) == NULL)
+		{
+			lea_filter_rule_destroy(pRule);
+			return NULL;
+		}
+
+		/* add predicate object to rule object */
+		if (lea_filter_rule_add_predicate(pRule, pPred) != OPSEC_SESSION_OK)
+		{
+			ParseError(pLex, "failed to add predicate to rule");
+			lea_filter_predicate_destroy(pPred);
+			lea_filter_rule_destroy(pRule);
+			return NULL;
+		}
+
+		/* decrease predicate object reference count */
+		lea_filter_predicate_destroy(pPred);
+	} while (IsWord(pLex, "and"));
+
+	if (pLex->nTok != TOK_END)
+	{
+		ParseError(pLex, "expected and");
+		lea_filter_rule_destroy(pRule);
+		return NULL;
+	}
+
+	return pRule;
+}
+
+/*
+ * Parses a condition, starting at the current token, and builds the
+ * predicate object. Leaves the token following the condition current.
+ */
+static LeaFilterPredicate *
+ParseCondition(RulesLexer *pLex)
+{
+	LeaFilterPredicate *pPred = NULL;
+	RulesType *pType;
+	lea_value_ex_t *apValues[LEA_RULES_MAX_VALUES];
+	char szAttr[LEA_RULES_TOKEN_LEN];
+	char szLow[LEA_RULES_TOKEN_LEN];
+	char *szHigh;
+	eLeaFilterPredicateType nPred;
+	unsigned int nAddr;
+	unsigned int nMask;
+	int nNegate = 0;
+	int nValues = 0;
+	int i;
+
+	if (IsWord(pLex, "not"))
+	{
+		nNegate = 1;
+		NextToken(pLex);
+	}
+
+	if (pLex->nTok != TOK_WORD && pLex->nTok != TOK_STRING)
+	{
+		ParseError(pLex, "expected a field name");
+		return NULL;
+	}
+	strcpy(szAttr, pLex->szTok);
+	NextToken(pLex);
+
+	if (IsWord(pLex, "exists"))
+	{
+		pPred = lea_filter_predicate_create(szAttr, -1, nNegate, LEA_FILTER_PRED_EXISTS);
+	}
+	else if (IsWord(pLex, "contains"))
+	{
+		if (NextToken(pLex) != TOK_WORD && pLex->nTok != TOK_STRING)
+		{
+			ParseError(pLex, "expected a string");
+			return NULL;
+		}
+		if ((apValues[0] = MakeValue(pLex, &g_aTypes[0], pLex->szTok)) == NULL)
+			return NULL;
+		nValues = 1;
+		pPred = lea_filter_predicate_create(szAttr, -1, nNegate, LEA_FILTER_PRED_CONTAINS_SUBSTRING, apValues[0]);
+	}
+	else if (IsWord(pLex, "in"))
+	{
+		NextToken(pLex);
+		if ((pType = ParseType(pLex)) == NULL)
+			return NULL;
+		NextToken(pLex);
+
+		if (pType->nKind == KIND_MASK)
+		{
+			/* in mask:<address>/<mask> */
+			if (pLex->nTok != TOK_WORD || (szHigh = strchr(pLex->szTok, '/')) == NULL)
+			{
+				ParseError(pLex, "expected <address>/<mask>");
+				return NULL;
+			}
+			*szHigh++ = '\0';
+			if (ParseAddress(pLex, pLex->szTok, &nAddr) != OPSEC_SESSION_OK ||
+			    ParseAddress(pLex, szHigh, &nMask) != OPSEC_SESSION_OK)
+				return NULL;
+			pPred = lea_filter_predicate_create(szAttr, -1, nNegate, LEA_FILTER_PRED_BELONGS_TO_MASK, nAddr, nMask);
+		}
+		else if (IsPunct(pLex, "{"))
+		{
+			/* in <type>:{<value>, ...} */
+			for (;;)
+			{
+				if (NextToken(pLex) != TOK_WORD && pLex->nTok != TOK_STRING)
+				{
+					ParseError(pLex, "expected a value");
+					break;
+				}
+				if (nValues == LEA_RULES_MAX_VALUES)
+				{
+					ParseError(pLex, "too many values");
+					break;
+				}
+				if ((apValues[nValues] = MakeValue(pLex, pType, pLex->szTok)) == NULL)
+					break;
+				nValues++;
+
+				NextToken(pLex);
+				if (IsPunct(pLex, "}"))
+				{
+					pPred = lea_filter_predicate_create(szAttr, -1, nNegate, LEA_FILTER_PRED_BELONGS_TO,
+					                                    nValues, apValues);
+					break;
+				}
+				if (!IsPunct(pLex, ","))
+				{
+					ParseError(pLex, "expected , or }");
+					break;
+				}
+			}
+
+			if (!pPred)
+			{
+				for (i=0; i<nValues; i++)
+					lea_value_ex_destroy(apValues[i]);
+				return NULL;
+			}
+		}
+		else
+		{
+			/* in <type>:<low>..<high> */
+			if ((pLex->nTok != TOK_WORD && pLex->nTok != TOK_STRING) ||
+			    (szHigh = strstr(pLex->szTok, "..")) == NULL)
+			{
+				ParseError(pLex, "expected {<values>} or <low>..<high>");
+				return NULL;
+			}
+			strncpy(szLow, pLex->szTok, szHigh - pLex->szTok);
+			szLow[szHigh - pLex->szTok] = '\0';
+			szHigh += 2;
+
+			if ((apValues[0] = MakeValue(pLex, pType, szLow)) == NULL)
+				return NULL;
+			nValues = 1;
+			if ((apValues[1] = MakeValue(pLex, pType, szHigh)) == NULL)
+			{
+				lea_value_ex_destroy(apValues[0]);
+				return NULL;
+			}
+			nValues = 2;
+			pPred = lea_filter_predicate_create(szAttr, -1, nNegate, LEA_FILTER_PRED_BELONGS_TO_RANGE,
+			                                    apValues[0], apValues[1]);
+		}
+	}
+	else if (pLex->nTok == TOK_PUNCT)
+	{
+		/* <op> <type>:<value> */
+		if (IsPunct(pLex, "="))
+			nPred = LEA_FILTER_PRED_EQUALS;
+		else if (IsPunct(pLex, "!="))
+		{
+			nPred = LEA_FILTER_PRED_EQUALS;
+			nNegate = !nNegate;
+		}
+		else if (IsPunct(pLex, "<"))
+			nPred = LEA_FILTER_PRED_SMALLER;
+		else if (IsPunct(pLex, "<="))
+			nPred = LEA_FILTER_PRED_SMALLER_EQUAL;
+		else if (IsPunct(pLex, ">"))
+			nPred = LEA_FILTER_PRED_GREATER;
+		else if (IsPunct(pLex, ">="))
+			nPred = LEA_FILTER_PRED_GREATER_EQUAL;
+		else
+		{
+			ParseError(pLex, "expected a condition");
+			return NULL;
+		}
+
+		NextToken(pLex);
+		if ((pType = ParseType(pLex)) == NULL)
+			return NULL;
+		if (pType->nKind == KIND_MASK)
+		{
+			ParseError(pLex, "mask can only be used with in");
+			return NULL;
+		}
+		if (NextToken(pLex) != TOK_WORD && pLex->nTok != TOK_STRING)
+		{
+			ParseError(pLex, "expected a value");
+			return NULL;
+		}
+		if ((apValues[0] = MakeValue(pLex, pType, pLex->szTok)) == NULL)
+			return NULL;
+		nValues = 1;
+		pPred = lea_filter_predicate_create(szAttr, -1, nNegate, nPred, apValues[0]);
+	}
+	else
+	{
+		ParseError(pLex, "expected a condition");
+		return NULL;
+	}
+
+	/* clear used data structures */
+	for (i=0; i<nValues; i++)
+		lea_value_ex_destroy(apValues[i]);
+
+	if (pPred == NULL)
+	{
+		ParseError(pLex, "failed to create predicate object");
+		return NULL;
+	}
+
+	NextToken(pLex);
+	return pPred;
+}
+
+/*
+ * Parses "<type>:" and returns the type.
+ */
+static RulesType *
+ParseType(RulesLexer *pLex)
+{
+	RulesType *pType;
+
+	if (pLex->nTok != TOK_WORD)
+	{
+		ParseError(pLex, "expected <type>:<value>");
+		return NULL;
+	}
+
+	for (pType = g_aTypes; pType->szName; pType++)
+		if (!strcmp(pType->szName, pLex->szTok))
+			break;
+
+	if (!pType->szName)
+	{
+		ParseError(pLex, "unknown type");
+		return NULL;
+	}
+
+	if (NextToken(pLex) != TOK_PUNCT || !IsPunct(pLex, ":"))
+	{
+		ParseError(pLex, "expected :");
+		return NULL;
+	}
+
+	return pType;
+}
+
+static lea_value_ex_t *
+MakeValue(RulesLexer *pLex, RulesType *pType, char *szValue)
+{
+	lea_value_ex_t *pVal;
+	unsigned int nAddr;
+	char *szEnd;
+	long nNum = 0;
+	int rc;
+
+	if (pType->nKind == KIND_INT || pType->nKind == KIND_PROTO)
+	{
+		if (pType->nKind == KIND_PROTO && !strcmp(szValue, "tcp"))
+			nNum = IPPROTO_TCP;
+		else if (pType->nKind == KIND_PROTO && !strcmp(szValue, "udp"))
+			nNum = IPPROTO_UDP;
+		else if (pType->nKind == KIND_PROTO && !strcmp(szValue, "icmp"))
+			nNum = IPPROTO_ICMP;
+		else
+		{
+			nNum = strtol(szValue, &szEnd, 0);
+			if (!*szValue || *szEnd)
+			{
+				ParseError(pLex, "expected a number");
+				return NULL;
+			}
+		}
+	}
+	else if (pType->nKind == KIND_IP)
+	{
+		if (ParseAddress(pLex, szValue, &nAddr) != OPSEC_SESSION_OK)
+			return NULL;
+	}
+
+	/* create value */
+	if ((pVal = lea_value_ex_create()) == NULL)
+	{
+		ParseError(pLex, "failed to create value");
+		return NULL;
+	}
+
+	/* set value */
+	switch (pType->nKind)
+	{
+	case KIND_INT:
+	case KIND_PROTO:
+		rc = lea_value_ex_set(pVal, pType->nType, (int)nNum);
+		break;
+	case KIND_IP:
+		rc = lea_value_ex_set(pVal, pType->nType, nAddr);
+		break;
+	default:
+		rc = lea_value_ex_set(pVal, pType->nType, szValue);
+		break;
+	}
+
+	if (rc != OPSEC_SESSION_OK)
+	{
+		ParseError(pLex, "failed to set value");
+		lea_value_ex_destroy(pVal);
+		return NULL;
+	}
+
+	return pVal;
+}
+
+/*
+ * Parses a dotted IP address (network byte order, as inet_addr()).
+ */
+static int
+ParseAddress(RulesLexer *pLex, char *szValue, unsigned int *pnAddr)
+{
+	int a, b, c, d;
+	char cExtra;
+
+	if (sscanf(szValue, "%d.%d.%d.%d%c", &a, &b, &c, &d, &cExtra) != 4 ||
+	    a < 0 || a > 255 || b < 0 || b > 255 || c < 0 || c > 255 || d < 0 || d > 255)
+	{
+		ParseError(pLex, "expected an IP address");
+		return OPSEC_SESSION_ERR;
+	}
+
+	*pnAddr = (unsigned int)inet_addr(szValue);
+	return OPSEC_SESSION_OK;
+}
@@ -0,0 +1,49 @@
+#ifndef _LEA_RULES_H_
+#define _LEA_RULES_H_
+
+/***************************************************************************
+ *                                                                         *
+ * lea_rules.h : LEA filter rulebase compiler                              *
+ *                                                                         *
+ * See lea_rules.c for further explanations.                               *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "opsec/lea.h"
+#include "opsec/lea_filter.h"
+#include "opsec/lea_filter_ext.h"
+#include "opsec/opsec.h"
+
+#define LEA_RULES_TOKEN_LEN      256
+#define LEA_RULES_MAX_LINE       4096
+#define LEA_RULES_MAX_FIELDS     64      /* fields of a pass_fields/drop_fields rule */
+#define LEA_RULES_MAX_VALUES     64      /* values of an "in {...}" condition        */
+
+/*
+ * Where the rulebase is applied
+ */
+#define LEA_RULES_SERVER         0       /* by the LEA server                        */
+#define LEA_RULES_LOCAL          1       /* by the client library                    */
+#define LEA_RULES_AUTO           2       /* by the server, locally if it can not     */
+
+/*
+ * Return value of LeaRulesRegister() when the result
+ * arrives with the LEA_FILTER_QUERY_ACK event
+ */
+#define LEA_RULES_PENDING        1
+
+typedef struct _LeaRules {
+	LeaFilterRulebase  *pRbase;
+	int                 nRules;
+	int                 nMode;           /* LEA_RULES_SERVER/LOCAL/AUTO              */
+	int                 bOnServer;       /* registered with the server               */
+	int                 bLocal;          /* registered locally                       */
+	int                 nFilterId;       /* of the server registration               */
+} LeaRules;
+
+LeaRules * LeaRulesLoad(char *szFile);
+void       LeaRulesDestroy(LeaRules *pRules);
+int        LeaRulesRegister(OpsecSession *pSession, LeaRules *pRules);
+int        LeaRulesAck(OpsecSession *pSession, LeaRules *pRules, int nResult);
+
+#endif
@@ -0,0 +1,191 @@
+/***************************************************************************
+ *                                                                         *
+ * chunk_ring.c : Sample OPSEC CVP Server                                  *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2001 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * The 'chunk ring' holds the data chunks that travel between the main     *
+ * thread and the worker threads. All of the chunk memory is allocated     *
+ * once, at startup, as a fixed number of equally sized slots. The indices *
+ * of the free slots are kept in a circular queue: a slot is taken from    *
+ * the head of the queue and returned to its tail.                         *
+ *                                                                         *
+ * Chunks are reference counted. The thread that fills a chunk owns the    *
+ * first reference and hands it over with the message that carries the     *
+ * chunk. A thread that wants to keep the chunk after handing it over (the *
+ * worker keeps the chunk it sent until the main thread reports a          *
+ * successful send) takes an extra reference. The slot returns to the ring *
+ * when the last reference is released.                                    *
+ *                                                                         *
+ * The ring never blocks. When it is empty, or when a chunk larger than    *
+ * the slot size is requested, an 'overflow' chunk is allocated from the   *
+ * heap and freed on its last release. The main thread uses                *
+ * chunk_ring_is_low() to suspend reading from sessions before this        *
+ * happens, so overflow chunks are only used under bursts.                 *
+ *                                                                         *
+ ***************************************************************************/
+
+
+#include <stdlib.h>
+#include <opsec/opsec.h>
+#include "chunk_ring.h"
+
+chunk_ring *
+chunk_ring_create(int n_slots, int slot_size)
+{
+	chunk_ring *ring;
+	int         i;
+
+	if (n_slots <= 0 || slot_size <= 0) return NULL;
+
+	ring = (chunk_ring *)calloc(1, sizeof(chunk_ring));
+	if (!ring) return NULL;
+
+	ring->mem       = (char *)malloc((size_t)n_slots * slot_size);
+	ring->chunks    = (ring_chunk *)calloc(n_slots, sizeof(ring_chunk));
+	ring->free_ring = (int *)calloc(n_slots, sizeof(int));
+	if (!ring->mem || !ring->chunks || !ring->free_ring || OS_mutex_init(&ring->lock)) {
+		free(ring->mem);
+		free(ring->chunks);
+		free(ring->free_ring);
+		free(ring);
+		return NULL;
+	}
+
+	ring->n_slots   = n_slots;
+	ring->slot_size = slot_size;
+	ring->low_water = n_slots / 8;
+
+	for (i = 0; i < n_slots; i++) {
+		ring->chunks[i].ring = ring;
+		ring->chunks[i].slot = i;
+		ring->chunks[i].size = slot_size;
+		ring->chunks[i].buf  = ring->mem + (size_t)i * slot_size;
+		ring->free_ring[i]   = i;
+	}
+	ring->head   = 0;
+	ring->n_free = n_slots;
+
+	return ring;
+}
+
+void
+chunk_ring_destroy(chunk_ring *ring)
+{
+	if (!ring) return;
+
+	OS_mutex_destroy(&ring->lock);
+	free(ring->free_ring);
+	free(ring->chunks);
+	free(ring->mem);
+	free(ring);
+}
+
+static ring_chunk *
+chunk_ring_overflow_chunk(chunk_ring *ring, int len)
+{
+	ring_chunk *chunk;
+
+	chunk = (ring_chunk *)malloc(sizeof(ring_chunk) + len);
+	if (!chunk) return NULL;
+
+	chunk->ring   = ring;
+	chunk->refcnt = 1;
+	chunk->slot   = -1;
+	chunk->size   = len;
+	chunk->buf    = (char *)(chunk + 1);
+
+	return chunk;
+}
+
+/*
+ * Get a chunk that can hold at least 'len' bytes. The caller owns the
+ * single reference of the returned chunk.
+ */
+ring_chunk *
+chunk_ring_get(chunk_ring *ring, int len)
+{
+	ring_chunk *chunk = NULL;
+
+	if (!ring || len < 0) return NULL;
+
+	if (len <= ring->slot_size) {
+		OS_mutex_lock(&ring->lock);
+		if (ring->n_free > 0) {
+			chunk = &ring->chunks[ring->free_ring[ring->head]];
+			ring->head = (ring->head + 1) % ring->n_slots;
+			ring->n_free--;
+			chunk->refcnt = 1;
+		} else {
+			ring->n_overflow++;
+		}
+		OS_mutex_unlock(&ring->lock);
+
+		if (chunk) return chunk;
+		len = ring->slot_size;
+	}
+
+	return chunk_ring_overflow_chunk(ring, len);
+}
+
+void
+chunk_ring_ref(ring_chunk *chunk)
+{
+	if (!chunk) return;
+
+	OS_mutex_lock(&chunk->ring->lock);
+	chunk->refcnt++;
+	OS_mutex_unlock(&chunk->ring->lock);
+}
+
+void
+chunk_ring_release(ring_chunk *chunk)
+{
+	chunk_ring *ring;
+	int         last;
+
+	if (!chunk) return;
+
+	ring = chunk->ring;
+
+	OS_mutex_lock(&ring->lock);
+	last = (--chunk->refcnt == 0);
+	if (last && chunk->slot >= 0) {
+		ring->free_ring[(ring->head + ring->n_free) % ring->n_slots] = chunk->slot;
+		ring->n_free++;
+	}
+	OS_mutex_unlock(&ring->lock);
+
+	if (last && chunk->slot < 0)
+		free(chunk);
+}
+
+/*
+ * Returns 1 if the number of free slots has dropped to the low water mark.
+ */
+int
+chunk_ring_is_low(chunk_ring *ring)
+{
+	int low;
+
+	if (!ring) return 0;
+
+	OS_mutex_lock(&ring->lock);
+	low = (ring->n_free <= ring->low_water);
+	OS_mutex_unlock(&ring->lock);
+
+	return low;
+}
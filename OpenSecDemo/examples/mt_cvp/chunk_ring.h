@@ -0,0 +1,59 @@
+#ifndef _CHUNK_RING_H_
+#define _CHUNK_RING_H_
+
+/***************************************************************************
+ *                                                                         *
+ * chunk_ring.h : Sample OPSEC CVP Server                                  *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2001 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * See chunk_ring.c for further explanations.                              *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "os_wrappers.h"
+
+struct _chunk_ring;
+
+typedef struct _ring_chunk {
+	struct _chunk_ring *ring;
+	int                 refcnt;
+	int                 slot;      /* -1 for overflow chunks */
+	int                 size;      /* capacity of buf         */
+	char               *buf;
+} ring_chunk;
+
+typedef struct _chunk_ring {
+	OS_mutex     lock;
+	int          n_slots;
+	int          slot_size;
+	char        *mem;          /* n_slots * slot_size bytes         */
+	ring_chunk  *chunks;       /* one descriptor per slot           */
+	int         *free_ring;    /* circular queue of free slot index */
+	int          head;
+	int          n_free;
+	int          low_water;
+	long         n_overflow;   /* statistics */
+} chunk_ring;
+
+chunk_ring * chunk_ring_create(int n_slots, int slot_size);
+void         chunk_ring_destroy(chunk_ring *ring);
+ring_chunk * chunk_ring_get(chunk_ring *ring, int len);
+void         chunk_ring_ref(ring_chunk *chunk);
+void         chunk_ring_release(ring_chunk *chunk);
+int          chunk_ring_is_low(chunk_ring *ring);
+
+#endif
@@ -22,28 +22,29 @@
  * OPSEC SDK. The same functionality as in the cvp_av_server is            *
  * accomplished here with one diffrence. The I/O related funcionality      *
  * of reading and writing the inspected file to the disk has been moved    *
- * to a worker thread.                                                     *
+ * to a pool of worker threads.                                            *
  *                                                                         *
- * The worker thread is also written around an OPSEC environment and       *
- * main-loop but this is done for the sake of simplicity. The OPSEC main-  *
- * loop of the worker thread is used only as a driver for events - no use  *
- * is made of other OPSEC functionality. See text in OS_wrappers.c and     *
- * cvp_worker.c for further details.                                       *
+ * The worker threads and the chunk memory are created once, at startup,   *
+ * so the number of threads and the memory used stay flat as the number of *
+ * sessions grows. See worker_pool.c, chunk_ring.c and cvp_worker.c for    *
+ * further details.                                                        *
  *                                                                         *
  * The server operates as followes:                                        *
  *                                                                         *
- *   1. When the session is created (start_handler) the session is         *
- *      suspended and a worker thread for the session created. Once the    *
- *      worker thread has indicated that it is ready (WORKER_THREAD_READY  *
- *      command), the session is resumed.                                  *
+ *   1. When the session is created (start_handler) it is bound to one of  *
+ *      the pool workers. All of the session messages go to that worker.   *
  *                                                                         *
  *   2. Receives all data from the client. Every chunk that is received    *
- *      is transferred to the worker thread using the OS_COMM_RECEIVE_CHUNK*
- *      command.                                                           *
+ *      is copied into a chunk ring slot and transferred to the worker     *
+ *      thread using the OS_COMM_RECEIVE_CHUNK command. If the ring is     *
+ *      running low the session is suspended until the worker has drained  *
+ *      the chunk (OS_WORKER_THREAD_READY command).                        *
  *                                                                         *
- *   3. Processes the file and determines the data safety. This is done in *
- *      context of the main thread since no I/O is involved and for the    *
- *      sake of simplicity of this example.                                *
+ *   3. Processes the file and determines the data safety. The content is  *
+ *      scanned by the worker as it arrives (see ../common/scan_engine.c;  *
+ *      the engines are listed in OPSEC_SCAN_ENGINES), the opinion is      *
+ *      formed in context of the main thread since no I/O is involved and  *
+ *      for the sake of simplicity of this example.                        *
  *                                                                         *
  *   4. Sends a reply and the file back to the client.                     *
  *      Note that since the server asks for the whole data stream          *
@@ -79,12 +80,20 @@
 #include "opsec/av_over_cvp.h"
 
 #include "os_wrappers.h"
+#include "chunk_ring.h"
+#include "worker_pool.h"
 #include "session_list.h"
+#include "../common/scan_stream.h"
+#include "../common/metrics.h"
+#include "../common/scan_engine.h"
 
 /*
  * Global definitions
  */
 #define	DEFAULT_CHUNK_SIZE	4096
+#define	WORKER_POOL_SIZE	4     /* number of worker threads              */
+#define	CHUNK_RING_SLOTS	256   /* chunks of DEFAULT_CHUNK_SIZE bytes    */
+#define	MSG_POOL_SIZE		1024  /* preallocated inter thread messages    */
 
 /*
  *  The following structure will be hanged on the session opaque
@@ -96,12 +105,20 @@ struct srv_opaque {
 	int    s_chunk_size;
 
 	char   s_sending;
+	char   s_fix;          /* the worker replaces the infected content     */
 
-	int    waiting_for_chunk;
-	char  *waiting_chunk;
-	int    waiting_chunk_size;
+	int         waiting_for_chunk;
+	char        has_waiting_chunk;
+	ring_chunk *waiting_chunk;
+	int         waiting_chunk_size;
 
-	OS_thr *thr_h;
+	char   stalled;        /* reading suspended until the worker catches up */
+
+	unsigned long gen;     /* tells the session from a reused session object */
+	int    worker;         /* index of the pool worker serving the session */
+	void  *worker_data;    /* worker side session state (see cvp_worker.c) */
+
+	unsigned long s_start; /* of the request [usec], for the metrics       */
 };
 
 #define SO(session) ((struct srv_opaque*)SESSION_OPAQUE(session))
@@ -111,19 +128,34 @@ struct srv_opaque {
  * Globals
  */
 int                         verbose_ = 0;
+int                         mem_threshold = SCAN_STREAM_DEFAULT_THRESHOLD;
 char                       *ProgName = "Unknown";
-long                        cvp_server_event_id = 0;
+OS_inbox                   *cvp_inbox = NULL;
 OpsecEnv                   *env = NULL;
+worker_pool                *cvp_pool = NULL;
+chunk_ring                 *cvp_ring = NULL;
+scan_chain                 *cvp_engines = NULL;
 static dying_session_lst   *d_sess_lst = NULL;
+static unsigned long        session_gen = 0;
+
+/*
+ * Metrics (see ../common/metrics.c). The worker queue metrics are
+ * updated by the worker threads as well.
+ */
+metric                     *m_worker_queue = NULL;
+metric                     *m_worker_wait_usec = NULL;
+static metric              *m_sessions, *m_requests, *m_chunks_in, *m_bytes_in,
+                           *m_chunks_out, *m_bytes_out, *m_stalls, *m_request_usec,
+                           *m_infected;
 
 
 /*
  * Prototypes
  */
 static int        cts_signal_handler(OpsecSession *session, int flow);
-static int        cvp_server_send_chunk_handler(OpsecSession *session, char *data, int len);
-static OpsecEnv * cvp_server_get_worker_thr_env(OpsecSession *session);
-static int        signal_worker_thread(OpsecSession *session, OS_command command, char *buf, int len, int chunk_size);
+static int        cvp_server_send_chunk_handler(OpsecSession *session, ring_chunk *chunk, int len);
+static int        signal_worker_thread(OpsecSession *session, OS_command command, ring_chunk *chunk,
+                                       int len, int chunk_size, int flags);
 static int        set_cts_size(OpsecSession *session);
 static void       print_request_parameters(char *filename, int ftype, int proto, char *command, int action);
 static int        fix_file(OpsecSession *session);
@@ -135,61 +167,54 @@ static int        chunk_handler(OpsecSession *session, char *buf, int len);
 static int        cts_signal_handler(OpsecSession *session, int flow);
 static int        start_handler(OpsecSession *session);
 static void       end_handler(OpsecSession *session);
-static int        cvp_server_send_chunk_handler(OpsecSession *session, char *data, int len);
-static int        cvp_server_ev_handler(OpsecEnv * env, long event_no, void *raise_data, void *set_data);
+static int        cvp_server_msg_handler(OS_raise_data *r_data, void *opaque);
+static void       cvp_server_msg_free(OS_raise_data *r_data, void *opaque);
+static void       create_metrics(void);
 
-#ifdef WIN32
-DWORD WINAPI      cvp_worker_entry_func(void *data);
-#else
-void            * cvp_worker_entry_func(void *data);
-#endif
+int               cvp_worker_msg_handler(OS_raise_data *r_data, void *opaque);
+void            * cvp_worker_session_init(OpsecSession *session, unsigned long gen);
+scan_job        * cvp_worker_scan_job(void *worker_data);
 
 
-static OpsecEnv *
-cvp_server_get_worker_thr_env(OpsecSession *session)
-{
-	if (!session) return NULL;
-
-	return SO(session)->thr_h->env;
-}
-
 /***************************************************************************
  *                                                                         *
- * A wrapper for sending an event to the worker thread.                    *
+ * A wrapper for posting a message to the worker thread of the session.    *
+ * The reference to 'chunk' (if any) is passed on to the worker thread, or *
+ * released if the message cannot be posted.                               *
  *                                                                         *
  ***************************************************************************/
 static int
-signal_worker_thread(OpsecSession *session, OS_command command, char *buf, int len, int chunk_size)
+signal_worker_thread(OpsecSession *session, OS_command command, ring_chunk *chunk,
+                     int len, int chunk_size, int flags)
 {
-	char          *t_buf   = NULL;
 	OS_raise_data *raise_d = NULL;
-	OpsecEnv      *worker_thread_env = cvp_server_get_worker_thr_env(session);
 
 	if (verbose_)
 		fprintf(stderr, "\nsignal_worker_thread: signaling session %x with command %s\n\n",
 	    	    session, OS_command_name(command));
 
-	if (buf != NULL) {
-		t_buf = malloc(len);
-		memcpy(t_buf, buf, len);
-	}
-
-	raise_d = (OS_raise_data *)calloc(1, sizeof(OS_raise_data));
+	raise_d = worker_pool_msg_alloc(cvp_pool);
 	if (!raise_d) {
-		free(t_buf);
+		chunk_ring_release(chunk);
 		return OPSEC_SESSION_ERR;
 	}
 	
+	raise_d->session      = session;
+	raise_d->gen          = SO(session)->gen;
+	raise_d->worker_data  = SO(session)->worker_data;
 	raise_d->command_type = command;
-	raise_d->data         = t_buf;
+	raise_d->chunk        = chunk;
 	raise_d->data_len     = len;
 	raise_d->chunk_size   = chunk_size;
+	raise_d->flags        = flags;
+	raise_d->posted       = metrics_now_usec();
 	
-	if (OS_raise_event(worker_thread_env, SO(session)->thr_h->event_id, (void *)raise_d)) {
-		free(raise_d);
-		free(t_buf);
+	if (worker_pool_post(cvp_pool, SO(session)->worker, raise_d)) {
+		worker_pool_msg_free(cvp_pool, raise_d);
+		chunk_ring_release(chunk);
 		return OPSEC_SESSION_ERR;
 	}
+	metric_add(m_worker_queue, 1);
 
 	return OPSEC_SESSION_OK;
 }
@@ -321,10 +346,12 @@ static int
 fix_file(OpsecSession *session)
 {
 	/* 
-	   In real life Anti-Virus's, this function fixes the data stream,
-	   if any viruses are found in it.
-	   This sample does not contain any logic for cleanning files.
+	   In real life Anti-Virus's, this function cleans the data stream.
+	   This sample replaces the infected content with a notice - the
+	   worker thread does it, as it starts sending (OS_FLAG_FIX).
 	 */
+	SO(session)->s_fix = 1;
+
 	return OPSEC_SESSION_OK;
 }
 
@@ -334,9 +361,8 @@ fix_file(OpsecSession *session)
   |
   |  Description:
   |  ------------
-  |  Determined if the file is ok.
+  |  Determined if the file is ok, from the verdict of the scan engines.
   |  A log message and warning will be sent, according to the processing result.
-  |  In real life this function will do the real processing of the file.
   |
   |  Note that in this case, the server is the only one holding the data
   |  (the client does not hold a copy of it). Thus, the server has to send
@@ -355,34 +381,45 @@ fix_file(OpsecSession *session)
 static int 
 process_file(OpsecSession *session, int *opinion, char *log_msg, char *warning)
 {
-	char *filename = SO(session)->s_filename;
+	scan_job *job = cvp_worker_scan_job(SO(session)->worker_data);
 
-	/* Is this an infected file ? */
-	if (strncmp(filename, "virus", 5) == 0) {
-		fprintf(stderr, "process_file: Found virus in file !\n");
+	switch (job->verdict) {
+	case SCAN_INFECTED:
+		fprintf(stderr, "process_file: Found %s in file !\n", job->threat);
+		metric_inc(m_infected);
 
-		/* Is the server allowd to fix the virus ? */
+		/* Is the server allowd to fix the file ? */
 		if (SO(session)->action != CVP_RDWR) {
 
-			*opinion = CVP_CONTENT_UNSAFE | CVP_CONTENT_NOT_MODIFIED;
-			sprintf(log_msg, "Found virus. CVP server is not allowed to modify content.");
+			*opinion = scan_opinion(SCAN_INFECTED, 0);
+			sprintf(log_msg, "Found %s (%s engine). CVP server is not allowed to modify content.",
+			        job->threat, job->engine);
 			strcpy(warning, "file was scanned and found infected");
 		}
 		else {
 			/* Fix the file */
 			fix_file(session);
-			*opinion = CVP_CONTENT_SAFE | CVP_ORIGINAL_CONTENT_UNSAFE | CVP_CONTENT_MODIFIED;
-			
-			sprintf(log_msg, "CVP server fixed infected file");
-			strcpy(warning, "file was scanned and fixed");
+			*opinion = scan_opinion(SCAN_INFECTED, CVP_CONTENT_REPLACED);
+			sprintf(log_msg, "CVP server replaced file infected with %s (%s engine)",
+			        job->threat, job->engine);
+			strcpy(warning, "file was scanned and the infected content was replaced");
 		}
-	}
-	else {
+		break;
+
+	case SCAN_CLEAN:
 		/* File is ok */
-		*opinion = CVP_CONTENT_SAFE | CVP_CONTENT_NOT_MODIFIED;
+		*opinion = scan_opinion(SCAN_CLEAN, 0);
 
-		sprintf(log_msg, "files beginning with '%c' are known to be safe", filename[0]);
+		sprintf(log_msg, "%ld bytes scanned by %d engines", job->bytes, cvp_engines->n_engines);
 		strcpy(warning, "file was scanned and found safe");
+		break;
+
+	default:
+		*opinion = scan_opinion(SCAN_ERROR, 0);
+
+		sprintf(log_msg, "scan engine failure");
+		strcpy(warning, "file could not be scanned");
+		break;
 	}
 
 	/* then start sending the file */
@@ -418,9 +455,10 @@ process_and_send(OpsecSession *session)
 	int        rc = OPSEC_SESSION_OK;
 
 	/*
-	   Here, the server should scan the file.
+	   The worker scanned the file as it arrived, form the opinion.
 	 */
-	process_file(session, &opinion, log_msg, warning);
+	if (process_file(session, &opinion, log_msg, warning) != OPSEC_SESSION_OK)
+		return OPSEC_SESSION_ERR;
 
 	/* create and populate the OpsecInfo */
 	if (!(info = opsec_info_init()))
@@ -442,8 +480,9 @@ process_and_send(OpsecSession *session)
 	/* send the file */
 	fprintf(stderr, "process_and_send: Will send file to client\n");
 
-	/* Ask the worker thread to prepare for reading the temporary file */
-	if (signal_worker_thread(session, OS_COMM_START_SENDING, NULL, 0, 0))
+	/* Ask the worker thread to prepare for reading the scan stream */
+	if (signal_worker_thread(session, OS_COMM_START_SENDING, NULL, 0, 0,
+	                         SO(session)->s_fix ? OS_FLAG_FIX : 0))
 		return OPSEC_SESSION_ERR;
 
 	/* Trigger the CTS events that will drive the chunk sending the the
@@ -472,10 +511,10 @@ process_and_send(OpsecSession *session)
 static int 
 send_chunk(OpsecSession *session)
 {
-	char *chunk       = NULL;
-	int   chunk_size  = 0;
+	ring_chunk *chunk       = NULL;
+	int         chunk_size  = 0;
 	
-	if (SO(session)->waiting_chunk) {
+	if (SO(session)->has_waiting_chunk) {
 		/*
 		 * If there is a chunk stored on the session opaque try to send it.
 		 * If the chunk is not sent eventually, the chunk data will be put
@@ -485,6 +524,7 @@ send_chunk(OpsecSession *session)
 		chunk      = SO(session)->waiting_chunk;
 		chunk_size = SO(session)->waiting_chunk_size;
 
+		SO(session)->has_waiting_chunk  = 0;
 		SO(session)->waiting_chunk      = NULL;
 		SO(session)->waiting_chunk_size = 0;
 		
@@ -502,7 +542,7 @@ send_chunk(OpsecSession *session)
 	 * If we are still here, it means we need to tell the worker thread 
 	 * that we are interested in the next chunk.
 	 */
-	if (signal_worker_thread(session, OS_COMM_SEND_CHUNK, NULL, 0, 0))
+	if (signal_worker_thread(session, OS_COMM_SEND_CHUNK, NULL, 0, 0, 0))
 		return OPSEC_SESSION_ERR;
 
 	SO(session)->waiting_for_chunk = 1;
@@ -545,6 +585,9 @@ request_handler(OpsecSession *session, OpsecInfo *info)
 
 	fprintf(stderr, "CVP server request handler invoked\n");
 
+	SO(session)->s_start = metrics_now_usec();
+	metric_inc(m_requests);
+
 	/*
 	 * Retrieve request parameters
 	 */
@@ -579,7 +622,7 @@ request_handler(OpsecSession *session, OpsecInfo *info)
 	/*
 	 * Alert the worker thread that the icoming data is about to arive.
 	 */
-	if (signal_worker_thread(session, OS_COMM_RQ_BEGIN, NULL, 0, SO(session)->s_chunk_size))
+	if (signal_worker_thread(session, OS_COMM_RQ_BEGIN, NULL, 0, SO(session)->s_chunk_size, 0))
 		return OPSEC_SESSION_ERR;
 
 	return OPSEC_SESSION_OK;
@@ -592,7 +635,9 @@ request_handler(OpsecSession *session, OpsecInfo *info)
   |  Description:
   |  ------------
   |  This is the CVP server's chunk handler.
-  |  It sends the chunks to the worker thread to be accumulated in a local file.
+  |  It copies the chunk into a chunk ring slot and sends it to the worker thread
+  |  to be accumulated in a local file. If the ring is running low, reading from
+  |  the session is suspended until the worker has written this chunk.
   |
   |  Parameters:
   |  -----------
@@ -607,10 +652,28 @@ request_handler(OpsecSession *session, OpsecInfo *info)
 static int 
 chunk_handler(OpsecSession *session, char *buf, int len)
 {
+	ring_chunk *chunk = NULL;
+	int         flags = 0;
 	
 	fprintf(stderr, "CVP server chunk handler invoked\n");
 
-	if (signal_worker_thread(session, OS_COMM_RECEIVE_CHUNK, buf, len, 0))
+	if (buf != NULL) {
+		chunk = chunk_ring_get(cvp_ring, len);
+		if (!chunk)
+			return OPSEC_SESSION_ERR;
+		memcpy(chunk->buf, buf, len);
+		metric_inc(m_chunks_in);
+		metric_add(m_bytes_in, len);
+
+		if (chunk_ring_is_low(cvp_ring) && !SO(session)->stalled) {
+			opsec_suspend_session_read(session);
+			SO(session)->stalled = 1;
+			flags = OS_FLAG_RESUME;
+			metric_inc(m_stalls);
+		}
+	}
+
+	if (signal_worker_thread(session, OS_COMM_RECEIVE_CHUNK, chunk, len, 0, flags))
 		return OPSEC_SESSION_ERR;
 
 	return OPSEC_SESSION_OK;
@@ -663,7 +726,7 @@ cts_signal_handler(OpsecSession *session, int flow)
   |  ------------
   |  This is the CVP server's start handler.
   |  It initializes the per-session application-level opaque structure.
-  |  It also creates the worker thread that will store the data for this session.
+  |  It also binds the session to the pool worker that will store its data.
   |
   |  Parameters:
   |  -----------
@@ -678,16 +741,21 @@ start_handler(OpsecSession *session)
 {
 	fprintf(stderr, "CVP server start handler invoked\n");
 
-	opsec_suspend_session_read(session);
-
 	SESSION_OPAQUE(session) = (void*)calloc(1, sizeof(struct srv_opaque));
+	if (!SESSION_OPAQUE(session))
+		return OPSEC_SESSION_ERR;
 
-	SO(session)->thr_h = OS_create_thread(cvp_worker_entry_func, session);
-	if (!SO(session)->thr_h) {
-		fprintf(stderr, "%s: failed to create worker thread for session (%x)\n",
+	SO(session)->gen         = ++session_gen;
+	SO(session)->worker      = worker_pool_assign(cvp_pool);
+	SO(session)->worker_data = cvp_worker_session_init(session, SO(session)->gen);
+	if (!SO(session)->worker_data) {
+		fprintf(stderr, "%s: failed to create worker state for session (%x)\n",
 		        ProgName, session);
+		free(SESSION_OPAQUE(session));
+		SESSION_OPAQUE(session) = NULL;
 		return OPSEC_SESSION_ERR;
 	}
+	metric_add(m_sessions, 1);
 		
 	return OPSEC_SESSION_OK;
 }
@@ -715,37 +783,57 @@ start_handler(OpsecSession *session)
 static void 
 end_handler(OpsecSession *session)
 {
+	unsigned long gen;
+
 	fprintf(stderr, "CVP server end handler invoked\n\n");
-	signal_worker_thread(session, OS_COMM_RQ_END, NULL, 0, 0);
+
+	if (!SESSION_OPAQUE(session))
+		return;
+
+	signal_worker_thread(session, OS_COMM_RQ_END, NULL, 0, 0, 0);
 
 	/* free memory */
 	if(SO(session)->s_filename)
 		free(SO(session)->s_filename);
 
+	chunk_ring_release(SO(session)->waiting_chunk);
+
+	gen = SO(session)->gen;
 	free(SESSION_OPAQUE(session));
 	SESSION_OPAQUE(session) = NULL;
+	metric_add(m_sessions, -1);
 
-	session_list_add(d_sess_lst, session);
+	if (session_list_add(d_sess_lst, session, gen))
+		fprintf(stderr, "%s: failed to register the ended session (%x)\n", ProgName, session);
 }
 
 /***************************************************************************
  * This function tries to send a chunk to the CVP client. If it does not   *
- * succeed, it stores the data on the session opaque in order to try again *
- * the next time a CTS signal is fired. If it succeeds, it signals the     *
- * worker thread to read the next chunk from the temporary file and send   *
- * it over.                                                                *
+ * succeed, it stores the chunk on the session opaque in order to try again*
+ * the next time a CTS signal is fired. If it succeeds, it releases the    *
+ * chunk and signals the worker thread that the chunk was sent. A NULL     *
+ * chunk stands for the end of the data.                                   *
  ***************************************************************************/
 static int
-cvp_server_send_chunk_handler(OpsecSession *session, char *data, int len)
+cvp_server_send_chunk_handler(OpsecSession *session, ring_chunk *chunk, int len)
 {
+	char *data = (chunk) ? chunk->buf : NULL;
+
 	if (cvp_send_chunk_to_dst(session, data, len) != 0) {
 		/* wait for next clear to send signal */
 		fprintf(stderr, "cvp_server_send_chunk_handler: Failed to send. Waiting for next cts signal\n");
-		SO(session)->waiting_chunk = data;
+		SO(session)->has_waiting_chunk  = 1;
+		SO(session)->waiting_chunk      = chunk;
 		SO(session)->waiting_chunk_size = len;
 	} else {
-		free(data);
-		if (signal_worker_thread(session, OS_MSG_SEND_SUCCESS, NULL, 0, 0))
+		if (chunk) {
+			metric_inc(m_chunks_out);
+			metric_add(m_bytes_out, len);
+		}
+		else
+			metric_observe(m_request_usec, metrics_now_usec() - SO(session)->s_start);
+		chunk_ring_release(chunk);
+		if (signal_worker_thread(session, OS_MSG_SEND_SUCCESS, NULL, 0, 0, 0))
 			return OPSEC_SESSION_ERR;
 	}
 
@@ -753,27 +841,27 @@ cvp_server_send_chunk_handler(OpsecSession *session, char *data, int len)
 }
 
 /***************************************************************************
- * Event dispatcher for the main thread. This handler sipatches events from*
- * the worker threads. For a description of the events see os_wrappers.h.  *
+ * Message dispatcher for the main thread. The messages of the worker      *
+ * threads are posted on the main thread inbox, and handled here from the  *
+ * mainloop (see OS_inbox_create). For a description of the messages see   *
+ * os_wrappers.h.                                                          *
  *                                                                         *
- * Each event is being tested for validity of the associated session. See  *
- * session_list.c for a detailed explanation.                              *
+ * Each message is being tested for validity of the associated session.    *
+ * See session_list.c for a detailed explanation.                          *
  ***************************************************************************/
 
 static int 
-cvp_server_ev_handler(OpsecEnv * env, long event_no, void *raise_data, void *set_data)
+cvp_server_msg_handler(OS_raise_data *r_data, void *opaque)
 {
-	OS_raise_data   *r_data = raise_data;
-
 	if (r_data->command_type == OS_MSG_LAST) {
-			session_list_delete(d_sess_lst, r_data->session);
-			free(r_data);
+			session_list_delete(d_sess_lst, r_data->session, r_data->gen);
+			worker_pool_msg_free(cvp_pool, r_data);
 			return OPSEC_SESSION_OK;
 	}
 
-	if (session_is_in_list(d_sess_lst, r_data->session)) {
-		if (r_data->data) free(r_data->data);
-		free(r_data);
+	if (session_is_in_list(d_sess_lst, r_data->session, r_data->gen)) {
+		chunk_ring_release(r_data->chunk);
+		worker_pool_msg_free(cvp_pool, r_data);
 		return OPSEC_SESSION_OK;
 	}
 
@@ -781,7 +869,9 @@ cvp_server_ev_handler(OpsecEnv * env, long event_no, void *raise_data, void *set
 		
 		case OS_COMM_RECEIVE_CHUNK:
 			SO(r_data->session)->waiting_for_chunk = 0;
-			cvp_server_send_chunk_handler(r_data->session, r_data->data, r_data->data_len);
+			/* the chunk reference is passed on */
+			cvp_server_send_chunk_handler(r_data->session, r_data->chunk, r_data->data_len);
+			r_data->chunk = NULL;
 			break;
 
 		case OS_COMM_PROCESS:
@@ -789,7 +879,10 @@ cvp_server_ev_handler(OpsecEnv * env, long event_no, void *raise_data, void *set
 			break;
 
 		case OS_WORKER_THREAD_READY:
-			opsec_resume_session_read(r_data->session);
+			if (SO(r_data->session)->stalled) {
+				SO(r_data->session)->stalled = 0;
+				opsec_resume_session_read(r_data->session);
+			}
 			break;
 
 		case OS_WORKER_THREAD_ERR:
@@ -800,12 +893,47 @@ cvp_server_ev_handler(OpsecEnv * env, long event_no, void *raise_data, void *set
 			break;
 	}
 
-	free(r_data);
+	chunk_ring_release(r_data->chunk);
+	worker_pool_msg_free(cvp_pool, r_data);
 
 	return OPSEC_SESSION_OK;
 	
 }
 
+/***************************************************************************
+ * Returns a message which was left in the main thread inbox when it is    *
+ * destroyed (see OS_inbox_destroy).                                       *
+ ***************************************************************************/
+
+static void
+cvp_server_msg_free(OS_raise_data *r_data, void *opaque)
+{
+	worker_pool_msg_free(cvp_pool, r_data);
+}
+
+
+/***************************************************************************
+ *                                                                         *
+ * Creates the metrics of the server before the worker threads start.      *
+ * They are exported by the main thread if OPSEC_METRICS_FILE is set (see  *
+ * ../common/metrics.c).                                                   *
+ *                                                                         *
+ ***************************************************************************/
+static void
+create_metrics(void)
+{
+	m_sessions         = metrics_gauge("cvp_sessions", "CVP sessions open");
+	m_requests         = metrics_counter("cvp_requests_total", "CVP requests received");
+	m_chunks_in        = metrics_counter("cvp_chunks_in_total", "chunks received from the client");
+	m_bytes_in         = metrics_counter("cvp_bytes_in_total", "bytes received from the client");
+	m_chunks_out       = metrics_counter("cvp_chunks_out_total", "chunks sent back");
+	m_bytes_out        = metrics_counter("cvp_bytes_out_total", "bytes sent back");
+	m_stalls           = metrics_counter("cvp_read_stalls_total", "session reads suspended for lack of chunks");
+	m_request_usec     = metrics_histogram("cvp_request_usec", "request to last chunk sent back [usec]");
+	m_worker_queue     = metrics_gauge("cvp_worker_queue", "messages posted to the workers and not yet handled");
+	m_worker_wait_usec = metrics_histogram("cvp_worker_wait_usec", "time a message waits for its worker [usec]");
+	m_infected         = metrics_counter("cvp_infected_total", "requests found infected by the scan engines");
+}
 
 
 /* -------------------------------------------------------------------------------------
@@ -813,16 +941,32 @@ cvp_server_ev_handler(OpsecEnv * env, long event_no, void *raise_data, void *set
 
 	The '-v' flag will make the CVP server print all of the events of the inter-
 	thread communication.
+	The '-m <bytes>' flag sets the size above which the workers spill a file
+	to the disk (see ../common/scan_stream.c).
                                        
    ------------------------------------------------------------------------------------- */
 int main(int ac, char *av[])
 {
 	OpsecEntity         *server;
+	int                  i;
 
 	ProgName = av[0];
 
-	if(ac == 2 && !strcmp(av[1], "-v"))
-		verbose_ = 1;
+	for (i = 1; i < ac; i++) {
+		if (!strcmp(av[i], "-v"))
+			verbose_ = 1;
+		else if (!strcmp(av[i], "-m") && i + 1 < ac)
+			mem_threshold = atoi(av[++i]);
+	}
+
+	create_metrics();
+
+	/* the scan engines, shared by the workers */
+	cvp_engines = scan_chain_env();
+	if (!cvp_engines) {
+		fprintf(stderr, "%s: no scan engines\n", ProgName);
+		exit(1);
+	}
 
 	d_sess_lst = create_session_list();
 	if (!d_sess_lst){
@@ -830,6 +974,18 @@ int main(int ac, char *av[])
 		exit(1);
 	}
 
+	cvp_ring = chunk_ring_create(CHUNK_RING_SLOTS, DEFAULT_CHUNK_SIZE);
+	if (!cvp_ring) {
+		fprintf(stderr, "%s: chunk_ring_create failed\n", ProgName);
+		exit(1);
+	}
+
+	cvp_pool = worker_pool_create(WORKER_POOL_SIZE, MSG_POOL_SIZE, cvp_worker_msg_handler, NULL);
+	if (!cvp_pool) {
+		fprintf(stderr, "%s: worker_pool_create failed\n", ProgName);
+		exit(1);
+	}
+
 	/*
 	 * Create environment
 	 */
@@ -866,15 +1022,15 @@ int main(int ac, char *av[])
 	}
 	fprintf(stderr, "\nServer is running\n");
 
-	cvp_server_event_id = opsec_new_event_id();
-
-	if (opsec_set_event_handler (env, cvp_server_event_id, 
-	                             (OpsecEventHandler) cvp_server_ev_handler, NULL)) {
-		fprintf(stderr, "%s: Server thread opsec_set_event_handler failed (%s)\n",
-			ProgName, opsec_errno_str(opsec_errno));
+	cvp_inbox = OS_inbox_create(env, cvp_server_msg_handler, NULL);
+	if (!cvp_inbox) {
+		fprintf(stderr, "%s: Server thread OS_inbox_create failed\n", ProgName);
 		exit(1);
 	}
 
+	if (metrics_export_env(env) < 0)
+		fprintf(stderr, "%s: metrics are not exported\n", ProgName);
+
 	opsec_mainloop(env);
 
 	fprintf(stderr, "%s: Server thread opsec_mainloop returned\n", ProgName);
@@ -882,10 +1038,19 @@ int main(int ac, char *av[])
 	/*
 	 * Destroy OPSEC server entity and environment
 	 */
+	metrics_export_stop(env);
 	opsec_destroy_entity(server);
+
+	/* the workers may still post to the inbox, whose messages are the pool's */
+	worker_pool_stop(cvp_pool);
+	OS_inbox_destroy(cvp_inbox, cvp_server_msg_free);
+	worker_pool_destroy(cvp_pool);
 	opsec_env_destroy(env);
 
+	chunk_ring_destroy(cvp_ring);
 	session_list_destroy(d_sess_lst);
+	scan_chain_destroy(cvp_engines);
+	metrics_destroy();
 	
 	return 0;
 }
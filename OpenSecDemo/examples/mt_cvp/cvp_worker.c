@@ -18,50 +18,66 @@
 /***************************************************************************
  *                                                                         *
  * All of the I/O related activity of the CVP server is off-loaded to a    *
- * worker thread, in order to enable the CVP main thread to be responsive  *
- * to OPSEC events. In this example, the CVP server does not really inspect*
- * the file content, therefore the worker thread merely writes the file to *
- * the disk and then reads it as is in order for it to be sent back to the *
- * CVP client. In 'real life' the worker thread would probably also        *
- * 'inspect' the content as well.                                          *
+ * pool of worker threads, in order to enable the CVP main thread to be    *
+ * responsive to OPSEC events. The worker thread stores the file in a      *
+ * scan stream (see ../common/scan_stream.c) and then reads it in order    *
+ * for it to be sent back to the CVP client. Files below the memory        *
+ * threshold are kept in memory; larger files are spilled to the disk.     *
  *                                                                         *
- * Upon creation, the worker thread registers an event handler for the     *
- * event ID dictated by the main thread. Via this handler, all commands    *
- * are received (see os_wrappers.h for command list). The entry function   *
- * also schedules the sending of a 'ready' message to the worker thread.   *
- * The thread either recevies or sends data chunks from/to the main        *
- * thread.                                                                 *
+ * The workers are created once, at startup (see worker_pool.c). Every     *
+ * session is served by a single worker, which keeps the per-session state *
+ * in a worker_opaque structure. The structure is created by the main      *
+ * thread when the session starts and travels with every message of the    *
+ * session (see os_wrappers.h for command list).                           *
  *                                                                         *
- * When the thread recevies the end command it de-registers the event      *
- * handler. This results in the wait on event blocking function to return. *
- * The worker thread then signals the main thread that it is exiting and   *
- * exits after cleaning up the memory used.                                *
+ * The content is inspected as it is received, by the scan engines of      *
+ * cvp_engines (see ../common/scan_engine.c) fed from the scan stream      *
+ * scanner hook, so the verdict is ready when the worker reports the end   *
+ * of the file. The main thread reads it then (cvp_worker_scan_job): the   *
+ * worker does not touch the scan job once OS_COMM_PROCESS is posted.      *
+ *                                                                         *
+ * Chunks read from the scan stream are placed in a slot of the chunk ring *
+ * (see chunk_ring.c) and handed to the main thread without copying. The   *
+ * worker keeps its own reference to the chunk until the main thread       *
+ * reports that the chunk was sent.                                        *
+ *                                                                         *
+ * When the worker recevies the end command it releases the session state  *
+ * and replies with the 'last' message for the session.                    *
  *                                                                         *
  ***************************************************************************/
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <errno.h>
 #include <opsec/opsec.h>
 #include <opsec/opsec_event.h>
 
 #include "os_wrappers.h"
+#include "chunk_ring.h"
+#include "worker_pool.h"
+#include "../common/scan_stream.h"
+#include "../common/metrics.h"
+#include "../common/scan_engine.h"
 
 
 typedef struct _worker_opaque {
-	char  *s_filename;
-	char   s_tempname[50];
-	FILE  *s_fp;
+	char        *s_filename;
+	scan_stream *s_stream;
+	scan_job    *s_job;
 
 	int    action;
 	int    s_chunk_size;
+	long   s_scanned;
 
-	char   s_buf[4096];
-	int    s_buf_len;
-	char   s_buf_full;
+	ring_chunk *s_chunk;     /* chunk handed to the main thread, not yet sent */
+	int         s_buf_len;
+	char        s_buf_full;
 
 	char   s_eof;
 	char   s_sending;
 	OpsecSession *session;
+	unsigned long gen;
 } worker_opaque;
 
 #define WO(_data)   ((worker_opaque *)(_data))
@@ -70,51 +86,58 @@ typedef struct _worker_opaque {
 #define WT_STATUS_ERR    -1
 
 extern char        *ProgName;
-extern long         cvp_server_event_id;
-extern OpsecEnv    *env;
+extern OS_inbox    *cvp_inbox;
 extern int          verbose_;
-
-static int cvp_worker_ev_handler(OpsecEnv * env, long event_no, void *raise_data, void *set_data);
-static int cvp_worker_start_sending(worker_opaque *wo);
+extern worker_pool *cvp_pool;
+extern chunk_ring  *cvp_ring;
+extern int          mem_threshold;
+extern scan_chain  *cvp_engines;
+extern metric      *m_worker_queue;
+extern metric      *m_worker_wait_usec;
+
+int        cvp_worker_msg_handler(OS_raise_data *r_data, void *opaque);
+void     * cvp_worker_session_init(OpsecSession *session, unsigned long gen);
+scan_job * cvp_worker_scan_job(void *worker_data);
+
+static int cvp_worker_start_sending(worker_opaque *wo, int fix);
 static int cvp_worker_send_success_handler(worker_opaque *wo);
 static int cvp_worker_send_chunk_handler(worker_opaque *wo);
-static int cvp_worker_send_chunk_to_dst(worker_opaque *wo, char *buf, int len);
-static int cvp_worker_chunk_handler(worker_opaque *wo, char *chunk, int len);
-static int cvp_worker_end_rq(OpsecEnv *env, long event_no, void *set_data, worker_opaque *wo);
+static int cvp_worker_send_chunk_to_dst(worker_opaque *wo, ring_chunk *chunk, int len);
+static int cvp_worker_chunk_handler(worker_opaque *wo, ring_chunk *chunk, int len);
+static int cvp_worker_end_rq(worker_opaque *wo);
 static int cvp_worker_begin_rq(worker_opaque *wo);
 
 
+/***************************************************************************
+ * Send a message to the main thread. The reference to 'chunk' (if any) is *
+ * passed on to the main thread, or released if the message is not sent.   *
+ ***************************************************************************/
 static int
-signal_server_thread(OpsecSession  *session, OS_command command_type, 
-                  void *data, int data_len, int chunk_size)
+signal_server_thread(OpsecSession  *session, unsigned long gen, OS_command command_type, 
+                  ring_chunk *chunk, int data_len, int chunk_size)
 {
-	char *t_buf = NULL;
 	OS_raise_data    *raise_d = NULL;
 
 	if (verbose_)
 		fprintf(stderr, "\nsignal_server_thread: signaling session %x with command %s\n\n",
 	    	    session, OS_command_name(command_type));
 	
-	if ((data != NULL) && (data_len != -1)) {
-		t_buf = (char *)malloc(data_len);
-		memcpy(t_buf, data, data_len);
-	}
-
-	raise_d = (OS_raise_data *)calloc(1, sizeof(OS_raise_data));
+	raise_d = worker_pool_msg_alloc(cvp_pool);
 	if (!raise_d) {
-		free(t_buf);
+		chunk_ring_release(chunk);
 		return WT_STATUS_ERR;
 	}
 	
 	raise_d->command_type = command_type;
-	raise_d->data         = t_buf;
+	raise_d->chunk        = chunk;
 	raise_d->data_len     = data_len;
 	raise_d->session      = session;
+	raise_d->gen          = gen;
 	raise_d->chunk_size   = chunk_size;
 	
-	if (OS_raise_event(env, cvp_server_event_id, (void *)raise_d)) {
-		free(raise_d);
-		free(t_buf);
+	if (OS_inbox_post(cvp_inbox, raise_d)) {
+		worker_pool_msg_free(cvp_pool, raise_d);
+		chunk_ring_release(chunk);
 		fprintf(stderr, "signal_server_thread: Could not signal server thread for session %x with command %s",
 		        session, OS_command_name(command_type));
 		return WT_STATUS_ERR;
@@ -123,70 +146,78 @@ signal_server_thread(OpsecSession  *session, OS_command command_type,
 	return WT_STATUS_OK;
 }
 
-void
-send_ready_signal(void *opq)
+/***************************************************************************
+ * Called by the main thread when a session starts. Creates the state that *
+ * the worker keeps for the session. From here on, the state is only used  *
+ * by the worker thread that serves the session.                           *
+ ***************************************************************************/
+
+void *
+cvp_worker_session_init(OpsecSession *session, unsigned long gen)
 {
-	worker_opaque *wo = (worker_opaque *)opq;
+	worker_opaque  *work_opq = (worker_opaque *)calloc(1, sizeof(worker_opaque));
+
+	if (!work_opq) return NULL;
+
+	work_opq->session = session;
+	work_opq->gen     = gen;
 
-	signal_server_thread(wo->session, OS_WORKER_THREAD_READY, NULL, 0, 0);
+	return (void *)work_opq;
 }
 
 /***************************************************************************
- * This is the entry point to the worker thread. The data received as input*
- * is the OS_thr data (see os_wrappers.h) that includes the event ID to be *
- * listened on and the session pointer to which this thread is associated. *
- *                                                                         *
- * The function creates an event handler, schedules an event for sending   *
- * the 'ready' message to the main thread and wiats for further events.    *
+ * The scan job of a session, for the main thread once it got              *
+ * OS_COMM_PROCESS.                                                        *
  ***************************************************************************/
 
-#ifdef WIN32
-DWORD WINAPI cvp_worker_entry_func(void *data)
-#else
-void * cvp_worker_entry_func(void *data)
-#endif
+scan_job *
+cvp_worker_scan_job(void *worker_data)
 {
-	OS_thr         *thr_h     = (OS_thr *)data;
-	OpsecEnv       *env       = thr_h->env;
-	worker_opaque  *work_opq  = NULL;
-
-	work_opq = (worker_opaque *)calloc(1, sizeof(worker_opaque));
-	
-	work_opq->session = (OpsecSession *)thr_h->data;
-	
-	OS_set_event_handler(env, thr_h->event_id, (OpsecEventHandler)cvp_worker_ev_handler, (void *)work_opq);
-
-	OS_schedule(env, 0, (void (*)(void *))send_ready_signal, (void *)work_opq);
+	return WO(worker_data)->s_job;
+}
 
-	OS_wait_on_events(env);
+/***************************************************************************
+ * Scanner hook of the session scan stream. Called with every chunk as it  *
+ * is received, and with (NULL, -1) at the end of the file. Feeds the      *
+ * scan engines.                                                           *
+ ***************************************************************************/
 
-	signal_server_thread(work_opq->session, OS_MSG_LAST, NULL, 0, 0);
+static int
+cvp_worker_scan_data(void *opaque, char *data, int len)
+{
+	worker_opaque *wo = WO(opaque);
 
-	OS_thread_cleanup(thr_h);
-	
-	free(work_opq);
+	if (data != NULL) {
+		wo->s_scanned += len;
+		scan_job_data(wo->s_job, data, len);
+	}
+	else
+		scan_job_end(wo->s_job);
 
 	return 0;
 }
 
 /***************************************************************************
  * Handle the activity related with preparing for receving data:           *
- * 1) Choose file name for storing the data.                               *
- * 2) Open it.                                                             *
+ * create the scan stream that will hold the data, and the scan job that   *
+ * will inspect it.                                                        *
  ***************************************************************************/
 
 static int
 cvp_worker_begin_rq(worker_opaque *wo)
 {
-	/* choose a file name for the local copy ... */
-	sprintf(wo->s_tempname, "%s%x.tmp", _TMPDIR, wo);
-	fprintf(stderr, "cvp_worker_begin_rq: (session %x) Temporary file name: %s\n", wo->session, wo->s_tempname);
-
-	/* ..and open it */
-	wo->s_fp = fopen(wo->s_tempname, "wb");
-	if (wo->s_fp == NULL) {
-		fprintf(stderr, "%s: (session %x) cvp_worker_begin_rq: fopen('%s', 'wb') failed: %s\n",
-			ProgName, wo->session, wo->s_tempname, strerror(errno));
+	wo->s_stream = scan_stream_create(mem_threshold, _TMPDIR);
+	if (wo->s_stream == NULL) {
+		fprintf(stderr, "%s: (session %x) cvp_worker_begin_rq: scan_stream_create failed\n",
+			ProgName, wo->session);
+		return WT_STATUS_ERR;
+	}
+	scan_stream_set_scanner(wo->s_stream, cvp_worker_scan_data, wo);
+
+	wo->s_job = scan_job_begin(cvp_engines);
+	if (wo->s_job == NULL) {
+		fprintf(stderr, "%s: (session %x) cvp_worker_begin_rq: scan_job_begin failed\n",
+			ProgName, wo->session);
 		return WT_STATUS_ERR;
 	}
 
@@ -195,72 +226,60 @@ cvp_worker_begin_rq(worker_opaque *wo)
 
 /***************************************************************************
  * Handle the activity related with folding up:                            *
- * 1) Close the temporary file.                                            *
- * 2) Delete it.                                                           *
- * 3) Delete the event handler - that will enable the blocking wait in the *
- *    entry function to exit. This will make the thread exit as well.      *
+ * 1) Destroy the scan stream (removes the spill file, if used) and the    *
+ *    scan job.                                                            *
+ * 2) Release the chunk still held for sending, if any.                    *
+ * 3) Send the 'last' message for the session and free the session state.  *
  ***************************************************************************/
 
 static int
-cvp_worker_end_rq(OpsecEnv *env, long event_no, void *set_data, worker_opaque *wo)
+cvp_worker_end_rq(worker_opaque *wo)
 {
-	/* close the scratch file */
-	if (wo->s_fp) {
-		if (fclose(wo->s_fp) != 0)
-			fprintf(stderr, "%s: (session %x) cvp_worker_end_rq: fclose('%s') failed: %s\n",
-				ProgName, wo->session, wo->s_tempname,
-				strerror(errno));
-		wo->s_fp = NULL; 
-	}
+	scan_stream_destroy(wo->s_stream);
+	wo->s_stream = NULL;
 
-	if (wo->s_tempname[0]) {
+	scan_job_free(wo->s_job);
+	wo->s_job = NULL;
 
-		/* remove the scratch file */
-		if (remove(wo->s_tempname) < 0) {
-			fprintf(stderr, "%s: (session %x) cvp_worker_end_rq: remove '%s' failed: %s\n",
-				ProgName, wo->session, wo->s_tempname,
-				strerror(errno));
-		}
-		wo->s_tempname[0] = '\0';
-	}
+	chunk_ring_release(wo->s_chunk);
+	wo->s_chunk = NULL;
 
-	OS_del_event_handler(env, event_no, 
-	                     (OpsecEventHandler)cvp_worker_ev_handler, 
-	                     set_data);
+	signal_server_thread(wo->session, wo->gen, OS_MSG_LAST, NULL, 0, 0);
+
+	free(wo);
 	
 	return WT_STATUS_OK;
 	
 }
 
 /***************************************************************************
- * Receive an incoming chunk and store it (write it) in the temporary file.*
+ * Receive an incoming chunk and store it in the scan stream.              *
  * If the last buffer has been written, signal the main thread that it can *
  * start processing the data.                                              *
  ***************************************************************************/
 static int
-cvp_worker_chunk_handler(worker_opaque *wo, char *chunk, int len)
+cvp_worker_chunk_handler(worker_opaque *wo, ring_chunk *chunk, int len)
 {
 	if (chunk == NULL) {	/* EOF received ? */
 		fprintf(stderr, "cvp_worker_chunk_handler: (session %x) Received EOF\n", wo->session);
-		/* close the scratch file.. */
-		if (fclose(wo->s_fp) != 0) {
-			fprintf(stderr, "%s: (session %x) cvp_worker_chunk_handler: fclose('%s') failed: %s\n",
-				ProgName, wo->s_tempname, strerror(errno));
+		/* finish the scan stream.. */
+		if (scan_stream_finish(wo->s_stream) < 0) {
+			fprintf(stderr, "%s: (session %x) cvp_worker_chunk_handler: scan_stream_finish failed\n",
+				ProgName, wo->session);
 			return WT_STATUS_ERR;
 		}
-		wo->s_fp = NULL;
 
 		/* .. and process it */
-		if (signal_server_thread(wo->session, OS_COMM_PROCESS, NULL, 0, 0))
+		if (signal_server_thread(wo->session, wo->gen, OS_COMM_PROCESS, NULL, 0, 0))
 			return WT_STATUS_ERR;
 
 		return WT_STATUS_OK;
 	}
 
-	fprintf(stderr, "cvp_worker_chunk_handler: (session %x) Received chunk (buff = %x, len = %d)\n", wo->session, chunk, len);
-	if ((int)fwrite(chunk, 1, len, wo->s_fp) != len) {
-		fprintf(stderr, "%s: (session %x) cvp_worker_chunk_handler: fwrite(%d, '%s') failed: %s\n",
-		        ProgName, wo->session, len, wo->s_tempname, strerror(errno));
+	fprintf(stderr, "cvp_worker_chunk_handler: (session %x) Received chunk (buff = %x, len = %d)\n", wo->session, chunk->buf, len);
+	if (scan_stream_write(wo->s_stream, chunk->buf, len) < 0) {
+		fprintf(stderr, "%s: (session %x) cvp_worker_chunk_handler: scan_stream_write(%d) failed\n",
+		        ProgName, wo->session, len);
 		return WT_STATUS_ERR;
 	}
 
@@ -268,109 +287,144 @@ cvp_worker_chunk_handler(worker_opaque *wo, char *chunk, int len)
 }
 
 /***************************************************************************
- * Helper function for sending one chunk to the main thread.               *
+ * Helper function for sending one chunk to the main thread. The main      *
+ * thread gets its own reference to the chunk.                             *
  ***************************************************************************/
 
 static int
-cvp_worker_send_chunk_to_dst(worker_opaque *wo, char *buf, int len)
+cvp_worker_send_chunk_to_dst(worker_opaque *wo, ring_chunk *chunk, int len)
 {
-	char *t_buf = NULL;
-	OS_raise_data *raise_d = NULL;
+	chunk_ring_ref(chunk);
 
-	if (signal_server_thread(wo->session, OS_COMM_RECEIVE_CHUNK, buf, len, 0))
+	if (signal_server_thread(wo->session, wo->gen, OS_COMM_RECEIVE_CHUNK, chunk, len, 0))
 		return WT_STATUS_ERR;
 
 	return WT_STATUS_OK;
 }
 
 /***************************************************************************
- *  Read a chunk from the temporary file and send it to the main thread.   *
+ *  Take a chunk from the scan stream and send it to the main thread.      *
+ *  The data is placed in a chunk ring slot.                               *
  ***************************************************************************/
 static int
 cvp_worker_send_chunk_handler(worker_opaque *wo)
 {
-	FILE *fp  = wo->s_fp;
-	char *buf = wo->s_buf;
+	ring_chunk *chunk = wo->s_chunk;
+	char       *data  = NULL;
 
-	/* need to read data from file ? */
+	/* need to read data from the stream ? */
 	if (! wo->s_buf_full) {
-		fprintf(stderr, "cvp_worker_chunk_handler: (session %x) Reading data from file\n", wo->session);
-		wo->s_buf_len = fread(buf, 1, wo->s_chunk_size, fp);
-
-		if (wo->s_buf_len == 0) {
-			/* fread error ? */
-			if (ferror(fp)) {
-				fprintf(stderr, "%s: (session %x) cvp_worker_chunk_handler: fread('%s') failed: %s\n",
-					ProgName, wo->session, wo->s_tempname, strerror(errno));
+		fprintf(stderr, "cvp_worker_chunk_handler: (session %x) Reading data from stream\n", wo->session);
+
+		wo->s_buf_len = scan_stream_peek(wo->s_stream, &data, wo->s_chunk_size);
+		if (wo->s_buf_len < 0) {
+			fprintf(stderr, "%s: (session %x) cvp_worker_chunk_handler: failed to read the scan stream\n",
+				ProgName, wo->session);
+			return WT_STATUS_ERR;
+		}
+
+		if (wo->s_buf_len > 0) {
+			chunk = chunk_ring_get(cvp_ring, wo->s_buf_len);
+			if (!chunk) {
+				fprintf(stderr, "%s: (session %x) cvp_worker_chunk_handler: out of chunk memory\n",
+					ProgName, wo->session);
 				return WT_STATUS_ERR;
 			}
+			memcpy(chunk->buf, data, wo->s_buf_len);
+			scan_stream_advance(wo->s_stream, wo->s_buf_len);
+		} else {
+			chunk = NULL;
 
 			/* reached end of file */
 			fprintf(stderr, "cvp_worker_chunk_handler: (session %x) Reached the end of file\n", wo->session);
 			wo->s_buf_len = -1;
 			wo->s_eof = 1;
-			buf = NULL;
 		}
 
 		/* have something to send */
+		wo->s_chunk    = chunk;
 		wo->s_buf_full = 1;
 	}
 
 	/* send data */
 	fprintf(stderr, "cvp_worker_chunk_handler: (session %x) Will try to send chunk (len = %d)\n",
 			wo->session, wo->s_buf_len);
-	if (cvp_worker_send_chunk_to_dst(wo, buf, wo->s_buf_len) == 0) {
-
-		/* just sent eof ? */
-		if (buf == NULL)
-			/* send completed */
-			wo->s_sending = 0;
-	}
-	else {
-		fprintf(stderr, "cvp_worker_chunk_handler: (session %x) Failed to send. Waiting for next cts signal\n", wo->session);	
-		/* wait for next clear to send signal */
+	if (cvp_worker_send_chunk_to_dst(wo, chunk, wo->s_buf_len) != 0) {
+		fprintf(stderr, "cvp_worker_chunk_handler: (session %x) Failed to signal the main thread\n", wo->session);
+		return WT_STATUS_ERR;
 	}
 
 	return WT_STATUS_OK;
 }
 
+/***************************************************************************
+ * The main thread sent the last chunk - drop our reference to it.         *
+ ***************************************************************************/
 static int
 cvp_worker_send_success_handler(worker_opaque *wo)
 {
+	chunk_ring_release(wo->s_chunk);
+	wo->s_chunk    = NULL;
 	wo->s_buf_full = 0;
+
+	/* just sent eof ? */
+	if (wo->s_eof)
+		/* send completed */
+		wo->s_sending = 0;
 	
 	return WT_STATUS_OK;
 }
 
 /***************************************************************************
- * Open the temporary file for reading in preparation for sending data     *
- * back tot he main thread.                                                *
+ * Prepare the scan stream for sending data back to the main thread. If    *
+ * the main thread asked to fix the file, the infected content is replaced *
+ * by a notice first.                                                      *
  ***************************************************************************/
 static int
-cvp_worker_start_sending(worker_opaque *wo)
+cvp_worker_start_sending(worker_opaque *wo, int fix)
 {
-	fprintf(stderr, "cvp_worker_start_sending: (session %x) Temporary file name: %s\n", wo->session, wo->s_tempname?wo->s_tempname:"NULL");
+	char notice[SCAN_NOTICE_LEN];
+	int  len;
+
+	if (fix) {
+		len = scan_job_notice(wo->s_job, notice, sizeof(notice));
+		if (scan_stream_reset(wo->s_stream) < 0 || scan_stream_write(wo->s_stream, notice, len) < 0 ||
+		    scan_stream_finish(wo->s_stream) < 0) {
+			fprintf(stderr, "%s: cvp_worker_start_sending: (session %x) failed to replace the content\n",
+			        ProgName, wo->session);
+			return WT_STATUS_ERR;
+		}
+	}
+
+	fprintf(stderr, "cvp_worker_start_sending: (session %x) %ld bytes, %s\n", wo->session,
+	        scan_stream_size(wo->s_stream),
+	        scan_stream_is_spilled(wo->s_stream) ? "spilled to disk" : "in memory");
 
-	wo->s_fp = fopen(wo->s_tempname, "rb");
-	rewind(wo->s_fp);
-	if (wo->s_fp == NULL) {
-		fprintf(stderr, "%s: cvp_worker_start_sending: (session %x) fopen('%s', 'rb') failed: %s\n",
-		        ProgName, wo->session, wo->s_tempname, strerror(errno));
+	if (scan_stream_rewind(wo->s_stream) < 0) {
+		fprintf(stderr, "%s: cvp_worker_start_sending: (session %x) scan_stream_rewind failed\n",
+		        ProgName, wo->session);
 		return WT_STATUS_ERR;
 	}
+	wo->s_sending = 1;
+
 	return WT_STATUS_OK;
 }
 
 /***************************************************************************
- * Event dispatcher for the worker thread.                                 *
- * For a description of the events see os_wrappers.h                       *
+ * Message dispatcher for the worker threads (called by the worker pool).  *
+ * For a description of the commands see os_wrappers.h                     *
  ***************************************************************************/
-static int 
-cvp_worker_ev_handler(OpsecEnv * env, long event_no, void *raise_data, void *set_data)
+int 
+cvp_worker_msg_handler(OS_raise_data *r_data, void *opaque)
 {
-	OS_raise_data   *r_data = raise_data;
-	worker_opaque   *wo     = WO(set_data);
-	int              rc     = WT_STATUS_OK;
+	worker_opaque   *wo      = WO(r_data->worker_data);
+	OpsecSession    *session = r_data->session;
+	unsigned long    gen     = r_data->gen;
+	int              resume  = (r_data->flags & OS_FLAG_RESUME);
+	int              rc      = WT_STATUS_OK;
+
+	metric_add(m_worker_queue, -1);
+	metric_observe(m_worker_wait_usec, metrics_now_usec() - r_data->posted);
 
 	switch (r_data->command_type) {
 		
@@ -380,11 +434,12 @@ cvp_worker_ev_handler(OpsecEnv * env, long event_no, void *raise_data, void *set
 			break;
 		
 		case OS_COMM_RQ_END:
-			rc = cvp_worker_end_rq(env, event_no, set_data, wo);
+			/* 'wo' is freed here and must not be used any more */
+			rc = cvp_worker_end_rq(wo);
 			break;
 			
 		case OS_COMM_RECEIVE_CHUNK:
-			rc = cvp_worker_chunk_handler(wo, r_data->data, r_data->data_len);
+			rc = cvp_worker_chunk_handler(wo, r_data->chunk, r_data->data_len);
 			break;
 		
 		case OS_COMM_SEND_CHUNK:
@@ -396,7 +451,7 @@ cvp_worker_ev_handler(OpsecEnv * env, long event_no, void *raise_data, void *set
 			break;
 
 		case OS_COMM_START_SENDING:
-			rc = cvp_worker_start_sending(wo);
+			rc = cvp_worker_start_sending(wo, r_data->flags & OS_FLAG_FIX);
 			break;
 
 		default:
@@ -404,11 +459,13 @@ cvp_worker_ev_handler(OpsecEnv * env, long event_no, void *raise_data, void *set
 			break;
 	}
 
-	if (r_data->data) free(r_data->data);
-	free(r_data);
+	chunk_ring_release(r_data->chunk);
+	worker_pool_msg_free(cvp_pool, r_data);
 
 	if (rc != WT_STATUS_OK)
-		signal_server_thread(wo->session, OS_WORKER_THREAD_ERR, NULL, 0, 0);
+		signal_server_thread(session, gen, OS_WORKER_THREAD_ERR, NULL, 0, 0);
+	else if (resume)
+		signal_server_thread(session, gen, OS_WORKER_THREAD_READY, NULL, 0, 0);
 
 	return WT_STATUS_OK;
 	
@@ -17,21 +17,39 @@
 
 /***************************************************************************
  * This file contains the realization of the inter thread communication    *
- * tools. For the sake of simplicity, the OPSEC mainloop and events are    *
- * used. A generalized realization should make use of 'standard' OS tools. *
+ * tools.                                                                  *
  *                                                                         *
- * The code is designed to compile and run in Windows NT and in Solaris2   *
- * using Solaris native threads (by linking with the 'thread' library). In *
- * order to use other thread IS changes should be made to the              *
- * OS_create_thread function.                                              *
+ * The main thread runs the OPSEC mainloop, so the worker threads wake it  *
+ * through a descriptor the mainloop watches: an eventfd on Linux, a pipe  *
+ * on other POSIX systems (see OS_inbox_create). Messages are queued on    *
+ * the inbox, and only the first message of a batch writes to the          *
+ * descriptor - the main thread handles all the queued messages at every   *
+ * wakeup. On Windows select() takes sockets only, and every message is    *
+ * raised as an OPSEC event instead.                                       *
+ *                                                                         *
+ * The code is designed to compile and run in Windows NT and on POSIX      *
+ * systems (Solaris, Linux) using POSIX threads (by linking with the       *
+ * 'pthread' library). In order to use other thread IS changes should be   *
+ * made to the OS_create_thread function and to the mutex and condition    *
+ * wrappers.                                                               *
   ***************************************************************************/
 
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#ifndef WIN32
+#include <fcntl.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+#endif
 #include <opsec/opsec.h>
 #include <opsec/opsec_event.h>
 
 #include "os_wrappers.h"
+#include "chunk_ring.h"
 
 int
 OS_raise_event(OpsecEnv *env, long event_no, void *raise_data)
@@ -79,36 +97,330 @@ void
 OS_thread_cleanup(OS_thr *thr_h)
 {
 	if (!thr_h) return;
-	if (thr_h->env) opsec_env_destroy(thr_h->env);
+#ifdef WIN32
+	if (thr_h->handle) CloseHandle(thr_h->handle);
+#endif
 	free(thr_h);
 }
 
+int
+OS_thread_join(OS_thr *thr_h)
+{
+	if (!thr_h) return -1;
+#ifdef WIN32
+	return (WaitForSingleObject(thr_h->handle, INFINITE) == WAIT_OBJECT_0) ? 0 : -1;
+#else
+	return pthread_join(thr_h->handle, NULL) ? -1 : 0;
+#endif
+}
+
 OS_thr * OS_create_thread (ThreadFuncType thread_func, void * data) {
 
-	ThrID     thread_id;
 	OS_thr   *thr_h = NULL;
 
 	thr_h = (OS_thr *)calloc(1, sizeof(OS_thr));
 	if (!thr_h) return NULL;
 
-	thr_h->env = opsec_init(OPSEC_EOL);
-	if (!thr_h->env) {
+	thr_h->data     = data;
+	
+#ifdef WIN32
+	thr_h->handle = CreateThread(NULL, 0, thread_func, (void *)thr_h, 0, &thr_h->thread_id);
+	if (thr_h->handle == NULL) {
+		free(thr_h);
+		return NULL;
+	}
+#else
+	if (pthread_create(&thr_h->handle, NULL, thread_func, (void *)thr_h) != 0) {
 		free(thr_h);
 		return NULL;
 	}
+	thr_h->thread_id = thr_h->handle;
+#endif
 
-	thr_h->event_id = OS_create_event();
-	thr_h->data     = data;
-	
+	return thr_h;
+}
+
+/*
+ * Mutex and condition variable wrappers.
+ */
+
+int
+OS_mutex_init(OS_mutex *mtx)
+{
 #ifdef WIN32
-	CreateThread(NULL, 0, thread_func, (void *)thr_h, 0, &thread_id);
+	InitializeCriticalSection(mtx);
+	return 0;
 #else
-	thr_create(NULL, NULL, thread_func, (void *)thr_h, NULL, &thread_id); /* != 0) */
+	return pthread_mutex_init(mtx, NULL) ? -1 : 0;
 #endif
+}
 
-	thr_h->thread_id = thread_id;
+void
+OS_mutex_lock(OS_mutex *mtx)
+{
+#ifdef WIN32
+	EnterCriticalSection(mtx);
+#else
+	pthread_mutex_lock(mtx);
+#endif
+}
 
-	return thr_h;
+void
+OS_mutex_unlock(OS_mutex *mtx)
+{
+#ifdef WIN32
+	LeaveCriticalSection(mtx);
+#else
+	pthread_mutex_unlock(mtx);
+#endif
+}
+
+void
+OS_mutex_destroy(OS_mutex *mtx)
+{
+#ifdef WIN32
+	DeleteCriticalSection(mtx);
+#else
+	pthread_mutex_destroy(mtx);
+#endif
+}
+
+int
+OS_cond_init(OS_cond *cond)
+{
+#ifdef WIN32
+	InitializeConditionVariable(cond);
+	return 0;
+#else
+	return pthread_cond_init(cond, NULL) ? -1 : 0;
+#endif
+}
+
+void
+OS_cond_wait(OS_cond *cond, OS_mutex *mtx)
+{
+#ifdef WIN32
+	SleepConditionVariableCS(cond, mtx, INFINITE);
+#else
+	pthread_cond_wait(cond, mtx);
+#endif
+}
+
+void
+OS_cond_signal(OS_cond *cond)
+{
+#ifdef WIN32
+	WakeConditionVariable(cond);
+#else
+	pthread_cond_signal(cond);
+#endif
+}
+
+void
+OS_cond_broadcast(OS_cond *cond)
+{
+#ifdef WIN32
+	WakeAllConditionVariable(cond);
+#else
+	pthread_cond_broadcast(cond);
+#endif
+}
+
+void
+OS_cond_destroy(OS_cond *cond)
+{
+#ifdef WIN32
+	/* Win32 condition variables need no cleanup */
+#else
+	pthread_cond_destroy(cond);
+#endif
+}
+
+/*
+ * The main thread inbox.
+ */
+
+#ifdef WIN32
+
+static int
+inbox_event_handler(OpsecEnv *env, int event_no, void *raise_data, void *set_data)
+{
+	OS_inbox *inbox = (OS_inbox *)set_data;
+
+	return inbox->handler((OS_raise_data *)raise_data, inbox->opaque);
+}
+
+#else
+
+static int
+inbox_set_nonblock(int fd)
+{
+	int flags = fcntl(fd, F_GETFL, 0);
+
+	return (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) ? -1 : 0;
+}
+
+/*
+ * Called by the mainloop when the inbox descriptor is readable: clear the
+ * wakeup and handle every message queued so far, in the order posted.
+ */
+static int
+inbox_wakeup(int fd, void *opaque)
+{
+	OS_inbox      *inbox = (OS_inbox *)opaque;
+	OS_raise_data *msg, *next;
+	char           buf[64];
+
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+
+	OS_mutex_lock(&inbox->lock);
+	msg = inbox->first;
+	inbox->first    = inbox->last = NULL;
+	inbox->signaled = 0;
+	OS_mutex_unlock(&inbox->lock);
+
+	for (; msg; msg = next) {
+		next = msg->next;
+		msg->next = NULL;
+		inbox->handler(msg, inbox->opaque);
+	}
+
+	return 0;
+}
+
+#endif
+
+OS_inbox *
+OS_inbox_create(OpsecEnv *env, OS_msg_handler handler, void *opaque)
+{
+	OS_inbox *inbox = (OS_inbox *)calloc(1, sizeof(OS_inbox));
+#ifndef WIN32
+	int       fds[2];
+#endif
+
+	if (!inbox) return NULL;
+
+	inbox->env     = env;
+	inbox->handler = handler;
+	inbox->opaque  = opaque;
+
+#ifdef WIN32
+	inbox->event_no = opsec_new_event_id();
+	if (opsec_set_event_handler(env, inbox->event_no, inbox_event_handler, inbox)) {
+		free(inbox);
+		return NULL;
+	}
+#else
+	if (OS_mutex_init(&inbox->lock)) {
+		free(inbox);
+		return NULL;
+	}
+
+#ifdef __linux__
+	fds[0] = fds[1] = eventfd(0, 0);
+	if (fds[0] < 0) {
+#else
+	if (pipe(fds) < 0) {
+#endif
+		fprintf(stderr, "OS_inbox_create: cannot create the wakeup descriptor: %s\n", strerror(errno));
+		OS_mutex_destroy(&inbox->lock);
+		free(inbox);
+		return NULL;
+	}
+	inbox->wake_rd = fds[0];
+	inbox->wake_wr = fds[1];
+
+	/* the reader drains until EAGAIN, the writers never block */
+	if (inbox_set_nonblock(inbox->wake_rd) || inbox_set_nonblock(inbox->wake_wr)) {
+		close(inbox->wake_rd);
+		if (inbox->wake_wr != inbox->wake_rd)
+			close(inbox->wake_wr);
+		OS_mutex_destroy(&inbox->lock);
+		free(inbox);
+		return NULL;
+	}
+
+	opsec_set_socket_event(env, OPSEC_SK_INPUT, inbox->wake_rd, inbox_wakeup, inbox);
+#endif
+
+	return inbox;
+}
+
+/*
+ * Post a message to the main thread. May be called by any thread.
+ * Returns 0 if successful, -1 otherwise (the message is not taken).
+ */
+int
+OS_inbox_post(OS_inbox *inbox, OS_raise_data *msg)
+{
+#ifdef WIN32
+	return opsec_raise_event(inbox->env, inbox->event_no, msg) ? -1 : 0;
+#else
+	int wake = 0;
+#ifdef __linux__
+	unsigned long long one = 1;
+#else
+	char one = 1;
+#endif
+
+	msg->next = NULL;
+
+	OS_mutex_lock(&inbox->lock);
+	if (inbox->last)
+		inbox->last->next = msg;
+	else
+		inbox->first = msg;
+	inbox->last = msg;
+
+	if (!inbox->signaled)
+		wake = inbox->signaled = 1;
+	OS_mutex_unlock(&inbox->lock);
+
+	/* a full pipe or eventfd already wakes the main thread */
+	if (wake && write(inbox->wake_wr, &one, sizeof(one)) < 0 && errno != EAGAIN)
+		fprintf(stderr, "OS_inbox_post: wakeup failed: %s\n", strerror(errno));
+
+	return 0;
+#endif
+}
+
+/*
+ * Destroy the inbox, once no thread posts to it any more. Messages which
+ * were not handled are dropped: their chunk reference is released, as the
+ * handler would, and the message is given to msg_free.
+ */
+void
+OS_inbox_destroy(OS_inbox *inbox, OS_msg_free msg_free)
+{
+#ifndef WIN32
+	OS_raise_data *msg, *next;
+#endif
+
+	if (!inbox) return;
+
+#ifdef WIN32
+	opsec_del_event_handler(inbox->env, inbox->event_no, inbox_event_handler, inbox);
+#else
+	opsec_del_socket_event(inbox->env, OPSEC_SK_INPUT, inbox->wake_rd);
+	close(inbox->wake_rd);
+	if (inbox->wake_wr != inbox->wake_rd)
+		close(inbox->wake_wr);
+
+	for (msg = inbox->first; msg; msg = next) {
+		next = msg->next;
+		msg->next = NULL;
+		chunk_ring_release(msg->chunk);
+		msg->chunk = NULL;
+		if (msg_free)
+			msg_free(msg, inbox->opaque);
+	}
+	inbox->first = inbox->last = NULL;
+
+	OS_mutex_destroy(&inbox->lock);
+#endif
+
+	free(inbox);
 }
 
 /*
@@ -133,6 +445,8 @@ OS_command_name(OS_command command)
 			return "OS_COMM_PROCESS";
 		case OS_MSG_SEND_SUCCESS:
 			return "OS_MSG_SEND_SUCCESS";
+		case OS_MSG_LAST:
+			return "OS_MSG_LAST";
 		case OS_WORKER_THREAD_READY:
 			return "OS_WORKER_THREAD_READY";
 		case OS_WORKER_THREAD_ERR:
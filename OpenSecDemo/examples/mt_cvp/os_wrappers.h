@@ -22,43 +22,50 @@
  * Inter thread communication commands:                                    *
  * ------------------------------------                                    *
  *                                                                         *
+ * Commands are carried in OS_raise_data messages. Messages to the worker  *
+ * threads are posted on the queue of the pool worker that owns the        *
+ * session (see worker_pool.c). Messages to the main thread are posted on  *
+ * its inbox (see OS_inbox_create in os_wrappers.c). Data chunks travel in *
+ * reference counted slots of the shared chunk ring (see chunk_ring.c) -   *
+ * they are never copied between the threads.                              *
+ *                                                                         *
  * OS_COMM_RQ_BEGIN (main thread to worker thread) - instructs the worker  * 
- * thread to gear up for activity - the worker thread chooses a temp file  *
- * name and opens it for writing.                                          *
+ * thread to gear up for activity - the worker thread creates the scan     *
+ * stream that will hold the file (see ../common/scan_stream.c).           *
  *                                                                         *
  * OS_COMM_RQ_END (main thread to worker thread) - instructs the worker    *
- * thread to unregister its event handler and exit.                        *
+ * thread to release all of the state it holds for the session.            *
  *                                                                         *
  * OS_COMM_RECEIVE_CHUNK (both directions) - used to inform the peer       *
  * thread that it should receive a data chunk. The worker thread writes    *
- * the chunk to the temporary file and the main thread sends it to the     *
+ * the chunk to the scan stream and the main thread sends it to the        *
  * client.                                                                 *
  *                                                                         *
  * OS_COMM_SEND_CHUNK (main thread to worker thread) - used by the main    *
- * thread to instruct the worker thread to read a chunk from the temporary *
- * file and send it to the main thread.                                    *
+ * thread to instruct the worker thread to read a chunk from the scan      *
+ * stream and send it to the main thread.                                  *
  *                                                                         *
  * OS_COMM_START_SENDING (main thread to worker thread) - used by the main *
  * thread to inform the worker thread that it will be asked to send chunks *
- * in the near future.                                                     *
+ * in the near future. With OS_FLAG_FIX the worker first replaces the      *
+ * infected content of the scan stream.                                    *
  *                                                                         *
  * OS_COMM_PROCESS (worker thread to main thread) - used by the worker     *
  * thread to inform the main thread that the last incoming chunk has been  *
- * written to the disk and that it may start processing the file.          *
+ * stored and scanned, and that it may start processing the file.          *
  *                                                                         *
  * OS_MSG_SEND_SUCCESS (main thread to worker thread) - the main thread    *
  * informs the worker thread that the previously supplied chunk was sent   *
  * to the CVP client.                                                      *
  *                                                                         *
  * OS_MSG_LAST (worker thread to main thread) - this is the last message   *
- * sent by the worker thread before it exits. The main thread can then     *
- * delete all references to the session with which the worker thread was   *
- * associated.                                                             *
+ * sent by the worker thread for a session (in reply to OS_COMM_RQ_END).   *
+ * The main thread can then delete all references to the session.          *
  *                                                                         *
- * OS_WORKER_THREAD_READY (worker thread to main thread) - this is the     *
- * message sent by the worker thread when it is ready to start receiving   *
- * messages from the main thread. This message will casue the main thread  *
- * resume the session.                                                     *
+ * OS_WORKER_THREAD_READY (worker thread to main thread) - sent by the     *
+ * worker thread once it has drained a chunk that the main thread marked   *
+ * with OS_FLAG_RESUME (the chunk ring was running low when the chunk was  *
+ * queued). This message will cause the main thread to resume the session. *
  *                                                                         *
  * OS_WORKER_THREAD_ERR (worker thread to main thread) - used by the       *
  * worker thread to inform the main thread of a fatal error (that will     *
@@ -70,13 +77,19 @@
 #include <winsock.h>
 #include <winbase.h>
 typedef DWORD ThrID;
+typedef HANDLE ThrHandle;
+typedef CRITICAL_SECTION   OS_mutex;
+typedef CONDITION_VARIABLE OS_cond;
 #define ThreadFuncType LPTHREAD_START_ROUTINE
 #define ThreadFuncReturnType DWORD WINAPI
 #else
 #include <unistd.h>
-#include <thread.h>
-/* use Solaris native threads (should link with -lthread) */
-typedef thread_t ThrID;
+#include <pthread.h>
+/* use POSIX threads (should link with -lpthread) */
+typedef pthread_t ThrID;
+typedef pthread_t ThrHandle;
+typedef pthread_mutex_t OS_mutex;
+typedef pthread_cond_t  OS_cond;
 #define ThreadFuncReturnType void *
 typedef void * (*ThreadFuncType) (void *);
 #endif
@@ -84,8 +97,7 @@ typedef void * (*ThreadFuncType) (void *);
 
 typedef struct _OS_thr {
 	ThrID          thread_id;
-	OpsecEnv      *env;
-	long           event_id;
+	ThrHandle      handle;
 	void          *data;
 } OS_thr;
 
@@ -102,15 +114,64 @@ typedef enum _OS_command {
 	OS_WORKER_THREAD_ERR
 } OS_command;
 
+/*
+ * OS_raise_data flags
+ */
+#define OS_FLAG_RESUME   0x1   /* reply with OS_WORKER_THREAD_READY once handled */
+#define OS_FLAG_FIX      0x2   /* OS_COMM_START_SENDING: replace infected content */
+
+struct _ring_chunk;
+
 typedef struct _OS_raise_data {
-	OpsecSession  *session;
-	OS_command     command_type;
-	void          *data;
-	int            data_len;
-	int            chunk_size;
+	struct _OS_raise_data *next;        /* queue / free list link        */
+	OpsecSession          *session;
+	unsigned long          gen;         /* generation of the session     */
+	void                  *worker_data; /* per-session worker state      */
+	OS_command             command_type;
+	struct _ring_chunk    *chunk;       /* NULL for commands without data */
+	int                    data_len;
+	int                    chunk_size;
+	int                    flags;
+	unsigned long          posted;      /* [usec], for the queue metrics */
 } OS_raise_data;
+
+/*
+ * Called for every message posted to a worker or to the main thread
+ * inbox. The handler owns the message.
+ */
+typedef int (*OS_msg_handler) (OS_raise_data *msg, void *opaque);
+
+/*
+ * Called by OS_inbox_destroy for every message which was not handled,
+ * once its chunk reference is released, to return the message.
+ */
+typedef void (*OS_msg_free) (OS_raise_data *msg, void *opaque);
+
+/*
+ * The inbox of the main thread. The worker threads post messages to it,
+ * the main thread handles them from its OPSEC mainloop.
+ */
+typedef struct _OS_inbox {
+	OpsecEnv        *env;
+	OS_msg_handler   handler;
+	void            *opaque;
+#ifdef WIN32
+	long             event_no;
+#else
+	OS_mutex         lock;
+	OS_raise_data   *first;
+	OS_raise_data   *last;
+	int              wake_rd;       /* registered with the mainloop      */
+	int              wake_wr;       /* == wake_rd for an eventfd         */
+	int              signaled;      /* a wakeup is pending               */
+#endif
+} OS_inbox;
 	
 
+OS_inbox * OS_inbox_create(OpsecEnv *env, OS_msg_handler handler, void *opaque);
+int        OS_inbox_post(OS_inbox *inbox, OS_raise_data *msg);
+void       OS_inbox_destroy(OS_inbox *inbox, OS_msg_free msg_free);
+
 int      OS_raise_event(OpsecEnv *env, long event_no, void *raise_data);
 int      OS_unraise_event(OpsecEnv *env,  long event_no, void *raise_data);
 long     OS_create_event();
@@ -119,12 +180,23 @@ int      OS_del_event_handler(OpsecEnv *env, long event_no, OpsecEventHandler ha
 int      OS_wait_on_events(OpsecEnv *env);
 void     OS_schedule(OpsecEnv *env, long time , void(*func)(void*), void *opaque);
 void     OS_thread_cleanup(OS_thr *thr_h);
+int      OS_thread_join(OS_thr *thr_h);
 OS_thr * OS_create_thread (ThreadFuncType thread_func, void * data);
 char   * OS_command_name(OS_command command);
 
+int      OS_mutex_init(OS_mutex *mtx);
+void     OS_mutex_lock(OS_mutex *mtx);
+void     OS_mutex_unlock(OS_mutex *mtx);
+void     OS_mutex_destroy(OS_mutex *mtx);
+int      OS_cond_init(OS_cond *cond);
+void     OS_cond_wait(OS_cond *cond, OS_mutex *mtx);
+void     OS_cond_signal(OS_cond *cond);
+void     OS_cond_broadcast(OS_cond *cond);
+void     OS_cond_destroy(OS_cond *cond);
+
 /*
- * The temporary directory where the temporary files will be written to
- * by the worker threads.
+ * The temporary directory where the worker threads spill files that are
+ * larger than the scan stream memory threshold.
  */
 
 #ifdef WIN32
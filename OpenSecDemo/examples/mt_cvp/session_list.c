@@ -19,22 +19,27 @@
  *                                                                         *
  * The 'session list' is used to keep track of session that have ended but *
  * their associated worker threads have not yet sent their last message.   *
- * In this manner, events that are on the event queue of the CVP server    *
- * main thread and are associated with sessions for which the end handler  *
+ * In this manner, messages that are on the inbox of the CVP server main   *
+ * thread and are associated with sessions for which the end handler       *
  * already been called, can safely be discarded.                           *
  *                                                                         *
  * The list is created by the server main thread at startup. Sessions are  *
  * added to it when the associated end handler is invoked. Sessions are    *
  * deleted from it when the 'last' message from the worker thread is       *
- * processed. Each event handled by the main thread is tested for the      *
+ * processed. Each message handled by the main thread is tested for the    *
  * validity of the sessions it is associated with.                         *
  *                                                                         *
- * Note: A better solution here may include:                               *
- *       1) Using some other key that is not the session pointer. A        *
- *          unique ID would do.                                            *
- *       2) A better seach algorithm than traversing through the list.     *
+ * Every message is tested, so the list is a hash table: open addressing   *
+ * with linear probing, keyed by the session pointer and generation.       *
+ * Adding, testing and deleting a session take constant time, however      *
+ * many sessions are dying. Deleting moves the following entries of the    *
+ * probe sequence back, so no 'deleted' marks are left behind. The table   *
+ * doubles when it is half full.                                           *
  *                                                                         *
- *       This implementation is a simplified example.                      *
+ * The OPSEC library may reuse the object of an ended session for a new    *
+ * session before the worker of the old one is done. The generation of     *
+ * the session, carried in every message, tells the two apart: messages    *
+ * of the new session are not discarded.                                   *
  *                                                                         *
  ***************************************************************************/
 
@@ -43,88 +48,123 @@
 #include <opsec/opsec.h>
 #include "session_list.h"
 
-static list_el * session_list_get_first(dying_session_lst *lst);
-static list_el * session_list_get_next(dying_session_lst *lst);
+#define SESSION_LIST_MIN_SIZE  64
 
-dying_session_lst*
-create_session_list(void)
+static unsigned int
+session_hash(OpsecSession *session, unsigned long gen)
 {
-	dying_session_lst *lst = (dying_session_lst *)calloc(1, sizeof(dying_session_lst));
+	unsigned long h = (unsigned long)(size_t)session >> 4;
 
-	return lst;
+	h ^= gen * 2654435761UL;
+	h ^= h >> 15;
+	h *= 2246822519UL;
+	h ^= h >> 13;
+
+	return (unsigned int)h;
 }
 
-static list_el *
-session_list_get_first(dying_session_lst *lst)
+/*
+ * The slot holding the session, or the free slot where it belongs.
+ */
+static dying_session *
+session_list_find(dying_session_lst *lst, OpsecSession *session, unsigned long gen)
 {
-	if (!lst) return NULL;
+	unsigned int   mask = lst->size - 1;
+	unsigned int   i    = session_hash(session, gen) & mask;
 
-	if (lst->num_elements == 0) return NULL;
+	while (lst->slots[i].session &&
+	       (lst->slots[i].session != session || lst->slots[i].gen != gen))
+		i = (i + 1) & mask;
 
-	lst->current = lst->first;
+	return &lst->slots[i];
+}
 
-	return lst->first;
+static int
+session_list_resize(dying_session_lst *lst, int size)
+{
+	dying_session *old      = lst->slots;
+	int            old_size = lst->size;
+	int            i;
+
+	lst->slots = (dying_session *)calloc(size, sizeof(dying_session));
+	if (!lst->slots) {
+		lst->slots = old;
+		return -1;
+	}
+	lst->size = size;
+
+	for (i = 0; i < old_size; i++)
+		if (old[i].session)
+			*session_list_find(lst, old[i].session, old[i].gen) = old[i];
+
+	free(old);
+
+	return 0;
 }
 
-static list_el *
-session_list_get_next(dying_session_lst *lst)
+dying_session_lst*
+create_session_list(void)
 {
+	dying_session_lst *lst = (dying_session_lst *)calloc(1, sizeof(dying_session_lst));
+
 	if (!lst) return NULL;
 
-	if (lst->current->next) {
-		lst->current = lst->current->next;
-		return lst->current;
-	} else 
+	if (session_list_resize(lst, SESSION_LIST_MIN_SIZE)) {
+		free(lst);
 		return NULL;
+	}
+
+	return lst;
 }
 
 int
-session_list_add(dying_session_lst *lst, OpsecSession *session)
+session_list_add(dying_session_lst *lst, OpsecSession *session, unsigned long gen)
 {
-	list_el   *el;
+	dying_session  *slot;
 	
 	if (!lst || !session) return -1;
 
-	el = (list_el *)calloc(1, sizeof(list_el));
-	if (!el) return -1;
+	if (2 * (lst->num_elements + 1) > lst->size &&
+	    session_list_resize(lst, 2 * lst->size))
+		return -1;
 
-	el->session = session;
-	
-	if (lst->num_elements == 0) {
-		lst->first = lst->last = el;
-	} else {
-		lst->last->next = el;
-		el->prev        = lst->last;
-		lst->last       = el;
-	}
+	slot = session_list_find(lst, session, gen);
+	if (slot->session) return 0;
 
+	slot->session = session;
+	slot->gen     = gen;
 	lst->num_elements++;
 	
 	return 0;
 }
 
 int
-session_list_delete(dying_session_lst *lst, OpsecSession *session)
+session_list_delete(dying_session_lst *lst, OpsecSession *session, unsigned long gen)
 {
-	list_el   *el;
+	unsigned int   mask;
+	unsigned int   i, j, home;
 	
 	if (!lst || !session || (lst->num_elements == 0)) return -1;
 
-	el = session_list_get_first(lst);
-	
-	while (el && (el->session != session) && (el = session_list_get_next(lst)));
-	if (!el) return 0;
-
-	if (el->prev) el->prev->next = el->next;
-	else lst->first = el->next;
-
-	if (el->next) el->next->prev = el->prev;
-	else lst->last = el->prev;
-
-	free(el);
+	mask = lst->size - 1;
+	i    = (unsigned int)(session_list_find(lst, session, gen) - lst->slots);
+	if (!lst->slots[i].session) return 0;
+
+	/*
+	 * Move back every following entry of the probe sequence which would
+	 * not be found past the hole.
+	 */
+	for (j = (i + 1) & mask; lst->slots[j].session; j = (j + 1) & mask) {
+		home = session_hash(lst->slots[j].session, lst->slots[j].gen) & mask;
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			lst->slots[i] = lst->slots[j];
+			i = j;
+		}
+	}
+	lst->slots[i].session = NULL;
+	lst->slots[i].gen     = 0;
 
 	lst->num_elements--;
-	if (lst->num_elements == 0) lst->current = NULL;
 	
 	return 0;
 }
@@ -132,39 +172,22 @@ session_list_delete(dying_session_lst *lst, OpsecSession *session)
 int
 session_list_destroy(dying_session_lst *lst)
 {
-	list_el  *el;
-	list_el  *next_el;
-
 	if (!lst) return 0;
 
-	el = session_list_get_first(lst);
-	if (el) {
-		do {
-			next_el = el->next;
-			free(el);
-			el = next_el;
-		} while(el);
-	}
-
+	free(lst->slots);
 	free(lst);
 	
 	return 0;
 }
 
 int
-session_is_in_list(dying_session_lst *lst, OpsecSession *session)
+session_is_in_list(dying_session_lst *lst, OpsecSession *session, unsigned long gen)
 {
-	list_el  *el;
-	
 	if (!lst) return -1;
 
 	if (!session) return 0;
 
 	if (lst->num_elements == 0) return 0;
 
-	el = session_list_get_first(lst);
-
-	while (el && (el->session != session) && (el = session_list_get_next(lst)));
-
-	return (el?1:0);	
+	return session_list_find(lst, session, gen)->session ? 1 : 0;
 }
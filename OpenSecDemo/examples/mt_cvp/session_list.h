@@ -25,23 +25,27 @@
  ***************************************************************************/
 
 
-typedef struct _list_el {
-	struct _list_el   *next;
-	struct _list_el   *prev;
-	OpsecSession      *session;
-} list_el;
+/*
+ * A slot of the table. Sessions are told apart by their generation, a
+ * number given by the main thread to every session it starts, so a
+ * session object reused by the OPSEC library is not taken for the
+ * session which used it before.
+ */
+typedef struct _dying_session {
+	OpsecSession   *session;       /* NULL for a free slot */
+	unsigned long   gen;
+} dying_session;
 
 typedef struct _dying_session_lst {
-	int       num_elements;
-	list_el  *first;
-	list_el  *last;
-	list_el  *current;
+	int             num_elements;
+	int             size;          /* number of slots, a power of 2 */
+	dying_session  *slots;
 } dying_session_lst;
 
 dying_session_lst * create_session_list(void);
-int                 session_list_add(dying_session_lst *lst, OpsecSession *session);
-int                 session_list_delete(dying_session_lst *lst, OpsecSession *session);
+int                 session_list_add(dying_session_lst *lst, OpsecSession *session, unsigned long gen);
+int                 session_list_delete(dying_session_lst *lst, OpsecSession *session, unsigned long gen);
 int                 session_list_destroy(dying_session_lst *lst);
-int                 session_is_in_list(dying_session_lst *lst, OpsecSession *session);
+int                 session_is_in_list(dying_session_lst *lst, OpsecSession *session, unsigned long gen);
 
 #endif
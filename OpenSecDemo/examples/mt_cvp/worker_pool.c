@@ -0,0 +1,260 @@
+/***************************************************************************
+ *                                                                         *
+ * worker_pool.c : Sample OPSEC CVP Server                                 *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2001 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * The worker pool is a fixed number of worker threads, created once at    *
+ * server startup. Each worker has its own message queue protected by a    *
+ * mutex and a condition variable; the worker sleeps on the condition      *
+ * until a message is posted.                                              *
+ *                                                                         *
+ * Every session is bound to a single worker (round robin) when it starts, *
+ * and all the messages of the session are posted to that worker. This     *
+ * keeps the messages of a session in order without any per-session lock.  *
+ *                                                                         *
+ * The pool also keeps the OS_raise_data messages used in both directions. *
+ * They are allocated once and recycled through a free list; the heap is   *
+ * used only if the free list runs dry.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+
+#include <stdlib.h>
+#include <string.h>
+#include <opsec/opsec.h>
+#include "worker_pool.h"
+
+static ThreadFuncReturnType worker_pool_thread_func(void *data);
+
+worker_pool *
+worker_pool_create(int n_workers, int n_msgs, OS_msg_handler handler, void *opaque)
+{
+	worker_pool *pool;
+	int          i;
+
+	if (n_workers <= 0 || !handler) return NULL;
+
+	pool = (worker_pool *)calloc(1, sizeof(worker_pool));
+	if (!pool) return NULL;
+
+	pool->handler = handler;
+	pool->opaque  = opaque;
+
+	if (OS_mutex_init(&pool->msg_lock)) {
+		free(pool);
+		return NULL;
+	}
+
+	if (n_msgs > 0) {
+		pool->msg_mem = (OS_raise_data *)calloc(n_msgs, sizeof(OS_raise_data));
+		if (!pool->msg_mem) {
+			worker_pool_destroy(pool);
+			return NULL;
+		}
+		for (i = 0; i < n_msgs; i++) {
+			pool->msg_mem[i].next = pool->msg_free;
+			pool->msg_free = &pool->msg_mem[i];
+		}
+		pool->n_msgs = n_msgs;
+	}
+
+	pool->workers = (pool_worker *)calloc(n_workers, sizeof(pool_worker));
+	if (!pool->workers) {
+		worker_pool_destroy(pool);
+		return NULL;
+	}
+
+	for (i = 0; i < n_workers; i++) {
+		pool_worker *w = &pool->workers[i];
+
+		w->pool = pool;
+		if (OS_mutex_init(&w->lock)) break;
+		if (OS_cond_init(&w->cond)) {
+			OS_mutex_destroy(&w->lock);
+			break;
+		}
+
+		w->thr_h = OS_create_thread(worker_pool_thread_func, w);
+		if (!w->thr_h) {
+			OS_cond_destroy(&w->cond);
+			OS_mutex_destroy(&w->lock);
+			break;
+		}
+		pool->n_workers++;
+	}
+
+	if (pool->n_workers != n_workers) {
+		worker_pool_destroy(pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+/*
+ * Stop all the workers and wait for them to exit. Messages still queued
+ * are handed to the handler first, so that chunk references are released.
+ * The messages themselves stay valid until worker_pool_destroy().
+ */
+void
+worker_pool_stop(worker_pool *pool)
+{
+	int i;
+
+	if (!pool) return;
+
+	for (i = 0; i < pool->n_workers; i++) {
+		pool_worker *w = &pool->workers[i];
+
+		OS_mutex_lock(&w->lock);
+		w->stop = 1;
+		OS_cond_signal(&w->cond);
+		OS_mutex_unlock(&w->lock);
+
+		OS_thread_join(w->thr_h);
+		OS_thread_cleanup(w->thr_h);
+		OS_cond_destroy(&w->cond);
+		OS_mutex_destroy(&w->lock);
+	}
+	free(pool->workers);
+
+	pool->workers   = NULL;
+	pool->n_workers = 0;
+}
+
+/*
+ * Stop the workers if worker_pool_stop() was not called, and free the
+ * pool with its messages.
+ */
+void
+worker_pool_destroy(worker_pool *pool)
+{
+	OS_raise_data *msg;
+
+	if (!pool) return;
+
+	worker_pool_stop(pool);
+
+	/* free the heap allocated messages that were returned to the free list */
+	while ((msg = pool->msg_free)) {
+		pool->msg_free = msg->next;
+		if (msg < pool->msg_mem || msg >= pool->msg_mem + pool->n_msgs)
+			free(msg);
+	}
+	free(pool->msg_mem);
+
+	OS_mutex_destroy(&pool->msg_lock);
+	free(pool);
+}
+
+/*
+ * Choose the worker for a new session.
+ */
+int
+worker_pool_assign(worker_pool *pool)
+{
+	int worker;
+
+	if (!pool) return -1;
+
+	worker = pool->next_worker;
+	pool->next_worker = (pool->next_worker + 1) % pool->n_workers;
+
+	return worker;
+}
+
+int
+worker_pool_post(worker_pool *pool, int worker, OS_raise_data *msg)
+{
+	pool_worker *w;
+
+	if (!pool || !msg || worker < 0 || worker >= pool->n_workers) return -1;
+
+	w = &pool->workers[worker];
+	msg->next = NULL;
+
+	OS_mutex_lock(&w->lock);
+	if (w->last) w->last->next = msg;
+	else w->first = msg;
+	w->last = msg;
+	OS_cond_signal(&w->cond);
+	OS_mutex_unlock(&w->lock);
+
+	return 0;
+}
+
+OS_raise_data *
+worker_pool_msg_alloc(worker_pool *pool)
+{
+	OS_raise_data *msg;
+
+	OS_mutex_lock(&pool->msg_lock);
+	msg = pool->msg_free;
+	if (msg) pool->msg_free = msg->next;
+	OS_mutex_unlock(&pool->msg_lock);
+
+	if (!msg) {
+		msg = (OS_raise_data *)malloc(sizeof(OS_raise_data));
+		if (!msg) return NULL;
+	}
+
+	memset(msg, 0, sizeof(OS_raise_data));
+
+	return msg;
+}
+
+void
+worker_pool_msg_free(worker_pool *pool, OS_raise_data *msg)
+{
+	if (!msg) return;
+
+	OS_mutex_lock(&pool->msg_lock);
+	msg->next = pool->msg_free;
+	pool->msg_free = msg;
+	OS_mutex_unlock(&pool->msg_lock);
+}
+
+/***************************************************************************
+ * The worker thread main loop: wait for a message, dispatch it.           *
+ ***************************************************************************/
+static ThreadFuncReturnType
+worker_pool_thread_func(void *data)
+{
+	OS_thr        *thr_h = (OS_thr *)data;
+	pool_worker   *w     = (pool_worker *)thr_h->data;
+	worker_pool   *pool  = w->pool;
+	OS_raise_data *msg;
+
+	for (;;) {
+		OS_mutex_lock(&w->lock);
+		while (!w->first && !w->stop)
+			OS_cond_wait(&w->cond, &w->lock);
+
+		msg = w->first;
+		if (msg) {
+			w->first = msg->next;
+			if (!w->first) w->last = NULL;
+		}
+		OS_mutex_unlock(&w->lock);
+
+		if (!msg) break;	/* stopped and drained */
+
+		pool->handler(msg, pool->opaque);
+	}
+
+	return 0;
+}
@@ -0,0 +1,68 @@
+#ifndef _WORKER_POOL_H_
+#define _WORKER_POOL_H_
+
+/***************************************************************************
+ *                                                                         *
+ * worker_pool.h : Sample OPSEC CVP Server                                 *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2001 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * See worker_pool.c for further explanations.                             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include "os_wrappers.h"
+
+/*
+ * The handler (see OS_msg_handler) is called by a worker thread for every
+ * message posted to it, and must return it with worker_pool_msg_free().
+ */
+
+struct _worker_pool;
+
+typedef struct _pool_worker {
+	struct _worker_pool *pool;
+	OS_thr              *thr_h;
+	OS_mutex             lock;
+	OS_cond              cond;
+	OS_raise_data       *first;
+	OS_raise_data       *last;
+	int                  stop;
+} pool_worker;
+
+typedef struct _worker_pool {
+	int              n_workers;
+	pool_worker     *workers;
+	int              next_worker;
+
+	OS_msg_handler   handler;
+	void            *opaque;
+
+	OS_mutex         msg_lock;
+	OS_raise_data   *msg_free;      /* free list of preallocated messages */
+	OS_raise_data   *msg_mem;
+	int              n_msgs;
+} worker_pool;
+
+worker_pool   * worker_pool_create(int n_workers, int n_msgs, OS_msg_handler handler, void *opaque);
+void            worker_pool_stop(worker_pool *pool);
+void            worker_pool_destroy(worker_pool *pool);
+int             worker_pool_assign(worker_pool *pool);
+int             worker_pool_post(worker_pool *pool, int worker, OS_raise_data *msg);
+OS_raise_data * worker_pool_msg_alloc(worker_pool *pool);
+void            worker_pool_msg_free(worker_pool *pool, OS_raise_data *msg);
+
+#endif
@@ -34,11 +34,14 @@
  This SAM client get its parameter through the command line.
  When the session established it perform the action or monitor request
  with its parameters.
+
+ To run many commands over the same sessions see sam_daemon.c.
  
  **************************************************************************/
 
 #include <sys/types.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #ifdef WIN32
@@ -51,186 +54,15 @@
 #include "opsec/sam.h"
 #include "opsec/opsec.h"
 #include "opsec/opsec_error.h"
+#include "sam_command.h"
 
 #define SAM_SERVER_IP	"127.0.0.1"
 #define SAM_PORT 	18183
 
 typedef enum {HandlerType_MonitorAck, HandlerType_Ack } eHandlerType;
 
-char *ALL = "All";
-char msg[4096] = {0};
-
-/*****************************************************************
- * SAM Command
- *****************************************************************/
-struct SamCommand {
-    int action;
-    int log;
-    char *fw_object;
-    int expiration;
-    int mode;
-    int src, src_mask, dst, dst_mask, service, ip_proto;
-    int is_monitor;
-};
-
 struct SamCommand g_command;
 
-static void SamCommandInit(struct SamCommand *command)
-{
-    command->action     = 0;
-    command->log        = SAM_LONG_NOALERT;
-    command->fw_object  = ALL;
-    command->expiration = SAM_EXPIRE_NEVER;
-    command->mode       = -1;
-
-    command->src        = 0;
-    command->src_mask   = 0;
-    command->dst        = 0;
-    command->dst_mask   = 0;
-    command->service    = 0;
-    command->ip_proto   = 0;
-    command->is_monitor = 0;
-}
-
-/*****************************************************************
- * SAM Modes
- *****************************************************************/
-struct _SamMode {
-    char *name;
-    int   n_args;
-    int   designator;
-} SamModeTable [] = {
-    "src",      1, SAM_SRC_IP,
-    "dst",      1, SAM_DST_IP,
-    "any",      1, SAM_ANY_IP,
-    "subsrc",   2, SAM_SUB_SRC_IP,
-    "subdst",   2, SAM_SUB_DST_IP,
-    "subany",   2, SAM_SUB_ANY_IP,    
-    "srv",      4, SAM_SERV,
-    "subsrv",   6, SAM_SUB_SERV,
-    "subsrvs",  5, SAM_SUB_SERV_SRC,
-    "subsrvd",  5, SAM_SUB_SERV_DST,
-    "dstsrv",   3, SAM_DST_SERV,
-    "subdstsrv",4, SAM_SUB_DST_SERV,
-    "srcpr",    2, SAM_SRC_IP_PROTO,
-    "dstpr",    2, SAM_DST_IP_PROTO,
-    "subsrcpr", 3, SAM_SUB_SRC_IP_PROTO,
-    "subdstpr", 3, SAM_SUB_DST_IP_PROTO,
-    "all",      0, SAM_ALL,
-    NULL,       0, 0 
-};
-
-
-static int SamModeByStr(char *arg)
-{
-    int i;
-    
-    for (i = 0; SamModeTable[i].name != NULL; i++)
-        if (strcmp(arg, SamModeTable[i].name) == 0)
-            return i;
-
-    return -1;    
-}
-
-static int SamModeByInt(int arg)
-{
-    int i;
-    
-    for (i = 0; SamModeTable[i].name != NULL; i++)
-        if (arg == SamModeTable[i].designator)
-            return i;
-
-    return -1;    
-}
-
-/*****************************************************************
- * SAM Actions
- *****************************************************************/
-struct _SamAction {
-    char *action_str;
-    int  action ;
-} SamActionsTable [] = {
-    "reject",               SAM_REJECT | SAM_INHIBIT,
-    "notify",               SAM_NOTIFY,
-    "inhibit",              SAM_INHIBIT,
-    "inhibit_close",        SAM_INHIBIT_AND_CLOSE,
-    "inhibit_drop",         SAM_INHIBIT_DROP,
-    "drop",                 SAM_INHIBIT_DROP,
-    "inhibit_drop_close",   SAM_INHIBIT_DROP_AND_CLOSE,
-    NULL,                   -1
-};
-
-static int SamActionsByStr(char *str)
-{
-    int i;
-    
-    for (i = 0; SamActionsTable[i].action_str != NULL; i++)
-        if (strcmp(str, SamActionsTable[i].action_str) == 0)
-            return SamActionsTable[i].action;
-
-    return -1;    
-}
-
-static char *SamActionsByInt(int action)
-{
-    int i;
-    
-    for (i = 0; SamActionsTable[i].action_str != NULL; i++)
-        if (action == SamActionsTable[i].action)
-            return SamActionsTable[i].action_str;
-
-    return NULL;    
-}
-
-static int SamMonitorAction(char *action_str)
-{
-    int action = 0, rc = 0;
-    char *tok = NULL;
-
-    for( tok = strtok(action_str, ",") ; tok != NULL; tok = strtok(NULL, ",") ) {
-        if ( (action = SamActionsByStr(tok)) < 0) 
-            return -1;
-        rc |= action;
-    }
-    return rc;
-}
-
-/*****************************************************************
- * SAM Log
- *****************************************************************/
-struct _SamLog {
-    char *log_str;
-    int   log;
-} SamLogsTable [] = {
-    "nolog",           SAM_NOLOG,
-    "log_noalert",     SAM_LONG_NOALERT,
-    "log_alert",       SAM_LONG_ALERT,
-    NULL,               -1
-};
-    
-
-static int SamLogbByStr(char *log_str)
-{
-    int i;
-    
-    for (i = 0; SamLogsTable[i].log_str != NULL; i++)
-        if (strcmp(log_str, SamLogsTable[i].log_str) == 0)
-            return SamLogsTable[i].log;
-
-    return -1;    
-}
-
-static char *SamLogbByInt(int log)
-{
-    int i;
-    
-    for (i = 0; SamLogsTable[i].log_str != NULL; i++)
-        if (log == SamLogsTable[i].log)
-            return SamLogsTable[i].log_str;
-
-    return NULL;    
-}
-
 /*****************************************************************/
 static void
 Usage()
@@ -285,112 +117,6 @@ Usage()
 }
 
 
-/*****************************************************************
- * Some utilites fuctions
- *****************************************************************/
-
-static char *ip2str(int ip)
-{
-    char *ip_str = NULL;
-    struct in_addr ipaddr;
-
-    ipaddr.s_addr = ip;
-    ip_str = inet_ntoa(ipaddr);
-    if (ip_str)
-        return strdup(ip_str);
-
-    return "NULL";
-}
-
-static char *time2str(time_t time)
-{
-    char *time_str = NULL; 
-    int len; 
-
-    if (time == 0) 
-        time_str = strdup("NEVER");
-	else {
-        time_str = strdup(ctime(&time));
-        len = strlen(time_str);
-        time_str[len - 1] = '\0';	/* avoid printing a new line */
-    }
-	
-    return time_str;
-}
-
-static void 
-print_info_table(opsec_table info_data)
-{
-    opsec_table_iterator iter;
-    opsec_vtype vtype;
-    void *elem = NULL;
-
-    unsigned short service, proto;
-    char *src = NULL, *src_mask = NULL, *dst = NULL, *dst_mask = NULL;
-    char *log = NULL, *action = NULL, *time = NULL;
-
-    int i, nentries;
-
-    nentries = sam_table_get_nrows( info_data);
-
-    if (!nentries){
-        fprintf(stderr, "no corresponding SAM requests\n");
-        return;
-    }
-    
-    else { /* prepare a table header */
-        fprintf(stdout, "\n%-16s %-16s %-16s %-16s %-10s %-10s %-15s %-12s %-25s\n",
-                "source ip", "netmask", "destination ip", "netmask", "service", "protocol", "log", 
-                "action", "expiration");
-    }
-    /* create iterator on table */
-    iter = sam_table_iterator_create( info_data);
-
-    for (i = 0; i < nentries ; i++ ) {
-
-        elem = sam_table_iterator_next(iter, &vtype);
-        src = ip2str(*((unsigned int*)elem));
-        
-        elem = sam_table_iterator_next(iter, &vtype);
-        src_mask= ip2str(*((unsigned int*)elem));
-
-        elem = sam_table_iterator_next(iter, &vtype);
-        dst = ip2str(*((unsigned int*)elem));
-        
-        elem = sam_table_iterator_next(iter, &vtype);
-        dst_mask= ip2str(*((unsigned int*)elem));
-
-        elem = sam_table_iterator_next(iter, &vtype);
-        service = (*((unsigned short*)elem));
-
-        elem = sam_table_iterator_next(iter, &vtype);
-        proto = *((unsigned short*)elem);
-
-        elem = sam_table_iterator_next(iter, &vtype);
-        log = SamLogbByInt(*((int*)elem));
-
-        elem = sam_table_iterator_next(iter, &vtype);
-        action = SamActionsByInt(*((int*)elem));
-
-        elem = sam_table_iterator_next(iter, &vtype);
-        time = time2str(*((time_t*)elem)); 
-
-        fprintf(stdout, "%-16s %-16s %-16s %-16s %-10d %-10d %-15s %-12s %-25s\n",
-            src, src_mask, dst, dst_mask, service, proto, log, action, time);
-
-#define FREE(_x) if (_x) free(_x)
-
-        FREE(src);
-        FREE(src_mask);
-        FREE(dst);
-        FREE(dst_mask);
-        FREE(time);
-    }
-        
-	sam_table_iterator_destroy(iter);
-	fprintf(stdout, "\n");		
-}
-
 
 static eOpsecHandlerRC
 print_status_message(eHandlerType type, int closed, int status, int fw_index, 
@@ -423,14 +149,12 @@ print_status_message(eHandlerType type, int closed, int status, int fw_index,
         else /* resolve error for a single target */
             fprintf(stderr, "%s (%d/%d)  failed to resolve firewalled object name for '%s'. The SAM request was not processed on this module.\n",
                     fw_host, fw_index+1, fw_total, (char *)cb_data);
-            free(cb_data);
 
         return OPSEC_SESSION_END;
 
     case SAM_UNEXPECTED_END_OF_SESSION:
         fprintf(stderr, "Unexpected end of session. It is possible that the SAM monitoring request for '%s' was not performed.\n",
                 (char *)cb_data);
-        free(cb_data);
         return OPSEC_SESSION_END;
 
     default:
@@ -442,152 +166,10 @@ print_status_message(eHandlerType type, int closed, int status, int fw_index,
 }
 
 
-static void parse_criteria(struct SamCommand *command, int *_index, int ac, char *av[])
-{
-#define STRCAT(_buf, _msg1, _msg2) \
-    strcat(_buf, _msg1); \
-    strcat(_buf, _msg2)
-
-    int mode_index;
-    int args;
-    int index = *_index;
-
-    if (index >= ac)
-        Usage();
-    
-    if ( (mode_index = SamModeByStr(av[index++])) < 0 )
-        Usage();
-
-    command->mode = SamModeTable[mode_index].designator;
-    strcat(msg, SamModeTable[mode_index].name);
-    
-    if ( ((args = SamModeTable[mode_index].n_args) + index) != ac) {       /* number of arguments is wrong*/
-        fprintf(stderr, "parse_criteria: arguments mismatch for filter %s\n", SamModeTable[mode_index].name);
-        Usage();
-    }
-/* might consider argument validity checks here - for example if the argument order is incorrect or invalid subnet mask, invalid ip etc. */
-    if (command->mode == SAM_ALL && !command->is_monitor) {
-        fprintf(stderr, "parse_criteria: can not use SAM_ALL when the command is not monitor\n");
-        Usage();
-    }
-    
-    if (command->mode & SAM_SRC_IP || command->mode & SAM_ANY_IP) {
-        command->src = inet_addr(av[index]);
-        STRCAT(msg, " src-ip ", av[index++]);  
-
-        if (command->mode & SAM_SMASK) {
-            command->src_mask = inet_addr(av[index]);
-            STRCAT(msg, " src-mask ", av[index++]);  
-        }
-    }
-    
-    if (command->mode & SAM_DST_IP) {
-        command->dst = inet_addr(av[index]);
-        STRCAT(msg, " dst-ip ", av[index++]);  
-        
-        if (command->mode & SAM_DMASK) {
-            command->dst_mask = inet_addr(av[index]);
-            STRCAT(msg, " dst-mask ", av[index++]);  
-        }
-    }
-    
-    if (command->mode & SAM_DPORT) {
-        command->service = atoi(av[index]);
-        STRCAT(msg, " service ", av[index++]);  
-    }
-
-    if (command->mode & SAM_PROTO) {
-        command->ip_proto = atoi(av[index]);
-        STRCAT(msg, " ip-proto ", av[index++]);  
-    }
-
-    *_index = index;
-}
-
-        
-static void parse_command_line(struct SamCommand *command, int ac, char *av[])
-{			
-    int i;
-
-    if (ac < 2)
-        Usage();
-
-    for (i = 1; i < ac; i++) {
-        if (av[i][0] != '-')
-            break;
-            
-        switch (av[i][1]) {
-		
-    	case 't':
-            if ( i+1 >= ac) Usage(); else i++;
-		    command->expiration = (int)atoi( av[i] );
-		    break;
-
-        case 'l':
-            if ( i+1 >= ac) Usage(); else i++;
-            if ( (command->log = SamLogbByStr(av[i]) ) < 0)
-                Usage();
-            break;
-
-        case 'f':
-            if ( i+1 >= ac) Usage(); else i++;
-            command->fw_object = av[i];
-        	break;
-
-        case 'A':
-            if ( i+1 >= ac) Usage(); else i++;
-            if ( (command->action |= SamActionsByStr(av[i++])) < 0) {
-                fprintf(stderr, "parse_command_line: Invalid action (%s)\n", av[i-1] ); 
-                Usage();
-            }
-            strcat(msg, av[i-1]);
-            strcat(msg, " ");
-            parse_criteria(command, &i, ac, av);
-            break;
-
-        case 'C':
-            command->action |= SAM_CANCEL;
-            strcat(msg, "Cancel: ");  
-            break;
-
-
-        case 'D':
-            if (command->action || ac > 4) 
-                Usage();
-            command->action = SAM_DELETE_ALL;
-            strcat(msg, "Delete All ");
-            break;
-			
-        case 'M':
-            strcat(msg, "Monitoring: ");
-            command->is_monitor = 1;
-            if ( i+1 >= ac) Usage(); else i++;
-            if (strcmp("all", av[i])) {
-                strcat(msg, av[i]); strcat(msg, " ");
-                if ( (command->action = SamMonitorAction(av[i++])) < 0) {
-                    fprintf(stderr, "parse_command_line: Invalid monitor action (%s)\n", av[i-1] ); 
-                    Usage();
-                }
-            }           
-            parse_criteria(command, &i, ac, av);
-            break;
-
-        default:
-            Usage();
-        }
-    }
-
-    strcat(msg, " On ");
-    strcat(msg, command->fw_object);
-
-    if (!command->action && !command->is_monitor)
-        Usage();
-}
-
 /******************************************************************
  * we give here two options to build sam command:
  * 1. execute_sam_command
- * 2. alternate_execute_sam_command
+ * 2. SamCommandExecute (sam_command.c)
  *
  * both alternatives are valid.
  ******************************************************************/   
@@ -599,10 +181,10 @@ static eOpsecHandlerRC execute_sam_command(OpsecSession *session)
     struct SamCommand *cmd = &g_command;
 
     if (cmd->mode == SAM_ALL && cmd->is_monitor) 
-        return sam_client_monitor(session, cmd->action, cmd->fw_object, msg, SAM_REQ_TYPE, SAM_ALL, NULL);
+        return sam_client_monitor(session, cmd->action, cmd->fw_object, cmd->msg, SAM_REQ_TYPE, SAM_ALL, NULL);
 
     if (cmd->action == SAM_DELETE_ALL)
-        sam_client_action(session, cmd->action, cmd->log, cmd->fw_object, msg, NULL);
+        sam_client_action(session, cmd->action, cmd->log, cmd->fw_object, cmd->msg, NULL);
     
     switch (cmd->mode) {
     case SAM_DST_IP:
@@ -610,10 +192,10 @@ static eOpsecHandlerRC execute_sam_command(OpsecSession *session)
     case SAM_SRC_IP:    
     case SAM_ANY_IP:
         if (cmd->is_monitor) 
-            rc = sam_client_monitor(session, cmd->action, cmd->fw_object, msg, 
+            rc = sam_client_monitor(session, cmd->action, cmd->fw_object, cmd->msg, 
                                     SAM_REQ_TYPE, cmd->mode, cmd->src, NULL);
         else
-            rc = sam_client_action(session, cmd->action, cmd->log, cmd->fw_object, msg, 
+            rc = sam_client_action(session, cmd->action, cmd->log, cmd->fw_object, cmd->msg, 
                                    SAM_EXPIRE, cmd->expiration, 
                                    SAM_REQ_TYPE, cmd->mode, 
                                    cmd->src, NULL);
@@ -625,12 +207,12 @@ static eOpsecHandlerRC execute_sam_command(OpsecSession *session)
     case SAM_SUB_SRC_IP:
     case SAM_SUB_ANY_IP: 
         if (cmd->is_monitor) 
-            rc = sam_client_monitor(session, cmd->action, cmd->fw_object, msg, 
+            rc = sam_client_monitor(session, cmd->action, cmd->fw_object, cmd->msg, 
                                     SAM_REQ_TYPE, cmd->mode, 
                                     cmd->src, cmd->src_mask,
                                     NULL);
         else
-            rc = sam_client_action(session, cmd->action, cmd->log, cmd->fw_object, msg, 
+            rc = sam_client_action(session, cmd->action, cmd->log, cmd->fw_object, cmd->msg, 
                                    SAM_EXPIRE, cmd->expiration, 
                                    SAM_REQ_TYPE, cmd->mode, 
                                    cmd->src, cmd->src_mask,
@@ -639,14 +221,14 @@ static eOpsecHandlerRC execute_sam_command(OpsecSession *session)
         
     case SAM_SERV:
         if (cmd->is_monitor) 
-            rc = sam_client_monitor(session, cmd->action, cmd->fw_object, msg, 
+            rc = sam_client_monitor(session, cmd->action, cmd->fw_object, cmd->msg, 
                                     SAM_REQ_TYPE, cmd->mode, 
                                     cmd->src, 
                                     cmd->dst, 
                                     cmd->service, cmd->ip_proto, 
                                     NULL);
         else
-            rc = sam_client_action(session, cmd->action, cmd->log, cmd->fw_object, msg, 
+            rc = sam_client_action(session, cmd->action, cmd->log, cmd->fw_object, cmd->msg, 
                                    SAM_EXPIRE, cmd->expiration, 
                                    SAM_REQ_TYPE, cmd->mode, 
                                    cmd->src, 
@@ -657,14 +239,14 @@ static eOpsecHandlerRC execute_sam_command(OpsecSession *session)
         
     case SAM_SUB_SERV:
         if (cmd->is_monitor) 
-            rc = sam_client_monitor(session, cmd->action, cmd->fw_object, msg, 
+            rc = sam_client_monitor(session, cmd->action, cmd->fw_object, cmd->msg, 
                                     SAM_REQ_TYPE, cmd->mode, 
                                     cmd->src, cmd->src_mask,
                                     cmd->dst, cmd->dst_mask,
                                     cmd->service, cmd->ip_proto, 
                                     NULL);
         else
-            rc = sam_client_action(session, cmd->action, cmd->log, cmd->fw_object, msg, 
+            rc = sam_client_action(session, cmd->action, cmd->log, cmd->fw_object, cmd->msg, 
                                    SAM_EXPIRE, cmd->expiration, 
                                    SAM_REQ_TYPE, cmd->mode, 
                                    cmd->src, cmd->src_mask,
@@ -675,14 +257,14 @@ static eOpsecHandlerRC execute_sam_command(OpsecSession *session)
         
     case SAM_SUB_SERV_SRC:
         if (cmd->is_monitor) 
-            rc = sam_client_monitor(session, cmd->action, cmd->fw_object, msg, 
+            rc = sam_client_monitor(session, cmd->action, cmd->fw_object, cmd->msg, 
                                     SAM_REQ_TYPE, cmd->mode, 
                                     cmd->src, cmd->src_mask,
                                     cmd->dst, 
                                     cmd->service, cmd->ip_proto, 
                                     NULL);
         else
-            rc = sam_client_action(session, cmd->action, cmd->log, cmd->fw_object, msg, 
+            rc = sam_client_action(session, cmd->action, cmd->log, cmd->fw_object, cmd->msg, 
                                    SAM_EXPIRE, cmd->expiration, 
                                    SAM_REQ_TYPE, cmd->mode, 
                                    cmd->src, cmd->src_mask,
@@ -693,14 +275,14 @@ static eOpsecHandlerRC execute_sam_command(OpsecSession *session)
         
     case SAM_SUB_SERV_DST:
         if (cmd->is_monitor) 
-            rc = sam_client_monitor(session, cmd->action, cmd->fw_object, msg, 
+            rc = sam_client_monitor(session, cmd->action, cmd->fw_object, cmd->msg, 
                                     SAM_REQ_TYPE, cmd->mode, 
                                     cmd->src, 
                                     cmd->dst, cmd->dst_mask,
                                     cmd->service, cmd->ip_proto, 
                                     NULL);
         else
-            rc = sam_client_action(session, cmd->action, cmd->log, cmd->fw_object, msg, 
+            rc = sam_client_action(session, cmd->action, cmd->log, cmd->fw_object, cmd->msg, 
                                    SAM_EXPIRE, cmd->expiration, 
                                    SAM_REQ_TYPE, cmd->mode, 
                                    cmd->src, 
@@ -711,13 +293,13 @@ static eOpsecHandlerRC execute_sam_command(OpsecSession *session)
         
     case SAM_DST_SERV:
         if (cmd->is_monitor) 
-            rc = sam_client_monitor(session, cmd->action, cmd->fw_object, msg, 
+            rc = sam_client_monitor(session, cmd->action, cmd->fw_object, cmd->msg, 
                                     SAM_REQ_TYPE, cmd->mode, 
                                     cmd->dst,
                                     cmd->service, cmd->ip_proto, 
                                     NULL);
         else
-            rc = sam_client_action(session, cmd->action, cmd->log, cmd->fw_object, msg, 
+            rc = sam_client_action(session, cmd->action, cmd->log, cmd->fw_object, cmd->msg, 
                                    SAM_EXPIRE, cmd->expiration, 
                                    SAM_REQ_TYPE, cmd->mode, 
                                    cmd->dst, 
@@ -726,13 +308,13 @@ static eOpsecHandlerRC execute_sam_command(OpsecSession *session)
         break;
     case SAM_SUB_DST_SERV:
         if (cmd->is_monitor) 
-            rc = sam_client_monitor(session, cmd->action, cmd->fw_object, msg, 
+            rc = sam_client_monitor(session, cmd->action, cmd->fw_object, cmd->msg, 
                                     SAM_REQ_TYPE, cmd->mode, 
                                     cmd->dst, cmd->dst_mask,
                                     cmd->service, cmd->ip_proto, 
                                     NULL);
         else
-            rc = sam_client_action(session, cmd->action, cmd->log, cmd->fw_object, msg, 
+            rc = sam_client_action(session, cmd->action, cmd->log, cmd->fw_object, cmd->msg, 
                                    SAM_EXPIRE, cmd->expiration, 
                                    SAM_REQ_TYPE, cmd->mode, 
                                    cmd->dst, cmd->dst_mask,
@@ -743,13 +325,13 @@ static eOpsecHandlerRC execute_sam_command(OpsecSession *session)
         cmd->src = cmd->dst;
     case SAM_SRC_IP_PROTO:
         if (cmd->is_monitor) 
-            rc = sam_client_monitor(session, cmd->action, cmd->fw_object, msg, 
+            rc = sam_client_monitor(session, cmd->action, cmd->fw_object, cmd->msg, 
                                     SAM_REQ_TYPE, cmd->mode, 
                                     cmd->src, 
                                     cmd->ip_proto, 
                                     NULL);
         else
-            rc = sam_client_action(session, cmd->action, cmd->log, cmd->fw_object, msg, 
+            rc = sam_client_action(session, cmd->action, cmd->log, cmd->fw_object, cmd->msg, 
                                    SAM_EXPIRE, cmd->expiration, 
                                    SAM_REQ_TYPE, cmd->mode, 
                                    cmd->src, 
@@ -762,13 +344,13 @@ static eOpsecHandlerRC execute_sam_command(OpsecSession *session)
         cmd->src_mask = cmd->dst_mask;
     case SAM_SUB_SRC_IP_PROTO:
         if (cmd->is_monitor) 
-            rc = sam_client_monitor(session, cmd->action, cmd->fw_object, msg, 
+            rc = sam_client_monitor(session, cmd->action, cmd->fw_object, cmd->msg, 
                                     SAM_REQ_TYPE, cmd->mode, 
                                     cmd->src, cmd->src_mask,
                                     cmd->ip_proto, 
                                     NULL);
         else
-            rc = sam_client_action(session, cmd->action, cmd->log, cmd->fw_object, msg, 
+            rc = sam_client_action(session, cmd->action, cmd->log, cmd->fw_object, cmd->msg, 
                                    SAM_EXPIRE, cmd->expiration, 
                                    SAM_REQ_TYPE, cmd->mode, 
                                    cmd->src, cmd->src_mask,
@@ -786,116 +368,6 @@ static eOpsecHandlerRC execute_sam_command(OpsecSession *session)
 }
 
 
-static eOpsecHandlerRC alternate_execute_sam_command(OpsecSession *session)
-{
-    eOpsecHandlerRC rc = OPSEC_SESSION_OK;
-    struct SamCommand *cmd = &g_command;
-    int arg1 = 0,
-        arg2 = 0,
-        arg3 = 0,
-        arg4 = 0,
-        arg5 = 0,
-        arg6 = 0;
-
-    int req_typ = SAM_REQ_TYPE;
-
-    if (cmd->action == SAM_DELETE_ALL)
-    	req_typ = 0;
-    
-    switch (cmd->mode) {
-    case SAM_DST_IP:
-        arg1 = cmd->dst; 
-        break;
-    case SAM_SRC_IP:    
-    case SAM_ANY_IP:
-    	 arg1 = cmd->src;
-        break;
-    case SAM_SUB_DST_IP:    
-        arg1 = cmd->dst;
-        arg2 = cmd->dst_mask;
-        break;
-    case SAM_SUB_SRC_IP:
-    case SAM_SUB_ANY_IP: 
-        arg1 = cmd->src;
-        arg2 = cmd->src_mask;
-        break;
-    case SAM_SERV:
-        arg1 = cmd->src;
-        arg2 = cmd->dst; 
-        arg3 = cmd->service;
-        arg4 = cmd->ip_proto; 
-        break;
-    case SAM_SUB_SERV:
-        arg1 = cmd->src;
-        arg2 = cmd->src_mask;
-        arg3 = cmd->dst;
-        arg4 = cmd->dst_mask;
-        arg5 = cmd->service;
-        arg6 = cmd->ip_proto;
-        break;
-    case SAM_SUB_SERV_SRC:
-        arg1 = cmd->src;
-        arg2 = cmd->src_mask;
-        arg3 = cmd->dst;
-        arg4 = cmd->service;
-        arg5 = cmd->ip_proto;
-        break;
-    case SAM_SUB_SERV_DST:
-        arg1 = cmd->src;
-        arg2 = cmd->dst;
-        arg3 = cmd->dst_mask;
-        arg4 = cmd->service;
-        arg5 = cmd->ip_proto;
-        break;
-    case SAM_DST_SERV:
-        arg1 = cmd->dst;
-	 arg2 = cmd->service;
-	 arg3 = cmd->ip_proto;
-        break;
-    case SAM_SUB_DST_SERV:
-        arg1 = cmd->dst;
-        arg2 = cmd->dst_mask;
-	 arg3 = cmd->service;
-	 arg4 = cmd->ip_proto;
-        break;
-    case SAM_DST_IP_PROTO:
-        arg1 = cmd->dst;
-        arg2 = cmd->ip_proto;
-        break;
-    case SAM_SRC_IP_PROTO:
-    	 arg1 = cmd->src;
-    	 arg2 = cmd->ip_proto;
-        break;
-    case SAM_SUB_DST_IP_PROTO:
-        arg1 = cmd->dst;
-        arg2 = cmd->dst_mask;
-        arg3 = cmd->ip_proto;
-        break;
-    case SAM_SUB_SRC_IP_PROTO:
-        arg1 = cmd->src;
-        arg2 = cmd->src_mask;
-        arg3 = cmd->ip_proto;
-        break;
-    default:
-        fprintf(stderr, "Can not execute command : mode %d is unknown\n", cmd->mode);
-        rc = OPSEC_SESSION_OK;
-        return rc;
-    }
-    if (cmd->is_monitor) 
-            rc = sam_client_monitor(session, cmd->action, cmd->fw_object, msg, 
-                                    req_typ, cmd->mode, 
-                                    arg1, arg2, arg3, arg4, arg5, arg6, 
-                                    NULL);
-    else
-            rc = sam_client_action(session, cmd->action, cmd->log, cmd->fw_object, msg, 
-                                   SAM_EXPIRE, cmd->expiration, 
-                                    req_typ, cmd->mode, 
-                                    arg1, arg2, arg3, arg4, arg5, arg6, 
-                                   NULL);
-
-    return rc;        
-}
-
 /**********************************************
  *
  * OPSEC Handlers
@@ -947,7 +419,7 @@ MonitorAckEventHandler(OpsecSession *session, int status, int fw_index, int fw_t
     rc = print_status_message(HandlerType_MonitorAck, 0, status, fw_index, fw_total, fw_host, (char *)cb_data);
 
     if (rc == OPSEC_SESSION_OK && status == SAM_MODULE_DONE)
-        print_info_table(info_data);
+        SamPrintInfoTable(stdout, info_data);
 
     return rc;
 }
@@ -967,7 +439,8 @@ int main(int argc, char *argv[])
 
 	SamCommandInit(&g_command);
 
-	parse_command_line(&g_command, argc, argv);
+	if (SamCommandParse(&g_command, 1, argc, argv) < 0)
+		Usage();
 
 	env = opsec_init(/* OPSEC_CONF_FILE, "sam.conf", */ 
 	                 OPSEC_CONF_ARGV, &argc, argv, 
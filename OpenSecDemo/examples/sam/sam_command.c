@@ -0,0 +1,590 @@
+/***************************************************************************
+ *                                                                         *
+ * sam_command.c : SAM command parsing and execution                       *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-1999 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+/***************************************************************************
+
+ The command syntax shared by sam_client and sam_daemon.
+
+ SamCommandParse() fills a SamCommand from an argument vector, e.g.
+
+     -t 600 -l nolog -A drop subsrc 10.1.1.0 255.255.255.0
+     -f gw1 -M reject,drop src 10.1.1.1
+
+ and returns -1 (after printing the reason) instead of exiting, so a
+ long-lived client can reject a bad line and go on. Every argument is
+ copied into the command, so the vector may be reused afterwards.
+
+ SamCommandExecute() sends the command on an established SAM session.
+ The request_id is handed back to the SAM_ACK_HANDLER and
+ SAM_MONITOR_ACK_HANDLER and is how replies are matched to commands
+ when several of them are outstanding on the same session.
+
+ **************************************************************************/
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef WIN32
+#include <winsock.h>
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
+#include "sam_command.h"
+
+/*****************************************************************
+ * SAM Modes
+ *****************************************************************/
+struct _SamMode SamModeTable [] = {
+    "src",      1, SAM_SRC_IP,
+    "dst",      1, SAM_DST_IP,
+    "any",      1, SAM_ANY_IP,
+    "subsrc",   2, SAM_SUB_SRC_IP,
+    "subdst",   2, SAM_SUB_DST_IP,
+    "subany",   2, SAM_SUB_ANY_IP,
+    "srv",      4, SAM_SERV,
+    "subsrv",   6, SAM_SUB_SERV,
+    "subsrvs",  5, SAM_SUB_SERV_SRC,
+    "subsrvd",  5, SAM_SUB_SERV_DST,
+    "dstsrv",   3, SAM_DST_SERV,
+    "subdstsrv",4, SAM_SUB_DST_SERV,
+    "srcpr",    2, SAM_SRC_IP_PROTO,
+    "dstpr",    2, SAM_DST_IP_PROTO,
+    "subsrcpr", 3, SAM_SUB_SRC_IP_PROTO,
+    "subdstpr", 3, SAM_SUB_DST_IP_PROTO,
+    "all",      0, SAM_ALL,
+    NULL,       0, 0
+};
+
+
+int SamModeByStr(char *arg)
+{
+    int i;
+
+    for (i = 0; SamModeTable[i].name != NULL; i++)
+        if (strcmp(arg, SamModeTable[i].name) == 0)
+            return i;
+
+    return -1;
+}
+
+int SamModeByInt(int arg)
+{
+    int i;
+
+    for (i = 0; SamModeTable[i].name != NULL; i++)
+        if (arg == SamModeTable[i].designator)
+            return i;
+
+    return -1;
+}
+
+/*****************************************************************
+ * SAM Actions
+ *****************************************************************/
+struct _SamAction {
+    char *action_str;
+    int  action ;
+} SamActionsTable [] = {
+    "reject",               SAM_REJECT | SAM_INHIBIT,
+    "notify",               SAM_NOTIFY,
+    "inhibit",              SAM_INHIBIT,
+    "inhibit_close",        SAM_INHIBIT_AND_CLOSE,
+    "inhibit_drop",         SAM_INHIBIT_DROP,
+    "drop",                 SAM_INHIBIT_DROP,
+    "inhibit_drop_close",   SAM_INHIBIT_DROP_AND_CLOSE,
+    NULL,                   -1
+};
+
+int SamActionsByStr(char *str)
+{
+    int i;
+
+    for (i = 0; SamActionsTable[i].action_str != NULL; i++)
+        if (strcmp(str, SamActionsTable[i].action_str) == 0)
+            return SamActionsTable[i].action;
+
+    return -1;
+}
+
+char *SamActionsByInt(int action)
+{
+    int i;
+
+    for (i = 0; SamActionsTable[i].action_str != NULL; i++)
+        if (action == SamActionsTable[i].action)
+            return SamActionsTable[i].action_str;
+
+    return NULL;
+}
+
+static int SamMonitorAction(char *action_str)
+{
+    int action = 0, rc = 0;
+    char *tok = NULL;
+
+    for( tok = strtok(action_str, ",") ; tok != NULL; tok = strtok(NULL, ",") ) {
+        if ( (action = SamActionsByStr(tok)) < 0)
+            return -1;
+        rc |= action;
+    }
+    return rc;
+}
+
+/*****************************************************************
+ * SAM Log
+ *****************************************************************/
+struct _SamLog {
+    char *log_str;
+    int   log;
+} SamLogsTable [] = {
+    "nolog",           SAM_NOLOG,
+    "log_noalert",     SAM_LONG_NOALERT,
+    "log_alert",       SAM_LONG_ALERT,
+    NULL,               -1
+};
+
+
+int SamLogbByStr(char *log_str)
+{
+    int i;
+
+    for (i = 0; SamLogsTable[i].log_str != NULL; i++)
+        if (strcmp(log_str, SamLogsTable[i].log_str) == 0)
+            return SamLogsTable[i].log;
+
+    return -1;
+}
+
+char *SamLogbByInt(int log)
+{
+    int i;
+
+    for (i = 0; SamLogsTable[i].log_str != NULL; i++)
+        if (log == SamLogsTable[i].log)
+            return SamLogsTable[i].log_str;
+
+    return NULL;
+}
+
+/*****************************************************************/
+
+void SamCommandInit(struct SamCommand *command)
+{
+    command->action     = 0;
+    command->log        = SAM_LONG_NOALERT;
+    strcpy(command->fw_object, "All");
+    command->expiration = SAM_EXPIRE_NEVER;
+    command->mode       = -1;
+
+    command->src        = 0;
+    command->src_mask   = 0;
+    command->dst        = 0;
+    command->dst_mask   = 0;
+    command->service    = 0;
+    command->ip_proto   = 0;
+    command->is_monitor = 0;
+    command->msg[0]     = '\0';
+}
+
+static void msg_cat(struct SamCommand *command, char *str)
+{
+    int len = strlen(command->msg);
+
+    strncat(command->msg, str, sizeof(command->msg) - len - 1);
+}
+
+
+static int parse_criteria(struct SamCommand *command, int *_index, int ac, char *av[])
+{
+#define STRCAT(_cmd, _msg1, _msg2) \
+    msg_cat(_cmd, _msg1); \
+    msg_cat(_cmd, _msg2)
+
+    int mode_index;
+    int args;
+    int index = *_index;
+
+    if (index >= ac) {
+        fprintf(stderr, "parse_criteria: missing criteria\n");
+        return -1;
+    }
+
+    if ( (mode_index = SamModeByStr(av[index++])) < 0 ) {
+        fprintf(stderr, "parse_criteria: unknown criteria (%s)\n", av[index-1]);
+        return -1;
+    }
+
+    command->mode = SamModeTable[mode_index].designator;
+    msg_cat(command, SamModeTable[mode_index].name);
+
+    if ( ((args = SamModeTable[mode_index].n_args) + index) != ac) {       /* number of arguments is wrong*/
+        fprintf(stderr, "parse_criteria: arguments mismatch for filter %s\n", SamModeTable[mode_index].name);
+        return -1;
+    }
+/* might consider argument validity checks here - for example if the argument order is incorrect or invalid subnet mask, invalid ip etc. */
+    if (command->mode == SAM_ALL && !command->is_monitor) {
+        fprintf(stderr, "parse_criteria: can not use SAM_ALL when the command is not monitor\n");
+        return -1;
+    }
+
+    if (command->mode & SAM_SRC_IP || command->mode & SAM_ANY_IP) {
+        command->src = inet_addr(av[index]);
+        STRCAT(command, " src-ip ", av[index++]);
+
+        if (command->mode & SAM_SMASK) {
+            command->src_mask = inet_addr(av[index]);
+            STRCAT(command, " src-mask ", av[index++]);
+        }
+    }
+
+    if (command->mode & SAM_DST_IP) {
+        command->dst = inet_addr(av[index]);
+        STRCAT(command, " dst-ip ", av[index++]);
+
+        if (command->mode & SAM_DMASK) {
+            command->dst_mask = inet_addr(av[index]);
+            STRCAT(command, " dst-mask ", av[index++]);
+        }
+    }
+
+    if (command->mode & SAM_DPORT) {
+        command->service = atoi(av[index]);
+        STRCAT(command, " service ", av[index++]);
+    }
+
+    if (command->mode & SAM_PROTO) {
+        command->ip_proto = atoi(av[index]);
+        STRCAT(command, " ip-proto ", av[index++]);
+    }
+
+    *_index = index;
+    return 0;
+}
+
+/*
+ * Parse av[first] .. av[ac-1] into the command.
+ * Returns 0 on success, -1 if the arguments are invalid.
+ */
+int SamCommandParse(struct SamCommand *command, int first, int ac, char *av[])
+{
+    int i;
+
+    if (ac <= first) {
+        fprintf(stderr, "SamCommandParse: empty command\n");
+        return -1;
+    }
+
+    for (i = first; i < ac; i++) {
+        if (av[i][0] != '-')
+            break;
+
+        switch (av[i][1]) {
+
+        case 't':
+            if ( i+1 >= ac) return -1; else i++;
+            command->expiration = (int)atoi( av[i] );
+            break;
+
+        case 'l':
+            if ( i+1 >= ac) return -1; else i++;
+            if ( (command->log = SamLogbByStr(av[i]) ) < 0) {
+                fprintf(stderr, "SamCommandParse: Invalid log (%s)\n", av[i] );
+                return -1;
+            }
+            break;
+
+        case 'f':
+            if ( i+1 >= ac) return -1; else i++;
+            strncpy(command->fw_object, av[i], sizeof(command->fw_object) - 1);
+            command->fw_object[sizeof(command->fw_object) - 1] = '\0';
+            break;
+
+        case 'A':
+            if ( i+1 >= ac) return -1; else i++;
+            if ( (command->action |= SamActionsByStr(av[i++])) < 0) {
+                fprintf(stderr, "SamCommandParse: Invalid action (%s)\n", av[i-1] );
+                return -1;
+            }
+            msg_cat(command, av[i-1]);
+            msg_cat(command, " ");
+            if (parse_criteria(command, &i, ac, av) < 0)
+                return -1;
+            break;
+
+        case 'C':
+            command->action |= SAM_CANCEL;
+            msg_cat(command, "Cancel: ");
+            break;
+
+
+        case 'D':
+            if (command->action || ac - first > 3) {
+                fprintf(stderr, "SamCommandParse: -D takes only -f\n");
+                return -1;
+            }
+            command->action = SAM_DELETE_ALL;
+            msg_cat(command, "Delete All ");
+            break;
+
+        case 'M':
+            msg_cat(command, "Monitoring: ");
+            command->is_monitor = 1;
+            if ( i+1 >= ac) return -1; else i++;
+            if (strcmp("all", av[i])) {
+                msg_cat(command, av[i]); msg_cat(command, " ");
+                if ( (command->action = SamMonitorAction(av[i++])) < 0) {
+                    fprintf(stderr, "SamCommandParse: Invalid monitor action (%s)\n", av[i-1] );
+                    return -1;
+                }
+            }
+            if (parse_criteria(command, &i, ac, av) < 0)
+                return -1;
+            break;
+
+        default:
+            fprintf(stderr, "SamCommandParse: unknown option (%s)\n", av[i]);
+            return -1;
+        }
+    }
+
+    if (i < ac) {
+        fprintf(stderr, "SamCommandParse: unexpected argument (%s)\n", av[i]);
+        return -1;
+    }
+
+    msg_cat(command, " On ");
+    msg_cat(command, command->fw_object);
+
+    if (!command->action && !command->is_monitor) {
+        fprintf(stderr, "SamCommandParse: no action or monitor given\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/******************************************************************
+ * Execute the command, passing the criteria arguments in the
+ * order of the mode (see sam_client.c for the explicit form).
+ * The request_id comes back with every ack of the request.
+ ******************************************************************/
+int SamCommandExecute(OpsecSession *session, struct SamCommand *cmd, void *request_id)
+{
+    int arg1 = 0,
+        arg2 = 0,
+        arg3 = 0,
+        arg4 = 0,
+        arg5 = 0,
+        arg6 = 0;
+
+    if (cmd->action == SAM_DELETE_ALL)
+        return sam_client_action(session, cmd->action, cmd->log, cmd->fw_object, request_id, NULL);
+
+    if (cmd->mode == SAM_ALL && cmd->is_monitor)
+        return sam_client_monitor(session, cmd->action, cmd->fw_object, request_id,
+                                  SAM_REQ_TYPE, SAM_ALL, NULL);
+
+    switch (cmd->mode) {
+    case SAM_DST_IP:
+        arg1 = cmd->dst;
+        break;
+    case SAM_SRC_IP:
+    case SAM_ANY_IP:
+        arg1 = cmd->src;
+        break;
+    case SAM_SUB_DST_IP:
+        arg1 = cmd->dst;
+        arg2 = cmd->dst_mask;
+        break;
+    case SAM_SUB_SRC_IP:
+    case SAM_SUB_ANY_IP:
+        arg1 = cmd->src;
+        arg2 = cmd->src_mask;
+        break;
+    case SAM_SERV:
+        arg1 = cmd->src;
+        arg2 = cmd->dst;
+        arg3 = cmd->service;
+        arg4 = cmd->ip_proto;
+        break;
+    case SAM_SUB_SERV:
+        arg1 = cmd->src;
+        arg2 = cmd->src_mask;
+        arg3 = cmd->dst;
+        arg4 = cmd->dst_mask;
+        arg5 = cmd->service;
+        arg6 = cmd->ip_proto;
+        break;
+    case SAM_SUB_SERV_SRC:
+        arg1 = cmd->src;
+        arg2 = cmd->src_mask;
+        arg3 = cmd->dst;
+        arg4 = cmd->service;
+        arg5 = cmd->ip_proto;
+        break;
+    case SAM_SUB_SERV_DST:
+        arg1 = cmd->src;
+        arg2 = cmd->dst;
+        arg3 = cmd->dst_mask;
+        arg4 = cmd->service;
+        arg5 = cmd->ip_proto;
+        break;
+    case SAM_DST_SERV:
+        arg1 = cmd->dst;
+        arg2 = cmd->service;
+        arg3 = cmd->ip_proto;
+        break;
+    case SAM_SUB_DST_SERV:
+        arg1 = cmd->dst;
+        arg2 = cmd->dst_mask;
+        arg3 = cmd->service;
+        arg4 = cmd->ip_proto;
+        break;
+    case SAM_DST_IP_PROTO:
+        arg1 = cmd->dst;
+        arg2 = cmd->ip_proto;
+        break;
+    case SAM_SRC_IP_PROTO:
+        arg1 = cmd->src;
+        arg2 = cmd->ip_proto;
+        break;
+    case SAM_SUB_DST_IP_PROTO:
+        arg1 = cmd->dst;
+        arg2 = cmd->dst_mask;
+        arg3 = cmd->ip_proto;
+        break;
+    case SAM_SUB_SRC_IP_PROTO:
+        arg1 = cmd->src;
+        arg2 = cmd->src_mask;
+        arg3 = cmd->ip_proto;
+        break;
+    default:
+        fprintf(stderr, "Can not execute command : mode %d is unknown\n", cmd->mode);
+        return -1;
+    }
+
+    if (cmd->is_monitor)
+        return sam_client_monitor(session, cmd->action, cmd->fw_object, request_id,
+                                  SAM_REQ_TYPE, cmd->mode,
+                                  arg1, arg2, arg3, arg4, arg5, arg6,
+                                  NULL);
+
+    return sam_client_action(session, cmd->action, cmd->log, cmd->fw_object, request_id,
+                             SAM_EXPIRE, cmd->expiration,
+                             SAM_REQ_TYPE, cmd->mode,
+                             arg1, arg2, arg3, arg4, arg5, arg6,
+                             NULL);
+}
+
+/*****************************************************************
+ * Monitor replies
+ *****************************************************************/
+
+static char *ip2str(unsigned int ip, char *buf)
+{
+    struct in_addr ipaddr;
+
+    ipaddr.s_addr = ip;
+    strcpy(buf, inet_ntoa(ipaddr));
+
+    return buf;
+}
+
+static char *time2str(time_t time, char *buf, int size)
+{
+    int len;
+
+    if (time == 0)
+        strcpy(buf, "NEVER");
+    else {
+        strncpy(buf, ctime(&time), size - 1);
+        buf[size - 1] = '\0';
+        len = strlen(buf);
+        if (len > 0 && buf[len - 1] == '\n')
+            buf[len - 1] = '\0';	/* avoid printing a new line */
+    }
+
+    return buf;
+}
+
+void SamPrintInfoTable(FILE *out, opsec_table info_data)
+{
+    opsec_table_iterator iter;
+    opsec_vtype vtype;
+    void *elem = NULL;
+
+    unsigned short service, proto;
+    char src[16], src_mask[16], dst[16], dst_mask[16], time[64];
+    char *log = NULL, *action = NULL;
+
+    int i, nentries;
+
+    nentries = sam_table_get_nrows( info_data);
+
+    if (!nentries){
+        fprintf(out, "no corresponding SAM requests\n");
+        return;
+    }
+
+    else { /* prepare a table header */
+        fprintf(out, "\n%-16s %-16s %-16s %-16s %-10s %-10s %-15s %-12s %-25s\n",
+                "source ip", "netmask", "destination ip", "netmask", "service", "protocol", "log",
+                "action", "expiration");
+    }
+    /* create iterator on table */
+    iter = sam_table_iterator_create( info_data);
+
+    for (i = 0; i < nentries ; i++ ) {
+
+        elem = sam_table_iterator_next(iter, &vtype);
+        ip2str(*((unsigned int*)elem), src);
+
+        elem = sam_table_iterator_next(iter, &vtype);
+        ip2str(*((unsigned int*)elem), src_mask);
+
+        elem = sam_table_iterator_next(iter, &vtype);
+        ip2str(*((unsigned int*)elem), dst);
+
+        elem = sam_table_iterator_next(iter, &vtype);
+        ip2str(*((unsigned int*)elem), dst_mask);
+
+        elem = sam_table_iterator_next(iter, &vtype);
+        service = (*((unsigned short*)elem));
+
+        elem = sam_table_iterator_next(iter, &vtype);
+        proto = *((unsigned short*)elem);
+
+        elem = sam_table_iterator_next(iter, &vtype);
+        log = SamLogbByInt(*((int*)elem));
+
+        elem = sam_table_iterator_next(iter, &vtype);
+        action = SamActionsByInt(*((int*)elem));
+
+        elem = sam_table_iterator_next(iter, &vtype);
+        time2str(*((time_t*)elem), time, sizeof(time));
+
+        fprintf(out, "%-16s %-16s %-16s %-16s %-10d %-10d %-15s %-12s %-25s\n",
+            src, src_mask, dst, dst_mask, service, proto,
+            log ? log : "-", action ? action : "-", time);
+    }
+
+    sam_table_iterator_destroy(iter);
+    fprintf(out, "\n");
+}
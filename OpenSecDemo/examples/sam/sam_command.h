@@ -0,0 +1,71 @@
+#ifndef _SAM_COMMAND_H_
+#define _SAM_COMMAND_H_
+
+/***************************************************************************
+ *                                                                         *
+ * sam_command.h : SAM command parsing and execution                       *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-1999 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * See sam_command.c for further explanations.                             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include "opsec/sam.h"
+#include "opsec/opsec.h"
+
+#define SAM_CMD_MSG_LEN     4096
+#define SAM_CMD_OBJ_LEN     256
+
+/*****************************************************************
+ * SAM Command
+ *****************************************************************/
+struct SamCommand {
+    int action;
+    int log;
+    char fw_object[SAM_CMD_OBJ_LEN];
+    int expiration;
+    int mode;
+    int src, src_mask, dst, dst_mask, service, ip_proto;
+    int is_monitor;
+    char msg[SAM_CMD_MSG_LEN];      /* readable description of the command */
+};
+
+/*****************************************************************
+ * SAM Modes
+ *****************************************************************/
+struct _SamMode {
+    char *name;
+    int   n_args;
+    int   designator;
+};
+
+extern struct _SamMode SamModeTable[];
+
+int   SamModeByStr(char *arg);
+int   SamModeByInt(int arg);
+int   SamActionsByStr(char *str);
+char *SamActionsByInt(int action);
+int   SamLogbByStr(char *log_str);
+char *SamLogbByInt(int log);
+
+void  SamCommandInit(struct SamCommand *command);
+int   SamCommandParse(struct SamCommand *command, int first, int ac, char *av[]);
+int   SamCommandExecute(OpsecSession *session, struct SamCommand *command, void *request_id);
+void  SamPrintInfoTable(FILE *out, opsec_table info_data);
+
+#endif
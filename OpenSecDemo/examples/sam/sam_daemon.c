@@ -0,0 +1,855 @@
+/***************************************************************************
+ *                                                                         *
+ * sam_daemon.c : A long-lived, pipelining OPSEC SAM Client                *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-1999 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+/***************************************************************************
+
+ sam_client performs one command per process, so a bulk block/unblock
+ pays for a full session setup per rule. This client keeps one or more
+ SAM sessions open and runs any number of commands over them.
+
+ Commands are read one per line, in the sam_client argument syntax
+ (see sam_command.c), from:
+
+     stdin                     (default)
+     -i <file>                 a command file
+     -s <path>                 a local (unix domain) socket; every
+                               connection is a separate command stream
+
+ Empty lines and lines starting with '#' are ignored.
+
+ Commands are not executed one after the other. Each is sent as soon
+ as a session is established and has room in its window (-w requests
+ in flight per session), without waiting for the acks of the previous
+ ones. The commands are spread over -n sessions, each of them going
+ to the least loaded one.
+
+ Every command line gets a sequence number, which its replies start
+ with. The SAM request id handed to SamCommandExecute() is the request
+ record itself, so the acks come back with the command they belong to.
+ The replies are written back to the stream the command came from:
+
+     <id> queued <description>
+     <id> invalid
+     <id> module <fw-host> <n>/<total> done | failed | resolve-error
+     <id> done | failed | resolve-error | session-ended | send-failed ok=<n> failed=<n>
+
+ the last one ending the request. For monitor commands the table of
+ every module follows its module line.
+
+ A session which ends is reopened after RECONNECT_DELAY seconds, the
+ requests it had in flight are reported as session-ended. When reading
+ a file or stdin the client exits once the input is over and every
+ request has completed.
+
+ The client keeps counters, queue depths and the latency of the
+ requests; they are written to the file named by OPSEC_METRICS_FILE
+ if it is set (see ../common/metrics.c).
+
+ See sam_client.c about the SAM Server port.
+
+ **************************************************************************/
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#ifdef WIN32
+#include <winsock.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#endif
+#include "opsec/sam.h"
+#include "opsec/opsec.h"
+#include "opsec/opsec_error.h"
+#include "sam_command.h"
+#include "../common/metrics.h"
+
+#define SAM_SERVER_IP       "127.0.0.1"
+#define SAM_PORT            18183
+
+#define SAM_SESSIONS        2       /* sessions kept open                      */
+#define SAM_WINDOW          32      /* requests in flight per session          */
+#define SAM_MAX_QUEUED      4096    /* queued requests above which the input   */
+                                    /* is no longer read                       */
+#define SAM_LINE_LEN        1024
+#define SAM_MAX_ARGS        32
+#define RECONNECT_DELAY     5
+
+/*****************************************************************
+ * A SAM session
+ *****************************************************************/
+struct SamConn {
+    OpsecSession *session;
+    int index;
+    int established;
+    int in_flight;
+};
+
+/*****************************************************************
+ * A command stream, the replies go back to it
+ *****************************************************************/
+struct SamSource {
+    int fd;
+    FILE *out;
+    char line[SAM_LINE_LEN];
+    int line_len;
+    int skip_line;              /* discarding the rest of a too long line   */
+    int eof;
+    int reading;                /* input event registered                   */
+    int refs;                   /* the stream itself and its requests       */
+    struct SamSource *next;
+};
+
+/*****************************************************************
+ * A request, queued or in flight
+ *****************************************************************/
+struct SamRequest {
+    unsigned long id;
+    struct SamCommand cmd;
+    struct SamSource *source;
+    struct SamConn *conn;
+    int n_done;
+    int n_failed;
+    unsigned long sent;         /* [usec], for the latency metric           */
+    struct SamRequest *prev, *next;
+};
+
+struct SamDaemon {
+    OpsecEnv *env;
+    OpsecEntity *client;
+    OpsecEntity *server;
+
+    struct SamConn *conns;
+    int n_conns;
+    int window;
+
+    struct SamRequest *queue_head, *queue_tail;
+    int n_queued;
+    struct SamRequest *in_flight;       /* all sessions                   */
+
+    struct SamSource *sources;
+    int listen_fd;
+    int input_paused;
+    int shutting_down;
+
+    unsigned long next_id;
+    long n_completed;
+    long n_failed;
+};
+
+struct SamDaemon g_daemon;
+
+/*****************************************************************
+ * Metrics (see ../common/metrics.c)
+ *****************************************************************/
+static metric *m_queued, *m_in_flight, *m_sent, *m_completed, *m_failed,
+              *m_request_usec;
+
+static void SamDispatch(void);
+static void SamCheckDone(void);
+static void SamInputResume(void);
+
+/*****************************************************************
+ * Replies
+ *****************************************************************/
+static void SamReply(struct SamSource *source, char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    vfprintf(source->out, fmt, ap);
+    va_end(ap);
+    fflush(source->out);
+}
+
+static void SamSourceRelease(struct SamSource *source)
+{
+    struct SamSource **pp;
+
+    if (--source->refs > 0)
+        return;
+
+    for (pp = &g_daemon.sources; *pp; pp = &(*pp)->next)
+        if (*pp == source) {
+            *pp = source->next;
+            break;
+        }
+
+    if (source->out != stdout)
+        fclose(source->out);            /* closes fd as well */
+    else if (source->fd > 0)
+        close(source->fd);
+    free(source);
+}
+
+/*****************************************************************
+ * Requests
+ *****************************************************************/
+static void SamRequestFinish(struct SamRequest *req, char *status)
+{
+    if (req->conn) {
+        if (req->prev)
+            req->prev->next = req->next;
+        else
+            g_daemon.in_flight = req->next;
+        if (req->next)
+            req->next->prev = req->prev;
+        req->conn->in_flight--;
+        metric_add(m_in_flight, -1);
+        metric_observe(m_request_usec, metrics_now_usec() - req->sent);
+    }
+
+    if (strcmp(status, "done") == 0 && req->n_failed == 0) {
+        g_daemon.n_completed++;
+        metric_inc(m_completed);
+    }
+    else {
+        g_daemon.n_failed++;
+        metric_inc(m_failed);
+    }
+
+    SamReply(req->source, "%lu %s ok=%d failed=%d\n", req->id, status, req->n_done, req->n_failed);
+
+    SamSourceRelease(req->source);
+    free(req);
+}
+
+static void SamEnqueue(struct SamRequest *req)
+{
+    req->next = NULL;
+    if (g_daemon.queue_tail)
+        g_daemon.queue_tail->next = req;
+    else
+        g_daemon.queue_head = req;
+    g_daemon.queue_tail = req;
+    g_daemon.n_queued++;
+    metric_add(m_queued, 1);
+}
+
+static struct SamConn *SamPickConn(void)
+{
+    struct SamConn *best = NULL;
+    int i;
+
+    for (i = 0; i < g_daemon.n_conns; i++) {
+        struct SamConn *conn = &g_daemon.conns[i];
+
+        if (!conn->established || conn->in_flight >= g_daemon.window)
+            continue;
+        if (!best || conn->in_flight < best->in_flight)
+            best = conn;
+    }
+    return best;
+}
+
+/*
+ * Send the queued requests while some session has room for them.
+ */
+static void SamDispatch(void)
+{
+    struct SamRequest *req;
+    struct SamConn *conn;
+
+    while (g_daemon.queue_head && (conn = SamPickConn()) != NULL) {
+
+        req = g_daemon.queue_head;
+        g_daemon.queue_head = req->next;
+        if (!g_daemon.queue_head)
+            g_daemon.queue_tail = NULL;
+        g_daemon.n_queued--;
+        metric_add(m_queued, -1);
+
+        req->sent = metrics_now_usec();
+        if (SamCommandExecute(conn->session, &req->cmd, req) < 0) {
+            fprintf(stderr, "session %d: failed to send request %lu: %s\n",
+                    conn->index, req->id, opsec_errno_str(opsec_errno));
+            req->conn = NULL;
+            SamRequestFinish(req, "send-failed");
+            continue;
+        }
+
+        req->conn = conn;
+        req->prev = NULL;
+        req->next = g_daemon.in_flight;
+        if (req->next)
+            req->next->prev = req;
+        g_daemon.in_flight = req;
+        conn->in_flight++;
+        metric_add(m_in_flight, 1);
+        metric_inc(m_sent);
+    }
+
+    if (g_daemon.input_paused && g_daemon.n_queued < SAM_MAX_QUEUED / 2)
+        SamInputResume();
+}
+
+/*****************************************************************
+ * Sessions
+ *****************************************************************/
+static void SamConnReopen(void *opaque);
+
+static void SamConnOpen(struct SamConn *conn)
+{
+    conn->established = 0;
+    conn->in_flight = 0;
+    conn->session = sam_new_session(g_daemon.client, g_daemon.server);
+
+    if (conn->session == NULL) {
+        fprintf(stderr, "session %d: SAM session initialization failed: %s\n",
+                conn->index, opsec_errno_str(opsec_errno));
+        opsec_schedule(g_daemon.env, RECONNECT_DELAY * 1000L, SamConnReopen, conn);
+        return;
+    }
+    SESSION_OPAQUE(conn->session) = conn;
+}
+
+static void SamConnReopen(void *opaque)
+{
+    if (!g_daemon.shutting_down)
+        SamConnOpen((struct SamConn *)opaque);
+}
+
+/*
+ * Nothing left to read or to wait for: end the sessions,
+ * which lets opsec_mainloop() return.
+ */
+static void SamCheckDone(void)
+{
+    struct SamSource *source;
+    int i;
+
+    if (g_daemon.shutting_down || g_daemon.listen_fd >= 0)
+        return;
+
+    for (source = g_daemon.sources; source; source = source->next)
+        if (!source->eof)
+            return;
+
+    if (g_daemon.queue_head || g_daemon.in_flight)
+        return;
+
+    g_daemon.shutting_down = 1;
+    metrics_export_stop(g_daemon.env);
+    for (i = 0; i < g_daemon.n_conns; i++) {
+        opsec_deschedule(g_daemon.env, SamConnReopen, &g_daemon.conns[i]);
+        if (g_daemon.conns[i].session)
+            opsec_end_session(g_daemon.conns[i].session);
+    }
+}
+
+/*****************************************************************
+ * Command streams
+ *****************************************************************/
+static int SamSourceRead(int fd, void *opaque);
+
+static void SamSourceLine(struct SamSource *source, char *line)
+{
+    struct SamRequest *req;
+    char *av[SAM_MAX_ARGS];
+    int ac = 0;
+    char *tok;
+
+    for (tok = strtok(line, " \t\r"); tok && ac < SAM_MAX_ARGS; tok = strtok(NULL, " \t\r"))
+        av[ac++] = tok;
+
+    if (ac == 0 || av[0][0] == '#')
+        return;
+
+    if ((req = (struct SamRequest *)calloc(1, sizeof(struct SamRequest))) == NULL) {
+        fprintf(stderr, "SamSourceLine: out of memory\n");
+        return;
+    }
+    req->id = ++g_daemon.next_id;
+
+    SamCommandInit(&req->cmd);
+    if (tok || SamCommandParse(&req->cmd, 0, ac, av) < 0) {
+        SamReply(source, "%lu invalid\n", req->id);
+        free(req);
+        return;
+    }
+
+    req->source = source;
+    source->refs++;
+    SamReply(source, "%lu queued %s\n", req->id, req->cmd.msg);
+    SamEnqueue(req);
+}
+
+static void SamSourceStopReading(struct SamSource *source)
+{
+#ifndef WIN32
+    if (source->reading)
+        opsec_del_socket_event(g_daemon.env, OPSEC_SK_INPUT, source->fd);
+#endif
+    source->reading = 0;
+}
+
+static void SamSourceStartReading(struct SamSource *source)
+{
+#ifndef WIN32
+    if (!source->reading && !source->eof)
+        opsec_set_socket_event(g_daemon.env, OPSEC_SK_INPUT, source->fd, SamSourceRead, source);
+    source->reading = !source->eof;
+#endif
+}
+
+static void SamInputPause(void)
+{
+    struct SamSource *source;
+
+#ifndef WIN32
+    if (g_daemon.listen_fd >= 0)
+        opsec_del_socket_event(g_daemon.env, OPSEC_SK_INPUT, g_daemon.listen_fd);
+#endif
+    for (source = g_daemon.sources; source; source = source->next)
+        SamSourceStopReading(source);
+    g_daemon.input_paused = 1;
+}
+
+static int SamAccept(int fd, void *opaque);
+
+static void SamInputResume(void)
+{
+    struct SamSource *source;
+
+    g_daemon.input_paused = 0;
+#ifndef WIN32
+    if (g_daemon.listen_fd >= 0)
+        opsec_set_socket_event(g_daemon.env, OPSEC_SK_INPUT, g_daemon.listen_fd, SamAccept, NULL);
+#endif
+    for (source = g_daemon.sources; source; source = source->next)
+        SamSourceStartReading(source);
+}
+
+/*
+ * Read what is available, queue the complete lines and send them.
+ */
+static int SamSourceRead(int fd, void *opaque)
+{
+    struct SamSource *source = (struct SamSource *)opaque;
+    char buf[4096];
+    int n, i;
+
+    n = read(fd, buf, sizeof(buf));
+
+    if (n <= 0) {
+        if (source->line_len > 0 && !source->skip_line) {
+            source->line[source->line_len] = '\0';
+            SamSourceLine(source, source->line);
+        }
+        source->line_len = 0;
+        SamSourceStopReading(source);
+        source->eof = 1;
+
+        SamDispatch();
+        SamSourceRelease(source);       /* the reference of the stream */
+        SamCheckDone();
+        return 0;
+    }
+
+    for (i = 0; i < n; i++) {
+        if (buf[i] == '\n') {
+            if (!source->skip_line) {
+                source->line[source->line_len] = '\0';
+                SamSourceLine(source, source->line);
+            }
+            source->line_len = 0;
+            source->skip_line = 0;
+            continue;
+        }
+        if (source->skip_line)
+            continue;
+        if (source->line_len == SAM_LINE_LEN - 1) {
+            SamReply(source, "%lu invalid\n", ++g_daemon.next_id);
+            source->skip_line = 1;
+            continue;
+        }
+        source->line[source->line_len++] = buf[i];
+    }
+
+    SamDispatch();
+    if (g_daemon.n_queued >= SAM_MAX_QUEUED)
+        SamInputPause();
+
+    return 0;
+}
+
+static struct SamSource *SamSourceCreate(int fd, FILE *out)
+{
+    struct SamSource *source;
+
+    if ((source = (struct SamSource *)calloc(1, sizeof(struct SamSource))) == NULL)
+        return NULL;
+
+    source->fd = fd;
+    source->out = out;
+    source->refs = 1;
+    source->next = g_daemon.sources;
+    g_daemon.sources = source;
+
+    if (!g_daemon.input_paused)
+        SamSourceStartReading(source);
+    return source;
+}
+
+#ifndef WIN32
+static int SamAccept(int fd, void *opaque)
+{
+    int sock;
+    FILE *out;
+
+    if ((sock = accept(fd, NULL, NULL)) < 0) {
+        perror("accept");
+        return 0;
+    }
+    if ((out = fdopen(sock, "w")) == NULL || SamSourceCreate(sock, out) == NULL) {
+        fprintf(stderr, "SamAccept: can not create a command stream\n");
+        if (out)
+            fclose(out);
+        else
+            close(sock);
+    }
+    return 0;
+}
+
+static int SamListen(char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        perror("socket");
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path);
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+#endif
+
+/**********************************************
+ *
+ * OPSEC Handlers
+ *
+ **********************************************/
+
+static eOpsecHandlerRC
+SamDaemonEstablishedHandler(OpsecSession *session)
+{
+    struct SamConn *conn = (struct SamConn *)SESSION_OPAQUE(session);
+
+    fprintf(stderr, "session %d established\n", conn->index);
+    conn->established = 1;
+    SamDispatch();
+
+    return OPSEC_SESSION_OK;
+}
+
+
+static void
+SamDaemonEndHandler(OpsecSession *session)
+{
+    struct SamConn *conn = (struct SamConn *)SESSION_OPAQUE(session);
+    struct SamRequest *req, *next;
+
+    if (conn == NULL)
+        return;
+
+    fprintf(stderr, "session %d ended\n", conn->index);
+
+    /*
+     * The requests were normally completed by SAM_UNEXPECTED_END_OF_SESSION
+     * acks, fail those which were not.
+     */
+    for (req = g_daemon.in_flight; req; req = next) {
+        next = req->next;
+        if (req->conn == conn)
+            SamRequestFinish(req, "session-ended");
+    }
+    conn->session = NULL;
+    conn->established = 0;
+
+    if (!g_daemon.shutting_down) {
+        opsec_schedule(g_daemon.env, RECONNECT_DELAY * 1000L, SamConnReopen, conn);
+        SamDispatch();
+        SamCheckDone();
+    }
+}
+
+
+/*
+ * Handle an ack of either kind. Returns 1 when it completed the request.
+ */
+static int
+SamHandleAck(struct SamRequest *req, int status, int fw_index, int fw_total, char *fw_host)
+{
+    switch (status) {
+    case SAM_REQUEST_RECEIVED:
+        break;
+
+    case SAM_MODULE_DONE:
+        req->n_done++;
+        SamReply(req->source, "%lu module %s %d/%d done\n", req->id, fw_host, fw_index+1, fw_total);
+        break;
+
+    case SAM_MODULE_FAILED:
+    case SAM_MODULE_INVALID_REQUEST:
+        req->n_failed++;
+        SamReply(req->source, "%lu module %s %d/%d failed\n", req->id, fw_host, fw_index+1, fw_total);
+        break;
+
+    case SAM_RESOLVE_ERR:
+        if (fw_index == -1) {   /* resolve error for the whole request */
+            SamRequestFinish(req, "resolve-error");
+            return 1;
+        }
+        req->n_failed++;
+        SamReply(req->source, "%lu module %s %d/%d resolve-error\n", req->id, fw_host, fw_index+1, fw_total);
+        if (fw_total <= 1) {    /* the only module, as sam_client ends there */
+            SamRequestFinish(req, "resolve-error");
+            return 1;
+        }
+        break;
+
+    case SAM_REQUEST_DONE:
+        SamRequestFinish(req, req->n_failed ? "failed" : "done");
+        return 1;
+
+    case SAM_UNEXPECTED_END_OF_SESSION:
+        SamRequestFinish(req, "session-ended");
+        return 1;
+
+    default:
+        fprintf(stderr, "request %lu: unexpected status '%d'\n", req->id, status);
+        break;
+    }
+    return 0;
+}
+
+
+/*
+ * Unlike sam_client the session is kept open when a request is done,
+ * other requests may still be in flight on it.
+ */
+static eOpsecHandlerRC
+AckEventHandler(OpsecSession *session, int closed, int status,
+                int fw_index, int fw_total, char *fw_host, void *data)
+{
+    if (SamHandleAck((struct SamRequest *)data, status, fw_index, fw_total, fw_host)) {
+        SamDispatch();
+        SamCheckDone();
+    }
+    return OPSEC_SESSION_OK;
+}
+
+
+static eOpsecHandlerRC
+MonitorAckEventHandler(OpsecSession *session, int status, int fw_index, int fw_total,
+                       char *fw_host, void *cb_data, opsec_table info_data)
+{
+    struct SamRequest *req = (struct SamRequest *)cb_data;
+
+    if (status == SAM_MODULE_DONE) {
+        SamHandleAck(req, status, fw_index, fw_total, fw_host);
+        SamPrintInfoTable(req->source->out, info_data);
+        fflush(req->source->out);
+        return OPSEC_SESSION_OK;
+    }
+
+    return AckEventHandler(session, 0, status, fw_index, fw_total, fw_host, cb_data);
+}
+
+/*****************************************************************/
+static void
+SamCreateMetrics(void)
+{
+    m_queued       = metrics_gauge("sam_queued", "commands waiting for a session");
+    m_in_flight    = metrics_gauge("sam_in_flight", "commands sent and not yet done");
+    m_sent         = metrics_counter("sam_sent_total", "commands sent");
+    m_completed    = metrics_counter("sam_completed_total", "commands done on every module");
+    m_failed       = metrics_counter("sam_failed_total", "commands failed or not sent");
+    m_request_usec = metrics_histogram("sam_request_usec", "command sent to last ack [usec]");
+
+    if (metrics_export_env(g_daemon.env) < 0)
+        fprintf(stderr, "metrics are not exported\n");
+}
+
+/*****************************************************************/
+static void
+Usage(char *prog)
+{
+    fprintf(stderr, "Usage: %s [-i <command file> | -s <socket path>] [-n sessions] [-w window]\n", prog);
+    fprintf(stderr, "\t-i - read the commands from a file (default stdin)\n");
+    fprintf(stderr, "\t-s - accept command streams on a local socket\n");
+    fprintf(stderr, "\t-n - number of SAM sessions to keep open (default %d)\n", SAM_SESSIONS);
+    fprintf(stderr, "\t-w - requests in flight per session (default %d)\n", SAM_WINDOW);
+    fprintf(stderr, "\ncommands are given one per line, as sam_client arguments, e.g.\n");
+    fprintf(stderr, "\t-t 600 -A drop src 10.1.1.1\n");
+    fprintf(stderr, "\t-C -A drop src 10.1.1.1\n");
+    fprintf(stderr, "\t-M all\n");
+    exit(1);
+}
+
+/**********************************************
+ *
+ * Main
+ *
+ **********************************************/
+int main(int argc, char *argv[])
+{
+    char *input = NULL;
+    char *sock_path = NULL;
+    struct SamSource *source;
+    int fd;
+    int i;
+
+    memset(&g_daemon, 0, sizeof(g_daemon));
+    g_daemon.n_conns = SAM_SESSIONS;
+    g_daemon.window = SAM_WINDOW;
+    g_daemon.listen_fd = -1;
+
+    g_daemon.env = opsec_init(OPSEC_CONF_ARGV, &argc, argv,
+                              OPSEC_EOL);
+
+    if (g_daemon.env == NULL) {
+        fprintf(stderr, "Opsec init failed.\n");
+        exit(1);
+    }
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-i") && i+1 < argc)
+            input = argv[++i];
+        else if (!strcmp(argv[i], "-s") && i+1 < argc)
+            sock_path = argv[++i];
+        else if (!strcmp(argv[i], "-n") && i+1 < argc)
+            g_daemon.n_conns = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-w") && i+1 < argc)
+            g_daemon.window = atoi(argv[++i]);
+        else
+            Usage(argv[0]);
+    }
+    if ((input && sock_path) || g_daemon.n_conns <= 0 || g_daemon.window <= 0)
+        Usage(argv[0]);
+
+    g_daemon.client = opsec_init_entity(
+                g_daemon.env, SAM_CLIENT,
+                OPSEC_SESSION_END_HANDLER,         SamDaemonEndHandler,
+                OPSEC_SESSION_ESTABLISHED_HANDLER, SamDaemonEstablishedHandler,
+                SAM_ACK_HANDLER,                   AckEventHandler,
+                SAM_MONITOR_ACK_HANDLER,           MonitorAckEventHandler,
+                OPSEC_EOL);
+
+    if (g_daemon.client == NULL) {
+        fprintf(stderr, "Client entity initialization failed.\n");
+        exit(1);
+    }
+
+    g_daemon.server = opsec_init_entity(
+                g_daemon.env, SAM_SERVER,
+                OPSEC_ENTITY_NAME, "sam_server",
+                OPSEC_SERVER_IP, inet_addr(SAM_SERVER_IP),
+                OPSEC_SERVER_PORT, htons(SAM_PORT),
+                OPSEC_EOL);
+
+    if (g_daemon.server == NULL) {
+        fprintf(stderr, "Server entity initialization failed.\n");
+        exit(1);
+    }
+
+    if ((g_daemon.conns = (struct SamConn *)calloc(g_daemon.n_conns, sizeof(struct SamConn))) == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < g_daemon.n_conns; i++)
+        g_daemon.conns[i].index = i;
+
+    SamCreateMetrics();
+
+    /*
+     * Command input
+     */
+#ifndef WIN32
+    signal(SIGPIPE, SIG_IGN);   /* a stream may go away before its replies */
+
+    if (sock_path) {
+        if ((g_daemon.listen_fd = SamListen(sock_path)) < 0)
+            exit(1);
+        opsec_set_socket_event(g_daemon.env, OPSEC_SK_INPUT, g_daemon.listen_fd, SamAccept, NULL);
+    }
+#else
+    if (sock_path) {
+        fprintf(stderr, "-s is not supported on this platform\n");
+        exit(1);
+    }
+#endif
+
+    if (!sock_path) {
+        if (!input)
+            fd = 0;
+        else if ((fd = open(input, O_RDONLY)) < 0) {
+            perror(input);
+            exit(1);
+        }
+
+        if ((source = SamSourceCreate(fd, stdout)) == NULL) {
+            fprintf(stderr, "can not create the command stream\n");
+            exit(1);
+        }
+#ifdef WIN32
+        /* select() takes sockets only, queue the whole input now */
+        source->refs++;
+        while (!source->eof)
+            SamSourceRead(fd, source);
+        SamSourceRelease(source);
+#endif
+    }
+
+    /*
+     * Sessions
+     */
+    for (i = 0; i < g_daemon.n_conns; i++)
+        SamConnOpen(&g_daemon.conns[i]);
+
+    opsec_mainloop(g_daemon.env);
+
+    fprintf(stderr, "%lu commands: %ld completed, %ld failed\n",
+            g_daemon.next_id, g_daemon.n_completed, g_daemon.n_failed);
+
+    free(g_daemon.conns);
+    opsec_destroy_entity(g_daemon.client);
+    opsec_destroy_entity(g_daemon.server);
+    opsec_env_destroy(g_daemon.env);
+    metrics_destroy();
+
+    return 0;
+}
@@ -0,0 +1,239 @@
+/***************************************************************************
+ *                                                                         *
+ * opsec_sl_host.c : Host of OPSEC shared library servers                  *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2001 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * The host loads servers which are shared libraries (see                  *
+ * shared_lib_server.h), and runs them all in its own OPSEC environment    *
+ * and main loop.                                                          *
+ *                                                                         *
+ * The sample CVP and UFP servers become such libraries when built with    *
+ * OPSEC_SL_SERVER (see ../cvp/cvp_av_server.c, ../ufp/ufp_server.c and    *
+ * ../common/sl_server.c), e.g.                                            *
+ *                                                                         *
+ *   cc -shared -fPIC -DOPSEC_SL_SERVER -o libcvp_av.so cvp_av_server.c    *
+ *      ../common/sl_server.c ../common/scan_stream.c                      *
+ *      ../common/scan_engine.c ../common/aho_corasick.c                   *
+ *      ../common/cvp_flow.c ../common/metrics.c                           *
+ *                                                                         *
+ * A server loaded by the host has no port of its own. Clients in the      *
+ * same process - entities of an application which embeds the host, or     *
+ * of another library it loads - connect to it over OPSEC_MEM_COMM: the    *
+ * requests and the replies are passed in memory, without the loopback     *
+ * TCP stack and the serialization to a socket. How every entity name      *
+ * connects comes from the OPSEC configuration file given with -f; see     *
+ * opsec_sl_host.conf for one which keeps the servers on memory comm.      *
+ *                                                                         *
+ * Usage: opsec_sl_host [-f <configuration file>]                          *
+ *                      <library>:<server name> ...                        *
+ *                                                                         *
+ * Every library serves a single entity, named by <server name>. The host  *
+ * runs until the main loop returns, then stops the servers and unloads    *
+ * the libraries in the reverse order.                                     *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "opsec/opsec.h"
+#include "opsec/opsec_error.h"
+#include "opsec/shared_lib_server.h"
+
+
+/*
+   Global definitions
+ */
+#define MAX_SERVERS   16
+
+/*
+   A loaded server
+ */
+typedef struct _hosted_server {
+	char            *lib;
+	char            *name;
+	SL_handle       *sl;
+	SL_ServerHandle *srv;
+} hosted_server;
+
+static hosted_server servers[MAX_SERVERS];
+static int           n_servers = 0;
+
+static char *ProgName = "Unknown";
+
+
+ /* -----------------------------------------------------------------------------
+  |  load_server:
+  |  ------------
+  |
+  |  Description:
+  |  ------------
+  |  Loads a shared library server, creates its entity in the host
+  |  environment and starts it.
+  |
+  |  Parameters:
+  |  -----------
+  |  env  - returned by a call to opsec_init.
+  |  spec - <library>:<server name>, changed in place.
+  |
+  |  Returned value:
+  |  ---------------
+  |  0 if successful, -1 otherwise. A library which was loaded is recorded,
+  |  so that unload_servers() unloads it in any case.
+   ----------------------------------------------------------------------------- */
+static int load_server(OpsecEnv *env, char *spec)
+{
+	hosted_server *hs  = &servers[n_servers];
+	char          *sep = strrchr(spec, ':');
+
+	if (!sep || sep == spec || !sep[1]) {
+		fprintf(stderr, "%s: bad server '%s', expected <library>:<server name>\n", ProgName, spec);
+		return -1;
+	}
+	*sep = '\0';
+
+	hs->lib  = spec;
+	hs->name = sep + 1;
+	hs->srv  = NULL;
+
+	if (!(hs->sl = opsec_sl_load(hs->lib))) {
+		fprintf(stderr, "%s: opsec_sl_load(%s) failed (%s)\n",
+			ProgName, hs->lib, opsec_errno_str(opsec_errno));
+		return -1;
+	}
+	n_servers++;
+
+	if (!(hs->srv = opsec_sl_init_server(hs->sl, env, hs->name))) {
+		fprintf(stderr, "%s: opsec_sl_init_server(%s) failed (%s)\n",
+			ProgName, hs->name, opsec_errno_str(opsec_errno));
+		return -1;
+	}
+
+	if (!opsec_sl_start_server(hs->srv)) {
+		fprintf(stderr, "%s: opsec_sl_start_server(%s) failed (%s)\n",
+			ProgName, hs->name, opsec_errno_str(opsec_errno));
+		return -1;
+	}
+
+	fprintf(stderr, "%s: %s from %s is running\n", ProgName, hs->name, hs->lib);
+
+	return 0;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  unload_servers:
+  |  ---------------
+  |
+  |  Description:
+  |  ------------
+  |  Stops and destroys the servers, and unloads their libraries, the last
+  |  loaded first.
+  |
+  |  Parameters:
+  |  -----------
+  |  None.
+  |
+  |  Returned value:
+  |  ---------------
+  |  None.
+   ----------------------------------------------------------------------------- */
+static void unload_servers(void)
+{
+	hosted_server *hs;
+
+	while (n_servers > 0) {
+		hs = &servers[--n_servers];
+
+		if (hs->srv) {
+			if (opsec_sl_is_server_running(hs->srv) && opsec_sl_stop_server(hs->srv) < 0)
+				fprintf(stderr, "%s: opsec_sl_stop_server(%s) failed\n", ProgName, hs->name);
+			opsec_sl_destroy_server(hs->srv);
+		}
+
+		if (opsec_sl_unload(hs->sl) < 0)
+			fprintf(stderr, "%s: opsec_sl_unload(%s) failed\n", ProgName, hs->lib);
+	}
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: %s [-f <configuration file>] <library>:<server name> ...\n", ProgName);
+	exit(1);
+}
+
+
+/* -------------------------------------------------------------------------------------
+                                        M A I N
+   ------------------------------------------------------------------------------------- */
+int main(int ac, char *av[])
+{
+	OpsecEnv *env;
+	char     *conf = NULL;
+	int       i = 1;
+
+	ProgName = av[0];
+
+	if (i + 1 < ac && !strcmp(av[i], "-f")) {
+		conf = av[i + 1];
+		i += 2;
+	}
+
+	if (i >= ac)
+		usage();
+
+	if (ac - i > MAX_SERVERS) {
+		fprintf(stderr, "%s: at most %d servers\n", ProgName, MAX_SERVERS);
+		exit(1);
+	}
+
+	/*
+	 * Create environment
+	 */
+	env = conf ? opsec_init(OPSEC_CONF_FILE, conf, OPSEC_EOL) : opsec_init(OPSEC_EOL);
+
+	if (env == NULL) {
+		fprintf(stderr, "%s: opsec_init failed (%s)\n",
+			ProgName, opsec_errno_str(opsec_errno));
+		exit(1);
+	}
+
+	/*
+	 * Load and start the servers
+	 */
+	for (; i < ac; i++) {
+		if (load_server(env, av[i]) < 0) {
+			unload_servers();
+			opsec_env_destroy(env);
+			exit(1);
+		}
+	}
+
+	fprintf(stderr, "\nHost is running %d servers\n", n_servers);
+
+	opsec_mainloop(env);
+
+	fprintf(stderr, "%s: opsec_mainloop returned\n", ProgName);
+
+	/*
+	 * Unload the servers and destroy the environment
+	 */
+	unload_servers();
+	opsec_env_destroy(env);
+
+	return 0;
+}
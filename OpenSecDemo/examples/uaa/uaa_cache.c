@@ -0,0 +1,671 @@
+ /*************************************************************************\
+ *                                                                         *
+ * uaa_cache.c : Cache of UAA query answers                                *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2001 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ \*************************************************************************/
+
+ /*************************************************************************\
+ * The cache answers repeated queries without going to the UAA server.     *
+ *                                                                         *
+ * 1. Queries are keyed by their assertions, sorted, so the order in which *
+ *    uaa_assert_t_add was called does not matter.                         *
+ *                                                                         *
+ * 2. An answer is positive when the reply holds a value for every type    *
+ *    queried with '?', negative otherwise. Each kind is kept for its own  *
+ *    TTL, a TTL of 0 disables caching it. Failed queries are not cached.  *
+ *                                                                         *
+ * 3. A query identical to one already in flight does not go to the        *
+ *    server, it waits for the same reply.                                 *
+ *                                                                         *
+ * 4. Updates sent through uaa_cache_update drop every entry whose query   *
+ *    or answer shares an assertion with the update.                       *
+ *                                                                         *
+ * 5. Beyond max_entries, the least recently used answers are dropped.     *
+ \*************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "opsec/opsec.h"
+#include <opsec/uaa.h>
+#include <opsec/uaa_client.h>
+#include <opsec/uaa_error.h>
+
+#include "uaa_cache.h"
+
+/*
+ * Prototypes
+ */
+
+static char          *make_key(uaa_assert_t *asserts);
+static unsigned int   key_hash(const char *key);
+static int            is_answered(uaa_assert_t *query, uaa_assert_t *reply);
+static int            has_assert(uaa_assert_t *asserts, const char *type, const char *value);
+static UaaCacheEntry *entry_find(UaaCache *cache, const char *key, unsigned int hash);
+static void           entry_unhash(UaaCacheEntry *entry);
+static void           entry_free(UaaCacheEntry *entry);
+static void           entry_reply(UaaEngine *engine, uaa_assert_t *reply,
+                                  uaa_reply_status status, void *opaque);
+static void           lru_remove(UaaCache *cache, UaaCacheEntry *entry);
+static void           lru_append(UaaCache *cache, UaaCacheEntry *entry);
+static int            cmp_str(const void *a, const void *b);
+
+ /* -----------------------------------------------------------------------------
+  |  uaa_cache_create:
+  |  -----------------
+  |
+  |  Description:
+  |  ------------
+  |  Creates a cache in front of an engine.
+  |
+  |  Parameters:
+  |  -----------
+  |  engine       - The engine the queries are sent through
+  |  positive_ttl - How long positive answers are kept, in seconds
+  |  negative_ttl - How long negative answers are kept, in seconds
+  |  max_entries  - The maximal number of cached queries
+  |
+  |  Returned value:
+  |  ---------------
+  |  The cache if successful, NULL otherwise.
+   ----------------------------------------------------------------------------- */
+UaaCache *uaa_cache_create(UaaEngine *engine, int positive_ttl, int negative_ttl,
+                           int max_entries)
+{
+	UaaCache *cache;
+
+	if (!(cache = (UaaCache *)calloc(1, sizeof(UaaCache))))
+		return NULL;
+
+	cache->engine       = engine;
+	cache->positive_ttl = positive_ttl;
+	cache->negative_ttl = negative_ttl;
+	cache->max_entries  = (max_entries > 0) ? max_entries : 1;
+
+	return cache;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  uaa_cache_destroy:
+  |  ------------------
+  |
+  |  Description:
+  |  ------------
+  |  Frees the cache. Queries still in flight are completed with
+  |  UAA_REPLY_STAT_CLOSING_SESSION; their entries stay with the engine and
+  |  are freed when it completes them.
+  |
+  |  Parameters:
+  |  -----------
+  |  cache - The cache
+  |
+  |  Returned value:
+  |  ---------------
+  |  None.
+   ----------------------------------------------------------------------------- */
+void uaa_cache_destroy(UaaCache *cache)
+{
+	UaaCacheEntry  *entry;
+	UaaCacheWaiter *waiter;
+	int             i;
+
+	if (!cache)
+		return;
+
+	for (i = 0; i < UAA_CACHE_BUCKETS; i++) {
+		while ((entry = cache->by_key[i])) {
+
+			entry_unhash(entry);
+
+			if (entry->state != UAA_CACHE_PENDING) {
+
+				entry_free(entry);
+				continue;
+			}
+
+			entry->cache = NULL;
+
+			while ((waiter = entry->waiters)) {
+
+				entry->waiters = waiter->next;
+				waiter->reply_cb(cache->engine, NULL, UAA_REPLY_STAT_CLOSING_SESSION,
+				                 waiter->opaque);
+				free(waiter);
+			}
+			entry->waiters_tail = &entry->waiters;
+		}
+	}
+
+	free(cache);
+}
+
+ /* -----------------------------------------------------------------------------
+  |  uaa_cache_query:
+  |  ----------------
+  |
+  |  Description:
+  |  ------------
+  |  Answers a query from the cache, joins an identical query in flight, or
+  |  sends it through the engine.
+  |
+  |  A cached answer is passed to reply_cb before returning; it remains valid
+  |  while reply_cb does not update or invalidate the cache.
+  |
+  |  Parameters:
+  |  -----------
+  |  cache    - The cache
+  |  query    - The query assertions, owned by the caller
+  |  timeout  - Deadline of the query in milliseconds, 0 for none
+  |  reply_cb - Called once with the answer
+  |  opaque   - Passed to reply_cb
+  |
+  |  Returned value:
+  |  ---------------
+  |  1 if answered from the cache, 0 if the answer will follow, -1 on error.
+   ----------------------------------------------------------------------------- */
+int uaa_cache_query(UaaCache *cache, uaa_assert_t *query, unsigned int timeout,
+                    UaaEngineReplyCB reply_cb, void *opaque)
+{
+	UaaCacheEntry  *entry;
+	UaaCacheWaiter *waiter;
+	char           *key;
+	unsigned int    hash;
+
+	if (!cache || !query || !reply_cb)
+		return -1;
+
+	if (!(key = make_key(query)))
+		return -1;
+
+	hash = key_hash(key);
+
+	if ((entry = entry_find(cache, key, hash)) &&
+	    entry->state != UAA_CACHE_PENDING && time(NULL) >= entry->expires) {
+
+		entry_unhash(entry);
+		entry_free(entry);
+		entry = NULL;
+	}
+
+	if (entry && entry->state != UAA_CACHE_PENDING) {
+
+		free(key);
+
+		if (entry->state == UAA_CACHE_POSITIVE)
+			cache->n_hits++;
+		else
+			cache->n_negative_hits++;
+
+		lru_remove(cache, entry);
+		lru_append(cache, entry);
+
+		reply_cb(cache->engine, entry->reply, UAA_REPLY_STAT_OK, opaque);
+		return 1;
+	}
+
+	if (!(waiter = (UaaCacheWaiter *)calloc(1, sizeof(UaaCacheWaiter)))) {
+
+		free(key);
+		return -1;
+	}
+	waiter->reply_cb = reply_cb;
+	waiter->opaque   = opaque;
+
+	if (entry) {
+
+		/*
+		 * the same query is in flight: wait for its reply
+		 */
+
+		free(key);
+		*entry->waiters_tail = waiter;
+		entry->waiters_tail  = &waiter->next;
+		cache->n_coalesced++;
+		return 0;
+	}
+
+	if (!(entry = (UaaCacheEntry *)calloc(1, sizeof(UaaCacheEntry))) ||
+	    !(entry->query = uaa_assert_t_duplicate(query))) {
+
+		free(entry);
+		free(waiter);
+		free(key);
+		return -1;
+	}
+
+	entry->cache        = cache;
+	entry->key          = key;
+	entry->hash         = hash;
+	entry->state        = UAA_CACHE_PENDING;
+	entry->waiters      = waiter;
+	entry->waiters_tail = &waiter->next;
+
+	if (uaa_engine_send(cache->engine, UAA_ENGINE_QUERY, query, timeout,
+	                    entry_reply, entry) < 0) {
+
+		entry->waiters = NULL;
+		free(waiter);
+		entry_free(entry);
+		return -1;
+	}
+
+	entry->hashed    = 1;
+	entry->hash_next = cache->by_key[hash % UAA_CACHE_BUCKETS];
+	cache->by_key[hash % UAA_CACHE_BUCKETS] = entry;
+	cache->n_entries++;
+	cache->n_misses++;
+
+	return 0;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  uaa_cache_update:
+  |  -----------------
+  |
+  |  Description:
+  |  ------------
+  |  Sends an update through the engine (uaa_send_update) and drops the
+  |  cached answers it may change.
+  |
+  |  Parameters:
+  |  -----------
+  |  cache    - The cache
+  |  update   - The update assertions, owned by the caller
+  |  timeout  - Deadline of the update in milliseconds, 0 for none
+  |  reply_cb - Called once with the reply to the update
+  |  opaque   - Passed to reply_cb
+  |
+  |  Returned value:
+  |  ---------------
+  |  0 if the update was sent, -1 otherwise.
+   ----------------------------------------------------------------------------- */
+int uaa_cache_update(UaaCache *cache, uaa_assert_t *update, unsigned int timeout,
+                     UaaEngineReplyCB reply_cb, void *opaque)
+{
+	if (!cache || !update)
+		return -1;
+
+	uaa_cache_invalidate(cache, update);
+
+	return uaa_engine_send(cache->engine, UAA_ENGINE_UPDATE, update, timeout,
+	                       reply_cb, opaque);
+}
+
+ /* -----------------------------------------------------------------------------
+  |  uaa_cache_invalidate:
+  |  ---------------------
+  |
+  |  Description:
+  |  ------------
+  |  Drops every entry whose query or answer holds one of the given
+  |  assertions ('?' values are ignored). A query in flight still completes
+  |  its waiters, but its answer is not cached.
+  |
+  |  Parameters:
+  |  -----------
+  |  cache   - The cache
+  |  asserts - The assertions which changed
+  |
+  |  Returned value:
+  |  ---------------
+  |  The number of entries dropped.
+   ----------------------------------------------------------------------------- */
+int uaa_cache_invalidate(UaaCache *cache, uaa_assert_t *asserts)
+{
+	uaa_assert_t_iter *iter;
+	UaaCacheEntry     *entry, *next;
+	char              *type, *value;
+	int                i, n = 0;
+
+	if (!(iter = uaa_assert_t_iter_create(asserts, NULL)))
+		return 0;
+
+	while (uaa_assert_t_iter_get_next(iter, &value, &type) != -1) {
+
+		if (!strcmp(value, "?"))
+			continue;
+
+		for (i = 0; i < UAA_CACHE_BUCKETS; i++) {
+			for (entry = cache->by_key[i]; entry; entry = next) {
+
+				next = entry->hash_next;
+
+				if (!has_assert(entry->query, type, value) &&
+				    !has_assert(entry->reply, type, value))
+					continue;
+
+				entry_unhash(entry);
+				if (entry->state != UAA_CACHE_PENDING)
+					entry_free(entry);
+				n++;
+			}
+		}
+	}
+
+	uaa_assert_t_iter_destroy(iter);
+
+	cache->n_invalidated += n;
+
+	return n;
+}
+
+/* -------------------------------------------------------------------------------------
+                                 Internal functions
+   ------------------------------------------------------------------------------------- */
+
+ /* -----------------------------------------------------------------------------
+  |  entry_reply:
+  |  ------------
+  |
+  |  Description:
+  |  ------------
+  |  The engine completed the query of an entry: keep the answer if the entry
+  |  is still current and the TTL of its kind allows, then pass the reply to
+  |  every query waiting for it.
+  |
+  |  Parameters:
+  |  -----------
+  |  engine - The engine
+  |  reply  - The reply assertions, or NULL
+  |  status - The reply status
+  |  opaque - The entry
+  |
+  |  Returned value:
+  |  ---------------
+  |  None.
+   ----------------------------------------------------------------------------- */
+static void entry_reply(UaaEngine *engine, uaa_assert_t *reply,
+                        uaa_reply_status status, void *opaque)
+{
+	UaaCacheEntry  *entry = (UaaCacheEntry *)opaque;
+	UaaCache       *cache = entry->cache;
+	UaaCacheWaiter *waiters, *waiter;
+	int             state = UAA_CACHE_NEGATIVE, ttl = 0;
+
+	waiters = entry->waiters;
+	entry->waiters      = NULL;
+	entry->waiters_tail = &entry->waiters;
+
+	if (status == UAA_REPLY_STAT_OK && cache) {
+
+		if (is_answered(entry->query, reply)) {
+			state = UAA_CACHE_POSITIVE;
+			ttl   = cache->positive_ttl;
+		} else {
+			ttl   = cache->negative_ttl;
+		}
+	}
+
+	if (ttl > 0 && entry->hashed &&
+	    (!reply || (entry->reply = uaa_assert_t_duplicate(reply)))) {
+
+		entry->state   = state;
+		entry->expires = time(NULL) + ttl;
+		lru_append(cache, entry);
+
+		while (cache->n_entries > cache->max_entries && cache->lru_head) {
+
+			entry = cache->lru_head;
+			entry_unhash(entry);
+			entry_free(entry);
+			cache->n_evicted++;
+		}
+	} else {
+
+		entry_unhash(entry);
+		entry_free(entry);
+	}
+
+	while ((waiter = waiters)) {
+
+		waiters = waiter->next;
+		waiter->reply_cb(engine, reply, status, waiter->opaque);
+		free(waiter);
+	}
+}
+
+ /* -----------------------------------------------------------------------------
+  |  make_key:
+  |  ---------
+  |
+  |  Description:
+  |  ------------
+  |  Builds the key of a query: its "type=value" assertions, sorted and
+  |  joined by new lines.
+  |
+  |  Parameters:
+  |  -----------
+  |  asserts - The query assertions
+  |
+  |  Returned value:
+  |  ---------------
+  |  An allocated string, or NULL.
+   ----------------------------------------------------------------------------- */
+static char *make_key(uaa_assert_t *asserts)
+{
+	uaa_assert_t_iter *iter;
+	char              *type, *value, **pairs, *key = NULL;
+	int                n, i = 0, len = 1;
+
+	if ((n = uaa_assert_t_n_elements(asserts)) < 0)
+		return NULL;
+
+	if (!(pairs = (char **)calloc(n + 1, sizeof(char *))))
+		return NULL;
+
+	if (!(iter = uaa_assert_t_iter_create(asserts, NULL))) {
+
+		free(pairs);
+		return NULL;
+	}
+
+	while (i < n && uaa_assert_t_iter_get_next(iter, &value, &type) != -1) {
+
+		if (!(pairs[i] = (char *)malloc(strlen(type) + strlen(value) + 2)))
+			goto out;
+		sprintf(pairs[i], "%s=%s", type, value);
+		len += strlen(pairs[i]) + 1;
+		i++;
+	}
+	n = i;
+
+	qsort(pairs, n, sizeof(char *), cmp_str);
+
+	if (!(key = (char *)malloc(len)))
+		goto out;
+
+	key[0] = '\0';
+	for (i = 0; i < n; i++) {
+		strcat(key, pairs[i]);
+		strcat(key, "\n");
+	}
+
+out:
+	uaa_assert_t_iter_destroy(iter);
+	for (i = 0; i < n && pairs[i]; i++)
+		free(pairs[i]);
+	free(pairs);
+
+	return key;
+}
+
+static int cmp_str(const void *a, const void *b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static unsigned int key_hash(const char *key)
+{
+	unsigned int h = 5381;
+
+	while (*key)
+		h = h * 33 + (unsigned char)*key++;
+
+	return h;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  is_answered:
+  |  ------------
+  |
+  |  Description:
+  |  ------------
+  |  Checks that a reply holds a value for every type queried with '?'.
+  |
+  |  Parameters:
+  |  -----------
+  |  query - The query assertions
+  |  reply - The reply assertions, or NULL
+  |
+  |  Returned value:
+  |  ---------------
+  |  1 for a positive answer, 0 for a negative one.
+   ----------------------------------------------------------------------------- */
+static int is_answered(uaa_assert_t *query, uaa_assert_t *reply)
+{
+	uaa_assert_t_iter *iter, *found;
+	char              *type, *value, *rtype, *rvalue;
+	int                rc = 1;
+
+	if (!reply)
+		return 0;
+
+	if (!(iter = uaa_assert_t_iter_create(query, NULL)))
+		return 0;
+
+	while (rc && uaa_assert_t_iter_get_next(iter, &value, &type) != -1) {
+
+		if (strcmp(value, "?"))
+			continue;
+
+		if (!(found = uaa_assert_t_iter_create(reply, type))) {
+			rc = 0;
+			break;
+		}
+		if (uaa_assert_t_iter_get_next(found, &rvalue, &rtype) == -1 || !strcmp(rvalue, "?"))
+			rc = 0;
+		uaa_assert_t_iter_destroy(found);
+	}
+
+	uaa_assert_t_iter_destroy(iter);
+
+	return rc;
+}
+
+static int has_assert(uaa_assert_t *asserts, const char *type, const char *value)
+{
+	uaa_assert_t_iter *iter;
+	char              *t, *v;
+	int                rc = 0;
+
+	if (!asserts || !(iter = uaa_assert_t_iter_create(asserts, type)))
+		return 0;
+
+	while (!rc && uaa_assert_t_iter_get_next(iter, &v, &t) != -1)
+		rc = !strcmp(v, value);
+
+	uaa_assert_t_iter_destroy(iter);
+
+	return rc;
+}
+
+static UaaCacheEntry *entry_find(UaaCache *cache, const char *key, unsigned int hash)
+{
+	UaaCacheEntry *entry;
+
+	for (entry = cache->by_key[hash % UAA_CACHE_BUCKETS]; entry; entry = entry->hash_next)
+		if (entry->hash == hash && !strcmp(entry->key, key))
+			return entry;
+
+	return NULL;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  entry_unhash:
+  |  -------------
+  |
+  |  Description:
+  |  ------------
+  |  Hides an entry from new queries. A pending entry lives on until the
+  |  engine completes its query.
+  |
+  |  Parameters:
+  |  -----------
+  |  entry - The entry
+  |
+  |  Returned value:
+  |  ---------------
+  |  None.
+   ----------------------------------------------------------------------------- */
+static void entry_unhash(UaaCacheEntry *entry)
+{
+	UaaCache       *cache = entry->cache;
+	UaaCacheEntry **pp;
+
+	if (!entry->hashed || !cache)
+		return;
+
+	for (pp = &cache->by_key[entry->hash % UAA_CACHE_BUCKETS]; *pp; pp = &(*pp)->hash_next) {
+		if (*pp == entry) {
+
+			*pp = entry->hash_next;
+			break;
+		}
+	}
+
+	if (entry->state != UAA_CACHE_PENDING)
+		lru_remove(cache, entry);
+
+	entry->hash_next = NULL;
+	entry->hashed    = 0;
+	cache->n_entries--;
+}
+
+static void entry_free(UaaCacheEntry *entry)
+{
+	if (entry->query)
+		uaa_assert_t_destroy(entry->query);
+	if (entry->reply)
+		uaa_assert_t_destroy(entry->reply);
+	free(entry->key);
+	free(entry);
+}
+
+static void lru_remove(UaaCache *cache, UaaCacheEntry *entry)
+{
+	if (entry->lru_prev)
+		entry->lru_prev->lru_next = entry->lru_next;
+	else
+		cache->lru_head = entry->lru_next;
+
+	if (entry->lru_next)
+		entry->lru_next->lru_prev = entry->lru_prev;
+	else
+		cache->lru_tail = entry->lru_prev;
+
+	entry->lru_prev = entry->lru_next = NULL;
+}
+
+static void lru_append(UaaCache *cache, UaaCacheEntry *entry)
+{
+	entry->lru_prev = cache->lru_tail;
+	entry->lru_next = NULL;
+
+	if (cache->lru_tail)
+		cache->lru_tail->lru_next = entry;
+	else
+		cache->lru_head = entry;
+	cache->lru_tail = entry;
+}
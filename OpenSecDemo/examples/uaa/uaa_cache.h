@@ -0,0 +1,92 @@
+ /*************************************************************************\
+ *                                                                         *
+ * uaa_cache.h : Cache of UAA query answers                                *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2001 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ \*************************************************************************/
+
+#ifndef _UAA_CACHE_H
+#define _UAA_CACHE_H
+
+#include <time.h>
+
+#include "uaa_engine.h"
+
+/*
+ * Entry states
+ */
+#define UAA_CACHE_PENDING       0   /* the query is in flight */
+#define UAA_CACHE_POSITIVE      1   /* every '?' of the query was answered */
+#define UAA_CACHE_NEGATIVE      2   /* the server did not know */
+
+#define UAA_CACHE_BUCKETS       4096
+
+typedef struct _UaaCache        UaaCache;
+typedef struct _UaaCacheEntry   UaaCacheEntry;
+typedef struct _UaaCacheWaiter  UaaCacheWaiter;
+
+struct _UaaCacheWaiter {
+	UaaEngineReplyCB  reply_cb;
+	void             *opaque;
+	UaaCacheWaiter   *next;
+};
+
+struct _UaaCacheEntry {
+	UaaCache         *cache;        /* NULL once the cache is gone */
+	char             *key;          /* the sorted assertions of the query */
+	unsigned int      hash;
+	int               state;
+	int               hashed;       /* found by new queries */
+	time_t            expires;
+	uaa_assert_t     *query;        /* a copy, for invalidation */
+	uaa_assert_t     *reply;        /* the cached answer, may be NULL */
+
+	UaaCacheWaiter   *waiters;      /* coalesced queries, while pending */
+	UaaCacheWaiter  **waiters_tail;
+
+	UaaCacheEntry    *hash_next;
+	UaaCacheEntry    *lru_prev;     /* answered entries only */
+	UaaCacheEntry    *lru_next;
+};
+
+struct _UaaCache {
+	UaaEngine        *engine;
+	int               positive_ttl; /* [sec] */
+	int               negative_ttl; /* [sec] */
+	int               max_entries;
+
+	UaaCacheEntry    *by_key[UAA_CACHE_BUCKETS];
+	UaaCacheEntry    *lru_head;     /* least recently used */
+	UaaCacheEntry    *lru_tail;
+	int               n_entries;
+
+	/* statistics */
+	unsigned long     n_hits;
+	unsigned long     n_negative_hits;
+	unsigned long     n_misses;
+	unsigned long     n_coalesced;
+	unsigned long     n_invalidated;
+	unsigned long     n_evicted;
+};
+
+UaaCache *uaa_cache_create(UaaEngine *engine, int positive_ttl, int negative_ttl,
+                           int max_entries);
+void      uaa_cache_destroy(UaaCache *cache);
+
+int       uaa_cache_query(UaaCache *cache, uaa_assert_t *query, unsigned int timeout,
+                          UaaEngineReplyCB reply_cb, void *opaque);
+int       uaa_cache_update(UaaCache *cache, uaa_assert_t *update, unsigned int timeout,
+                           UaaEngineReplyCB reply_cb, void *opaque);
+int       uaa_cache_invalidate(UaaCache *cache, uaa_assert_t *asserts);
+
+#endif /* _UAA_CACHE_H */
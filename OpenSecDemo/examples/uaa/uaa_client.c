@@ -27,6 +27,15 @@
  * 3. If the UAG doesn't send the user name back, we try to authenticate   *
  *    the user                                                             *
  *                                                                         *
+ * When started with -n <count>, the client instead resolves <count>       *
+ * source addresses through the pipelined engine of uaa_engine.c, keeping  *
+ * up to -w <window> queries in flight, each with a deadline of            *
+ * -t <timeout> milliseconds.                                              *
+ *                                                                         *
+ * With -P <sec> and/or -N <sec> the lookups go through the answer cache   *
+ * of uaa_cache.c, keeping positive / negative answers for that long.      *
+ * -a <count> makes the lookups cycle over that many addresses.            *
+ *                                                                         *
  \*************************************************************************/
 
 #include <stdio.h>
@@ -46,15 +55,39 @@
 #include <opsec/uaa_client.h>
 #include <opsec/uaa_error.h>
 
+#include "uaa_engine.h"
+#include "uaa_cache.h"
+
 /*
  * Global definitions
  */
 
+#define DEFAULT_WINDOW   64
+#define DEFAULT_TIMEOUT  5000       /* [ms] */
+#define CACHE_ENTRIES    65536
+
 typedef struct _Info{
 	OpsecEntity     *server;
 	OpsecEntity     *client;
 }Info;
 
+/*
+ * Pipelined lookups (-n)
+ */
+
+static int g_lookups = 0;
+static int g_window  = DEFAULT_WINDOW;
+static int g_timeout = DEFAULT_TIMEOUT;
+static int g_issued  = 0;
+static int g_done    = 0;
+static int g_found   = 0;
+static int g_addrs   = 0;
+static int g_pos_ttl = 0;           /* [sec] */
+static int g_neg_ttl = 0;           /* [sec] */
+static int g_filling = 0;
+
+static UaaCache *g_cache = NULL;
+
 /*
  * Functions
  */
@@ -289,10 +322,220 @@ int authenticateUAG(OpsecSession *session)
 	return 1;
 }
 
+static void lookup_reply(UaaEngine *engine, uaa_assert_t *reply,
+                         uaa_reply_status status, void *opaque);
+static void lookup_finish(void *session_);
+
+ /* -----------------------------------------------------------------------------
+  |  lookup_next:
+  |  ------------
+  |
+  |  Description:
+  |  ------------
+  |  Sends the query for the user behind the next source address through the
+  |  cache, if any, or the engine.
+  |
+  |  Parameters:
+  |  -----------
+  |  engine - The engine of the session
+  |
+  |  Returned value:
+  |  ---------------
+  |  0 if successful, -1 otherwise
+   ----------------------------------------------------------------------------- */
+static int lookup_next(UaaEngine *engine)
+{
+	uaa_assert_t *query;
+	char          src[32];
+	int           idx = g_issued, addr, rc = -1;
+
+	addr = (g_addrs > 0) ? idx % g_addrs : idx;
+	sprintf(src, "10.%d.%d.%d", (addr >> 16) & 0xff, (addr >> 8) & 0xff, addr & 0xff);
+
+	if (!(query = uaa_assert_t_create()))
+		return -1;
+
+	if (uaa_assert_t_add(query, "src", src) == -1 ||
+	    uaa_assert_t_add(query, "user", "?") == -1) {
+
+		Error("lookup_next: uaa_assert_t_add failed");
+	} else {
+
+		/*
+		 * a cached answer is delivered before uaa_cache_query returns
+		 */
+
+		g_issued++;
+
+		if (g_cache)
+			rc = (uaa_cache_query(g_cache, query, (unsigned int)g_timeout,
+			                      lookup_reply, (void *)(long)idx) < 0) ? -1 : 0;
+		else
+			rc = uaa_engine_send(engine, UAA_ENGINE_QUERY, query, (unsigned int)g_timeout,
+			                     lookup_reply, (void *)(long)idx);
+		if (rc < 0)
+			g_issued--;
+	}
+
+	uaa_assert_t_destroy(query);
+
+	return rc;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  lookup_fill:
+  |  ------------
+  |
+  |  Description:
+  |  ------------
+  |  Sends lookups until 'window' are unanswered or all were sent, then ends
+  |  the session once all were answered. Cached answers call back into it,
+  |  so nested calls return at once.
+  |
+  |  Parameters:
+  |  -----------
+  |  engine - The engine of the session
+  |
+  |  Returned value:
+  |  ---------------
+  |  None.
+   ----------------------------------------------------------------------------- */
+static void lookup_fill(UaaEngine *engine)
+{
+	if (g_filling)
+		return;
+
+	g_filling = 1;
+
+	while (g_issued < g_lookups && g_issued - g_done < g_window)
+		if (lookup_next(engine) < 0)
+			g_lookups = g_issued;
+
+	g_filling = 0;
+
+	if (g_done == g_lookups)
+		opsec_schedule(engine->env, 0L, lookup_finish, engine->session);
+}
+
+ /* -----------------------------------------------------------------------------
+  |  lookup_finish:
+  |  --------------
+  |
+  |  Description:
+  |  ------------
+  |  Prints the engine statistics and ends the session. Scheduled, so it does
+  |  not run from within a reply handler.
+  |
+  |  Parameters:
+  |  -----------
+  |  session_ - Pointer to an OpsecSession object
+  |
+  |  Returned value:
+  |  ---------------
+  |  None.
+   ----------------------------------------------------------------------------- */
+static void lookup_finish(void *session_)
+{
+	OpsecSession *session = (OpsecSession *)session_;
+	UaaEngine    *engine  = uaa_engine_get(session);
+
+	if (engine)
+		fprintf(stderr, "lookups: %d done, %d users found, "
+		                "%lu sent, %lu replied, %lu expired, %lu failed\n",
+		                g_done, g_found, engine->n_sent, engine->n_replied,
+		                engine->n_expired, engine->n_failed);
+
+	if (g_cache)
+		fprintf(stderr, "cache: %lu hits, %lu negative hits, %lu misses, %lu coalesced, "
+		                "%lu evicted\n",
+		                g_cache->n_hits, g_cache->n_negative_hits, g_cache->n_misses,
+		                g_cache->n_coalesced, g_cache->n_evicted);
+
+	uaa_end_session(session);
+}
+
+ /* -----------------------------------------------------------------------------
+  |  lookup_reply:
+  |  -------------
+  |
+  |  Description:
+  |  ------------
+  |  Called by the engine or the cache with the outcome of one lookup.
+  |  Keeps the window full until all the lookups were sent.
+  |
+  |  Parameters:
+  |  -----------
+  |  engine - The engine of the session
+  |  reply  - The reply assertions, NULL if the query failed
+  |  status - A uaa_reply_status object, holding the reply status
+  |  opaque - The index of the lookup
+  |
+  |  Returned value:
+  |  ---------------
+  |  None.
+   ----------------------------------------------------------------------------- */
+static void lookup_reply(UaaEngine *engine, uaa_assert_t *reply,
+                         uaa_reply_status status, void *opaque)
+{
+	uaa_assert_t_iter *iter;
+	char              *type, *value = NULL;
+
+	if (status == UAA_REPLY_STAT_OK && reply &&
+	    (iter = uaa_assert_t_iter_create(reply, "user"))) {
+
+		uaa_assert_t_iter_get_next(iter, &value, &type);
+		uaa_assert_t_iter_destroy(iter);
+	}
+
+	if (value)
+		g_found++;
+
+	fprintf(stdout, "lookup %ld: %s (%s)\n", (long)opaque,
+	        value ? value : "-", uaa_error_str(status));
+
+	g_done++;
+
+	if (status == UAA_REPLY_STAT_CLOSING_SESSION)
+		return;
+
+	lookup_fill(engine);
+}
+
 /* -------------------------------------------------------------------------------------
                                  UAA   client   handlers
    ------------------------------------------------------------------------------------- */
 
+ /* -----------------------------------------------------------------------------
+  |  uaa_update_reply_handler:
+  |  -------------------------
+  |
+  |  Description:
+  |  ------------
+  |  this handler is called whenever the server sends back a reply for an update
+  |  sent through the answer cache (uaa_cache_update).
+  |
+  |  Parameters:
+  |  -----------
+  |  session - Pointer to an OpsecSession object
+  |  reply   - A pointer to a uaa_assert_t object, holding the servers reply
+  |  opaque  - Data hanged on the update
+  |  cmd_id  - the id returned by the uaa_send_update
+  |  status  - A uaa_reply_status object, holding the reply status
+  |
+  |  Returned value:
+  |  ---------------
+  |  OPSEC_SESSION_OK
+   ----------------------------------------------------------------------------- */
+static int uaa_update_reply_handler(OpsecSession *session,
+                                    uaa_assert_t *reply,
+                                    void *opaque,
+                                    int cmd_id,
+                                    uaa_reply_status status)
+{
+	uaa_engine_reply(session, reply, cmd_id, status);
+	return OPSEC_SESSION_OK;
+}
+
  /* -----------------------------------------------------------------------------
   |  uaa_authenticate_reply_handler:
   |  -------------------------------
@@ -325,6 +568,15 @@ static int uaa_authenticate_reply_handler(OpsecSession *session,
                                           uaa_reply_status status)
 
 {
+	/*
+	 * replies to the pipelined lookups belong to the engine
+	 */
+
+	if (uaa_engine_get(session)) {
+		uaa_engine_reply(session, reply, cmd_id, status);
+		return OPSEC_SESSION_OK;
+	}
+
 	fprintf(stderr,"\nuaa_authenticate_handler\n");
 
 	fprintf(stderr, "uaa_authenticate_handler: status is %s\n",uaa_error_str(status));
@@ -377,6 +629,13 @@ static int uaa_query_reply_handler(OpsecSession *session,
 	uaa_assert_t_iter *iter = uaa_assert_t_iter_create(reply,"user");
 	int               rc = 0;
 
+	if (uaa_engine_get(session)) {
+		if (iter)
+			uaa_assert_t_iter_destroy(iter);
+		uaa_engine_reply(session, reply, cmd_id, status);
+		return OPSEC_SESSION_OK;
+	}
+
 	fprintf(stderr, "\nuaa_query_reply_handler\n");
 
 	fprintf(stderr, "uaa_query_reply_handler: status is %s\n", uaa_error_str(status));
@@ -437,7 +696,7 @@ static int start_handler(OpsecSession *session)
   |
   |  Description:
   |  ------------
-  |  Sends a query to the server
+  |  Sends a query to the server, or starts the pipelined lookups
   |
   |  Parameters:
   |  -----------
@@ -449,9 +708,31 @@ static int start_handler(OpsecSession *session)
    ----------------------------------------------------------------------------- */
 static int session_established_handler(OpsecSession *session)
 {
-	int rc;
+	UaaEngine *engine;
+	int        rc;
 
 	fprintf(stdout, "session_established_handler: Session is active\n");
+
+	if (g_lookups > 0) {
+
+		if (!(engine = uaa_engine_create(session, g_window))) {
+
+			Error("session_established_handler: uaa_engine_create failed");
+			return OPSEC_SESSION_END;
+		}
+
+		if ((g_pos_ttl > 0 || g_neg_ttl > 0) &&
+		    !(g_cache = uaa_cache_create(engine, g_pos_ttl, g_neg_ttl, CACHE_ENTRIES))) {
+
+			Error("session_established_handler: uaa_cache_create failed");
+			return OPSEC_SESSION_END;
+		}
+
+		lookup_fill(engine);
+
+		return g_issued ? OPSEC_SESSION_OK : OPSEC_SESSION_END;
+	}
+
 	rc = queryUAG(session);
 	if (rc == 0)
 		return OPSEC_SESSION_OK;
@@ -478,6 +759,16 @@ static int session_established_handler(OpsecSession *session)
 static void end_handler(OpsecSession *session)
 {
 	fprintf(stderr, "uaa_client_end_handler\n");
+
+	opsec_deschedule(opsec_get_session_env(session), lookup_finish, session);
+
+	/*
+	 * the engine first: its pending queries complete through the cache
+	 */
+
+	uaa_engine_destroy(uaa_engine_get(session));
+	uaa_cache_destroy(g_cache);
+	g_cache = NULL;
 	return;
 }
 
@@ -491,9 +782,40 @@ int main(int ac, char *av[])
 	OpsecEntity *client, *server;
 	char        *ProgName;
 	Info        info;
+	int         i;
 	
 	ProgName = av[0];
 
+	/*
+	 * Pipelined lookups: -n <count> [-w <window>] [-t <timeout ms>]
+	 *                    [-a <addresses>] [-P <positive ttl>] [-N <negative ttl>]
+	 */
+
+	for (i = 1; i + 1 < ac; i += 2) {
+
+		if (!strcmp(av[i], "-n"))
+			g_lookups = atoi(av[i + 1]);
+		else if (!strcmp(av[i], "-w"))
+			g_window = atoi(av[i + 1]);
+		else if (!strcmp(av[i], "-t"))
+			g_timeout = atoi(av[i + 1]);
+		else if (!strcmp(av[i], "-a"))
+			g_addrs = atoi(av[i + 1]);
+		else if (!strcmp(av[i], "-P"))
+			g_pos_ttl = atoi(av[i + 1]);
+		else if (!strcmp(av[i], "-N"))
+			g_neg_ttl = atoi(av[i + 1]);
+		else
+			break;
+	}
+
+	if (i < ac) {
+		fprintf(stderr, "Usage: %s [-n <count>] [-w <window>] [-t <timeout ms>]\n"
+		                "          [-a <addresses>] [-P <positive ttl>] [-N <negative ttl>]\n",
+		                ProgName);
+		exit(1);
+	}
+
 	/*
 	 * Create environment
 	 */
@@ -516,6 +838,7 @@ int main(int ac, char *av[])
 	                                OPSEC_SESSION_ESTABLISHED_HANDLER, session_established_handler,
 	                                UAA_QUERY_REPLY_HANDLER,uaa_query_reply_handler,
 	                                UAA_AUTHENTICATE_REPLY_HANDLER, uaa_authenticate_reply_handler,
+	                                UAA_UPDATE_REPLY_HANDLER, uaa_update_reply_handler,
 	                                OPSEC_EOL);
 
 	server = opsec_init_entity(env, UAA_SERVER,
@@ -0,0 +1,585 @@
+ /*************************************************************************\
+ *                                                                         *
+ * uaa_engine.c : Pipelined UAA client requests                            *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2001 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ \*************************************************************************/
+
+ /*************************************************************************\
+ * The engine keeps many queries and authentication requests in flight on  *
+ * one UAA session instead of waiting for each reply in turn.              *
+ *                                                                         *
+ * 1. Requests are sent at once while fewer than 'window' are outstanding, *
+ *    the others wait in a FIFO queue holding a copy of their assertions.  *
+ *                                                                         *
+ * 2. Replies are matched to their request by the cmd_id returned from     *
+ *    uaa_send_query / uaa_send_authenticate_request. Replies with an      *
+ *    unknown cmd_id (aborted or timed out requests) are dropped.          *
+ *                                                                         *
+ * 3. Each request has its own deadline, set with opsec_schedule from the  *
+ *    time it was submitted. When it expires the request is aborted with   *
+ *    uaa_abort_query and completed with UAA_REPLY_STAT_TIMEOUT.           *
+ *                                                                         *
+ * 4. Request records are kept in a free list and reused.                  *
+ *                                                                         *
+ * The engine is hung on the session opaque, the reply handlers of the     *
+ * client entity pass their replies to uaa_engine_reply.                   *
+ \*************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "opsec/opsec.h"
+#include "opsec/opsec_error.h"
+#include <opsec/uaa.h>
+#include <opsec/uaa_client.h>
+#include <opsec/uaa_error.h>
+
+#include "uaa_engine.h"
+
+/*
+ * Prototypes
+ */
+
+static UaaRequest *request_alloc(UaaEngine *engine);
+static void        request_free(UaaEngine *engine, UaaRequest *req);
+static int         request_send(UaaEngine *engine, UaaRequest *req, uaa_assert_t *asserts);
+static void        request_expire(void *opaque);
+static void        request_complete(UaaRequest *req, uaa_assert_t *reply, uaa_reply_status status);
+static void        hash_remove(UaaEngine *engine, UaaRequest *req);
+static void        queue_remove(UaaEngine *engine, UaaRequest *req);
+static void        queue_pump(UaaEngine *engine);
+
+#define ID_BUCKET(cmd_id)  ((unsigned int)(cmd_id) % UAA_ENGINE_BUCKETS)
+
+ /* -----------------------------------------------------------------------------
+  |  uaa_engine_create:
+  |  ------------------
+  |
+  |  Description:
+  |  ------------
+  |  Creates an engine for an established UAA session and hangs it on the
+  |  session opaque.
+  |
+  |  Parameters:
+  |  -----------
+  |  session - Pointer to an OpsecSession object
+  |  window  - The maximal number of requests in flight
+  |
+  |  Returned value:
+  |  ---------------
+  |  The engine if successful, NULL otherwise.
+   ----------------------------------------------------------------------------- */
+UaaEngine *uaa_engine_create(OpsecSession *session, int window)
+{
+	UaaEngine *engine;
+
+	if (!(engine = (UaaEngine *)calloc(1, sizeof(UaaEngine))))
+		return NULL;
+
+	engine->session = session;
+	engine->env     = opsec_get_session_env(session);
+	engine->window  = (window > 0) ? window : 1;
+
+	SESSION_OPAQUE(session) = engine;
+
+	return engine;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  uaa_engine_destroy:
+  |  -------------------
+  |
+  |  Description:
+  |  ------------
+  |  Completes every request still in flight or queued with
+  |  UAA_REPLY_STAT_CLOSING_SESSION and frees the engine.
+  |  Called from the session end handler, so nothing is aborted on the wire.
+  |
+  |  Parameters:
+  |  -----------
+  |  engine - The engine
+  |
+  |  Returned value:
+  |  ---------------
+  |  None.
+   ----------------------------------------------------------------------------- */
+void uaa_engine_destroy(UaaEngine *engine)
+{
+	UaaRequest   *req;
+	UaaPoolChunk *chunk;
+	int           i;
+
+	if (!engine)
+		return;
+
+	/*
+	 * no more sends from the callbacks below
+	 */
+
+	engine->window = 0;
+
+	for (i = 0; i < UAA_ENGINE_BUCKETS; i++) {
+		while ((req = engine->by_id[i])) {
+
+			hash_remove(engine, req);
+			request_complete(req, NULL, UAA_REPLY_STAT_CLOSING_SESSION);
+		}
+	}
+
+	while ((req = engine->queue_head)) {
+
+		queue_remove(engine, req);
+		request_complete(req, NULL, UAA_REPLY_STAT_CLOSING_SESSION);
+	}
+
+	while ((chunk = engine->chunks)) {
+
+		engine->chunks = chunk->next;
+		free(chunk);
+	}
+
+	if (SESSION_OPAQUE(engine->session) == engine)
+		SESSION_OPAQUE(engine->session) = NULL;
+
+	free(engine);
+}
+
+ /* -----------------------------------------------------------------------------
+  |  uaa_engine_get:
+  |  ---------------
+  |
+  |  Description:
+  |  ------------
+  |  Returns the engine of a session, if any.
+  |
+  |  Parameters:
+  |  -----------
+  |  session - Pointer to an OpsecSession object
+  |
+  |  Returned value:
+  |  ---------------
+  |  The engine, or NULL.
+   ----------------------------------------------------------------------------- */
+UaaEngine *uaa_engine_get(OpsecSession *session)
+{
+	return session ? (UaaEngine *)SESSION_OPAQUE(session) : NULL;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  uaa_engine_send:
+  |  ----------------
+  |
+  |  Description:
+  |  ------------
+  |  Sends a query, an update or an authentication request, or queues it when
+  |  the window is full. The assertions remain owned by the caller.
+  |
+  |  Parameters:
+  |  -----------
+  |  engine   - The engine
+  |  kind     - UAA_ENGINE_QUERY, UAA_ENGINE_UPDATE or UAA_ENGINE_AUTHENTICATE
+  |  asserts  - The request assertions
+  |  timeout  - Deadline of the request in milliseconds, 0 for none
+  |  reply_cb - Called once with the outcome of the request
+  |  opaque   - Passed to reply_cb
+  |
+  |  Returned value:
+  |  ---------------
+  |  0 if the request was accepted (reply_cb will be called), -1 otherwise.
+   ----------------------------------------------------------------------------- */
+int uaa_engine_send(UaaEngine *engine, int kind, uaa_assert_t *asserts,
+                    unsigned int timeout, UaaEngineReplyCB reply_cb, void *opaque)
+{
+	UaaRequest *req;
+
+	if (!engine || !asserts || !reply_cb || engine->window <= 0)
+		return -1;
+
+	if (!(req = request_alloc(engine)))
+		return -1;
+
+	req->kind     = kind;
+	req->timeout  = timeout;
+	req->reply_cb = reply_cb;
+	req->opaque   = opaque;
+
+	if (engine->n_outstanding < engine->window && !engine->queue_head) {
+
+		if (request_send(engine, req, asserts) < 0) {
+
+			request_free(engine, req);
+			return -1;
+		}
+	} else {
+
+		/*
+		 * the window is full: keep a copy until a slot frees up
+		 */
+
+		if (!(req->asserts = uaa_assert_t_duplicate(asserts))) {
+
+			request_free(engine, req);
+			return -1;
+		}
+
+		req->prev = engine->queue_tail;
+		req->next = NULL;
+		if (engine->queue_tail)
+			engine->queue_tail->next = req;
+		else
+			engine->queue_head = req;
+		engine->queue_tail = req;
+		engine->n_queued++;
+	}
+
+	if (timeout) {
+
+		opsec_schedule(engine->env, (time_t)timeout, request_expire, req);
+		req->scheduled = 1;
+	}
+
+	return 0;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  uaa_engine_reply:
+  |  -----------------
+  |
+  |  Description:
+  |  ------------
+  |  Passes a reply received by a client reply handler to its request.
+  |  The request is found by cmd_id only, the opaque of the reply is not used.
+  |
+  |  Parameters:
+  |  -----------
+  |  session - Pointer to an OpsecSession object
+  |  reply   - The reply assertions
+  |  cmd_id  - The id of the request
+  |  status  - The reply status
+  |
+  |  Returned value:
+  |  ---------------
+  |  0 if the reply matched a request, -1 otherwise.
+   ----------------------------------------------------------------------------- */
+int uaa_engine_reply(OpsecSession *session, uaa_assert_t *reply,
+                     int cmd_id, uaa_reply_status status)
+{
+	UaaEngine  *engine = uaa_engine_get(session);
+	UaaRequest *req;
+
+	if (!engine)
+		return -1;
+
+	for (req = engine->by_id[ID_BUCKET(cmd_id)]; req; req = req->hash_next)
+		if (req->cmd_id == cmd_id)
+			break;
+
+	if (!req)
+		return -1;
+
+	hash_remove(engine, req);
+	engine->n_replied++;
+
+	request_complete(req, reply, status);
+	queue_pump(engine);
+
+	return 0;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  uaa_engine_pending:
+  |  -------------------
+  |
+  |  Description:
+  |  ------------
+  |  Returns the number of requests in flight or queued.
+  |
+  |  Parameters:
+  |  -----------
+  |  engine - The engine
+  |
+  |  Returned value:
+  |  ---------------
+  |  The number of requests not completed yet.
+   ----------------------------------------------------------------------------- */
+int uaa_engine_pending(UaaEngine *engine)
+{
+	return engine ? engine->n_outstanding + engine->n_queued : 0;
+}
+
+/* -------------------------------------------------------------------------------------
+                                 Internal functions
+   ------------------------------------------------------------------------------------- */
+
+ /* -----------------------------------------------------------------------------
+  |  request_alloc:
+  |  --------------
+  |
+  |  Description:
+  |  ------------
+  |  Takes a request record from the free list, refilling it by a chunk of
+  |  UAA_ENGINE_POOL_CHUNK records when empty.
+  |
+  |  Parameters:
+  |  -----------
+  |  engine - The engine
+  |
+  |  Returned value:
+  |  ---------------
+  |  A cleared request, or NULL.
+   ----------------------------------------------------------------------------- */
+static UaaRequest *request_alloc(UaaEngine *engine)
+{
+	UaaPoolChunk *chunk;
+	UaaRequest   *req;
+	int           i;
+
+	if (!engine->free_list) {
+
+		if (!(chunk = (UaaPoolChunk *)calloc(1, sizeof(UaaPoolChunk)))) {
+
+			fprintf(stderr, "request_alloc: out of memory\n");
+			return NULL;
+		}
+		chunk->next    = engine->chunks;
+		engine->chunks = chunk;
+
+		for (i = UAA_ENGINE_POOL_CHUNK - 1; i >= 0; i--) {
+
+			chunk->requests[i].next = engine->free_list;
+			engine->free_list = &chunk->requests[i];
+		}
+	}
+
+	req = engine->free_list;
+	engine->free_list = req->next;
+
+	memset(req, 0, sizeof(UaaRequest));
+	req->engine = engine;
+
+	return req;
+}
+
+static void request_free(UaaEngine *engine, UaaRequest *req)
+{
+	if (req->scheduled) {
+
+		opsec_deschedule(engine->env, request_expire, req);
+		req->scheduled = 0;
+	}
+
+	if (req->asserts) {
+
+		uaa_assert_t_destroy(req->asserts);
+		req->asserts = NULL;
+	}
+
+	req->engine = NULL;
+	req->next   = engine->free_list;
+	engine->free_list = req;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  request_send:
+  |  -------------
+  |
+  |  Description:
+  |  ------------
+  |  Puts a request on the wire and indexes it by its cmd_id.
+  |  The library timeout is not used, the deadline is kept by the engine.
+  |
+  |  Parameters:
+  |  -----------
+  |  engine  - The engine
+  |  req     - The request
+  |  asserts - The request assertions
+  |
+  |  Returned value:
+  |  ---------------
+  |  0 if successful, -1 otherwise
+   ----------------------------------------------------------------------------- */
+static int request_send(UaaEngine *engine, UaaRequest *req, uaa_assert_t *asserts)
+{
+	int cmd_id;
+
+	switch (req->kind) {
+	case UAA_ENGINE_AUTHENTICATE:
+		cmd_id = uaa_send_authenticate_request(engine->session, asserts, NULL, 0);
+		break;
+	case UAA_ENGINE_UPDATE:
+		cmd_id = uaa_send_update(engine->session, asserts, NULL, 0);
+		break;
+	default:
+		cmd_id = uaa_send_query(engine->session, asserts, NULL, 0);
+		break;
+	}
+
+	if (cmd_id <= 0) {
+
+		fprintf(stderr, "request_send: sending the request failed\n");
+		engine->n_failed++;
+		return -1;
+	}
+
+	req->cmd_id    = cmd_id;
+	req->hash_next = engine->by_id[ID_BUCKET(cmd_id)];
+	engine->by_id[ID_BUCKET(cmd_id)] = req;
+
+	engine->n_outstanding++;
+	engine->n_sent++;
+
+	return 0;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  request_expire:
+  |  ---------------
+  |
+  |  Description:
+  |  ------------
+  |  The deadline of a request passed: abort it if it is in flight, drop it
+  |  from the queue otherwise, and complete it with UAA_REPLY_STAT_TIMEOUT.
+  |
+  |  Parameters:
+  |  -----------
+  |  opaque - The request
+  |
+  |  Returned value:
+  |  ---------------
+  |  None.
+   ----------------------------------------------------------------------------- */
+static void request_expire(void *opaque)
+{
+	UaaRequest *req    = (UaaRequest *)opaque;
+	UaaEngine  *engine = req->engine;
+
+	if (!engine)
+		return;
+
+	req->scheduled = 0;
+
+	if (req->cmd_id) {
+
+		uaa_abort_query(engine->session, req->cmd_id);
+		hash_remove(engine, req);
+	} else {
+
+		queue_remove(engine, req);
+	}
+
+	engine->n_expired++;
+
+	request_complete(req, NULL, UAA_REPLY_STAT_TIMEOUT);
+	queue_pump(engine);
+}
+
+ /* -----------------------------------------------------------------------------
+  |  request_complete:
+  |  -----------------
+  |
+  |  Description:
+  |  ------------
+  |  Returns a request, already out of the hash and the queue, to the free
+  |  list and calls its callback. The record is recycled first, so the
+  |  callback may send new requests.
+  |
+  |  Parameters:
+  |  -----------
+  |  req    - The request
+  |  reply  - The reply assertions, or NULL
+  |  status - The outcome of the request
+  |
+  |  Returned value:
+  |  ---------------
+  |  None.
+   ----------------------------------------------------------------------------- */
+static void request_complete(UaaRequest *req, uaa_assert_t *reply, uaa_reply_status status)
+{
+	UaaEngine        *engine   = req->engine;
+	UaaEngineReplyCB  reply_cb = req->reply_cb;
+	void             *opaque   = req->opaque;
+
+	request_free(engine, req);
+
+	reply_cb(engine, reply, status, opaque);
+}
+
+static void hash_remove(UaaEngine *engine, UaaRequest *req)
+{
+	UaaRequest **pp;
+
+	for (pp = &engine->by_id[ID_BUCKET(req->cmd_id)]; *pp; pp = &(*pp)->hash_next) {
+		if (*pp == req) {
+
+			*pp = req->hash_next;
+			engine->n_outstanding--;
+			break;
+		}
+	}
+	req->hash_next = NULL;
+}
+
+static void queue_remove(UaaEngine *engine, UaaRequest *req)
+{
+	if (req->prev)
+		req->prev->next = req->next;
+	else
+		engine->queue_head = req->next;
+
+	if (req->next)
+		req->next->prev = req->prev;
+	else
+		engine->queue_tail = req->prev;
+
+	req->prev = req->next = NULL;
+	engine->n_queued--;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  queue_pump:
+  |  -----------
+  |
+  |  Description:
+  |  ------------
+  |  Sends queued requests while the window has room. A request which cannot
+  |  be sent is completed with UAA_REPLY_STAT_SENDING_ERR.
+  |
+  |  Parameters:
+  |  -----------
+  |  engine - The engine
+  |
+  |  Returned value:
+  |  ---------------
+  |  None.
+   ----------------------------------------------------------------------------- */
+static void queue_pump(UaaEngine *engine)
+{
+	UaaRequest *req;
+
+	while (engine->queue_head && engine->n_outstanding < engine->window) {
+
+		req = engine->queue_head;
+		queue_remove(engine, req);
+
+		if (request_send(engine, req, req->asserts) < 0) {
+
+			request_complete(req, NULL, UAA_REPLY_STAT_SENDING_ERR);
+			continue;
+		}
+
+		uaa_assert_t_destroy(req->asserts);
+		req->asserts = NULL;
+	}
+}
@@ -0,0 +1,99 @@
+ /*************************************************************************\
+ *                                                                         *
+ * uaa_engine.h : Pipelined UAA client requests                            *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2001 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ \*************************************************************************/
+
+#ifndef _UAA_ENGINE_H
+#define _UAA_ENGINE_H
+
+#include "opsec/opsec.h"
+#include <opsec/uaa.h>
+#include <opsec/uaa_client.h>
+#include <opsec/uaa_error.h>
+
+/*
+ * Request kinds
+ */
+#define UAA_ENGINE_QUERY            0
+#define UAA_ENGINE_AUTHENTICATE     1
+#define UAA_ENGINE_UPDATE           2
+
+#define UAA_ENGINE_BUCKETS          1024    /* cmd_id hash */
+#define UAA_ENGINE_POOL_CHUNK       64      /* requests allocated at once */
+
+typedef struct _UaaEngine     UaaEngine;
+typedef struct _UaaRequest    UaaRequest;
+typedef struct _UaaPoolChunk  UaaPoolChunk;
+
+/*
+ * Called once for every request the engine accepted: with the reply of the
+ * server, or with UAA_REPLY_STAT_TIMEOUT, UAA_REPLY_STAT_SENDING_ERR or
+ * UAA_REPLY_STAT_CLOSING_SESSION (reply is NULL then).
+ * It may send further requests.
+ */
+typedef void (*UaaEngineReplyCB)(UaaEngine *engine, uaa_assert_t *reply,
+                                 uaa_reply_status status, void *opaque);
+
+struct _UaaRequest {
+	UaaEngine        *engine;
+	int               kind;
+	int               cmd_id;       /* 0 while queued */
+	uaa_assert_t     *asserts;      /* a copy, only while queued */
+	unsigned int      timeout;      /* [ms], 0 for none */
+	int               scheduled;    /* deadline timer is set */
+	UaaEngineReplyCB  reply_cb;
+	void             *opaque;
+
+	UaaRequest       *hash_next;    /* by cmd_id */
+	UaaRequest       *prev;         /* queue */
+	UaaRequest       *next;         /* queue or free list */
+};
+
+struct _UaaPoolChunk {
+	UaaPoolChunk     *next;
+	UaaRequest        requests[UAA_ENGINE_POOL_CHUNK];
+};
+
+struct _UaaEngine {
+	OpsecSession     *session;
+	OpsecEnv         *env;
+	int               window;       /* max requests in flight */
+	int               n_outstanding;
+	int               n_queued;
+
+	UaaRequest       *by_id[UAA_ENGINE_BUCKETS];
+	UaaRequest       *queue_head;
+	UaaRequest       *queue_tail;
+	UaaRequest       *free_list;
+	UaaPoolChunk     *chunks;
+
+	/* statistics */
+	unsigned long     n_sent;
+	unsigned long     n_replied;
+	unsigned long     n_expired;
+	unsigned long     n_failed;
+};
+
+UaaEngine *uaa_engine_create(OpsecSession *session, int window);
+void       uaa_engine_destroy(UaaEngine *engine);
+UaaEngine *uaa_engine_get(OpsecSession *session);
+
+int        uaa_engine_send(UaaEngine *engine, int kind, uaa_assert_t *asserts,
+                           unsigned int timeout, UaaEngineReplyCB reply_cb, void *opaque);
+int        uaa_engine_reply(OpsecSession *session, uaa_assert_t *reply,
+                            int cmd_id, uaa_reply_status status);
+int        uaa_engine_pending(UaaEngine *engine);
+
+#endif /* _UAA_ENGINE_H */
@@ -0,0 +1,597 @@
+/***************************************************************************
+ *                                                                         *
+ * ufp_cat.c : Sample OPSEC UFP Server                                     *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2000 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * The categorization engine of the UFP server.                            *
+ *                                                                         *
+ * The 'match strings' of all the categories are compiled once into an     *
+ * Aho-Corasick automaton: a trie of the strings, where every node also    *
+ * has a failure link (the node of the longest proper suffix of the node   *
+ * string that is in the trie) and an output mask (the categories of all   *
+ * the strings that end at the node, or at a node on its failure chain).   *
+ *                                                                         *
+ * A URL is categorized in a single pass - one transition per URL byte,    *
+ * whatever the number of match strings. Matching is case insensitive.     *
+ *                                                                         *
+ * The automaton is that of ../common/aho_corasick.c, also used by the     *
+ * patterns scan engine. Its outputs are interned output masks, so every   *
+ * distinct set of categories is stored once.                              *
+ *                                                                         *
+ * Category file format - one match string per line:                       *
+ *                                                                         *
+ *     <category> <match string>                                           *
+ *                                                                         *
+ * where <category> is a dictionary category name or number. Empty lines   *
+ * and lines starting with '#' are ignored.                                *
+ *                                                                         *
+ * The loader watches the category file. When the file changes, a new      *
+ * engine is built by a background thread while the current engine keeps   *
+ * serving requests. The new engine is handed to the main thread, which    *
+ * swaps it in between two requests.                                       *
+ *                                                                         *
+ ***************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "ufp_cat.h"
+
+#define UFP_CAT_INITIAL_MASKS   16
+
+#ifdef WIN32
+#define UFP_CAT_THREAD_RETURN   DWORD WINAPI
+#else
+#define UFP_CAT_THREAD_RETURN   void *
+#endif
+
+
+/* -------------------------------------------------------------------------------------
+                                     Output masks
+   ------------------------------------------------------------------------------------- */
+
+static unsigned long
+mask_hash_value(unsigned char *mask, int len)
+{
+	unsigned long hash = 2166136261UL;
+	int           i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= mask[i];
+		hash  = (hash * 16777619UL) & 0xffffffffUL;
+	}
+
+	return hash;
+}
+
+static int
+mask_hash_grow(ufp_cat_engine *engine)
+{
+	int  size = engine->mask_hash_size ? engine->mask_hash_size * 2 : UFP_CAT_INITIAL_MASKS * 2;
+	int *table;
+	int  id, h;
+
+	table = (int *)calloc(size, sizeof(int));
+	if (!table) return -1;
+
+	for (id = 0; id < engine->n_masks; id++) {
+		h = (int)(mask_hash_value(engine->masks + id * engine->mask_bytes, engine->mask_bytes) & (size - 1));
+		while (table[h]) h = (h + 1) & (size - 1);
+		table[h] = id + 1;
+	}
+
+	free(engine->mask_hash);
+	engine->mask_hash      = table;
+	engine->mask_hash_size = size;
+
+	return 0;
+}
+
+/*
+ * Return the id of 'mask', adding it to the mask table if it is new.
+ */
+static int
+mask_intern(ufp_cat_engine *engine, unsigned char *mask)
+{
+	int h, id;
+
+	if (2 * (engine->n_masks + 1) > engine->mask_hash_size && mask_hash_grow(engine) < 0)
+		return -1;
+
+	h = (int)(mask_hash_value(mask, engine->mask_bytes) & (engine->mask_hash_size - 1));
+	while ((id = engine->mask_hash[h])) {
+		if (!memcmp(engine->masks + (id - 1) * engine->mask_bytes, mask, engine->mask_bytes))
+			return id - 1;
+		h = (h + 1) & (engine->mask_hash_size - 1);
+	}
+
+	if (engine->n_masks == engine->masks_size) {
+		int            size  = engine->masks_size ? engine->masks_size * 2 : UFP_CAT_INITIAL_MASKS;
+		unsigned char *masks = (unsigned char *)realloc(engine->masks, size * engine->mask_bytes);
+
+		if (!masks) return -1;
+		engine->masks      = masks;
+		engine->masks_size = size;
+	}
+
+	id = engine->n_masks++;
+	memcpy(engine->masks + id * engine->mask_bytes, mask, engine->mask_bytes);
+	engine->mask_hash[h] = id + 1;
+
+	return id;
+}
+
+/*
+ * Return the id of the union of two output masks (-1 is the empty mask).
+ */
+static int
+mask_union(ufp_cat_engine *engine, int a, int b)
+{
+	unsigned char mask[UFP_CAT_MAX_CATEGORIES / 8];
+	int           i;
+
+	if (a < 0 || a == b) return b;
+	if (b < 0) return a;
+
+	for (i = 0; i < engine->mask_bytes; i++)
+		mask[i] = engine->masks[a * engine->mask_bytes + i] | engine->masks[b * engine->mask_bytes + i];
+
+	return mask_intern(engine, mask);
+}
+
+
+/* -------------------------------------------------------------------------------------
+                                      Building
+   ------------------------------------------------------------------------------------- */
+
+ufp_cat_engine *
+ufp_cat_engine_create(char **dict, int n_cats)
+{
+	ufp_cat_engine *engine;
+
+	if (n_cats <= 0 || n_cats > UFP_CAT_MAX_CATEGORIES) return NULL;
+
+	engine = (ufp_cat_engine *)calloc(1, sizeof(ufp_cat_engine));
+	if (!engine) return NULL;
+
+	engine->dict       = dict;
+	engine->n_cats     = n_cats;
+	engine->mask_bytes = (n_cats + 7) / 8;
+
+	if (!(engine->ac = ac_create())) {
+		ufp_cat_engine_destroy(engine);
+		return NULL;
+	}
+
+	return engine;
+}
+
+/*
+ * Add a match string of category 'cat'. Must be called before compiling.
+ */
+int
+ufp_cat_engine_add(ufp_cat_engine *engine, char *pattern, int cat)
+{
+	unsigned char mask[UFP_CAT_MAX_CATEGORIES / 8];
+	unsigned char lower[UFP_CAT_MAX_LINE];
+	int           node, id, len;
+
+	if (!engine || !pattern || !*pattern) return -1;
+	if (cat < 0 || cat >= engine->n_cats) return -1;
+
+	for (len = 0; pattern[len]; len++) {
+		if (len == sizeof(lower)) return -1;
+		lower[len] = (unsigned char)tolower((unsigned char)pattern[len]);
+	}
+
+	if ((node = ac_add(engine->ac, lower, len)) < 0)
+		return -1;
+
+	memset(mask, 0, engine->mask_bytes);
+	mask[cat / 8] |= (unsigned char)(1 << (cat % 8));
+
+	if ((id = mask_intern(engine, mask)) < 0 || (id = mask_union(engine, engine->ac->out[node], id)) < 0)
+		return -1;
+	engine->ac->out[node] = id;
+
+	engine->n_patterns++;
+
+	return 0;
+}
+
+/*
+ * The output of a node covers the categories of its failure target.
+ */
+static int
+merge_masks(int own, int inherited, void *opaque)
+{
+	int m = mask_union((ufp_cat_engine *)opaque, own, inherited);
+
+	return (m < 0 && (own >= 0 || inherited >= 0)) ? AC_ERROR : m;
+}
+
+/*
+ * Build the automaton and the output masks.
+ */
+int
+ufp_cat_engine_compile(ufp_cat_engine *engine)
+{
+	if (!engine) return -1;
+
+	return ac_compile(engine->ac, merge_masks, engine);
+}
+
+static int
+dict_lookup(char **dict, int n_cats, char *name)
+{
+	char *p;
+	int   cat;
+
+	for (p = name; isdigit((unsigned char)*p); p++)
+		;
+	if (!*p) {
+		cat = atoi(name);
+		return (cat < n_cats) ? cat : -1;
+	}
+
+	for (cat = 0; cat < n_cats; cat++) {
+		char *a = dict[cat], *b = name;
+
+		while (*a && tolower((unsigned char)*a) == tolower((unsigned char)*b)) a++, b++;
+		if (!*a && !*b)
+			return cat;
+	}
+
+	return -1;
+}
+
+/*
+ * Build and compile an engine from a category file.
+ */
+ufp_cat_engine *
+ufp_cat_engine_load(char *file, char **dict, int n_cats)
+{
+	ufp_cat_engine *engine;
+	FILE           *fp;
+	char            line[UFP_CAT_MAX_LINE];
+	char           *name, *pattern, *end;
+	int             line_no = 0, cat;
+
+	if (!(fp = fopen(file, "r"))) {
+		fprintf(stderr, "ufp_cat_engine_load: fopen('%s') failed: %s\n", file, strerror(errno));
+		return NULL;
+	}
+
+	if (!(engine = ufp_cat_engine_create(dict, n_cats))) {
+		fclose(fp);
+		return NULL;
+	}
+
+	while (fgets(line, sizeof(line), fp)) {
+		line_no++;
+
+		if (!strchr(line, '\n') && !feof(fp)) {
+			int ch;
+
+			fprintf(stderr, "ufp_cat_engine_load: %s:%d: line too long, ignored\n", file, line_no);
+			while ((ch = fgetc(fp)) != EOF && ch != '\n')
+				;
+			continue;
+		}
+
+		for (name = line; isspace((unsigned char)*name); name++)
+			;
+		if (!*name || *name == '#')
+			continue;
+
+		for (pattern = name; *pattern && !isspace((unsigned char)*pattern); pattern++)
+			;
+		if (*pattern) *pattern++ = '\0';
+		while (isspace((unsigned char)*pattern)) pattern++;
+
+		for (end = pattern + strlen(pattern); end > pattern && isspace((unsigned char)end[-1]); end--)
+			;
+		*end = '\0';
+
+		if ((cat = dict_lookup(dict, n_cats, name)) < 0 || !*pattern) {
+			fprintf(stderr, "ufp_cat_engine_load: %s:%d: bad category line, ignored\n", file, line_no);
+			continue;
+		}
+
+		if (ufp_cat_engine_add(engine, pattern, cat) < 0) {
+			fprintf(stderr, "ufp_cat_engine_load: %s:%d: failed to add match string\n", file, line_no);
+			fclose(fp);
+			ufp_cat_engine_destroy(engine);
+			return NULL;
+		}
+	}
+
+	fclose(fp);
+
+	if (ufp_cat_engine_compile(engine) < 0) {
+		fprintf(stderr, "ufp_cat_engine_load: failed to compile '%s'\n", file);
+		ufp_cat_engine_destroy(engine);
+		return NULL;
+	}
+
+	fprintf(stderr, "ufp_cat_engine_load: %s: %d match strings, %d nodes, %d distinct masks\n",
+	        file, engine->n_patterns, engine->ac->n_nodes, engine->n_masks);
+
+	return engine;
+}
+
+void
+ufp_cat_engine_destroy(ufp_cat_engine *engine)
+{
+	if (!engine) return;
+
+	ac_destroy(engine->ac);
+	free(engine->masks);
+	free(engine->mask_hash);
+	free(engine);
+}
+
+
+/* -------------------------------------------------------------------------------------
+                                       Matching
+   ------------------------------------------------------------------------------------- */
+
+ /* -----------------------------------------------------------------------------
+  |  ufp_cat_engine_match:
+  |  ---------------------
+  |
+  |  Description:
+  |  ------------
+  |  Runs the URL through the automaton and sets the bit of every category
+  |  with a match string in the URL. Bits already set in 'mask' are kept.
+  |
+  |  Parameters:
+  |  -----------
+  |  engine   - a compiled engine.
+  |  url      - the URL to categorize.
+  |  mask     - the categorization mask.
+  |  mask_len - categorization mask length.
+  |
+  |  Returned value:
+  |  ---------------
+  |  The number of matched categories, -1 on error.
+   ----------------------------------------------------------------------------- */
+int
+ufp_cat_engine_match(ufp_cat_engine *engine, char *url, ufp_mask mask, int mask_len)
+{
+	unsigned char  found[UFP_CAT_MAX_CATEGORIES / 8];
+	unsigned char *out;
+	ac_automaton  *ac;
+	int            state = 0, last_out = -1;
+	int            i, cat, n_found = 0;
+
+	if (!engine || !engine->ac->compiled || !url || !mask) return -1;
+
+	ac = engine->ac;
+	memset(found, 0, engine->mask_bytes);
+
+	for (; *url; url++) {
+		state = ac_goto(ac, state, (unsigned char)tolower((unsigned char)*url));
+
+		if (ac->out[state] >= 0 && ac->out[state] != last_out) {
+			last_out = ac->out[state];
+			out = engine->masks + last_out * engine->mask_bytes;
+			for (i = 0; i < engine->mask_bytes; i++)
+				found[i] |= out[i];
+		}
+	}
+
+	for (cat = 0; cat < engine->n_cats && cat < mask_len; cat++)
+		if (found[cat / 8] & (1 << (cat % 8))) {
+			ufp_mask_set(mask, mask_len, cat);
+			n_found++;
+		}
+
+	return n_found;
+}
+
+
+/* -------------------------------------------------------------------------------------
+                                       Reloading
+   ------------------------------------------------------------------------------------- */
+
+static void
+loader_lock(ufp_cat_loader *loader)
+{
+#ifdef WIN32
+	EnterCriticalSection(&loader->lock);
+#else
+	pthread_mutex_lock(&loader->lock);
+#endif
+}
+
+static void
+loader_unlock(ufp_cat_loader *loader)
+{
+#ifdef WIN32
+	LeaveCriticalSection(&loader->lock);
+#else
+	pthread_mutex_unlock(&loader->lock);
+#endif
+}
+
+static void
+loader_join(ufp_cat_loader *loader)
+{
+#ifdef WIN32
+	WaitForSingleObject(loader->thread, INFINITE);
+	CloseHandle(loader->thread);
+#else
+	pthread_join(loader->thread, NULL);
+#endif
+	loader->busy = 0;
+}
+
+static int
+file_mtime(char *file, time_t *mtime)
+{
+	struct stat st;
+
+	if (stat(file, &st) < 0)
+		return -1;
+
+	*mtime = st.st_mtime;
+
+	return 0;
+}
+
+static UFP_CAT_THREAD_RETURN
+loader_thread_func(void *data)
+{
+	ufp_cat_loader *loader = (ufp_cat_loader *)data;
+	ufp_cat_engine *engine;
+
+	engine = ufp_cat_engine_load(loader->file, loader->dict, loader->n_cats);
+
+	loader_lock(loader);
+	loader->ready = engine;
+	loader->done  = 1;
+	loader_unlock(loader);
+
+	return 0;
+}
+
+/*
+ * Create a loader for 'file'. The current modification time of the file is
+ * taken as the one of the engine already serving.
+ */
+ufp_cat_loader *
+ufp_cat_loader_create(char *file, char **dict, int n_cats)
+{
+	ufp_cat_loader *loader;
+
+	if (!file) return NULL;
+
+	loader = (ufp_cat_loader *)calloc(1, sizeof(ufp_cat_loader));
+	if (!loader) return NULL;
+
+	strncpy(loader->file, file, sizeof(loader->file) - 1);
+	loader->dict   = dict;
+	loader->n_cats = n_cats;
+
+	if (file_mtime(loader->file, &loader->mtime) < 0)
+		loader->mtime = 0;
+
+#ifdef WIN32
+	InitializeCriticalSection(&loader->lock);
+#else
+	if (pthread_mutex_init(&loader->lock, NULL)) {
+		free(loader);
+		return NULL;
+	}
+#endif
+
+	return loader;
+}
+
+void
+ufp_cat_loader_destroy(ufp_cat_loader *loader)
+{
+	if (!loader) return;
+
+	if (loader->busy)
+		loader_join(loader);
+
+	ufp_cat_engine_destroy(loader->ready);
+
+#ifdef WIN32
+	DeleteCriticalSection(&loader->lock);
+#else
+	pthread_mutex_destroy(&loader->lock);
+#endif
+
+	free(loader);
+}
+
+ /* -----------------------------------------------------------------------------
+  |  ufp_cat_loader_poll:
+  |  --------------------
+  |
+  |  Description:
+  |  ------------
+  |  Called periodically by the main thread. Starts a loader thread when the
+  |  category file has changed, and collects the engine it built.
+  |  The caller swaps the returned engine in, and destroys the old one.
+  |
+  |  Parameters:
+  |  -----------
+  |  loader - the category file loader.
+  |
+  |  Returned value:
+  |  ---------------
+  |  A newly built engine, or NULL if there is none (yet).
+   ----------------------------------------------------------------------------- */
+ufp_cat_engine *
+ufp_cat_loader_poll(ufp_cat_loader *loader)
+{
+	ufp_cat_engine *engine = NULL;
+	time_t          mtime;
+	int             done;
+
+	if (!loader) return NULL;
+
+	if (loader->busy) {
+		loader_lock(loader);
+		done = loader->done;
+		if (done) {
+			engine        = loader->ready;
+			loader->ready = NULL;
+			loader->done  = 0;
+		}
+		loader_unlock(loader);
+
+		if (!done)
+			return NULL;
+
+		loader_join(loader);
+		if (!engine)
+			fprintf(stderr, "ufp_cat_loader_poll: failed to reload '%s', keeping current categories\n",
+			        loader->file);
+
+		return engine;
+	}
+
+	if (file_mtime(loader->file, &mtime) < 0 || mtime == loader->mtime)
+		return NULL;
+
+	fprintf(stderr, "ufp_cat_loader_poll: '%s' changed, reloading\n", loader->file);
+	loader->mtime = mtime;
+
+#ifdef WIN32
+	loader->thread = CreateThread(NULL, 0, loader_thread_func, (void *)loader, 0, NULL);
+	if (loader->thread == NULL) {
+#else
+	if (pthread_create(&loader->thread, NULL, loader_thread_func, (void *)loader) != 0) {
+#endif
+		fprintf(stderr, "ufp_cat_loader_poll: failed to create loader thread\n");
+		return NULL;
+	}
+	loader->busy = 1;
+
+	return NULL;
+}
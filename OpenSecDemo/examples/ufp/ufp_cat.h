@@ -0,0 +1,94 @@
+#ifndef _UFP_CAT_H_
+#define _UFP_CAT_H_
+
+/***************************************************************************
+ *                                                                         *
+ * ufp_cat.h : Sample OPSEC UFP Server                                     *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2000 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * See ufp_cat.c for further explanations.                                 *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <time.h>
+#ifdef WIN32
+#include <windows.h>
+typedef CRITICAL_SECTION   ufp_cat_lock;
+typedef HANDLE             ufp_cat_thread;
+#else
+#include <pthread.h>
+/* use POSIX threads (should link with -lpthread) */
+typedef pthread_mutex_t    ufp_cat_lock;
+typedef pthread_t          ufp_cat_thread;
+#endif
+#include "opsec/ufp_opsec.h"
+#include "../common/aho_corasick.h"
+
+#define UFP_CAT_MAX_CATEGORIES   256
+#define UFP_CAT_MAX_LINE         4096
+#define UFP_CAT_NAME_LEN         256
+
+/*
+ * A categorization engine: an Aho-Corasick automaton (see
+ * ../common/aho_corasick.c) of the lower case match strings, whose
+ * outputs are the ids of interned category masks.
+ */
+typedef struct _ufp_cat_engine {
+	char           **dict;
+	int              n_cats;
+	int              mask_bytes;
+	int              n_patterns;
+
+	ac_automaton    *ac;
+
+	/* distinct output masks, mask_bytes each */
+	unsigned char   *masks;
+	int              n_masks;
+	int              masks_size;
+	int             *mask_hash;       /* open addressing, mask id + 1       */
+	int              mask_hash_size;
+} ufp_cat_engine;
+
+ufp_cat_engine * ufp_cat_engine_create(char **dict, int n_cats);
+int              ufp_cat_engine_add(ufp_cat_engine *engine, char *pattern, int cat);
+int              ufp_cat_engine_compile(ufp_cat_engine *engine);
+ufp_cat_engine * ufp_cat_engine_load(char *file, char **dict, int n_cats);
+void             ufp_cat_engine_destroy(ufp_cat_engine *engine);
+int              ufp_cat_engine_match(ufp_cat_engine *engine, char *url, ufp_mask mask, int mask_len);
+
+/*
+ * Background reloader of a category file.
+ */
+typedef struct _ufp_cat_loader {
+	char             file[UFP_CAT_NAME_LEN];
+	char           **dict;
+	int              n_cats;
+
+	time_t           mtime;           /* of the file the engine came from   */
+	ufp_cat_thread   thread;
+	int              busy;            /* a loader thread is running         */
+
+	ufp_cat_lock     lock;            /* protects the fields below          */
+	int              done;            /* the loader thread has finished     */
+	ufp_cat_engine  *ready;           /* engine built by the loader thread  */
+} ufp_cat_loader;
+
+ufp_cat_loader * ufp_cat_loader_create(char *file, char **dict, int n_cats);
+void             ufp_cat_loader_destroy(ufp_cat_loader *loader);
+ufp_cat_engine * ufp_cat_loader_poll(ufp_cat_loader *loader);
+
+#endif
@@ -28,6 +28,26 @@
  * The mode is determined according to the value of the BC_MODE parameter  *
  * which is used only for convenience in this sample.                      *
  *                                                                         *
+ * URLs are categorized by the category engine (see ufp_cat.c), which      *
+ * compiles all the 'match strings' into a single automaton. The match     *
+ * strings are read from a category file, or taken from the built-in       *
+ * match_data table if no file is given. The category file is checked      *
+ * periodically and reloaded in the background when it changes.            *
+ *                                                                         *
+ * Verdicts are cached per URL (see ufp_verdict.c), together with the      *
+ * UfpCacheInfo sent to the client. The TTL of the cache info depends on   *
+ * the categories of the URL (see cat_ttl).                                *
+ *                                                                         *
+ * Usage: ufp_server [-c <category file>]                                  *
+ *                                                                         *
+ * Built with OPSEC_SL_SERVER, the server is a shared library which runs   *
+ * in the process of its clients (see ../sl_host/opsec_sl_host.c). The     *
+ * category file is then named by OPSEC_UFP_CATEGORY_FILE.                 *
+ *                                                                         *
+ * The server keeps counters and latencies of the requests, written to     *
+ * the file named by OPSEC_METRICS_FILE if it is set (see                  *
+ * ../common/metrics.c).                                                   *
+ *                                                                         *
  * ufp.conf contains configuration information for the connection between  *
  * the UFP Client and Server (e.g. port number, authentication type etc.). *
  *                                                                         *
@@ -50,13 +70,30 @@
 #include <arpa/inet.h>
 #endif
 
+#include "ufp_cat.h"
+#include "ufp_verdict.h"
+#include "../common/metrics.h"
+#ifdef OPSEC_SL_SERVER
+#include "../common/sl_server.h"
+#endif
+
 /*
    Global definitions (arbitrarily chosen)
  */
 #define BC_MODE    0
-#define TTL        500 /* [ms] */
+#define TTL        500 /* [ms] - for uncategorized URLs */
 #define HTTP_PORT  80
 
+/* verdict cache */
+#define VERDICT_CACHE_SIZE   4096
+#define VERDICT_MAX_AGE      300 /* [sec] */
+
+/* the category file of the shared library server */
+#define UFP_CATEGORY_FILE_ENV  "OPSEC_UFP_CATEGORY_FILE"
+
+/* how often the category file is checked for changes */
+#define CAT_RELOAD_INTERVAL  5 /* [sec] */
+
 char *description     = "OPSEC_UFP_Demo_Server";
 char *redirection_url = "www.checkpoint.com";
 
@@ -89,6 +126,17 @@ char *dict[DICT_LEN] = { "Alcohol",      /* 0 */
                          "MegaSports",   /* 7 */
                          "8CAT" };       /* 8 */
 
+/* cache info TTL of each category [ms] - a URL gets the smallest TTL of its categories */
+unsigned int cat_ttl[DICT_LEN] = { 60000,        /* Alcohol     */
+                                   60000,        /* Drugs       */
+                                   30000,        /* Games       */
+                                   60000,        /* Sex         */
+                                   60000,        /* Pornography */
+                                   10000,        /* Sports      */
+                                   300000,       /* CheckPoint  */
+                                   10000,        /* MegaSports  */
+                                   500 };        /* 8CAT        */
+
 /*
    These are the 'match strings', used for categorizing URL's, sent by the client.
  */
@@ -117,6 +165,24 @@ match_st match_data[MATCH_LEN] = { {"wine"      , 0},
                                    {"8"         , 8},
                                    { NULL       ,-1} };
 
+/*
+   The category engine serving the requests, and the loader of the category file
+ */
+ufp_cat_engine *cat_engine = NULL;
+ufp_cat_loader *cat_loader = NULL;
+
+/*
+   The verdict cache, and the pool of categorization masks
+ */
+ufp_verdict_cache *verdict_cache = NULL;
+ufp_mask_pool     *mask_pool     = NULL;
+
+/*
+   Metrics (see ../common/metrics.c)
+ */
+static metric *m_requests, *m_errors, *m_cache_hits, *m_cache_misses,
+              *m_reloads, *m_cat_usec;
+
 
  /* -----------------------------------------------------------------------------
   |  free_all:
@@ -214,11 +280,15 @@ static int send_bc_reply(OpsecSession *session, ufp_mask cat_mask, int cat_mask_
   |
   |  In this sample we ignored the client request mask for simplicity.
   |
+  |  A cached verdict carries a cache info that is reused. Otherwise a cache
+  |  info is built for this reply only.
+  |
   |  Parameters:
   |  -----------
   |  session      - Pointer so an OpsecSession object.
   |  cat_mask     - the UFP server categorization mask.
   |  cat_mask_len - categorization mask length.
+  |  verdict      - the cached verdict of the URL, or NULL.
   |  dst_ip       - used as the cached IP in the UfpCacheInfo.
   |  status       - of the UFP server reply.
   |
@@ -229,16 +299,31 @@ static int send_bc_reply(OpsecSession *session, ufp_mask cat_mask, int cat_mask_
 static int send_reply(OpsecSession *session,
                       ufp_mask      cat_mask,
                       int           cat_mask_len,
+                      ufp_verdict  *verdict,
                       char         *dst_ip,
                       int           status)
 {
 	UfpCacheInfo *cache_info = NULL;
 	int returned_val = OPSEC_SESSION_OK;
+
+	if (verdict) {
+		if (! (cache_info = ufp_verdict_cache_info(verdict_cache, verdict, dst_ip, HTTP_PORT)) ) {
+			fprintf(stderr, "send_reply: Error while creating cache info");
+			return OPSEC_SESSION_ERR;
+		}
+
+		return ufp_send_cat_reply_with_cache_info(session,
+		                                          cat_mask,
+		                                          ufp_mask_len,
+		                                          status,
+		                                          cache_info,
+		                                          redirection_url);
+	}
 	
 	/*
 	   Add the categorization reply to UfpCacheInfo:
 	 */
-	if (! (cache_info = ufp_create_cache_info(TTL)) ) {
+	if (! (cache_info = ufp_create_cache_info(ufp_verdict_ttl(verdict_cache, cat_mask))) ) {
 		fprintf(stderr, "send_reply: Error while creating cache info");
 		return OPSEC_SESSION_ERR;
 	}
@@ -276,10 +361,9 @@ static int send_reply(OpsecSession *session,
   |
   |  Description:
   |  ------------
-  |  This function does the URL categorization. It simply looks for the given
-  |  URL string in the 'match strings' defined for each category.
-  |  If found it sets the relating bit in the cat. mask 'on'.
-  |  This is a naive implementation of categorization just for this example.
+  |  This function does the URL categorization. The category engine finds all
+  |  the 'match strings' in the URL in a single pass, and sets the bits of
+  |  the relating categories in the cat. mask 'on'.
   |
   |  Parameters:
   |  -----------
@@ -288,19 +372,97 @@ static int send_reply(OpsecSession *session,
   |
   |  Returned value:
   |  ---------------
-  |  OPSEC_SESSION_OK.
+  |  OPSEC_SESSION_OK if successful, OPSEC_SESSION_ERR otherwise.
    ----------------------------------------------------------------------------- */
 static int do_cat(char *url, ufp_mask *cat_mask)
 {
 	int idx = 0;
 
+	if (ufp_cat_engine_match(cat_engine, url, *cat_mask, ufp_mask_len) < 0)
+		return OPSEC_SESSION_ERR;
+
+	for (idx = 0; idx < DICT_LEN; idx++)
+		if (ufp_mask_isset(*cat_mask, ufp_mask_len, idx))
+			fprintf(stderr, "do_cat: Found match: %s\n", dict[idx]);
+
+	return OPSEC_SESSION_OK;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  load_categories:
+  |  ----------------
+  |
+  |  Description:
+  |  ------------
+  |  This function builds the category engine, from the category file if one
+  |  is given, or from the built-in 'match strings' otherwise.
+  |
+  |  Parameters:
+  |  -----------
+  |  cat_file - the category file, or NULL.
+  |
+  |  Returned value:
+  |  ---------------
+  |  The category engine, NULL on error.
+   ----------------------------------------------------------------------------- */
+static ufp_cat_engine *load_categories(char *cat_file)
+{
+	ufp_cat_engine *engine = NULL;
+	int idx = 0;
+
+	if (cat_file)
+		return ufp_cat_engine_load(cat_file, dict, DICT_LEN);
+
+	if (!(engine = ufp_cat_engine_create(dict, DICT_LEN)))
+		return NULL;
+
 	for (idx = 0; (match_data[idx].match_str) ; idx++)
-		if (strstr(url, match_data[idx].match_str)) {
-			ufp_mask_set(*cat_mask, ufp_mask_len, match_data[idx].match_cat);
-			fprintf(stderr, "do_cat: Found match: %s\n", dict[match_data[idx].match_cat]);
+		if (ufp_cat_engine_add(engine, match_data[idx].match_str, match_data[idx].match_cat) < 0) {
+			ufp_cat_engine_destroy(engine);
+			return NULL;
 		}
 
-	return OPSEC_SESSION_OK;
+	if (ufp_cat_engine_compile(engine) < 0) {
+		ufp_cat_engine_destroy(engine);
+		return NULL;
+	}
+
+	return engine;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  reload_categories:
+  |  ------------------
+  |
+  |  Description:
+  |  ------------
+  |  Periodic callback. Picks up the engine built by the category file loader
+  |  (if the file changed) and swaps it in. Since all the handlers run in the
+  |  main loop, no categorization is in progress while the engines are swapped.
+  |
+  |  Parameters:
+  |  -----------
+  |  opaque - not used.
+  |
+  |  Returned value:
+  |  ---------------
+  |  None.
+   ----------------------------------------------------------------------------- */
+static void reload_categories(void *opaque)
+{
+	ufp_cat_engine *engine = NULL;
+
+	if (!(engine = ufp_cat_loader_poll(cat_loader)))
+		return;
+
+	ufp_cat_engine_destroy(cat_engine);
+	cat_engine = engine;
+
+	/* the cached verdicts were made by the old engine */
+	ufp_verdict_cache_flush(verdict_cache);
+	metric_inc(m_reloads);
+
+	fprintf(stderr, "reload_categories: Category engine replaced\n");
 }
 
 
@@ -410,13 +572,22 @@ static int cat_handler( OpsecSession *session,
 	/* Categorization mask, sent to the client */
 	ufp_mask  cat_mask;
 	char     *cat_mask_s = NULL;
+
+	/* Cached verdict of the URL */
+	ufp_verdict *verdict = NULL;
+	char         key[UFP_VERDICT_URL_LEN];
+	int          cached  = 0;
+
     char     *user_name = NULL;
 
 	int status       = UFP_OK,
 	    returned_val = OPSEC_SESSION_OK;
 	static int cnt   = 1;
 
+	unsigned long start = metrics_now_usec();
+
 	fprintf(stderr, "\ncat_handler: Received categorization request(#%d). url: %s\n", cnt++, url);
+	metric_inc(m_requests);
 	/*
 	   Check if Dictionary versions match.
 	   (Different versions will probably result in wrong categorization)
@@ -456,22 +627,47 @@ static int cat_handler( OpsecSession *session,
 		if (client_mask_len != ufp_mask_len)
 		{
 			fprintf(stderr, "cat_handler: Mask length is illegal");
+			metric_inc(m_errors);
 			return OPSEC_SESSION_ERR;
 		}
 	}
 
+	/*
+	   Look for the verdict in the cache
+	   (URLs too long for the cache are categorized with a mask from the pool)
+	 */
+	if (ufp_verdict_normalize(url, key, sizeof(key)) >= 0) {
+		if ((verdict = ufp_verdict_lookup(verdict_cache, key)))
+			cached = 1;
+		else
+			verdict = ufp_verdict_insert(verdict_cache, key);
+	}
+
 	/*
 	   Categorize the URL
 	 */
-	if (!(cat_mask = ufp_mask_init(ufp_mask_len))) {
-		fprintf(stderr,"cat_handler: Unable to create mask (url = %s)\n", url);
-		return OPSEC_SESSION_ERR;
+	if (cached) {
+		fprintf(stderr, "cat_handler: Verdict found in cache\n");
+		cat_mask = verdict->mask;
+		metric_inc(m_cache_hits);
 	}
-	
+	else {
+		metric_inc(m_cache_misses);
+		if (!(cat_mask = verdict ? verdict->mask : ufp_mask_pool_get(mask_pool))) {
+			fprintf(stderr,"cat_handler: Unable to create mask (url = %s)\n", url);
+			metric_inc(m_errors);
+			return OPSEC_SESSION_ERR;
+		}
 
-	if(do_cat( url, &cat_mask ) != OPSEC_SESSION_OK){
-		fprintf(stderr, "cat_handler: Error while categorizing URL\n");
-		return OPSEC_SESSION_ERR;
+		if(do_cat( url, &cat_mask ) != OPSEC_SESSION_OK){
+			fprintf(stderr, "cat_handler: Error while categorizing URL\n");
+			if (verdict)
+				ufp_verdict_remove(verdict_cache, verdict);
+			else
+				ufp_mask_pool_put(mask_pool, cat_mask);
+			metric_inc(m_errors);
+			return OPSEC_SESSION_ERR;
+		}
 	}
 
 	/*
@@ -480,20 +676,313 @@ static int cat_handler( OpsecSession *session,
 	if (BC_MODE)
 		returned_val = send_bc_reply(session, cat_mask, ufp_mask_len, status);
 	else
-		returned_val = send_reply(session, cat_mask, ufp_mask_len, dst_ip, status);
+		returned_val = send_reply(session, cat_mask, ufp_mask_len, verdict, dst_ip, status);
 	
-	if(returned_val != OPSEC_SESSION_OK)
+	if(returned_val != OPSEC_SESSION_OK) {
 		fprintf(stderr, "cat_handler: can't send cat reply (%s)\n",	opsec_errno_str(opsec_errno));
-	else
+		metric_inc(m_errors);
+	}
+	else {
 		fprintf(stderr, "cat_handler: Sent reply (status = %s)\n", (status == UFP_OK) ? "ok" : "error");
+		metric_observe(m_cat_usec, metrics_now_usec() - start);
+	}
 
 	/*
-	   Free allocated memory
+	   Return the mask to the pool (a cached mask stays with its verdict)
 	 */
-	ufp_mask_destroy(cat_mask);
+	if (!verdict)
+		ufp_mask_pool_put(mask_pool, cat_mask);
 
 	return returned_val;
 }
+ /* -----------------------------------------------------------------------------
+  |  create_metrics:
+  |  ---------------
+  |
+  |  Description:
+  |  ------------
+  |  Creates the metrics of the server, and exports them if
+  |  OPSEC_METRICS_FILE is set (see ../common/metrics.c).
+  |
+  |  Parameters:
+  |  -----------
+  |  env  - returned by a call to opsec_init.
+  |  name - appended to the export file name, or NULL.
+  |
+  |  Returned value:
+  |  ---------------
+  |  None.
+   ----------------------------------------------------------------------------- */
+static void create_metrics(OpsecEnv *env, char *name)
+{
+	m_requests     = metrics_counter("ufp_requests_total", "categorization requests received");
+	m_errors       = metrics_counter("ufp_errors_total", "categorization requests failed");
+	m_cache_hits   = metrics_counter("ufp_cache_hits_total", "verdicts found in the cache");
+	m_cache_misses = metrics_counter("ufp_cache_misses_total", "URLs categorized by the engine");
+	m_reloads      = metrics_counter("ufp_reloads_total", "category file reloads");
+	m_cat_usec     = metrics_histogram("ufp_cat_usec", "request to reply sent [usec]");
+
+	if (metrics_export_env_named(env, name) < 0)
+		fprintf(stderr, "Metrics are not exported\n");
+}
+
+ /* -----------------------------------------------------------------------------
+  |  init_categories:
+  |  ----------------
+  |
+  |  Description:
+  |  ------------
+  |  Builds the category engine and the verdict cache.
+  |
+  |  Parameters:
+  |  -----------
+  |  cat_file - category file, or NULL for the built-in match strings.
+  |
+  |  Returned value:
+  |  ---------------
+  |  0 if successful, -1 otherwise.
+   ----------------------------------------------------------------------------- */
+static int init_categories(char *cat_file)
+{
+	/*
+	 * Build the category engine
+	 */
+	if (!(cat_engine = load_categories(cat_file))) {
+		fprintf(stderr, "Unable to load categories\n");
+		return -1;
+	}
+
+	/*
+	 * Create the verdict cache
+	 */
+	mask_pool     = ufp_mask_pool_create(ufp_mask_len, VERDICT_CACHE_SIZE + 16);
+	verdict_cache = ufp_verdict_cache_create(VERDICT_CACHE_SIZE, mask_pool, DICT_LEN,
+	                                         cat_ttl, TTL, VERDICT_MAX_AGE);
+	if (!mask_pool || !verdict_cache) {
+		fprintf(stderr, "Unable to create verdict cache\n");
+		return -1;
+	}
+
+	return 0;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  watch_categories:
+  |  -----------------
+  |
+  |  Description:
+  |  ------------
+  |  Watches the category file for changes, from the main loop of env,
+  |  unless it is watched already.
+  |
+  |  Parameters:
+  |  -----------
+  |  env      - returned by a call to opsec_init.
+  |  cat_file - category file, or NULL for the built-in match strings.
+  |
+  |  Returned value:
+  |  ---------------
+  |  0 if successful, -1 otherwise.
+   ----------------------------------------------------------------------------- */
+static int watch_categories(OpsecEnv *env, char *cat_file)
+{
+	if (!cat_file || cat_loader)
+		return 0;
+
+	if (!(cat_loader = ufp_cat_loader_create(cat_file, dict, DICT_LEN))) {
+		fprintf(stderr, "Unable to watch category file\n");
+		return -1;
+	}
+	opsec_periodic_schedule(env, CAT_RELOAD_INTERVAL * 1000L, reload_categories, NULL);
+
+	return 0;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  free_categories:
+  |  ----------------
+  |
+  |  Description:
+  |  ------------
+  |  Frees the category engine, its loader and the verdict cache.
+  |
+  |  Parameters:
+  |  -----------
+  |  None.
+  |
+  |  Returned value:
+  |  ---------------
+  |  None.
+   ----------------------------------------------------------------------------- */
+static void free_categories(void)
+{
+	if (verdict_cache)
+		fprintf(stderr, "Verdict cache: %ld hits, %ld misses, %ld evictions\n",
+		        verdict_cache->hits, verdict_cache->misses, verdict_cache->evictions);
+
+	ufp_verdict_cache_destroy(verdict_cache);
+	ufp_mask_pool_destroy(mask_pool);
+	ufp_cat_loader_destroy(cat_loader);
+	ufp_cat_engine_destroy(cat_engine);
+
+	verdict_cache = NULL;
+	mask_pool     = NULL;
+	cat_loader    = NULL;
+	cat_engine    = NULL;
+}
+
+#ifdef OPSEC_SL_SERVER
+
+/*
+   ---------------------------
+     Shared library server
+   ---------------------------
+ */
+
+/*
+   Built with OPSEC_SL_SERVER, the server is a shared library with the entry
+   points of shared_lib_server.h. It runs in the main loop of the application
+   that loads it (see ../sl_host/opsec_sl_host.c). The entry points shared
+   by the sample servers are in ../common/sl_server.c; the ones below are
+   those of the UFP server.
+ */
+
+ /* -----------------------------------------------------------------------------
+  |  opsec_sl_exp_init_sl:
+  |  ---------------------
+  |
+  |  Description:
+  |  ------------
+  |  Called when the library is loaded. Builds the category engine, from the
+  |  file named by OPSEC_UFP_CATEGORY_FILE if it is set.
+  |
+  |  Parameters:
+  |  -----------
+  |  None.
+  |
+  |  Returned value:
+  |  ---------------
+  |  0 if successful, -1 otherwise.
+   ----------------------------------------------------------------------------- */
+SL_EXPORT int opsec_sl_exp_init_sl(void)
+{
+	if (init_categories(getenv(UFP_CATEGORY_FILE_ENV)) < 0) {
+		free_categories();
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Called before the library is unloaded */
+SL_EXPORT int opsec_sl_exp_close_sl(void)
+{
+	free_categories();
+	metrics_destroy();
+
+	return 0;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  sl_start_handler:
+  |  -----------------
+  |
+  |  Description:
+  |  ------------
+  |  Tells how the client of a new session reached the server.
+  |
+  |  Parameters:
+  |  -----------
+  |  session - Pointer to an OpsecSession object.
+  |
+  |  Returned value:
+  |  ---------------
+  |  OPSEC_SESSION_OK.
+   ----------------------------------------------------------------------------- */
+static int sl_start_handler(OpsecSession *session)
+{
+	sl_server_peer(session);
+
+	return OPSEC_SESSION_OK;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  sl_server_create:
+  |  -----------------
+  |
+  |  Description:
+  |  ------------
+  |  Creates the server entity in the environment of the host, for
+  |  opsec_sl_exp_init_server_entity (see ../common/sl_server.c), and
+  |  watches the category file from the main loop of the host. The metrics
+  |  are exported to OPSEC_METRICS_FILE.<srv_name>.
+  |
+  |  Parameters:
+  |  -----------
+  |  srv_name - the entity name.
+  |  env      - the environment of the host.
+  |
+  |  Returned value:
+  |  ---------------
+  |  The server entity, NULL on error.
+   ----------------------------------------------------------------------------- */
+OpsecEntity *sl_server_create(char *srv_name, OpsecEnv *env)
+{
+	OpsecEntity *server;
+
+	server = opsec_init_entity(env, UFP_SERVER,
+	                                OPSEC_ENTITY_NAME, srv_name,
+	                                UFP_DESC_HANDLER, desc_handler,
+	                                UFP_DICT_HANDLER, dict_handler,
+	                                UFP_CAT_HANDLER, cat_handler,
+	                                OPSEC_SESSION_START_HANDLER, sl_start_handler,
+	                                OPSEC_EOL);
+	if (!server) {
+		fprintf(stderr, "Unable to init server entity. (%s)\n",
+				opsec_errno_str(opsec_errno));
+		return NULL;
+	}
+
+	if (watch_categories(env, getenv(UFP_CATEGORY_FILE_ENV)) < 0) {
+		opsec_destroy_entity(server);
+		return NULL;
+	}
+
+	create_metrics(env, srv_name);
+	print_dictionary();
+
+	return server;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  sl_server_free:
+  |  ---------------
+  |
+  |  Description:
+  |  ------------
+  |  Stops watching the category file, and destroys its loader and the
+  |  loader thread. The category engine in use stays, until the library is
+  |  closed.
+  |
+  |  Parameters:
+  |  -----------
+  |  env - the environment of the host.
+  |
+  |  Returned value:
+  |  ---------------
+  |  None.
+   ----------------------------------------------------------------------------- */
+void sl_server_free(OpsecEnv *env)
+{
+	if (!cat_loader)
+		return;
+
+	opsec_deschedule(env, reload_categories, NULL);
+	ufp_cat_loader_destroy(cat_loader);
+	cat_loader = NULL;
+}
+
+#else
 
 /*
  * MAIN
@@ -502,6 +991,17 @@ int main(int argc, char **argv)
 {
 	OpsecEnv    *opsec_env = NULL;
 	OpsecEntity *server    = NULL;
+	char        *cat_file  = NULL;
+
+	if (argc == 3 && !strcmp(argv[1], "-c"))
+		cat_file = argv[2];
+	else if (argc != 1) {
+		fprintf(stderr, "Usage: %s [-c <category file>]\n", argv[0]);
+		exit(1);
+	}
+
+	if (init_categories(cat_file) < 0)
+		exit(1);
 
 	/*
 	 * Create environment
@@ -535,6 +1035,14 @@ int main(int argc, char **argv)
 	 */
 	print_dictionary();
 
+	/*
+	   Watch the category file for changes
+	 */
+	if (watch_categories(opsec_env, cat_file) < 0)
+		exit(1);
+
+	create_metrics(opsec_env, NULL);
+
 	fprintf(stderr, "\nServer is running\n\n");
 
 	opsec_mainloop( opsec_env );
@@ -544,7 +1052,13 @@ int main(int argc, char **argv)
 	/*
 	 * Free the server entity & environment before exiting.
 	 */
+	metrics_export_stop(opsec_env);
 	free_all(opsec_env, server);
+
+	free_categories();
+	metrics_destroy();
 	
 	return 0;
 }
+
+#endif
@@ -0,0 +1,437 @@
+/***************************************************************************
+ *                                                                         *
+ * ufp_verdict.c : Sample OPSEC UFP Server                                 *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2000 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * The verdict cache of the UFP server.                                    *
+ *                                                                         *
+ * Clients tend to ask for the same URLs over and over. The verdict cache  *
+ * keeps, per normalized URL, the categorization mask and the UfpCacheInfo *
+ * that was sent with it, so a repeated request is answered without        *
+ * categorizing the URL or building a new cache info.                      *
+ *                                                                         *
+ * URLs are normalized by case folding only. The category engine matches   *
+ * case insensitively, so this never changes the verdict.                  *
+ *                                                                         *
+ * The TTL of the cache info depends on the categories of the URL: it is   *
+ * the smallest TTL of the matched categories (or the default TTL for an   *
+ * uncategorized URL). The cache info also names the destination IP. It    *
+ * is reused as long as requests for the URL come with the same IP, and    *
+ * rebuilt otherwise.                                                      *
+ *                                                                         *
+ * The cache has a fixed number of entries, allocated once. When it is     *
+ * full, the least recently used verdict is replaced. Verdicts also expire *
+ * after a maximal age, and are all flushed when the categories change.    *
+ * URLs longer than UFP_VERDICT_URL_LEN are not cached.                    *
+ *                                                                         *
+ * The masks are taken from a mask pool and returned to it, so once the    *
+ * pool is warm, categorization does not allocate masks.                   *
+ *                                                                         *
+ ***************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "ufp_verdict.h"
+
+
+/* -------------------------------------------------------------------------------------
+                                      Mask pool
+   ------------------------------------------------------------------------------------- */
+
+ufp_mask_pool *
+ufp_mask_pool_create(int mask_len, int size)
+{
+	ufp_mask_pool *pool;
+
+	if (mask_len <= 0 || size <= 0) return NULL;
+
+	pool = (ufp_mask_pool *)calloc(1, sizeof(ufp_mask_pool));
+	if (!pool) return NULL;
+
+	pool->masks = (ufp_mask *)calloc(size, sizeof(ufp_mask));
+	if (!pool->masks) {
+		free(pool);
+		return NULL;
+	}
+
+	pool->size     = size;
+	pool->mask_len = mask_len;
+
+	return pool;
+}
+
+void
+ufp_mask_pool_destroy(ufp_mask_pool *pool)
+{
+	if (!pool) return;
+
+	while (pool->n_free > 0)
+		ufp_mask_destroy(pool->masks[--pool->n_free]);
+
+	free(pool->masks);
+	free(pool);
+}
+
+/*
+ * Return a clear mask.
+ */
+ufp_mask
+ufp_mask_pool_get(ufp_mask_pool *pool)
+{
+	ufp_mask mask;
+	int      n;
+
+	if (pool->n_free == 0)
+		return ufp_mask_init(pool->mask_len);
+
+	mask = pool->masks[--pool->n_free];
+	for (n = 0; n < pool->mask_len; n++)
+		ufp_mask_clr(mask, pool->mask_len, n);
+
+	return mask;
+}
+
+void
+ufp_mask_pool_put(ufp_mask_pool *pool, ufp_mask mask)
+{
+	if (!mask) return;
+
+	if (pool->n_free == pool->size) {
+		ufp_mask_destroy(mask);
+		return;
+	}
+
+	pool->masks[pool->n_free++] = mask;
+}
+
+
+/* -------------------------------------------------------------------------------------
+                                    Verdict cache
+   ------------------------------------------------------------------------------------- */
+
+static unsigned long
+url_hash(char *url)
+{
+	unsigned long hash = 2166136261UL;
+
+	for (; *url; url++) {
+		hash ^= (unsigned char)*url;
+		hash  = (hash * 16777619UL) & 0xffffffffUL;
+	}
+
+	return hash;
+}
+
+ufp_verdict_cache *
+ufp_verdict_cache_create(int size, ufp_mask_pool *mask_pool, int n_cats,
+                         unsigned int *cat_ttl, unsigned int default_ttl, int max_age)
+{
+	ufp_verdict_cache *cache;
+	int                i;
+
+	if (size <= 0 || !mask_pool) return NULL;
+
+	cache = (ufp_verdict_cache *)calloc(1, sizeof(ufp_verdict_cache));
+	if (!cache) return NULL;
+
+	for (cache->n_buckets = 1; cache->n_buckets < 2 * size; cache->n_buckets *= 2)
+		;
+
+	cache->entries = (ufp_verdict *)calloc(size, sizeof(ufp_verdict));
+	cache->buckets = (ufp_verdict **)calloc(cache->n_buckets, sizeof(ufp_verdict *));
+	if (!cache->entries || !cache->buckets) {
+		free(cache->entries);
+		free(cache->buckets);
+		free(cache);
+		return NULL;
+	}
+
+	cache->size = size;
+	for (i = size - 1; i >= 0; i--) {
+		cache->entries[i].hnext = cache->free_list;
+		cache->free_list = &cache->entries[i];
+	}
+
+	cache->mask_pool   = mask_pool;
+	cache->mask_len    = mask_pool->mask_len;
+	cache->n_cats      = n_cats;
+	cache->cat_ttl     = cat_ttl;
+	cache->default_ttl = default_ttl;
+	cache->max_age     = max_age;
+
+	return cache;
+}
+
+void
+ufp_verdict_cache_destroy(ufp_verdict_cache *cache)
+{
+	if (!cache) return;
+
+	ufp_verdict_cache_flush(cache);
+
+	free(cache->entries);
+	free(cache->buckets);
+	free(cache);
+}
+
+/*
+ * Remove all the verdicts (e.g. when the categories change).
+ */
+void
+ufp_verdict_cache_flush(ufp_verdict_cache *cache)
+{
+	if (!cache) return;
+
+	while (cache->lru_first)
+		ufp_verdict_remove(cache, cache->lru_first);
+}
+
+ /* -----------------------------------------------------------------------------
+  |  ufp_verdict_normalize:
+  |  ----------------------
+  |
+  |  Description:
+  |  ------------
+  |  Builds the cache key of a URL: the URL in lower case.
+  |
+  |  Parameters:
+  |  -----------
+  |  url     - sent by the client.
+  |  key     - buffer for the key.
+  |  key_len - size of the buffer.
+  |
+  |  Returned value:
+  |  ---------------
+  |  The key length, -1 if the URL is too long to be cached.
+   ----------------------------------------------------------------------------- */
+int
+ufp_verdict_normalize(char *url, char *key, int key_len)
+{
+	int len = 0;
+
+	if (!url) return -1;
+
+	for (; *url; url++) {
+		if (len == key_len - 1)
+			return -1;
+		key[len++] = (char)tolower((unsigned char)*url);
+	}
+
+	key[len] = '\0';
+
+	return len;
+}
+
+static void
+lru_unlink(ufp_verdict_cache *cache, ufp_verdict *verdict)
+{
+	if (verdict->lru_prev) verdict->lru_prev->lru_next = verdict->lru_next;
+	else cache->lru_first = verdict->lru_next;
+
+	if (verdict->lru_next) verdict->lru_next->lru_prev = verdict->lru_prev;
+	else cache->lru_last = verdict->lru_prev;
+
+	verdict->lru_prev = verdict->lru_next = NULL;
+}
+
+static void
+lru_push_front(ufp_verdict_cache *cache, ufp_verdict *verdict)
+{
+	verdict->lru_prev = NULL;
+	verdict->lru_next = cache->lru_first;
+
+	if (cache->lru_first) cache->lru_first->lru_prev = verdict;
+	else cache->lru_last = verdict;
+
+	cache->lru_first = verdict;
+}
+
+/*
+ * Find the verdict of a normalized URL, and mark it as recently used.
+ * Expired verdicts are removed.
+ */
+ufp_verdict *
+ufp_verdict_lookup(ufp_verdict_cache *cache, char *key)
+{
+	ufp_verdict   *verdict;
+	unsigned long  hash;
+
+	if (!cache || !key) return NULL;
+
+	hash = url_hash(key);
+	for (verdict = cache->buckets[hash & (cache->n_buckets - 1)]; verdict; verdict = verdict->hnext)
+		if (verdict->hash == hash && !strcmp(verdict->url, key))
+			break;
+
+	if (verdict && verdict->expires <= time(NULL)) {
+		ufp_verdict_remove(cache, verdict);
+		verdict = NULL;
+	}
+
+	if (!verdict) {
+		cache->misses++;
+		return NULL;
+	}
+
+	lru_unlink(cache, verdict);
+	lru_push_front(cache, verdict);
+	cache->hits++;
+
+	return verdict;
+}
+
+/*
+ * Add a verdict for a normalized URL that is not in the cache. The verdict
+ * comes with a clear mask, to be filled by the caller. If the cache is full,
+ * the least recently used verdict is replaced.
+ */
+ufp_verdict *
+ufp_verdict_insert(ufp_verdict_cache *cache, char *key)
+{
+	ufp_verdict *verdict;
+	ufp_mask     mask;
+
+	if (!cache || !key || strlen(key) >= UFP_VERDICT_URL_LEN) return NULL;
+
+	if (!(mask = ufp_mask_pool_get(cache->mask_pool)))
+		return NULL;
+
+	if (!cache->free_list) {
+		ufp_verdict_remove(cache, cache->lru_last);
+		cache->evictions++;
+	}
+
+	verdict = cache->free_list;
+	cache->free_list = verdict->hnext;
+
+	strcpy(verdict->url, key);
+	verdict->hash       = url_hash(key);
+	verdict->mask       = mask;
+	verdict->ttl        = 0;
+	verdict->cache_info = NULL;
+	verdict->dst_ip[0]  = '\0';
+	verdict->expires    = time(NULL) + cache->max_age;
+
+	verdict->hnext = cache->buckets[verdict->hash & (cache->n_buckets - 1)];
+	cache->buckets[verdict->hash & (cache->n_buckets - 1)] = verdict;
+	lru_push_front(cache, verdict);
+
+	return verdict;
+}
+
+void
+ufp_verdict_remove(ufp_verdict_cache *cache, ufp_verdict *verdict)
+{
+	ufp_verdict **pp;
+
+	if (!cache || !verdict) return;
+
+	pp = &cache->buckets[verdict->hash & (cache->n_buckets - 1)];
+	while (*pp && *pp != verdict) pp = &(*pp)->hnext;
+	if (*pp) *pp = verdict->hnext;
+
+	lru_unlink(cache, verdict);
+
+	if (verdict->cache_info)
+		ufp_destroy_cache_info(verdict->cache_info);
+	verdict->cache_info = NULL;
+
+	ufp_mask_pool_put(cache->mask_pool, verdict->mask);
+	verdict->mask = NULL;
+
+	verdict->hnext = cache->free_list;
+	cache->free_list = verdict;
+}
+
+/*
+ * The cache info TTL of a mask - the smallest TTL of its categories.
+ */
+unsigned int
+ufp_verdict_ttl(ufp_verdict_cache *cache, ufp_mask mask)
+{
+	unsigned int ttl = 0;
+	int          cat, found = 0;
+
+	if (!cache->cat_ttl)
+		return cache->default_ttl;
+
+	for (cat = 0; cat < cache->n_cats; cat++)
+		if (ufp_mask_isset(mask, cache->mask_len, cat) && (!found || cache->cat_ttl[cat] < ttl)) {
+			ttl   = cache->cat_ttl[cat];
+			found = 1;
+		}
+
+	return found ? ttl : cache->default_ttl;
+}
+
+ /* -----------------------------------------------------------------------------
+  |  ufp_verdict_cache_info:
+  |  -----------------------
+  |
+  |  Description:
+  |  ------------
+  |  Returns the cache info to send with a verdict. The cache info is built
+  |  once, with an ABSOLUTE mask and the TTL of the verdict categories, and
+  |  reused by the following requests for the same destination IP.
+  |  The cache info belongs to the verdict - the caller must not destroy it.
+  |
+  |  Parameters:
+  |  -----------
+  |  cache   - the verdict cache.
+  |  verdict - a verdict with its final mask.
+  |  dst_ip  - used as the cached IP in the UfpCacheInfo.
+  |  port    - used as the cached port in the UfpCacheInfo.
+  |
+  |  Returned value:
+  |  ---------------
+  |  The cache info, NULL on error.
+   ----------------------------------------------------------------------------- */
+UfpCacheInfo *
+ufp_verdict_cache_info(ufp_verdict_cache *cache, ufp_verdict *verdict, char *dst_ip, unsigned short port)
+{
+	char         *ip = dst_ip ? dst_ip : "";
+	UfpCacheInfo *cache_info;
+
+	if (verdict->cache_info && !strcmp(verdict->dst_ip, ip))
+		return verdict->cache_info;
+
+	if (verdict->cache_info) {
+		ufp_destroy_cache_info(verdict->cache_info);
+		verdict->cache_info = NULL;
+	}
+
+	verdict->ttl = ufp_verdict_ttl(cache, verdict->mask);
+
+	if (!(cache_info = ufp_create_cache_info(verdict->ttl)))
+		return NULL;
+
+	if (ufp_add_to_cache_info(cache_info, NULL, dst_ip, port, verdict->mask,
+	                          cache->mask_len, ABSOLUTE_MASK) != OPSEC_SESSION_OK) {
+		ufp_destroy_cache_info(cache_info);
+		return NULL;
+	}
+
+	verdict->cache_info = cache_info;
+	strncpy(verdict->dst_ip, ip, sizeof(verdict->dst_ip) - 1);
+	verdict->dst_ip[sizeof(verdict->dst_ip) - 1] = '\0';
+
+	return cache_info;
+}
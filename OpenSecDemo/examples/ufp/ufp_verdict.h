@@ -0,0 +1,103 @@
+#ifndef _UFP_VERDICT_H_
+#define _UFP_VERDICT_H_
+
+/***************************************************************************
+ *                                                                         *
+ * ufp_verdict.h : Sample OPSEC UFP Server                                 *
+ *                                                                         *
+ * This is a part of the Check Point OPSEC SDK                             *
+ * Copyright (c) 1994-2000 Check Point Software Technologies, Ltd.         *
+ * All rights reserved.                                                    *
+ *                                                                         *
+ * This source code is only intended as a supplement to the                *
+ * Check Point OPSEC SDK and related documentation provided with the SDK   *
+ * and shall be used in accordance with the standard                       *
+ * End-User License Agreement.                                             *
+ * See related documentation for detailed information                      *
+ * regarding the Check Point OPSEC SDK.                                    *
+ *                                                                         *
+ ***************************************************************************/
+
+/***************************************************************************
+ *                                                                         *
+ * See ufp_verdict.c for further explanations.                             *
+ *                                                                         *
+ ***************************************************************************/
+
+#include <time.h>
+#include "opsec/ufp_opsec.h"
+
+#define UFP_VERDICT_URL_LEN   256
+#define UFP_VERDICT_IP_LEN    64
+
+/*
+ * A pool of categorization masks.
+ */
+typedef struct _ufp_mask_pool {
+	ufp_mask   *masks;          /* free masks                         */
+	int         n_free;
+	int         size;
+	int         mask_len;
+} ufp_mask_pool;
+
+ufp_mask_pool * ufp_mask_pool_create(int mask_len, int size);
+void            ufp_mask_pool_destroy(ufp_mask_pool *pool);
+ufp_mask        ufp_mask_pool_get(ufp_mask_pool *pool);
+void            ufp_mask_pool_put(ufp_mask_pool *pool, ufp_mask mask);
+
+/*
+ * A cached verdict.
+ */
+typedef struct _ufp_verdict {
+	struct _ufp_verdict *hnext;
+	struct _ufp_verdict *lru_prev;
+	struct _ufp_verdict *lru_next;
+	unsigned long        hash;
+	char                 url[UFP_VERDICT_URL_LEN];   /* normalized url         */
+
+	ufp_mask             mask;
+	unsigned int         ttl;                        /* of the cache info [ms] */
+	UfpCacheInfo        *cache_info;
+	char                 dst_ip[UFP_VERDICT_IP_LEN]; /* of the cache info      */
+	time_t               expires;
+} ufp_verdict;
+
+typedef struct _ufp_verdict_cache {
+	ufp_verdict         *entries;
+	int                  size;
+	ufp_verdict         *free_list;   /* linked by hnext               */
+
+	ufp_verdict        **buckets;
+	int                  n_buckets;
+
+	ufp_verdict         *lru_first;   /* most recently used            */
+	ufp_verdict         *lru_last;    /* least recently used           */
+
+	ufp_mask_pool       *mask_pool;
+	int                  mask_len;
+	int                  n_cats;
+	unsigned int        *cat_ttl;     /* cache info TTL per category   */
+	unsigned int         default_ttl; /* for uncategorized urls        */
+	int                  max_age;     /* of a cached verdict [sec]     */
+
+	/* statistics */
+	long                 hits;
+	long                 misses;
+	long                 evictions;
+} ufp_verdict_cache;
+
+ufp_verdict_cache * ufp_verdict_cache_create(int size, ufp_mask_pool *mask_pool, int n_cats,
+                                             unsigned int *cat_ttl, unsigned int default_ttl,
+                                             int max_age);
+void                ufp_verdict_cache_destroy(ufp_verdict_cache *cache);
+void                ufp_verdict_cache_flush(ufp_verdict_cache *cache);
+
+int                 ufp_verdict_normalize(char *url, char *key, int key_len);
+ufp_verdict       * ufp_verdict_lookup(ufp_verdict_cache *cache, char *key);
+ufp_verdict       * ufp_verdict_insert(ufp_verdict_cache *cache, char *key);
+void                ufp_verdict_remove(ufp_verdict_cache *cache, ufp_verdict *verdict);
+UfpCacheInfo      * ufp_verdict_cache_info(ufp_verdict_cache *cache, ufp_verdict *verdict,
+                                           char *dst_ip, unsigned short port);
+unsigned int        ufp_verdict_ttl(ufp_verdict_cache *cache, ufp_mask mask);
+
+#endif